@@ -508,6 +508,28 @@ cleanup:
 
 
 
+static int remoteDispatchConnectGetAllDomainStats(
+    virNetServerPtr server,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg,
+    virNetMessageErrorPtr rerr,
+    remote_connect_get_all_domain_stats_args *args,
+    remote_connect_get_all_domain_stats_ret *ret);
+static int remoteDispatchConnectGetAllDomainStatsHelper(
+    virNetServerPtr server,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg,
+    virNetMessageErrorPtr rerr,
+    void *args,
+    void *ret)
+{
+  VIR_DEBUG("server=%p client=%p msg=%p rerr=%p args=%p ret=%p", server, client, msg, rerr, args, ret);
+  return remoteDispatchConnectGetAllDomainStats(server, client, msg, rerr, args, ret);
+}
+/* remoteDispatchConnectGetAllDomainStats body has to be implemented manually */
+
+
+
 static int remoteDispatchConnectGetCapabilities(
     virNetServerPtr server,
     virNetServerClientPtr client,
@@ -727,6 +749,28 @@ cleanup:
 
 
 
+static int remoteDispatchConnectGetStartupProgress(
+    virNetServerPtr server,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg,
+    virNetMessageErrorPtr rerr,
+    remote_connect_get_startup_progress_args *args,
+    remote_connect_get_startup_progress_ret *ret);
+static int remoteDispatchConnectGetStartupProgressHelper(
+    virNetServerPtr server,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg,
+    virNetMessageErrorPtr rerr,
+    void *args,
+    void *ret)
+{
+  VIR_DEBUG("server=%p client=%p msg=%p rerr=%p args=%p ret=%p", server, client, msg, rerr, args, ret);
+  return remoteDispatchConnectGetStartupProgress(server, client, msg, rerr, args, ret);
+}
+/* remoteDispatchConnectGetStartupProgress body has to be implemented manually */
+
+
+
 static int remoteDispatchConnectGetSysinfo(
     virNetServerPtr server,
     virNetServerClientPtr client,
@@ -5929,7 +5973,7 @@ static int remoteDispatchDomainMigratePrepareTunnel(
     if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
         goto cleanup;
 
-    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header)))
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header, false)))
         goto cleanup;
 
     if (virDomainMigratePrepareTunnel(priv->conn, st, flags, dname, resource, args->dom_xml) < 0)
@@ -6006,7 +6050,7 @@ static int remoteDispatchDomainMigratePrepareTunnel3(
     if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
         goto cleanup;
 
-    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header)))
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header, false)))
         goto cleanup;
 
     if (virDomainMigratePrepareTunnel3(priv->conn, st, args->cookie_in.cookie_in_val, args->cookie_in.cookie_in_len, &cookie_out, &cookie_out_len, flags, dname, resource, args->dom_xml) < 0)
@@ -6261,7 +6305,7 @@ static int remoteDispatchDomainOpenChannel(
     if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
         goto cleanup;
 
-    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header)))
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header, false)))
         goto cleanup;
 
     if (virDomainOpenChannel(dom, name, st, args->flags) < 0)
@@ -6334,7 +6378,7 @@ static int remoteDispatchDomainOpenConsole(
     if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
         goto cleanup;
 
-    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header)))
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header, false)))
         goto cleanup;
 
     if (virDomainOpenConsole(dom, dev_name, st, args->flags) < 0)
@@ -7170,7 +7214,7 @@ static int remoteDispatchDomainScreenshot(
     if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
         goto cleanup;
 
-    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header)))
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header, false)))
         goto cleanup;
 
     if ((mime = virDomainScreenshot(dom, st, args->screen, args->flags)) == NULL)
@@ -13331,6 +13375,58 @@ cleanup:
 
 
 
+static int remoteDispatchStorageVolAbortJob(
+    virNetServerPtr server,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg,
+    virNetMessageErrorPtr rerr,
+    remote_storage_vol_abort_job_args *args);
+static int remoteDispatchStorageVolAbortJobHelper(
+    virNetServerPtr server,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg,
+    virNetMessageErrorPtr rerr,
+    void *args,
+    void *ret ATTRIBUTE_UNUSED)
+{
+  VIR_DEBUG("server=%p client=%p msg=%p rerr=%p args=%p ret=%p", server, client, msg, rerr, args, ret);
+  return remoteDispatchStorageVolAbortJob(server, client, msg, rerr, args);
+}
+static int remoteDispatchStorageVolAbortJob(
+    virNetServerPtr server ATTRIBUTE_UNUSED,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg ATTRIBUTE_UNUSED,
+    virNetMessageErrorPtr rerr,
+    remote_storage_vol_abort_job_args *args)
+{
+    int rv = -1;
+    virStorageVolPtr vol = NULL;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (!(vol = get_nonnull_storage_vol(priv->conn, args->vol)))
+        goto cleanup;
+
+    if (virStorageVolAbortJob(vol, args->flags) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    if (vol)
+        virStorageVolFree(vol);
+    return rv;
+}
+
+
+
 static int remoteDispatchStorageVolCreateXML(
     virNetServerPtr server,
     virNetServerClientPtr client,
@@ -13547,7 +13643,7 @@ static int remoteDispatchStorageVolDownload(
     if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
         goto cleanup;
 
-    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header)))
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header, args->flags & VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM)))
         goto cleanup;
 
     if (virStorageVolDownload(vol, st, args->offset, args->length, args->flags) < 0)
@@ -13633,6 +13729,67 @@ cleanup:
 
 
 
+static int remoteDispatchStorageVolGetJobInfo(
+    virNetServerPtr server,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg,
+    virNetMessageErrorPtr rerr,
+    remote_storage_vol_get_job_info_args *args,
+    remote_storage_vol_get_job_info_ret *ret);
+static int remoteDispatchStorageVolGetJobInfoHelper(
+    virNetServerPtr server,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg,
+    virNetMessageErrorPtr rerr,
+    void *args,
+    void *ret)
+{
+  VIR_DEBUG("server=%p client=%p msg=%p rerr=%p args=%p ret=%p", server, client, msg, rerr, args, ret);
+  return remoteDispatchStorageVolGetJobInfo(server, client, msg, rerr, args, ret);
+}
+static int remoteDispatchStorageVolGetJobInfo(
+    virNetServerPtr server ATTRIBUTE_UNUSED,
+    virNetServerClientPtr client,
+    virNetMessagePtr msg ATTRIBUTE_UNUSED,
+    virNetMessageErrorPtr rerr,
+    remote_storage_vol_get_job_info_args *args,
+    remote_storage_vol_get_job_info_ret *ret)
+{
+    int rv = -1;
+    virStorageVolPtr vol = NULL;
+    virStorageVolJobInfo tmp;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (!(vol = get_nonnull_storage_vol(priv->conn, args->vol)))
+        goto cleanup;
+
+    if (virStorageVolGetJobInfo(vol, &tmp, args->flags) < 0)
+        goto cleanup;
+
+    ret->type = tmp.type;
+    ret->state = tmp.state;
+    ret->elapsed = tmp.elapsed;
+    ret->processed = tmp.processed;
+    ret->total = tmp.total;
+    ret->bandwidth = tmp.bandwidth;
+    rv = 0;
+
+cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    if (vol)
+        virStorageVolFree(vol);
+    return rv;
+}
+
+
+
 static int remoteDispatchStorageVolGetPath(
     virNetServerPtr server,
     virNetServerClientPtr client,
@@ -14001,7 +14158,7 @@ static int remoteDispatchStorageVolUpload(
     if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
         goto cleanup;
 
-    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header)))
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header, args->flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM)))
         goto cleanup;
 
     if (virStorageVolUpload(vol, st, args->offset, args->length, args->flags) < 0)
@@ -17149,5 +17306,41 @@ virNetServerProgramProc remoteProcs[] = {
    true,
    0
 },
+{ /* Method ConnectGetAllDomainStats => 335 */
+   remoteDispatchConnectGetAllDomainStatsHelper,
+   sizeof(remote_connect_get_all_domain_stats_args),
+   (xdrproc_t)xdr_remote_connect_get_all_domain_stats_args,
+   sizeof(remote_connect_get_all_domain_stats_ret),
+   (xdrproc_t)xdr_remote_connect_get_all_domain_stats_ret,
+   true,
+   0
+},
+{ /* Method ConnectGetStartupProgress => 336 */
+   remoteDispatchConnectGetStartupProgressHelper,
+   sizeof(remote_connect_get_startup_progress_args),
+   (xdrproc_t)xdr_remote_connect_get_startup_progress_args,
+   sizeof(remote_connect_get_startup_progress_ret),
+   (xdrproc_t)xdr_remote_connect_get_startup_progress_ret,
+   true,
+   0
+},
+{ /* Method StorageVolGetJobInfo => 337 */
+   remoteDispatchStorageVolGetJobInfoHelper,
+   sizeof(remote_storage_vol_get_job_info_args),
+   (xdrproc_t)xdr_remote_storage_vol_get_job_info_args,
+   sizeof(remote_storage_vol_get_job_info_ret),
+   (xdrproc_t)xdr_remote_storage_vol_get_job_info_ret,
+   true,
+   0
+},
+{ /* Method StorageVolAbortJob => 338 */
+   remoteDispatchStorageVolAbortJobHelper,
+   sizeof(remote_storage_vol_abort_job_args),
+   (xdrproc_t)xdr_remote_storage_vol_abort_job_args,
+   0,
+   (xdrproc_t)xdr_void,
+   true,
+   0
+},
 };
 size_t remoteNProcs = ARRAY_CARDINALITY(remoteProcs);
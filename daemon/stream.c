@@ -23,12 +23,15 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+
 #include "stream.h"
 #include "remote.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virnetserverclient.h"
 #include "virerror.h"
+#include "fdstream.h"
 
 #define VIR_FROM_THIS VIR_FROM_STREAMS
 
@@ -47,6 +50,17 @@ struct daemonClientStream {
     unsigned int recvEOF : 1;
     unsigned int closed : 1;
 
+    /* Holes are skipped rather than sent as zeros */
+    bool allowSkip;
+
+    /* Raw data from the client, see VIR_NET_STREAM_RAW: whether the
+     * stream waits for more of it rather than for being writable, and
+     * what is read of it for streams that can't have it spliced */
+    bool rawWait;
+    char *rawBuf;
+    size_t rawBufLength;
+    size_t rawBufOffset;
+
     int filterID;
 
     virNetMessagePtr rx;
@@ -76,7 +90,7 @@ static void
 daemonStreamUpdateEvents(daemonClientStream *stream)
 {
     int newEvents = 0;
-    if (stream->rx)
+    if (stream->rx && !stream->rawWait)
         newEvents |= VIR_STREAM_EVENT_WRITABLE;
     if (stream->tx && !stream->recvEOF)
         newEvents |= VIR_STREAM_EVENT_READABLE;
@@ -106,6 +120,32 @@ daemonStreamMessageFinished(virNetMessagePtr msg ATTRIBUTE_UNUSED,
 }
 
 
+/*
+ * Invoked when more raw data came in from the client, for
+ * the streams that were waiting for it
+ */
+static void
+daemonStreamRawReady(virNetServerClientPtr client,
+                     void *opaque ATTRIBUTE_UNUSED)
+{
+    daemonClientPrivatePtr priv = virNetServerClientGetPrivateData(client);
+    daemonClientStream *stream;
+
+    virMutexLock(&priv->lock);
+
+    for (stream = priv->streams; stream; stream = stream->next) {
+        if (!stream->rawWait)
+            continue;
+
+        stream->rawWait = false;
+        if (!stream->closed)
+            daemonStreamUpdateEvents(stream);
+    }
+
+    virMutexUnlock(&priv->lock);
+}
+
+
 /*
  * Callback that gets invoked when a stream becomes writable/readable
  */
@@ -283,7 +323,9 @@ daemonStreamFilter(virNetServerClientPtr client ATTRIBUTE_UNUSED,
 
     virMutexLock(&stream->priv->lock);
 
-    if (msg->header.type != VIR_NET_STREAM)
+    if (msg->header.type != VIR_NET_STREAM &&
+        msg->header.type != VIR_NET_STREAM_HOLE &&
+        msg->header.type != VIR_NET_STREAM_RAW)
         goto cleanup;
 
     if (!virNetServerProgramMatches(stream->prog, msg))
@@ -310,6 +352,7 @@ daemonStreamFilter(virNetServerClientPtr client ATTRIBUTE_UNUSED,
 /*
  * @conn: a connection object to associate the stream with
  * @header: the method call to associate with the stream
+ * @allowSkip: whether holes are exchanged as such, for sparse streams
  *
  * Creates a new stream for this conn
  *
@@ -319,13 +362,14 @@ daemonClientStream *
 daemonCreateClientStream(virNetServerClientPtr client,
                          virStreamPtr st,
                          virNetServerProgramPtr prog,
-                         virNetMessageHeaderPtr header)
+                         virNetMessageHeaderPtr header,
+                         bool allowSkip)
 {
     daemonClientStream *stream;
     daemonClientPrivatePtr priv = virNetServerClientGetPrivateData(client);
 
-    VIR_DEBUG("client=%p, proc=%d, serial=%d, st=%p",
-              client, header->proc, header->serial, st);
+    VIR_DEBUG("client=%p, proc=%d, serial=%d, st=%p, allowSkip=%d",
+              client, header->proc, header->serial, st, allowSkip);
 
     if (VIR_ALLOC(stream) < 0)
         return NULL;
@@ -337,6 +381,7 @@ daemonCreateClientStream(virNetServerClientPtr client,
     stream->serial = header->serial;
     stream->filterID = -1;
     stream->st = st;
+    stream->allowSkip = allowSkip;
 
     return stream;
 }
@@ -369,6 +414,11 @@ int daemonFreeClientStream(virNetServerClientPtr client,
     while (msg) {
         virNetMessagePtr tmp = msg->next;
         if (client) {
+            /* Nothing is going to take the data sent with it */
+            if (msg->header.type == VIR_NET_STREAM_RAW)
+                virNetServerClientDiscardRaw(client);
+
+
             /* Send a dummy reply to free up 'msg' & unblock client rx */
             virNetMessageClear(msg);
             msg->header.type = VIR_NET_REPLY;
@@ -384,6 +434,7 @@ int daemonFreeClientStream(virNetServerClientPtr client,
     }
 
     virStreamFree(stream->st);
+    VIR_FREE(stream->rawBuf);
     VIR_FREE(stream);
 
     return ret;
@@ -550,6 +601,153 @@ daemonStreamHandleWriteData(virNetServerClientPtr client,
 }
 
 
+/*
+ * Skips a hole sent by the client in a sparse stream
+ *
+ * Returns:
+ *   -1  if fatal error occurred
+ *    0  if message was fully processed
+ *    1  if message is still being processed
+ */
+static int
+daemonStreamHandleHole(virNetServerClientPtr client,
+                       daemonClientStream *stream,
+                       virNetMessagePtr msg)
+{
+    virNetStreamHole data;
+    virNetMessageError rerr;
+    size_t offset = msg->bufferOffset;
+    size_t len = msg->bufferLength;
+    int ret;
+
+    VIR_DEBUG("client=%p, stream=%p, proc=%d, serial=%d",
+              client, stream, msg->header.proc, msg->header.serial);
+
+    memset(&data, 0, sizeof(data));
+    memset(&rerr, 0, sizeof(rerr));
+
+    if (!stream->allowSkip) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("stream holes are not allowed on this stream"));
+        goto error;
+    }
+
+    if (virNetMessageDecodePayload(msg, (xdrproc_t)xdr_virNetStreamHole,
+                                   &data) < 0)
+        goto error;
+
+    ret = virStreamSendHole(stream->st, data.length, data.flags);
+    if (ret == -2) {
+        /* Blocking, so decode it again later */
+        msg->bufferOffset = offset;
+        msg->bufferLength = len;
+        return 1;
+    }
+    if (ret < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    VIR_INFO("Stream hole failed");
+    stream->closed = 1;
+    return virNetServerProgramSendReplyError(stream->prog,
+                                             client,
+                                             msg,
+                                             &rerr,
+                                             &msg->header);
+}
+
+
+/*
+ * Moves the raw data following a VIR_NET_STREAM_RAW message from the
+ * client socket to the stream, spliced when the stream allows it
+ *
+ * Returns:
+ *   -1  if fatal error occurred
+ *    0  if message was fully processed
+ *    1  if message is still being processed
+ */
+static int
+daemonStreamHandleRaw(virNetServerClientPtr client,
+                      daemonClientStream *stream,
+                      virNetMessagePtr msg)
+{
+    virNetMessageError rerr;
+    size_t len;
+    ssize_t got;
+    int ret;
+    int fd;
+
+    VIR_DEBUG("client=%p, stream=%p, proc=%d, serial=%d",
+              client, stream, msg->header.proc, msg->header.serial);
+
+    memset(&rerr, 0, sizeof(rerr));
+
+    for (;;) {
+        /* Data read from the client earlier goes first */
+        if (stream->rawBufOffset < stream->rawBufLength) {
+            ret = virStreamSend(stream->st,
+                                stream->rawBuf + stream->rawBufOffset,
+                                stream->rawBufLength - stream->rawBufOffset);
+            if (ret == -2)
+                return 1;
+            if (ret < 0)
+                goto error;
+            stream->rawBufOffset += ret;
+            continue;
+        }
+
+        if (!(len = virNetServerClientGetRawPending(client)))
+            return 0;
+
+        if ((fd = virFDStreamReserveRaw(stream->st, true, &len)) == -2)
+            return 1;
+        if (fd == -1)
+            goto error;
+
+        if (fd >= 0) {
+            got = virNetServerClientRecvRaw(client, fd, NULL, len);
+        } else {
+            if (!stream->rawBuf &&
+                VIR_ALLOC_N(stream->rawBuf,
+                            VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX) < 0)
+                return -1;
+            got = virNetServerClientRecvRaw(client, -1, stream->rawBuf,
+                                            MIN(len, VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX));
+        }
+
+        if (got == -2)
+            return 1; /* The stream is full */
+        if (got < 0)
+            return -1;
+        if (got == 0) {
+            /* Wait for the client rather than for the stream */
+            stream->rawWait = true;
+            virNetServerClientWaitRaw(client, daemonStreamRawReady, NULL);
+            return 1;
+        }
+
+        if (fd >= 0) {
+            virFDStreamCommitRaw(stream->st, got);
+        } else {
+            stream->rawBufLength = got;
+            stream->rawBufOffset = 0;
+        }
+    }
+
+ error:
+    VIR_INFO("Stream raw data failed");
+    stream->closed = 1;
+    virNetServerClientDiscardRaw(client);
+    return virNetServerProgramSendReplyError(stream->prog,
+                                             client,
+                                             msg,
+                                             &rerr,
+                                             &msg->header);
+}
+
+
 /*
  * Process a finish handshake from the client.
  *
@@ -654,7 +852,12 @@ daemonStreamHandleWrite(virNetServerClientPtr client,
             break;
 
         case VIR_NET_CONTINUE:
-            ret = daemonStreamHandleWriteData(client, stream, msg);
+            if (msg->header.type == VIR_NET_STREAM_HOLE)
+                ret = daemonStreamHandleHole(client, stream, msg);
+            else if (msg->header.type == VIR_NET_STREAM_RAW)
+                ret = daemonStreamHandleRaw(client, stream, msg);
+            else
+                ret = daemonStreamHandleWriteData(client, stream, msg);
             break;
 
         case VIR_NET_ERROR:
@@ -709,8 +912,12 @@ static int
 daemonStreamHandleRead(virNetServerClientPtr client,
                        daemonClientStream *stream)
 {
+    virNetMessagePtr msg;
     char *buffer;
     size_t bufferLen = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t rawLen = VIR_NET_MESSAGE_PAYLOAD_MAX;
+    long long holeLen = 0;
+    int rawFD = -3;
     int ret;
 
     VIR_DEBUG("client=%p, stream=%p tx=%d closed=%d",
@@ -728,50 +935,90 @@ daemonStreamHandleRead(virNetServerClientPtr client,
     if (!stream->tx)
         return 0;
 
-    if (VIR_ALLOC_N(buffer, bufferLen) < 0)
+    if (!(msg = virNetMessageNew(false)))
         return -1;
 
-    ret = virStreamRecv(stream->st, buffer, bufferLen);
-    if (ret == -2) {
+    /* Clients taking raw data get it spliced from the stream
+     * to the socket, without it being read here at all */
+    if (virNetServerClientHasRawStreams(client))
+        rawFD = virFDStreamReserveRaw(stream->st, false, &rawLen);
+
+    if (rawFD >= 0) {
+        if ((rawFD = fcntl(rawFD, F_DUPFD_CLOEXEC, 0)) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to copy stream file handle"));
+            ret = -1;
+        } else {
+            virFDStreamCommitRaw(stream->st, rawLen);
+            ret = rawLen;
+        }
+    } else if (rawFD == -1) {
+        ret = -1;
+    } else {
+        /* Receive straight into the outgoing message buffer,
+         * rather than copying the data in afterwards */
+        if (!(buffer = virNetServerProgramReserveStreamData(remoteProgram,
+                                                            msg,
+                                                            stream->procedure,
+                                                            stream->serial,
+                                                            bufferLen))) {
+            virNetMessageFree(msg);
+            return -1;
+        }
+
+        /* On sparse streams, holes are sent as such rather than
+         * read as zeros */
+        if (stream->allowSkip) {
+            ret = virStreamRecvFlags(stream->st, buffer, bufferLen,
+                                     VIR_STREAM_RECV_STOP_AT_HOLE);
+            if (ret == -3 && virStreamRecvHole(stream->st, &holeLen, 0) < 0)
+                ret = -1;
+        } else {
+            ret = virStreamRecv(stream->st, buffer, bufferLen);
+        }
+    }
+
+    if (ret == -2 || (ret == -3 && holeLen == 0)) {
         /* Should never get this, since we're only called when we know
          * we're readable, but hey things change... */
+        virNetMessageFree(msg);
         ret = 0;
-    } else if (ret < 0) {
-        virNetMessagePtr msg;
+    } else if (ret < 0 && ret != -3) {
         virNetMessageError rerr;
 
         memset(&rerr, 0, sizeof(rerr));
 
-        if (!(msg = virNetMessageNew(false)))
-            ret = -1;
-        else
-            ret = virNetServerProgramSendStreamError(remoteProgram,
-                                                     client,
-                                                     msg,
-                                                     &rerr,
-                                                     stream->procedure,
-                                                     stream->serial);
+        ret = virNetServerProgramSendStreamError(remoteProgram,
+                                                 client,
+                                                 msg,
+                                                 &rerr,
+                                                 stream->procedure,
+                                                 stream->serial);
     } else {
-        virNetMessagePtr msg;
         stream->tx = 0;
         if (ret == 0)
             stream->recvEOF = 1;
-        if (!(msg = virNetMessageNew(false)))
-            ret = -1;
 
-        if (msg) {
-            msg->cb = daemonStreamMessageFinished;
-            msg->opaque = stream;
-            stream->refs++;
-            ret = virNetServerProgramSendStreamData(remoteProgram,
+        msg->cb = daemonStreamMessageFinished;
+        msg->opaque = stream;
+        stream->refs++;
+        if (ret == -3)
+            ret = virNetServerProgramSendStreamHole(remoteProgram,
                                                     client,
                                                     msg,
                                                     stream->procedure,
                                                     stream->serial,
-                                                    buffer, ret);
-        }
+                                                    holeLen, 0);
+        else if (rawFD >= 0)
+            ret = virNetServerProgramSendStreamRaw(remoteProgram,
+                                                   client,
+                                                   msg,
+                                                   stream->procedure,
+                                                   stream->serial,
+                                                   rawFD, ret);
+        else
+            ret = virNetServerProgramSendStreamDataReserved(client, msg, ret);
     }
 
-    VIR_FREE(buffer);
     return ret;
 }
@@ -2291,6 +2291,63 @@ typedef enum {
 int                     virConnectListAllDomains (virConnectPtr conn,
                                                   virDomainPtr **domains,
                                                   unsigned int flags);
+
+/**
+ * virDomainStatsRecord:
+ *
+ * A record of statistics of a single domain, as returned by
+ * virConnectGetAllDomainStats() and virDomainListGetStats().
+ */
+typedef struct _virDomainStatsRecord virDomainStatsRecord;
+typedef virDomainStatsRecord *virDomainStatsRecordPtr;
+struct _virDomainStatsRecord {
+    virDomainPtr dom;
+    virTypedParameterPtr params;
+    int nparams;
+};
+
+/**
+ * virDomainStatsTypes:
+ *
+ * Groups of statistics which can be requested by
+ * virConnectGetAllDomainStats() and virDomainListGetStats().
+ */
+typedef enum {
+    VIR_DOMAIN_STATS_STATE = (1 << 0), /* return domain state */
+    VIR_DOMAIN_STATS_CPU_TOTAL = (1 << 1), /* return domain CPU info */
+    VIR_DOMAIN_STATS_BALLOON = (1 << 2), /* return domain balloon info */
+    VIR_DOMAIN_STATS_VCPU = (1 << 3), /* return domain virtual CPU info */
+    VIR_DOMAIN_STATS_INTERFACE = (1 << 4), /* return domain interfaces info */
+    VIR_DOMAIN_STATS_BLOCK = (1 << 5), /* return domain block info */
+    VIR_DOMAIN_STATS_JOB_LATENCY = (1 << 6), /* return job and monitor latency */
+} virDomainStatsTypes;
+
+typedef enum {
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE = VIR_CONNECT_LIST_DOMAINS_ACTIVE,
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_INACTIVE = VIR_CONNECT_LIST_DOMAINS_INACTIVE,
+
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_PERSISTENT = VIR_CONNECT_LIST_DOMAINS_PERSISTENT,
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_TRANSIENT = VIR_CONNECT_LIST_DOMAINS_TRANSIENT,
+
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_RUNNING = VIR_CONNECT_LIST_DOMAINS_RUNNING,
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_PAUSED = VIR_CONNECT_LIST_DOMAINS_PAUSED,
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_SHUTOFF = VIR_CONNECT_LIST_DOMAINS_SHUTOFF,
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_OTHER = VIR_CONNECT_LIST_DOMAINS_OTHER,
+
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS = 1U << 31, /* enforce requested stats */
+} virConnectGetAllDomainStatsFlags;
+
+int                     virConnectGetAllDomainStats (virConnectPtr conn,
+                                                     unsigned int stats,
+                                                     virDomainStatsRecordPtr **retStats,
+                                                     unsigned int flags);
+
+int                     virDomainListGetStats   (virDomainPtr *doms,
+                                                 unsigned int stats,
+                                                 virDomainStatsRecordPtr **retStats,
+                                                 unsigned int flags);
+
+void                    virDomainStatsRecordListFree (virDomainStatsRecordPtr *stats);
 int                     virDomainCreate         (virDomainPtr domain);
 int                     virDomainCreateWithFlags (virDomainPtr domain,
                                                   unsigned int flags);
@@ -3239,6 +3296,7 @@ const char*             virStorageVolGetKey             (virStorageVolPtr vol);
 
 typedef enum {
     VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA = 1 << 0,
+    VIR_STORAGE_VOL_CREATE_ASYNC = 1 << 1, /* return once a clone started */
 } virStorageVolCreateFlags;
 
 virStorageVolPtr        virStorageVolCreateXML          (virStoragePoolPtr pool,
@@ -3248,11 +3306,19 @@ virStorageVolPtr        virStorageVolCreateXMLFrom      (virStoragePoolPtr pool,
                                                          const char *xmldesc,
                                                          virStorageVolPtr clonevol,
                                                          unsigned int flags);
+typedef enum {
+    VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM = 1 << 0, /* skip holes */
+} virStorageVolDownloadFlags;
+
 int                     virStorageVolDownload           (virStorageVolPtr vol,
                                                          virStreamPtr stream,
                                                          unsigned long long offset,
                                                          unsigned long long length,
                                                          unsigned int flags);
+typedef enum {
+    VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM = 1 << 0, /* punch holes */
+} virStorageVolUploadFlags;
+
 int                     virStorageVolUpload             (virStorageVolPtr vol,
                                                          virStreamPtr stream,
                                                          unsigned long long offset,
@@ -3260,6 +3326,10 @@ int                     virStorageVolUpload             (virStorageVolPtr vol,
                                                          unsigned int flags);
 int                     virStorageVolDelete             (virStorageVolPtr vol,
                                                          unsigned int flags);
+typedef enum {
+    VIR_STORAGE_VOL_WIPE_ASYNC = 1 << 0, /* return once the wipe started */
+} virStorageVolWipeFlags;
+
 int                     virStorageVolWipe               (virStorageVolPtr vol,
                                                          unsigned int flags);
 int                     virStorageVolWipePattern        (virStorageVolPtr vol,
@@ -3279,12 +3349,67 @@ typedef enum {
     VIR_STORAGE_VOL_RESIZE_ALLOCATE = 1 << 0, /* force allocation of new size */
     VIR_STORAGE_VOL_RESIZE_DELTA    = 1 << 1, /* size is relative to current */
     VIR_STORAGE_VOL_RESIZE_SHRINK   = 1 << 2, /* allow decrease in capacity */
+    VIR_STORAGE_VOL_RESIZE_ASYNC    = 1 << 3, /* return once resize started */
 } virStorageVolResizeFlags;
 
 int                     virStorageVolResize             (virStorageVolPtr vol,
                                                          unsigned long long capacity,
                                                          unsigned int flags);
 
+/**
+ * virStorageVolJobType:
+ *
+ * The operation run by a storage volume job
+ */
+typedef enum {
+    VIR_STORAGE_VOL_JOB_NONE   = 0, /* No job was run on the volume */
+    VIR_STORAGE_VOL_JOB_WIPE   = 1, /* virStorageVolWipePattern */
+    VIR_STORAGE_VOL_JOB_CLONE  = 2, /* virStorageVolCreateXMLFrom */
+    VIR_STORAGE_VOL_JOB_RESIZE = 3, /* virStorageVolResize */
+
+#ifdef VIR_ENUM_SENTINELS
+    VIR_STORAGE_VOL_JOB_LAST
+#endif
+} virStorageVolJobType;
+
+/**
+ * virStorageVolJobState:
+ *
+ * The state of a storage volume job
+ */
+typedef enum {
+    VIR_STORAGE_VOL_JOB_STATE_NONE      = 0, /* No job was run */
+    VIR_STORAGE_VOL_JOB_STATE_QUEUED    = 1, /* Waiting for other jobs in
+                                                the pool to finish */
+    VIR_STORAGE_VOL_JOB_STATE_RUNNING   = 2, /* Job is running */
+    VIR_STORAGE_VOL_JOB_STATE_COMPLETED = 3, /* Job finished successfully */
+    VIR_STORAGE_VOL_JOB_STATE_FAILED    = 4, /* Job hit an error */
+    VIR_STORAGE_VOL_JOB_STATE_CANCELLED = 5, /* Job was aborted */
+
+#ifdef VIR_ENUM_SENTINELS
+    VIR_STORAGE_VOL_JOB_STATE_LAST
+#endif
+} virStorageVolJobState;
+
+typedef struct _virStorageVolJobInfo virStorageVolJobInfo;
+
+struct _virStorageVolJobInfo {
+    int type;                      /* virStorageVolJobType */
+    int state;                     /* virStorageVolJobState */
+    unsigned long long elapsed;    /* Time the job has run, in ms */
+    unsigned long long processed;  /* Bytes written so far */
+    unsigned long long total;      /* Bytes to write, 0 if unknown */
+    unsigned long long bandwidth;  /* Average bytes written per second */
+};
+
+typedef virStorageVolJobInfo *virStorageVolJobInfoPtr;
+
+int                     virStorageVolGetJobInfo         (virStorageVolPtr vol,
+                                                         virStorageVolJobInfoPtr info,
+                                                         unsigned int flags);
+int                     virStorageVolAbortJob           (virStorageVolPtr vol,
+                                                         unsigned int flags);
+
 
 /**
  * virKeycodeSet:
@@ -3973,6 +4098,23 @@ int virStreamRecv(virStreamPtr st,
                   char *data,
                   size_t nbytes);
 
+typedef enum {
+    VIR_STREAM_RECV_STOP_AT_HOLE = (1 << 0),
+} virStreamRecvFlagsValues;
+
+int virStreamRecvFlags(virStreamPtr st,
+                       char *data,
+                       size_t nbytes,
+                       unsigned int flags);
+
+int virStreamSendHole(virStreamPtr st,
+                      long long length,
+                      unsigned int flags);
+
+int virStreamRecvHole(virStreamPtr st,
+                      long long *length,
+                      unsigned int flags);
+
 
 /**
  * virStreamSourceFunc:
@@ -4007,6 +4149,55 @@ int virStreamSendAll(virStreamPtr st,
                      virStreamSourceFunc handler,
                      void *opaque);
 
+/**
+ * virStreamSourceHoleFunc:
+ *
+ * @st: the stream object
+ * @inData: whether the source is in data or in a hole
+ * @length: how long the data or the hole is
+ * @opaque: optional application provided data
+ *
+ * The virStreamSourceHoleFunc callback is used together
+ * with the virStreamSparseSendAll function for libvirt to
+ * find out where the holes of the source are.
+ *
+ * The callback should set @inData to 1 if the current
+ * position of the source is in data and 0 if it is in
+ * a hole, and @length to the number of bytes left up to
+ * the next change between the two. At the end of the
+ * source, @inData and @length are both 0.
+ *
+ * Returns 0 on success, or -1 upon error
+ */
+typedef int (*virStreamSourceHoleFunc)(virStreamPtr st,
+                                       int *inData,
+                                       long long *length,
+                                       void *opaque);
+
+/**
+ * virStreamSourceSkipFunc:
+ *
+ * @st: the stream object
+ * @length: number of bytes to skip
+ * @opaque: optional application provided data
+ *
+ * The virStreamSourceSkipFunc callback is used together
+ * with the virStreamSparseSendAll function for libvirt to
+ * move the current position of the source past a hole
+ * once it has been sent.
+ *
+ * Returns 0 on success, or -1 upon error
+ */
+typedef int (*virStreamSourceSkipFunc)(virStreamPtr st,
+                                       long long length,
+                                       void *opaque);
+
+int virStreamSparseSendAll(virStreamPtr st,
+                           virStreamSourceFunc handler,
+                           virStreamSourceHoleFunc holeHandler,
+                           virStreamSourceSkipFunc skipHandler,
+                           void *opaque);
+
 /**
  * virStreamSinkFunc:
  *
@@ -4040,6 +4231,30 @@ int virStreamRecvAll(virStreamPtr st,
                      virStreamSinkFunc handler,
                      void *opaque);
 
+/**
+ * virStreamSinkHoleFunc:
+ *
+ * @st: the stream object
+ * @length: number of bytes of the hole
+ * @opaque: optional application provided data
+ *
+ * The virStreamSinkHoleFunc callback is used together
+ * with the virStreamSparseRecvAll function for libvirt to
+ * provide the holes that have been received. The
+ * application should make the next @length bytes of the
+ * sink read back as zeros, ideally without storing them.
+ *
+ * Returns 0 on success, or -1 upon error
+ */
+typedef int (*virStreamSinkHoleFunc)(virStreamPtr st,
+                                     long long length,
+                                     void *opaque);
+
+int virStreamSparseRecvAll(virStreamPtr st,
+                           virStreamSinkFunc handler,
+                           virStreamSinkHoleFunc holeHandler,
+                           void *opaque);
+
 typedef enum {
     VIR_STREAM_EVENT_READABLE  = (1 << 0),
     VIR_STREAM_EVENT_WRITABLE  = (1 << 1),
@@ -4093,6 +4308,10 @@ int virInterfaceIsActive(virInterfacePtr iface);
 int virConnectIsEncrypted(virConnectPtr conn);
 int virConnectIsSecure(virConnectPtr conn);
 int virConnectIsAlive(virConnectPtr conn);
+int virConnectGetStartupProgress(virConnectPtr conn,
+                                 unsigned int *completed,
+                                 unsigned int *total,
+                                 unsigned int flags);
 
 /*
  * CPU specification API
@@ -4339,6 +4558,15 @@ int virDomainAbortJob(virDomainPtr dom);
  */
 #define VIR_DOMAIN_JOB_MEMORY_NORMAL_BYTES      "memory_normal_bytes"
 
+/**
+ * VIR_DOMAIN_JOB_MEMORY_BPS:
+ *
+ * virDomainGetJobStats field: average rate at which guest memory has been
+ * processed since the beginning of the job, in bytes per second, as
+ * VIR_TYPED_PARAM_ULLONG.
+ */
+#define VIR_DOMAIN_JOB_MEMORY_BPS               "memory_bps"
+
 /**
  * VIR_DOMAIN_JOB_DISK_TOTAL:
  *
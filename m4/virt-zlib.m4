@@ -0,0 +1,9 @@
+dnl The libz.so library
+
+AC_DEFUN([LIBVIRT_CHECK_ZLIB],[
+  LIBVIRT_CHECK_LIB([ZLIB], [z], [compressBound], [zlib.h])
+])
+
+AC_DEFUN([LIBVIRT_RESULT_ZLIB],[
+  LIBVIRT_RESULT_LIB([ZLIB])
+])
@@ -24,11 +24,14 @@ extern bool virConnectDomainEventRegisterAnyCheckACL(virConnectPtr conn, virDoma
 extern int virConnectDomainXMLFromNativeEnsureACL(virConnectPtr conn);
 extern int virConnectDomainXMLToNativeEnsureACL(virConnectPtr conn);
 extern int virConnectFindStoragePoolSourcesEnsureACL(virConnectPtr conn);
+extern int virConnectGetAllDomainStatsEnsureACL(virConnectPtr conn);
+extern bool virConnectGetAllDomainStatsCheckACL(virConnectPtr conn, virDomainDefPtr domain);
 extern int virConnectGetCapabilitiesEnsureACL(virConnectPtr conn);
 extern int virConnectGetCPUModelNamesEnsureACL(virConnectPtr conn);
 extern int virConnectGetHostnameEnsureACL(virConnectPtr conn);
 extern int virConnectGetLibVersionEnsureACL(virConnectPtr conn);
 extern int virConnectGetMaxVcpusEnsureACL(virConnectPtr conn);
+extern int virConnectGetStartupProgressEnsureACL(virConnectPtr conn);
 extern int virConnectGetSysinfoEnsureACL(virConnectPtr conn);
 extern int virConnectGetTypeEnsureACL(virConnectPtr conn);
 extern int virConnectGetURIEnsureACL(virConnectPtr conn);
@@ -326,11 +329,13 @@ extern bool virStoragePoolNumOfVolumesCheckACL(virConnectPtr conn, virStoragePoo
 extern int virStoragePoolRefreshEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool);
 extern int virStoragePoolSetAutostartEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool);
 extern int virStoragePoolUndefineEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool);
+extern int virStorageVolAbortJobEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
 extern int virStorageVolCreateXMLEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
 extern int virStorageVolCreateXMLFromEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
 extern int virStorageVolDeleteEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
 extern int virStorageVolDownloadEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
 extern int virStorageVolGetInfoEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
+extern int virStorageVolGetJobInfoEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
 extern int virStorageVolGetPathEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
 extern int virStorageVolGetXMLDescEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
 extern int virStorageVolLookupByKeyEnsureACL(virConnectPtr conn, virStoragePoolDefPtr pool, virStorageVolDefPtr vol);
@@ -53,6 +53,7 @@
 #include "device_conf.h"
 #include "virtpm.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
@@ -2102,11 +2103,16 @@ void virDomainDefFree(virDomainDefPtr def)
 static void virDomainObjDispose(void *obj)
 {
     virDomainObjPtr dom = obj;
+    size_t i;
 
     VIR_DEBUG("obj=%p", dom);
     virDomainDefFree(dom->def);
     virDomainDefFree(dom->newDef);
 
+    for (i = 0; i < VIR_DOMAIN_OBJ_XML_CACHE_SIZE; i++)
+        VIR_FREE(dom->xmlCache[i].xml);
+    VIR_FREE(dom->statusXML);
+
     if (dom->privateDataFreeFunc)
         (dom->privateDataFreeFunc)(dom->privateData);
 
@@ -2167,11 +2173,99 @@ virDomainDefPtr virDomainDefNew(const char *name,
 }
 
 
+/**
+ * virDomainObjBumpGeneration:
+ * @obj: domain object
+ *
+ * Record that the definition or state of @obj may have changed,
+ * so that XML cached by virDomainObjCacheXML() is no longer used.
+ * Must be called with @obj locked.
+ */
+void
+virDomainObjBumpGeneration(virDomainObjPtr obj)
+{
+    obj->generation++;
+}
+
+
+/**
+ * virDomainObjGetCachedXML:
+ * @obj: domain object
+ * @flags: bitwise-OR of virDomainXMLFlags the XML was formatted with
+ * @xml: filled with a copy of the cached XML
+ *
+ * Look up XML formatted with @flags since the last call to
+ * virDomainObjBumpGeneration(). Must be called with @obj locked.
+ *
+ * Returns 1 if @xml was filled in, 0 if there is nothing cached and
+ * -1 on error.
+ */
+int
+virDomainObjGetCachedXML(virDomainObjPtr obj,
+                         unsigned int flags,
+                         char **xml)
+{
+    size_t i;
+
+    *xml = NULL;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_XML_CACHE_SIZE; i++) {
+        virDomainObjXMLCachePtr entry = &obj->xmlCache[i];
+
+        if (entry->xml &&
+            entry->generation == obj->generation &&
+            entry->flags == flags)
+            return VIR_STRDUP(*xml, entry->xml) < 0 ? -1 : 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virDomainObjCacheXML:
+ * @obj: domain object
+ * @flags: bitwise-OR of virDomainXMLFlags @xml was formatted with
+ * @xml: XML of the current definition of @obj
+ *
+ * Remember @xml for virDomainObjGetCachedXML() until the next call to
+ * virDomainObjBumpGeneration(). Must be called with @obj locked.
+ * Failing to cache is not an error.
+ */
+void
+virDomainObjCacheXML(virDomainObjPtr obj,
+                     unsigned int flags,
+                     const char *xml)
+{
+    virDomainObjXMLCachePtr entry = &obj->xmlCache[0];
+    size_t i;
+
+    /* Reuse the slot for @flags or a stale one, else evict the first */
+    for (i = 0; i < VIR_DOMAIN_OBJ_XML_CACHE_SIZE; i++) {
+        virDomainObjXMLCachePtr cur = &obj->xmlCache[i];
+
+        if (!cur->xml || cur->generation != obj->generation ||
+            cur->flags == flags) {
+            entry = cur;
+            break;
+        }
+    }
+
+    VIR_FREE(entry->xml);
+    if (VIR_STRDUP_QUIET(entry->xml, xml) < 0)
+        return;
+    entry->generation = obj->generation;
+    entry->flags = flags;
+}
+
+
 void virDomainObjAssignDef(virDomainObjPtr domain,
                            virDomainDefPtr def,
                            bool live,
                            virDomainDefPtr *oldDef)
 {
+    virDomainObjBumpGeneration(domain);
+
     if (oldDef)
         *oldDef = NULL;
     if (virDomainObjIsActive(domain)) {
@@ -2334,6 +2428,7 @@ virDomainObjSetDefTransient(virCapsPtr caps,
     if (domain->newDef)
         return 0;
 
+    virDomainObjBumpGeneration(domain);
     if (!(domain->newDef = virDomainDefCopy(domain->def, caps, xmlopt, false)))
         goto out;
 
@@ -10199,6 +10294,7 @@ void virDomainDiskInsertPreAlloced(virDomainDefPtr def,
     int idx;
     /* Tenatively plan to insert disk at the end. */
     int insertAt = -1;
+    int diskIndex = virDiskNameToIndex(disk->dst);
 
     /* Then work backwards looking for disks on
      * the same bus. If we find a disk with a drive
@@ -10209,8 +10305,7 @@ void virDomainDiskInsertPreAlloced(virDomainDefPtr def,
         /* If bus matches and current disk is after
          * new disk, then new disk should go here */
         if (def->disks[idx]->bus == disk->bus &&
-            (virDiskNameToIndex(def->disks[idx]->dst) >
-             virDiskNameToIndex(disk->dst))) {
+            virDiskNameToIndex(def->disks[idx]->dst) > diskIndex) {
             insertAt = idx;
         } else if (def->disks[idx]->bus == disk->bus &&
                    insertAt == -1) {
@@ -11138,6 +11233,101 @@ virDomainDefMaybeAddHostdevSCSIcontroller(virDomainDefPtr def)
     return 0;
 }
 
+/* Device elements which may appear in <devices> */
+static const char *const virDomainDeviceNodeNames[] = {
+    "disk", "controller", "lease", "filesystem", "interface",
+    "smartcard", "parallel", "serial", "console", "channel",
+    "input", "graphics", "sound", "video", "hostdev",
+    "watchdog", "memballoon", "rng", "tpm", "nvram",
+    "hub", "redirdev", "redirfilter", "panic",
+};
+
+/* Elements of <devices> grouped by name, in document order */
+typedef struct _virDomainDeviceNodes virDomainDeviceNodes;
+typedef virDomainDeviceNodes *virDomainDeviceNodesPtr;
+struct _virDomainDeviceNodes {
+    xmlNodePtr *nodes[ARRAY_CARDINALITY(virDomainDeviceNodeNames)];
+    size_t nnodes[ARRAY_CARDINALITY(virDomainDeviceNodeNames)];
+};
+
+static void
+virDomainDeviceNodesClear(virDomainDeviceNodesPtr devnodes)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_CARDINALITY(virDomainDeviceNodeNames); i++) {
+        VIR_FREE(devnodes->nodes[i]);
+        devnodes->nnodes[i] = 0;
+    }
+}
+
+
+/*
+ * Sort all element children of the <devices> elements of @root by
+ * element name. Evaluating "./devices/disk", "./devices/interface", ...
+ * separately means walking all devices once for every device type.
+ */
+static int
+virDomainDeviceNodesCollect(xmlNodePtr root,
+                            virDomainDeviceNodesPtr devnodes)
+{
+    xmlNodePtr devices;
+    xmlNodePtr cur;
+    size_t i;
+
+    for (devices = root->children; devices; devices = devices->next) {
+        if (devices->type != XML_ELEMENT_NODE || devices->ns ||
+            !xmlStrEqual(devices->name, BAD_CAST "devices"))
+            continue;
+
+        for (cur = devices->children; cur; cur = cur->next) {
+            if (cur->type != XML_ELEMENT_NODE || cur->ns)
+                continue;
+
+            for (i = 0; i < ARRAY_CARDINALITY(virDomainDeviceNodeNames); i++) {
+                if (STREQ((const char *)cur->name,
+                          virDomainDeviceNodeNames[i]))
+                    break;
+            }
+            if (i == ARRAY_CARDINALITY(virDomainDeviceNodeNames))
+                continue;
+
+            if (VIR_APPEND_ELEMENT_COPY(devnodes->nodes[i],
+                                        devnodes->nnodes[i], cur) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Equivalent of virXPathNodeSet("./devices/@name", ctxt, nodes).
+ * The caller has to free @nodes.
+ */
+static int
+virDomainDeviceNodesGet(virDomainDeviceNodesPtr devnodes,
+                        const char *name,
+                        xmlNodePtr **nodes)
+{
+    size_t i;
+    int n;
+
+    for (i = 0; i < ARRAY_CARDINALITY(virDomainDeviceNodeNames); i++) {
+        if (STREQ(name, virDomainDeviceNodeNames[i]))
+            break;
+    }
+    sa_assert(i < ARRAY_CARDINALITY(virDomainDeviceNodeNames));
+
+    *nodes = devnodes->nodes[i];
+    n = devnodes->nnodes[i];
+    devnodes->nodes[i] = NULL;
+    devnodes->nnodes[i] = 0;
+    return n;
+}
+
+
 static virDomainDefPtr
 virDomainDefParseXML(xmlDocPtr xml,
                      xmlNodePtr root,
@@ -11161,6 +11351,9 @@ virDomainDefParseXML(xmlDocPtr xml,
     bool usb_other = false;
     bool usb_master = false;
     bool primaryVideo = false;
+    virDomainDeviceNodes devnodes;
+
+    memset(&devnodes, 0, sizeof(devnodes));
 
     if (VIR_ALLOC(def) < 0)
         return NULL;
@@ -12137,8 +12330,11 @@ virDomainDefParseXML(xmlDocPtr xml,
 
     def->emulator = virXPathString("string(./devices/emulator[1])", ctxt);
 
+    if (virDomainDeviceNodesCollect(ctxt->node, &devnodes) < 0)
+        goto error;
+
     /* analysis of the disk devices */
-    if ((n = virXPathNodeSet("./devices/disk", ctxt, &nodes)) < 0)
+    if ((n = virDomainDeviceNodesGet(&devnodes, "disk", &nodes)) < 0)
         goto error;
 
     if (n && VIR_ALLOC_N(def->disks, n) < 0)
@@ -12160,7 +12356,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the controller devices */
-    if ((n = virXPathNodeSet("./devices/controller", ctxt, &nodes)) < 0)
+    if ((n = virDomainDeviceNodesGet(&devnodes, "controller", &nodes)) < 0)
         goto error;
 
     if (n && VIR_ALLOC_N(def->controllers, n) < 0)
@@ -12210,7 +12406,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* analysis of the resource leases */
-    if ((n = virXPathNodeSet("./devices/lease", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "lease", &nodes)) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        "%s", _("cannot extract device leases"));
         goto error;
@@ -12227,7 +12423,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the filesystems */
-    if ((n = virXPathNodeSet("./devices/filesystem", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "filesystem", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->fss, n) < 0)
@@ -12243,7 +12439,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the network devices */
-    if ((n = virXPathNodeSet("./devices/interface", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "interface", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->nets, n) < 0)
@@ -12272,7 +12468,7 @@ virDomainDefParseXML(xmlDocPtr xml,
 
 
     /* analysis of the smartcard devices */
-    if ((n = virXPathNodeSet("./devices/smartcard", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "smartcard", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->smartcards, n) < 0)
@@ -12290,7 +12486,7 @@ virDomainDefParseXML(xmlDocPtr xml,
 
 
     /* analysis of the character devices */
-    if ((n = virXPathNodeSet("./devices/parallel", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "parallel", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->parallels, n) < 0)
@@ -12318,7 +12514,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
-    if ((n = virXPathNodeSet("./devices/serial", ctxt, &nodes)) < 0)
+    if ((n = virDomainDeviceNodesGet(&devnodes, "serial", &nodes)) < 0)
         goto error;
 
     if (n && VIR_ALLOC_N(def->serials, n) < 0)
@@ -12346,7 +12542,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
-    if ((n = virXPathNodeSet("./devices/console", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "console", &nodes)) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        "%s", _("cannot extract console devices"));
         goto error;
@@ -12368,7 +12564,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
-    if ((n = virXPathNodeSet("./devices/channel", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "channel", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->channels, n) < 0)
@@ -12409,7 +12605,7 @@ virDomainDefParseXML(xmlDocPtr xml,
 
 
     /* analysis of the input devices */
-    if ((n = virXPathNodeSet("./devices/input", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "input", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->inputs, n) < 0)
@@ -12451,7 +12647,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the graphics devices */
-    if ((n = virXPathNodeSet("./devices/graphics", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "graphics", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->graphics, n) < 0)
@@ -12487,7 +12683,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* analysis of the sound devices */
-    if ((n = virXPathNodeSet("./devices/sound", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "sound", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->sounds, n) < 0)
@@ -12504,7 +12700,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the video devices */
-    if ((n = virXPathNodeSet("./devices/video", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "video", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->videos, n) < 0)
@@ -12561,7 +12757,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* analysis of the host devices */
-    if ((n = virXPathNodeSet("./devices/hostdev", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "hostdev", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_REALLOC_N(def->hostdevs, def->nhostdevs + n) < 0)
@@ -12591,7 +12787,7 @@ virDomainDefParseXML(xmlDocPtr xml,
 
     /* analysis of the watchdog devices */
     def->watchdog = NULL;
-    if ((n = virXPathNodeSet("./devices/watchdog", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "watchdog", &nodes)) < 0) {
         goto error;
     }
     if (n > 1) {
@@ -12611,7 +12807,7 @@ virDomainDefParseXML(xmlDocPtr xml,
 
     /* analysis of the memballoon devices */
     def->memballoon = NULL;
-    if ((n = virXPathNodeSet("./devices/memballoon", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "memballoon", &nodes)) < 0) {
         goto error;
     }
     if (n > 1) {
@@ -12630,7 +12826,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* Parse the RNG device */
-    if ((n = virXPathNodeSet("./devices/rng", ctxt, &nodes)) < 0)
+    if ((n = virDomainDeviceNodesGet(&devnodes, "rng", &nodes)) < 0)
         goto error;
 
     if (n > 1) {
@@ -12647,7 +12843,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* Parse the TPM devices */
-    if ((n = virXPathNodeSet("./devices/tpm", ctxt, &nodes)) < 0)
+    if ((n = virDomainDeviceNodesGet(&devnodes, "tpm", &nodes)) < 0)
         goto error;
 
     if (n > 1) {
@@ -12662,7 +12858,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
-    if ((n = virXPathNodeSet("./devices/nvram", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "nvram", &nodes)) < 0) {
         goto error;
     }
 
@@ -12680,7 +12876,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* analysis of the hub devices */
-    if ((n = virXPathNodeSet("./devices/hub", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "hub", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->hubs, n) < 0)
@@ -12703,7 +12899,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the redirected devices */
-    if ((n = virXPathNodeSet("./devices/redirdev", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "redirdev", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->redirdevs, n) < 0)
@@ -12727,7 +12923,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the redirection filter rules */
-    if ((n = virXPathNodeSet("./devices/redirfilter", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "redirfilter", &nodes)) < 0) {
         goto error;
     }
     if (n > 1) {
@@ -12748,7 +12944,7 @@ virDomainDefParseXML(xmlDocPtr xml,
 
     /* analysis of the panic devices */
     def->panic = NULL;
-    if ((n = virXPathNodeSet("./devices/panic", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDeviceNodesGet(&devnodes, "panic", &nodes)) < 0) {
         goto error;
     }
     if (n > 1) {
@@ -12870,6 +13066,7 @@ virDomainDefParseXML(xmlDocPtr xml,
         goto error;
 
     virHashFree(bootHash);
+    virDomainDeviceNodesClear(&devnodes);
 
     return def;
 
@@ -12877,6 +13074,7 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(tmp);
     VIR_FREE(nodes);
     virHashFree(bootHash);
+    virDomainDeviceNodesClear(&devnodes);
     virDomainDefFree(def);
     return NULL;
 }
@@ -17995,12 +18193,24 @@ virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
     int ret = -1;
     char *xml;
 
+    /* Callers save the status after changing the domain */
+    virDomainObjBumpGeneration(obj);
+
     if (!(xml = virDomainObjFormat(xmlopt, obj, flags)))
         goto cleanup;
 
+    /* Nothing changed since the file was last written */
+    if (STREQ_NULLABLE(obj->statusXML, xml)) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    VIR_FREE(obj->statusXML);
     if (virDomainSaveXML(statusDir, obj->def, xml))
         goto cleanup;
 
+    obj->statusXML = xml;
+    xml = NULL;
     ret = 0;
  cleanup:
     VIR_FREE(xml);
@@ -18008,104 +18218,181 @@ virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
 }
 
 
+/* Upper limit on threads parsing domain XML files in parallel */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_MAX_WORKERS 8
+
+/* One XML file found by virDomainObjListLoadAllConfigs */
+struct virDomainObjListLoadItem {
+    char *name;
+    virDomainDefPtr def;        /* Parsed config, if !liveStatus */
+    int autostart;
+    virDomainObjPtr obj;        /* Parsed status, if liveStatus */
+};
+
+struct virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    int liveStatus;
+    virCapsPtr caps;
+    virDomainXMLOptionPtr xmlopt;
+    unsigned int expectedVirtTypes;
+
+    struct virDomainObjListLoadItem *items;
+    size_t nitems;
+
+    virMutex lock;
+    size_t next;                /* Next file to be parsed */
+};
+
+
+static int
+virDomainObjListParseConfig(struct virDomainObjListLoadData *data,
+                            struct virDomainObjListLoadItem *item)
+{
+    char *configFile = NULL, *autostartLink = NULL;
+    int ret = -1;
+
+    if ((configFile = virDomainConfigFile(data->configDir, item->name)) == NULL)
+        goto cleanup;
+    if (!(item->def = virDomainDefParseFile(configFile, data->caps,
+                                            data->xmlopt,
+                                            data->expectedVirtTypes,
+                                            VIR_DOMAIN_XML_INACTIVE)))
+        goto cleanup;
+
+    if ((autostartLink = virDomainConfigFile(data->autostartDir,
+                                             item->name)) == NULL)
+        goto cleanup;
+
+    if ((item->autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (ret < 0) {
+        virDomainDefFree(item->def);
+        item->def = NULL;
+    }
+    VIR_FREE(configFile);
+    VIR_FREE(autostartLink);
+    return ret;
+}
+
+
+static int
+virDomainObjListParseStatus(struct virDomainObjListLoadData *data,
+                            struct virDomainObjListLoadItem *item)
+{
+    char *statusFile = NULL;
+    int ret = -1;
+
+    if ((statusFile = virDomainConfigFile(data->configDir, item->name)) == NULL)
+        goto cleanup;
+
+    if (!(item->obj = virDomainObjParseFile(statusFile, data->caps,
+                                            data->xmlopt,
+                                            data->expectedVirtTypes,
+                                            VIR_DOMAIN_XML_INTERNAL_STATUS |
+                                            VIR_DOMAIN_XML_INTERNAL_ACTUAL_NET |
+                                            VIR_DOMAIN_XML_INTERNAL_PCI_ORIG_STATES |
+                                            VIR_DOMAIN_XML_INTERNAL_BASEDATE)))
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(statusFile);
+    return ret;
+}
+
+
+static void
+virDomainObjListParseThread(void *opaque)
+{
+    struct virDomainObjListLoadData *data = opaque;
+
+    while (true) {
+        struct virDomainObjListLoadItem *item;
+        int rc;
+
+        virMutexLock(&data->lock);
+        if (data->next == data->nitems) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        item = &data->items[data->next++];
+        virMutexUnlock(&data->lock);
+
+        /* NB: ignoring errors, so one malformed config doesn't
+           kill the whole process */
+        VIR_INFO("Loading config file '%s.xml'", item->name);
+        if (data->liveStatus)
+            rc = virDomainObjListParseStatus(data, item);
+        else
+            rc = virDomainObjListParseConfig(data, item);
+        if (rc < 0)
+            virResetLastError();
+    }
+}
+
+
 static virDomainObjPtr
 virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virCapsPtr caps,
                            virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
-                           unsigned int expectedVirtTypes,
+                           struct virDomainObjListLoadItem *item,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *configFile = NULL, *autostartLink = NULL;
-    virDomainDefPtr def = NULL;
     virDomainObjPtr dom;
-    int autostart;
     virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
-    if (!(def = virDomainDefParseFile(configFile, caps, xmlopt,
-                                      expectedVirtTypes,
-                                      VIR_DOMAIN_XML_INACTIVE)))
-        goto error;
-
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        goto error;
-
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
-        goto error;
-
-    if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+    if (!(dom = virDomainObjListAddLocked(doms, item->def, xmlopt, 0, &oldDef)))
+        return NULL;
+    item->def = NULL;
 
-    dom->autostart = autostart;
+    dom->autostart = item->autostart;
 
     if (notify)
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
-
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
 }
 
 static virDomainObjPtr
 virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virCapsPtr caps,
-                           virDomainXMLOptionPtr xmlopt,
-                           unsigned int expectedVirtTypes,
+                           struct virDomainObjListLoadItem *item,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
+    virDomainObjPtr obj = item->obj;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, caps, xmlopt, expectedVirtTypes,
-                                      VIR_DOMAIN_XML_INTERNAL_STATUS |
-                                      VIR_DOMAIN_XML_INTERNAL_ACTUAL_NET |
-                                      VIR_DOMAIN_XML_INTERNAL_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_XML_INTERNAL_BASEDATE)))
-        goto error;
-
     virUUIDFormat(obj->def->uuid, uuidstr);
 
     if (virHashLookup(doms->objs, uuidstr) != NULL) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected domain %s already exists"),
                        obj->def->name);
-        goto error;
+        return NULL;
     }
 
     if (virHashAddEntry(doms->objs, uuidstr, obj) < 0)
-        goto error;
+        return NULL;
+    item->obj = NULL;
 
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
-
- error:
-    virObjectUnref(obj);
-    VIR_FREE(statusFile);
-    return NULL;
 }
 
+/*
+ * Parsing the XML files takes most of the time, so it is spread over
+ * a few threads. The domains are then added to the list by the calling
+ * thread in order of their file names, so the outcome does not depend
+ * on the order in which readdir() returns the files or in which the
+ * threads finish, e.g. when two files define the same domain.
+ */
 int
 virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                const char *configDir,
@@ -18119,9 +18406,22 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
 {
     DIR *dir;
     struct dirent *entry;
+    char **names = NULL;
+    size_t nnames = 0;
+    struct virDomainObjListLoadData data;
+    size_t i;
+    int ret = -1;
 
     VIR_INFO("Scanning for configs in %s", configDir);
 
+    memset(&data, 0, sizeof(data));
+    data.configDir = configDir;
+    data.autostartDir = autostartDir;
+    data.liveStatus = liveStatus;
+    data.caps = caps;
+    data.xmlopt = xmlopt;
+    data.expectedVirtTypes = expectedVirtTypes;
+
     if (!(dir = opendir(configDir))) {
         if (errno == ENOENT)
             return 0;
@@ -18131,10 +18431,8 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
         return -1;
     }
 
-    virObjectLock(doms);
-
     while ((entry = readdir(dir))) {
-        virDomainObjPtr dom;
+        char *name;
 
         if (entry->d_name[0] == '.')
             continue;
@@ -18142,38 +18440,74 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
         if (!virFileStripSuffix(entry->d_name, ".xml"))
             continue;
 
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
-        if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             caps,
-                                             xmlopt,
-                                             expectedVirtTypes,
-                                             notify,
-                                             opaque);
+        if (VIR_STRDUP(name, entry->d_name) < 0 ||
+            VIR_APPEND_ELEMENT(names, nnames, name) < 0) {
+            VIR_FREE(name);
+            goto cleanup;
+        }
+    }
+
+    if (nnames == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    qsort(names, nnames, sizeof(*names), virStringSortCompare);
+
+    if (VIR_ALLOC_N(data.items, nnames) < 0)
+        goto cleanup;
+    data.nitems = nnames;
+    for (i = 0; i < nnames; i++)
+        data.items[i].name = names[i];
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        goto cleanup;
+    }
+
+    virThreadRunWorkers(MIN(nnames, VIR_DOMAIN_OBJ_LIST_LOAD_MAX_WORKERS),
+                        virDomainObjListParseThread, &data);
+
+    virObjectLock(doms);
+
+    for (i = 0; i < data.nitems; i++) {
+        struct virDomainObjListLoadItem *item = &data.items[i];
+        virDomainObjPtr dom = NULL;
+
+        if (item->obj)
+            dom = virDomainObjListLoadStatus(doms, item, notify, opaque);
+        else if (item->def)
+            dom = virDomainObjListLoadConfig(doms, xmlopt, item,
+                                             notify, opaque);
         else
-            dom = virDomainObjListLoadConfig(doms,
-                                             caps,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             expectedVirtTypes,
-                                             notify,
-                                             opaque);
+            continue;
+
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
             virObjectUnlock(dom);
+        } else {
+            virResetLastError();
         }
     }
 
-    closedir(dir);
     virObjectUnlock(doms);
-    return 0;
+
+    virMutexDestroy(&data.lock);
+    ret = 0;
+
+ cleanup:
+    closedir(dir);
+    for (i = 0; i < data.nitems; i++) {
+        virDomainDefFree(data.items[i].def);
+        virObjectUnref(data.items[i].obj);
+    }
+    VIR_FREE(data.items);
+    for (i = 0; i < nnames; i++)
+        VIR_FREE(names[i]);
+    VIR_FREE(names);
+    return ret;
 }
 
 int
@@ -18184,6 +18518,9 @@ virDomainDeleteConfig(const char *configDir,
     char *configFile = NULL, *autostartLink = NULL;
     int ret = -1;
 
+    /* @configDir may be the status directory */
+    VIR_FREE(dom->statusXML);
+
     if ((configFile = virDomainConfigFile(configDir, dom->def->name)) == NULL)
         goto cleanup;
     if ((autostartLink = virDomainConfigFile(autostartDir,
@@ -18675,6 +19012,7 @@ virDomainObjSetState(virDomainObjPtr dom, virDomainState state, int reason)
         return;
     }
 
+    virDomainObjBumpGeneration(dom);
     dom->state.state = state;
     if (reason > 0 && reason < last)
         dom->state.reason = reason;
@@ -19588,6 +19926,8 @@ virDomainObjSetMetadata(virDomainObjPtr vm,
                                         &persistentDef) < 0)
         return -1;
 
+    virDomainObjBumpGeneration(vm);
+
     if (flags & VIR_DOMAIN_AFFECT_LIVE)
         if (virDomainDefSetMetadata(vm->def, type, metadata, key, uri) < 0)
             return -1;
@@ -2010,6 +2010,17 @@ struct _virDomainStateReason {
 
 typedef struct _virDomainObj virDomainObj;
 typedef virDomainObj *virDomainObjPtr;
+/* Number of flag sets virDomainObjGetCachedXML() remembers XML for */
+# define VIR_DOMAIN_OBJ_XML_CACHE_SIZE 4
+
+typedef struct _virDomainObjXMLCache virDomainObjXMLCache;
+typedef virDomainObjXMLCache *virDomainObjXMLCachePtr;
+struct _virDomainObjXMLCache {
+    unsigned long long generation;
+    unsigned int flags;
+    char *xml;
+};
+
 struct _virDomainObj {
     virObjectLockable parent;
 
@@ -2032,6 +2043,11 @@ struct _virDomainObj {
     void (*privateDataFreeFunc)(void *);
 
     int taint;
+
+    /* Bumped whenever def, newDef or state may have changed */
+    unsigned long long generation;
+    virDomainObjXMLCache xmlCache[VIR_DOMAIN_OBJ_XML_CACHE_SIZE];
+    char *statusXML; /* Contents of the status file as last written */
 };
 
 typedef struct _virDomainObjList virDomainObjList;
@@ -2209,6 +2225,14 @@ virDomainObjPtr virDomainObjListAdd(virDomainObjListPtr doms,
                                     virDomainXMLOptionPtr xmlopt,
                                     unsigned int flags,
                                     virDomainDefPtr *oldDef);
+void virDomainObjBumpGeneration(virDomainObjPtr obj);
+int virDomainObjGetCachedXML(virDomainObjPtr obj,
+                             unsigned int flags,
+                             char **xml);
+void virDomainObjCacheXML(virDomainObjPtr obj,
+                          unsigned int flags,
+                          const char *xml);
+
 void virDomainObjAssignDef(virDomainObjPtr domain,
                            virDomainDefPtr def,
                            bool live,
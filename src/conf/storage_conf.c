@@ -44,6 +44,8 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virstring.h"
+#include "virtime.h"
+#include "viratomic.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -331,9 +333,154 @@ virStorageVolDefFree(virStorageVolDefPtr def)
 
     virStorageSourceClear(&def->target);
     virStorageSourceClear(&def->backingStore);
+    virStorageVolJobFree(def->job);
     VIR_FREE(def);
 }
 
+
+virStorageVolJobPtr
+virStorageVolJobNew(int type,
+                    unsigned long long total)
+{
+    virStorageVolJobPtr job;
+
+    if (VIR_ALLOC(job) < 0)
+        return NULL;
+
+    if (virMutexInit(&job->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        VIR_FREE(job);
+        return NULL;
+    }
+
+    job->type = type;
+    job->state = VIR_STORAGE_VOL_JOB_STATE_QUEUED;
+    job->total = total;
+
+    return job;
+}
+
+
+void
+virStorageVolJobFree(virStorageVolJobPtr job)
+{
+    if (!job)
+        return;
+
+    virMutexDestroy(&job->lock);
+    VIR_FREE(job);
+}
+
+
+/* Move @job to @state, recording when it started running or finished */
+void
+virStorageVolJobSetState(virStorageVolJobPtr job,
+                         int state)
+{
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0)
+        now = 0;
+
+    virMutexLock(&job->lock);
+    job->state = state;
+    if (state == VIR_STORAGE_VOL_JOB_STATE_RUNNING)
+        job->started = now;
+    else if (state != VIR_STORAGE_VOL_JOB_STATE_QUEUED)
+        job->finished = now;
+    virMutexUnlock(&job->lock);
+}
+
+
+bool
+virStorageVolJobIsAborted(virStorageVolJobPtr job)
+{
+    bool ret;
+
+    if (!job)
+        return false;
+
+    virMutexLock(&job->lock);
+    ret = job->abort;
+    virMutexUnlock(&job->lock);
+
+    return ret;
+}
+
+
+/*
+ * Account for @bytes more written by @job, which may be NULL. Safe to
+ * call from several threads at once. Returns -1 without reporting an
+ * error if the job was asked to stop, 0 otherwise.
+ */
+int
+virStorageVolJobProgress(virStorageVolJobPtr job,
+                         unsigned long long bytes)
+{
+    int ret = 0;
+
+    if (!job)
+        return 0;
+
+    virMutexLock(&job->lock);
+    job->processed += bytes;
+    if (job->abort)
+        ret = -1;
+    virMutexUnlock(&job->lock);
+
+    return ret;
+}
+
+
+/* Ask @job to stop. Returns -1 if it is not queued or running. */
+int
+virStorageVolJobAbort(virStorageVolJobPtr job)
+{
+    int ret = -1;
+
+    virMutexLock(&job->lock);
+    if (job->state == VIR_STORAGE_VOL_JOB_STATE_QUEUED ||
+        job->state == VIR_STORAGE_VOL_JOB_STATE_RUNNING) {
+        job->abort = true;
+        ret = 0;
+    }
+    virMutexUnlock(&job->lock);
+
+    if (ret < 0)
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("no job is active on the volume"));
+    return ret;
+}
+
+
+void
+virStorageVolJobGetInfo(virStorageVolJobPtr job,
+                        virStorageVolJobInfoPtr info)
+{
+    unsigned long long end;
+
+    memset(info, 0, sizeof(*info));
+
+    virMutexLock(&job->lock);
+    info->type = job->type;
+    info->state = job->state;
+    info->processed = job->processed;
+    info->total = job->total;
+
+    if (job->started) {
+        end = job->finished;
+        if (!end && virTimeMillisNow(&end) < 0)
+            end = job->started;
+        if (end > job->started)
+            info->elapsed = end - job->started;
+    }
+    virMutexUnlock(&job->lock);
+
+    if (info->elapsed)
+        info->bandwidth = info->processed * 1000 / info->elapsed;
+}
+
 static void
 virStoragePoolSourceAdapterClear(virStoragePoolSourceAdapter adapter)
 {
@@ -425,7 +572,7 @@ virStoragePoolObjFree(virStoragePoolObjPtr obj)
     VIR_FREE(obj->configFile);
     VIR_FREE(obj->autostartLink);
 
-    virMutexDestroy(&obj->lock);
+    virRWLockDestroy(&obj->lock);
 
     VIR_FREE(obj);
 }
@@ -1730,45 +1877,239 @@ virStoragePoolObjClearVols(virStoragePoolObjPtr pool)
 
     VIR_FREE(pool->volumes.objs);
     pool->volumes.count = 0;
+
+    virHashFree(pool->volumes.objsName);
+    virHashFree(pool->volumes.objsKey);
+    virHashFree(pool->volumes.objsPath);
+    pool->volumes.objsName = NULL;
+    pool->volumes.objsKey = NULL;
+    pool->volumes.objsPath = NULL;
 }
 
-virStorageVolDefPtr
-virStorageVolDefFindByKey(virStoragePoolObjPtr pool,
-                          const char *key)
+
+static const char *
+virStorageVolDefGetName(virStorageVolDefPtr vol)
+{
+    return vol->name;
+}
+
+static const char *
+virStorageVolDefGetKey(virStorageVolDefPtr vol)
+{
+    return vol->key;
+}
+
+static const char *
+virStorageVolDefGetPath(virStorageVolDefPtr vol)
+{
+    return vol->target.path;
+}
+
+
+/* Volume indexed under an id, together with how many other volumes
+ * of the pool share that id */
+typedef struct _virStorageVolDefIndexEntry virStorageVolDefIndexEntry;
+typedef virStorageVolDefIndexEntry *virStorageVolDefIndexEntryPtr;
+struct _virStorageVolDefIndexEntry {
+    virStorageVolDefPtr vol;
+    size_t dups;
+};
+
+static unsigned int virStoragePoolObjVolAdditions;
+
+
+static int
+virStoragePoolObjIndexVol(virHashTablePtr *table,
+                          const char *id,
+                          virStorageVolDefPtr vol)
+{
+    virStorageVolDefIndexEntryPtr entry;
+
+    if (!id)
+        return 0;
+
+    if (!*table && !(*table = virHashCreate(32, virHashValueFree)))
+        return -1;
+
+    /* Lookups used to return the first volume matching, keep it so */
+    if ((entry = virHashLookup(*table, id))) {
+        entry->dups++;
+        return 0;
+    }
+
+    if (VIR_ALLOC(entry) < 0)
+        return -1;
+    entry->vol = vol;
+
+    if (virHashAddEntry(*table, id, entry) < 0) {
+        VIR_FREE(entry);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+virStoragePoolObjUnindexVol(virStoragePoolObjPtr pool,
+                            virHashTablePtr table,
+                            const char *(*getid)(virStorageVolDefPtr),
+                            virStorageVolDefPtr vol)
 {
+    virStorageVolDefIndexEntryPtr entry;
+    const char *id = getid(vol);
     size_t i;
 
-    for (i = 0; i < pool->volumes.count; i++)
-        if (STREQ(pool->volumes.objs[i]->key, key))
-            return pool->volumes.objs[i];
+    if (!id || !(entry = virHashLookup(table, id)))
+        return;
 
-    return NULL;
+    if (entry->dups == 0) {
+        ignore_value(virHashRemoveEntry(table, id));
+        return;
+    }
+
+    entry->dups--;
+    if (entry->vol != vol)
+        return;
+
+    /* Let the next volume sharing the id take over the entry; @vol
+     * is no longer in the list */
+    for (i = 0; i < pool->volumes.count; i++) {
+        const char *otherid = getid(pool->volumes.objs[i]);
+
+        if (otherid && STREQ(otherid, id)) {
+            entry->vol = pool->volumes.objs[i];
+            break;
+        }
+    }
 }
 
-virStorageVolDefPtr
-virStorageVolDefFindByPath(virStoragePoolObjPtr pool,
-                           const char *path)
+
+static virStorageVolDefPtr
+virStoragePoolObjLookupVol(virHashTablePtr table,
+                           const char *id)
+{
+    virStorageVolDefIndexEntryPtr entry;
+
+    if (!table || !(entry = virHashLookup(table, id)))
+        return NULL;
+
+    return entry->vol;
+}
+
+
+/**
+ * virStoragePoolObjGetVolAdditions:
+ *
+ * Returns a counter increased every time a volume is added to any
+ * pool. As long as it does not change, a volume found by scanning
+ * the pools in order cannot show up in an earlier pool.
+ */
+unsigned int
+virStoragePoolObjGetVolAdditions(void)
+{
+    return virAtomicIntGet(&virStoragePoolObjVolAdditions);
+}
+
+
+/**
+ * virStoragePoolObjAddVol:
+ * @pool: locked storage pool object
+ * @vol: volume definition
+ *
+ * Append @vol to the volumes of @pool and index it by name, key and
+ * target path. On success @pool owns @vol, on failure the caller
+ * keeps it.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virStoragePoolObjAddVol(virStoragePoolObjPtr pool,
+                        virStorageVolDefPtr vol)
 {
+    virStorageVolDefListPtr volumes = &pool->volumes;
+
+    if (virStoragePoolObjIndexVol(&volumes->objsName, vol->name, vol) < 0)
+        return -1;
+
+    if (virStoragePoolObjIndexVol(&volumes->objsKey, vol->key, vol) < 0)
+        goto error_name;
+
+    if (virStoragePoolObjIndexVol(&volumes->objsPath,
+                                  vol->target.path, vol) < 0)
+        goto error_key;
+
+    if (VIR_APPEND_ELEMENT_COPY(volumes->objs, volumes->count, vol) < 0)
+        goto error_path;
+
+    virAtomicIntInc(&virStoragePoolObjVolAdditions);
+    return 0;
+
+ error_path:
+    virStoragePoolObjUnindexVol(pool, volumes->objsPath,
+                                virStorageVolDefGetPath, vol);
+ error_key:
+    virStoragePoolObjUnindexVol(pool, volumes->objsKey,
+                                virStorageVolDefGetKey, vol);
+ error_name:
+    virStoragePoolObjUnindexVol(pool, volumes->objsName,
+                                virStorageVolDefGetName, vol);
+    return -1;
+}
+
+
+/**
+ * virStoragePoolObjRemoveVol:
+ * @pool: locked storage pool object
+ * @vol: volume definition
+ *
+ * Remove @vol from the volumes of @pool and its indexes. The caller
+ * becomes responsible for freeing @vol.
+ */
+void
+virStoragePoolObjRemoveVol(virStoragePoolObjPtr pool,
+                           virStorageVolDefPtr vol)
+{
+    virStorageVolDefListPtr volumes = &pool->volumes;
     size_t i;
 
-    for (i = 0; i < pool->volumes.count; i++)
-        if (STREQ(pool->volumes.objs[i]->target.path, path))
-            return pool->volumes.objs[i];
+    for (i = 0; i < volumes->count; i++) {
+        if (volumes->objs[i] == vol)
+            break;
+    }
+    if (i == volumes->count)
+        return;
 
-    return NULL;
+    VIR_DELETE_ELEMENT(volumes->objs, i, volumes->count);
+
+    virStoragePoolObjUnindexVol(pool, volumes->objsName,
+                                virStorageVolDefGetName, vol);
+    virStoragePoolObjUnindexVol(pool, volumes->objsKey,
+                                virStorageVolDefGetKey, vol);
+    virStoragePoolObjUnindexVol(pool, volumes->objsPath,
+                                virStorageVolDefGetPath, vol);
 }
 
+
 virStorageVolDefPtr
-virStorageVolDefFindByName(virStoragePoolObjPtr pool,
-                           const char *name)
+virStorageVolDefFindByKey(virStoragePoolObjPtr pool,
+                          const char *key)
 {
-    size_t i;
+    return virStoragePoolObjLookupVol(pool->volumes.objsKey, key);
+}
 
-    for (i = 0; i < pool->volumes.count; i++)
-        if (STREQ(pool->volumes.objs[i]->name, name))
-            return pool->volumes.objs[i];
+virStorageVolDefPtr
+virStorageVolDefFindByPath(virStoragePoolObjPtr pool,
+                           const char *path)
+{
+    return virStoragePoolObjLookupVol(pool->volumes.objsPath, path);
+}
 
-    return NULL;
+virStorageVolDefPtr
+virStorageVolDefFindByName(virStoragePoolObjPtr pool,
+                           const char *name)
+{
+    return virStoragePoolObjLookupVol(pool->volumes.objsName, name);
 }
 
 virStoragePoolObjPtr
@@ -1791,9 +2132,9 @@ virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
     if (VIR_ALLOC(pool) < 0)
         return NULL;
 
-    if (virMutexInit(&pool->lock) < 0) {
+    if (virRWLockInitPreferWriter(&pool->lock) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("cannot initialize mutex"));
+                       _("cannot initialize lock"));
         VIR_FREE(pool);
         return NULL;
     }
@@ -2175,13 +2516,30 @@ virStoragePoolSourceFindDuplicate(virStoragePoolObjListPtr pools,
 void
 virStoragePoolObjLock(virStoragePoolObjPtr obj)
 {
-    virMutexLock(&obj->lock);
+    virRWLockWrite(&obj->lock);
+}
+
+/* Lock @obj against changes only, letting other readers in. The
+ * volume list and the definition of the pool may be looked at but
+ * not modified while holding it. */
+void
+virStoragePoolObjLockRead(virStoragePoolObjPtr obj)
+{
+    virRWLockRead(&obj->lock);
+}
+
+/* Like virStoragePoolObjLockRead, but returns false rather than wait
+ * for a writer */
+bool
+virStoragePoolObjTryLockRead(virStoragePoolObjPtr obj)
+{
+    return virRWLockTryRead(&obj->lock);
 }
 
 void
 virStoragePoolObjUnlock(virStoragePoolObjPtr obj)
 {
-    virMutexUnlock(&obj->lock);
+    virRWLockUnlock(&obj->lock);
 }
 
 #define MATCH(FLAG) (flags & (FLAG))
@@ -29,6 +29,7 @@
 # include "virstoragefile.h"
 # include "virbitmap.h"
 # include "virthread.h"
+# include "virhash.h"
 
 # include <libxml/tree.h>
 
@@ -58,12 +59,46 @@ struct _virStorageVolSource {
 
 typedef struct _virStorageVolDef virStorageVolDef;
 typedef virStorageVolDef *virStorageVolDefPtr;
+typedef struct _virStorageVolStamp virStorageVolStamp;
+typedef virStorageVolStamp *virStorageVolStampPtr;
+struct _virStorageVolStamp {
+    unsigned long long ino;
+    unsigned long long size;
+    struct timespec mtime;
+    struct timespec ctime;
+};
+
+/* Wipe, clone or resize of a volume, which may run without the pool
+ * lock held. Fields other than @lock are protected by @lock. */
+typedef struct _virStorageVolJob virStorageVolJob;
+typedef virStorageVolJob *virStorageVolJobPtr;
+struct _virStorageVolJob {
+    virMutex lock;
+
+    int type;                      /* virStorageVolJobType */
+    int state;                     /* virStorageVolJobState */
+    bool abort;                    /* Cancellation was requested */
+
+    unsigned long long started;    /* ms since the Epoch, 0 while queued */
+    unsigned long long finished;   /* ms since the Epoch, 0 until done */
+    unsigned long long processed;  /* Bytes written */
+    unsigned long long total;      /* Bytes to write, 0 if unknown */
+};
+
 struct _virStorageVolDef {
     char *name;
     char *key;
     int type; /* enum virStorageVolType */
 
     unsigned int building;
+    /* Number of jobs using the volume without holding the pool lock */
+    unsigned int in_use;
+    /* Last job run on the volume, if any */
+    virStorageVolJobPtr job;
+
+    /* Identity of the volume file when a pool refresh last probed it,
+     * all zero if it was not probed that way */
+    virStorageVolStamp stamp;
 
     virStorageVolSource source;
     virStorageSource target;
@@ -75,6 +110,12 @@ typedef virStorageVolDefList *virStorageVolDefListPtr;
 struct _virStorageVolDefList {
     size_t count;
     virStorageVolDefPtr *objs;
+
+    /* Indexes of @objs by name, key and target path, maintained by
+     * virStoragePoolObjAddVol and virStoragePoolObjRemoveVol */
+    virHashTablePtr objsName;
+    virHashTablePtr objsKey;
+    virHashTablePtr objsPath;
 };
 
 VIR_ENUM_DECL(virStorageVol)
@@ -286,13 +327,30 @@ typedef struct _virStoragePoolObj virStoragePoolObj;
 typedef virStoragePoolObj *virStoragePoolObjPtr;
 
 struct _virStoragePoolObj {
-    virMutex lock;
+    virRWLock lock;
 
     char *configFile;
     char *autostartLink;
     int active;
     int autostart;
     unsigned int asyncjobs;
+    /* Those of asyncjobs wiping a volume, which changes of the pool
+     * itself wait for rather than fail */
+    unsigned int wipejobs;
+    /* Set while storagePoolRefresh or the watcher update the volumes
+     * with the pool unlocked; waiters use the driver's jobCond */
+    bool refreshing;
+    /* Volume jobs currently running rather than queued, protected by
+     * the driver's jobLock */
+    unsigned int runningjobs;
+    /* Set by the storage driver while refreshing the pool along with
+     * all the others at autostart, when backends may answer from a
+     * query shared among pools */
+    bool batchRefresh;
+
+    /* Storage driver's watcher of the target directory of the active
+     * pool, if any */
+    void *watch;
 
     virStoragePoolDefPtr def;
     virStoragePoolDefPtr newDef;
@@ -311,13 +369,37 @@ typedef struct _virStorageDriverState virStorageDriverState;
 typedef virStorageDriverState *virStorageDriverStatePtr;
 
 struct _virStorageDriverState {
-    virMutex lock;
+    /* Held for writing to add, remove or redefine pools, for reading
+     * to look them up */
+    virRWLock lock;
 
     virStoragePoolObjList pools;
 
+    /* Names of the first pools found to hold a volume with a given
+     * key or path; only hints, verified on every use and dropped once
+     * virStoragePoolObjGetVolAdditions moves past @hintsStamp */
+    virMutex hintsLock;
+    virHashTablePtr volKeyPools;
+    virHashTablePtr volPathPools;
+    unsigned int hintsStamp;
+
+    /* Signalled whenever a volume job finishes or is aborted, for
+     * the queued jobs waiting for the pool's runningjobs to drop, and
+     * whenever a pool stops refreshing or its asyncjobs drop, for
+     * refreshes waiting to run, and whenever a pool watcher or volume
+     * job thread exits, for storageStateCleanup */
+    virMutex jobLock;
+    virCond jobCond;
+    size_t watchThreads;        /* running pool watcher updates */
+    size_t jobThreads;          /* running asynchronous volume jobs */
+
     char *configDir;
     char *autostartDir;
     bool privileged;
+
+    /* Settings of storage.conf */
+    bool watchPools;
+    bool lvmSharedReport;
 };
 
 typedef struct _virStoragePoolSourceList virStoragePoolSourceList;
@@ -362,6 +444,11 @@ virStorageVolDefFindByName(virStoragePoolObjPtr pool,
                            const char *name);
 
 void virStoragePoolObjClearVols(virStoragePoolObjPtr pool);
+unsigned int virStoragePoolObjGetVolAdditions(void);
+int virStoragePoolObjAddVol(virStoragePoolObjPtr pool,
+                            virStorageVolDefPtr vol);
+void virStoragePoolObjRemoveVol(virStoragePoolObjPtr pool,
+                                virStorageVolDefPtr vol);
 
 virStoragePoolDefPtr virStoragePoolDefParseString(const char *xml);
 virStoragePoolDefPtr virStoragePoolDefParseFile(const char *filename);
@@ -392,6 +479,17 @@ int virStoragePoolObjSaveDef(virStorageDriverStatePtr driver,
 int virStoragePoolObjDeleteDef(virStoragePoolObjPtr pool);
 
 void virStorageVolDefFree(virStorageVolDefPtr def);
+
+virStorageVolJobPtr virStorageVolJobNew(int type,
+                                        unsigned long long total);
+void virStorageVolJobFree(virStorageVolJobPtr job);
+void virStorageVolJobSetState(virStorageVolJobPtr job, int state);
+bool virStorageVolJobIsAborted(virStorageVolJobPtr job);
+int virStorageVolJobProgress(virStorageVolJobPtr job,
+                             unsigned long long bytes);
+int virStorageVolJobAbort(virStorageVolJobPtr job);
+void virStorageVolJobGetInfo(virStorageVolJobPtr job,
+                             virStorageVolJobInfoPtr info);
 void virStoragePoolSourceClear(virStoragePoolSourcePtr source);
 void virStoragePoolSourceDeviceClear(virStoragePoolSourceDevicePtr dev);
 void virStoragePoolSourceFree(virStoragePoolSourcePtr source);
@@ -416,6 +514,9 @@ int virStoragePoolSourceFindDuplicate(virStoragePoolObjListPtr pools,
                                       virStoragePoolDefPtr def);
 
 void virStoragePoolObjLock(virStoragePoolObjPtr obj);
+void virStoragePoolObjLockRead(virStoragePoolObjPtr obj);
+bool virStoragePoolObjTryLockRead(virStoragePoolObjPtr obj)
+    ATTRIBUTE_RETURN_CHECK;
 void virStoragePoolObjUnlock(virStoragePoolObjPtr obj);
 
 
@@ -1149,6 +1149,20 @@ typedef int
                                      unsigned int flags,
                                      int cancelled);
 
+typedef int
+(*virDrvConnectGetAllDomainStats)(virConnectPtr conn,
+                                  virDomainPtr *doms,
+                                  unsigned int ndoms,
+                                  unsigned int stats,
+                                  virDomainStatsRecordPtr **retStats,
+                                  unsigned int flags);
+
+typedef int
+(*virDrvConnectGetStartupProgress)(virConnectPtr conn,
+                                   unsigned int *completed,
+                                   unsigned int *total,
+                                   unsigned int flags);
+
 typedef struct _virDriver virDriver;
 typedef virDriver *virDriverPtr;
 
@@ -1363,6 +1377,8 @@ struct _virDriver {
     virDrvDomainMigrateFinish3Params domainMigrateFinish3Params;
     virDrvDomainMigrateConfirm3Params domainMigrateConfirm3Params;
     virDrvConnectGetCPUModelNames connectGetCPUModelNames;
+    virDrvConnectGetAllDomainStats connectGetAllDomainStats;
+    virDrvConnectGetStartupProgress connectGetStartupProgress;
 };
 
 
@@ -1771,6 +1787,15 @@ typedef int
                           unsigned long long capacity,
                           unsigned int flags);
 
+typedef int
+(*virDrvStorageVolGetJobInfo)(virStorageVolPtr vol,
+                              virStorageVolJobInfoPtr info,
+                              unsigned int flags);
+
+typedef int
+(*virDrvStorageVolAbortJob)(virStorageVolPtr vol,
+                            unsigned int flags);
+
 typedef int
 (*virDrvStoragePoolIsActive)(virStoragePoolPtr pool);
 
@@ -1836,6 +1861,8 @@ struct _virStorageDriver {
     virDrvStorageVolResize storageVolResize;
     virDrvStoragePoolIsActive storagePoolIsActive;
     virDrvStoragePoolIsPersistent storagePoolIsPersistent;
+    virDrvStorageVolGetJobInfo storageVolGetJobInfo;
+    virDrvStorageVolAbortJob storageVolAbortJob;
 };
 
 # ifdef WITH_LIBVIRTD
@@ -2050,6 +2077,22 @@ typedef int
                     char *data,
                     size_t nbytes);
 
+typedef int
+(*virDrvStreamRecvFlags)(virStreamPtr st,
+                         char *data,
+                         size_t nbytes,
+                         unsigned int flags);
+
+typedef int
+(*virDrvStreamSendHole)(virStreamPtr st,
+                        long long length,
+                        unsigned int flags);
+
+typedef int
+(*virDrvStreamRecvHole)(virStreamPtr st,
+                        long long *length,
+                        unsigned int flags);
+
 typedef int
 (*virDrvStreamEventAddCallback)(virStreamPtr stream,
                                 int events,
@@ -2076,6 +2119,9 @@ typedef virStreamDriver *virStreamDriverPtr;
 struct _virStreamDriver {
     virDrvStreamSend streamSend;
     virDrvStreamRecv streamRecv;
+    virDrvStreamRecvFlags streamRecvFlags;
+    virDrvStreamSendHole streamSendHole;
+    virDrvStreamRecvHole streamRecvHole;
     virDrvStreamEventAddCallback streamEventAddCallback;
     virDrvStreamEventUpdateCallback streamEventUpdateCallback;
     virDrvStreamEventRemoveCallback streamEventRemoveCallback;
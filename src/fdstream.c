@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
 #if HAVE_SYS_UN_H
 # include <sys/un.h>
 #endif
@@ -55,6 +56,18 @@ struct virFDStreamData {
     unsigned long long offset;
     unsigned long long length;
 
+    /* A sparse stream is exchanged with the I/O helper as records, see
+     * virFileSparseRecordEncode. Reading, @header holds the @headerLen
+     * bytes of the next record header read so far; writing, its last
+     * @headerPending bytes are still to be written out. Either way,
+     * @recordLen is what is left of the current record */
+    bool sparse;
+    char header[VIR_FILE_SPARSE_RECORD_HEADER_LEN];
+    size_t headerLen;
+    size_t headerPending;
+    virFileSparseRecordType recordType;
+    unsigned long long recordLen;
+
     int watch;
     int events;         /* events the stream callback is subscribed for */
     bool cbRemoved;
@@ -252,6 +265,73 @@ virFDStreamAddCallback(virStreamPtr st,
 }
 
 
+/* Writes out what is left of the header of the current record of a
+ * sparse stream. Returns 0 once done, -2 if it would block, or -1 on
+ * error */
+static int
+virFDStreamWriteRecord(struct virFDStreamData *fdst)
+{
+    while (fdst->headerPending) {
+        ssize_t done = write(fdst->fd,
+                             fdst->header + sizeof(fdst->header) -
+                             fdst->headerPending,
+                             fdst->headerPending);
+        if (done < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return -2;
+            virReportSystemError(errno, "%s",
+                                 _("cannot write to stream"));
+            return -1;
+        }
+        fdst->headerPending -= done;
+    }
+
+    return 0;
+}
+
+/* Reads the header of the next record of a sparse stream once the
+ * current one is over. Returns 1 if there is a current record, 0 at
+ * the end of the stream, -2 if it would block, or -1 on error */
+static int
+virFDStreamReadRecord(struct virFDStreamData *fdst)
+{
+    while (fdst->recordLen == 0) {
+        ssize_t got = read(fdst->fd,
+                           fdst->header + fdst->headerLen,
+                           sizeof(fdst->header) - fdst->headerLen);
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return -2;
+            virReportSystemError(errno, "%s",
+                                 _("cannot read from stream"));
+            return -1;
+        }
+        if (got == 0) {
+            if (fdst->headerLen == 0)
+                return 0;
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("truncated record in sparse stream"));
+            return -1;
+        }
+
+        fdst->headerLen += got;
+        if (fdst->headerLen < sizeof(fdst->header))
+            continue;
+
+        fdst->headerLen = 0;
+        if (virFileSparseRecordDecode(fdst->header, &fdst->recordType,
+                                      &fdst->recordLen) < 0)
+            return -1;
+    }
+
+    return 1;
+}
+
+
 static int
 virFDStreamCloseInt(virStreamPtr st, bool streamAbort)
 {
@@ -295,7 +375,14 @@ virFDStreamCloseInt(virStreamPtr st, bool streamAbort)
     }
 
     /* mutex locked */
-    ret = VIR_CLOSE(fdst->fd);
+    ret = 0;
+    /* A hole at the end of a sparse stream may not be written out yet */
+    if (!streamAbort && fdst->headerPending &&
+        (virSetBlocking(fdst->fd, true) < 0 ||
+         virFDStreamWriteRecord(fdst) < 0))
+        ret = -1;
+    if (VIR_CLOSE(fdst->fd) < 0)
+        ret = -1;
     if (fdst->cmd) {
         char buf[1024];
         ssize_t len;
@@ -396,6 +483,27 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
+    if (fdst->sparse) {
+        /* Data goes out as records of the size the caller asked for,
+         * which later calls complete if this one falls short */
+        if (nbytes == 0) {
+            ret = 0;
+            goto cleanup;
+        }
+        if ((ret = virFDStreamWriteRecord(fdst)) < 0)
+            goto cleanup;
+        if (fdst->recordLen == 0) {
+            virFileSparseRecordEncode(fdst->header,
+                                      VIR_FILE_SPARSE_RECORD_DATA, nbytes);
+            fdst->headerPending = sizeof(fdst->header);
+            fdst->recordLen = nbytes;
+            if ((ret = virFDStreamWriteRecord(fdst)) < 0)
+                goto cleanup;
+        }
+        if (fdst->recordLen < nbytes)
+            nbytes = fdst->recordLen;
+    }
+
  retry:
     ret = write(fdst->fd, bytes, nbytes);
     if (ret < 0) {
@@ -408,20 +516,86 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
             virReportSystemError(errno, "%s",
                                  _("cannot write to stream"));
         }
-    } else if (fdst->length) {
-        fdst->offset += ret;
+    } else {
+        if (fdst->length)
+            fdst->offset += ret;
+        if (fdst->sparse)
+            fdst->recordLen -= ret;
     }
 
+ cleanup:
     virMutexUnlock(&fdst->lock);
     return ret;
 }
 
 
-static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
+static int
+virFDStreamSendHole(virStreamPtr st, long long length, unsigned int flags)
+{
+    struct virFDStreamData *fdst = st->privateData;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!fdst) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "%s", _("stream is not open"));
+        return -1;
+    }
+
+    virMutexLock(&fdst->lock);
+
+    if (!fdst->sparse) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("stream is not sparse"));
+        goto cleanup;
+    }
+
+    if (fdst->recordLen) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("cannot send a hole before the data sent so far "
+                         "is complete"));
+        goto cleanup;
+    }
+
+    if ((ret = virFDStreamWriteRecord(fdst)) < 0)
+        goto cleanup;
+
+    if (fdst->length) {
+        if (length > fdst->length - fdst->offset) {
+            virReportSystemError(ENOSPC, "%s",
+                                 _("cannot write to stream"));
+            ret = -1;
+            goto cleanup;
+        }
+        fdst->offset += length;
+    }
+
+    /* The header is written out with whatever comes next if the
+     * helper is not ready for it yet */
+    virFileSparseRecordEncode(fdst->header,
+                              VIR_FILE_SPARSE_RECORD_HOLE, length);
+    fdst->headerPending = sizeof(fdst->header);
+    if ((ret = virFDStreamWriteRecord(fdst)) == -2)
+        ret = 0;
+
+ cleanup:
+    virMutexUnlock(&fdst->lock);
+    return ret;
+}
+
+
+static int
+virFDStreamRecvFlags(virStreamPtr st,
+                     char *bytes,
+                     size_t nbytes,
+                     unsigned int flags)
 {
     struct virFDStreamData *fdst = st->privateData;
     int ret;
 
+    virCheckFlags(VIR_STREAM_RECV_STOP_AT_HOLE, -1);
+
     if (nbytes > INT_MAX) {
         virReportSystemError(ERANGE, "%s",
                              _("Too many bytes to read from stream"));
@@ -446,6 +620,24 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
+    if (fdst->sparse) {
+        if ((ret = virFDStreamReadRecord(fdst)) <= 0)
+            goto cleanup;
+        if (fdst->recordLen < nbytes)
+            nbytes = fdst->recordLen;
+
+        if (fdst->recordType == VIR_FILE_SPARSE_RECORD_HOLE) {
+            if (flags & VIR_STREAM_RECV_STOP_AT_HOLE) {
+                ret = -3;
+                goto cleanup;
+            }
+            /* Read back as zeros by callers that don't handle holes */
+            memset(bytes, 0, nbytes);
+            ret = nbytes;
+            goto done;
+        }
+    }
+
  retry:
     ret = read(fdst->fd, bytes, nbytes);
     if (ret < 0) {
@@ -458,10 +650,67 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             virReportSystemError(errno, "%s",
                                  _("cannot read from stream"));
         }
-    } else if (fdst->length) {
+        goto cleanup;
+    }
+
+    if (fdst->sparse && ret == 0 && nbytes) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("truncated record in sparse stream"));
+        ret = -1;
+        goto cleanup;
+    }
+
+ done:
+    if (fdst->length)
         fdst->offset += ret;
+    if (fdst->sparse)
+        fdst->recordLen -= ret;
+
+ cleanup:
+    virMutexUnlock(&fdst->lock);
+    return ret;
+}
+
+
+static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
+{
+    return virFDStreamRecvFlags(st, bytes, nbytes, 0);
+}
+
+
+static int
+virFDStreamRecvHole(virStreamPtr st, long long *length, unsigned int flags)
+{
+    struct virFDStreamData *fdst = st->privateData;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!fdst) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "%s", _("stream is not open"));
+        return -1;
+    }
+
+    virMutexLock(&fdst->lock);
+
+    *length = 0;
+    if (fdst->sparse) {
+        int rc = virFDStreamReadRecord(fdst);
+
+        if (rc == -1)
+            goto cleanup;
+        if (rc == 1 && fdst->recordType == VIR_FILE_SPARSE_RECORD_HOLE) {
+            *length = fdst->recordLen;
+            if (fdst->length)
+                fdst->offset += fdst->recordLen;
+            fdst->recordLen = 0;
+        }
     }
 
+    ret = 0;
+
+ cleanup:
     virMutexUnlock(&fdst->lock);
     return ret;
 }
@@ -470,6 +719,9 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
 static virStreamDriver virFDStreamDrv = {
     .streamSend = virFDStreamWrite,
     .streamRecv = virFDStreamRead,
+    .streamRecvFlags = virFDStreamRecvFlags,
+    .streamSendHole = virFDStreamSendHole,
+    .streamRecvHole = virFDStreamRecvHole,
     .streamFinish = virFDStreamClose,
     .streamAbort = virFDStreamAbort,
     .streamEventAddCallback = virFDStreamAddCallback,
@@ -477,6 +729,131 @@ static virStreamDriver virFDStreamDrv = {
     .streamEventRemoveCallback = virFDStreamRemoveCallback
 };
 
+
+/*
+ * virFDStreamReserveRaw:
+ * @st: the stream
+ * @output: whether data is to be written to the stream, rather than read
+ * @len: the most data the caller wants to move, updated with how much
+ *       it may move
+ *
+ * Lets the caller move stream data with splice(), straight from or to
+ * the pipe to the I/O helper, rather than with virStreamRecv and
+ * virStreamSend. The caller then tells how much data it actually moved
+ * with virFDStreamCommitRaw, before doing anything else with the stream.
+ * When reading, up to @len bytes are already in the pipe.
+ *
+ * Returns the FD of the pipe, -2 if the stream can't take data at the
+ * moment, -3 if the data has to go through the regular stream APIs for
+ * now, or -1 on error
+ */
+int
+virFDStreamReserveRaw(virStreamPtr st,
+                      bool output,
+                      size_t *len)
+{
+    struct virFDStreamData *fdst = st->privateData;
+    int ret = -3;
+    int avail;
+
+    if (st->driver != &virFDStreamDrv)
+        return -3;
+
+    if (!fdst) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "%s", _("stream is not open"));
+        return -1;
+    }
+
+    virMutexLock(&fdst->lock);
+
+    /* Only the pipe to the I/O helper is sure to be spliceable */
+    if (!fdst->cmd)
+        goto cleanup;
+
+    if (fdst->length) {
+        if (fdst->length == fdst->offset) {
+            if (output) {
+                virReportSystemError(ENOSPC, "%s",
+                                     _("cannot write to stream"));
+                ret = -1;
+            }
+            goto cleanup;
+        }
+
+        if ((fdst->length - fdst->offset) < *len)
+            *len = fdst->length - fdst->offset;
+    }
+
+    if (output) {
+        if (fdst->sparse) {
+            /* The data makes a record of its own, as in virFDStreamWrite */
+            if ((ret = virFDStreamWriteRecord(fdst)) < 0)
+                goto cleanup;
+            if (fdst->recordLen == 0) {
+                virFileSparseRecordEncode(fdst->header,
+                                          VIR_FILE_SPARSE_RECORD_DATA, *len);
+                fdst->headerPending = sizeof(fdst->header);
+                fdst->recordLen = *len;
+                if ((ret = virFDStreamWriteRecord(fdst)) < 0)
+                    goto cleanup;
+            }
+            if (fdst->recordLen < *len)
+                *len = fdst->recordLen;
+        }
+    } else {
+        if (fdst->sparse) {
+            /* Holes, the end of the stream and errors are for
+             * the regular APIs to report */
+            int rc = virFDStreamReadRecord(fdst);
+
+            if (rc == -1) {
+                ret = -1;
+                goto cleanup;
+            }
+            if (rc != 1 ||
+                fdst->recordType != VIR_FILE_SPARSE_RECORD_DATA)
+                goto cleanup;
+            if (fdst->recordLen < *len)
+                *len = fdst->recordLen;
+        }
+
+        /* Only hand out data that is there already */
+        if (ioctl(fdst->fd, FIONREAD, &avail) < 0 || avail <= 0)
+            goto cleanup;
+        if ((size_t) avail < *len)
+            *len = avail;
+    }
+
+    ret = fdst->fd;
+
+ cleanup:
+    virMutexUnlock(&fdst->lock);
+    return ret;
+}
+
+
+/*
+ * virFDStreamCommitRaw:
+ * @st: the stream
+ * @len: the amount of data moved
+ *
+ * Accounts for data moved after virFDStreamReserveRaw
+ */
+void
+virFDStreamCommitRaw(virStreamPtr st,
+                     size_t len)
+{
+    struct virFDStreamData *fdst = st->privateData;
+
+    virMutexLock(&fdst->lock);
+    if (fdst->length)
+        fdst->offset += len;
+    if (fdst->sparse)
+        fdst->recordLen -= len;
+    virMutexUnlock(&fdst->lock);
+}
+
 static int virFDStreamOpenInternal(virStreamPtr st,
                                    int fd,
                                    virCommandPtr cmd,
@@ -586,7 +963,8 @@ virFDStreamOpenFileInternal(virStreamPtr st,
                             unsigned long long offset,
                             unsigned long long length,
                             int oflags,
-                            int mode)
+                            int mode,
+                            bool sparse)
 {
     int fd = -1;
     int childfd = -1;
@@ -594,8 +972,8 @@ virFDStreamOpenFileInternal(virStreamPtr st,
     virCommandPtr cmd = NULL;
     int errfd = -1;
 
-    VIR_DEBUG("st=%p path=%s oflags=%x offset=%llu length=%llu mode=%o",
-              st, path, oflags, offset, length, mode);
+    VIR_DEBUG("st=%p path=%s oflags=%x offset=%llu length=%llu mode=%o "
+              "sparse=%d", st, path, oflags, offset, length, mode, sparse);
 
     oflags |= O_NOCTTY | O_BINARY;
 
@@ -629,8 +1007,10 @@ virFDStreamOpenFileInternal(virStreamPtr st,
      * non-blocking I/O on block devs/regular files. To
      * support those we need to fork a helper process to do
      * the I/O so we just have a fifo. Or use AIO :-(
+     * The helper is also the one to find holes in sparse
+     * streams, and to punch them.
      */
-    if ((st->flags & VIR_STREAM_NONBLOCK) &&
+    if (((st->flags & VIR_STREAM_NONBLOCK) || sparse) &&
         (!S_ISCHR(sb.st_mode) &&
          !S_ISFIFO(sb.st_mode))) {
         int fds[2] = { -1, -1 };
@@ -655,6 +1035,8 @@ virFDStreamOpenFileInternal(virStreamPtr st,
         virCommandPassFD(cmd, fd,
                          VIR_COMMAND_PASS_FD_CLOSE_PARENT);
         virCommandAddArgFormat(cmd, "%d", fd);
+        if (sparse)
+            virCommandAddArg(cmd, "1");
 
         if ((oflags & O_ACCMODE) == O_RDONLY) {
             childfd = fds[1];
@@ -676,6 +1058,12 @@ virFDStreamOpenFileInternal(virStreamPtr st,
     if (virFDStreamOpenInternal(st, fd, cmd, errfd, length) < 0)
         goto error;
 
+    /* Character devices and FIFOs can't have holes */
+    if (cmd && sparse) {
+        struct virFDStreamData *fdst = st->privateData;
+        fdst->sparse = true;
+    }
+
     return 0;
 
  error:
@@ -702,7 +1090,28 @@ int virFDStreamOpenFile(virStreamPtr st,
     }
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
-                                       oflags, 0);
+                                       oflags, 0, false);
+}
+
+/* Like virFDStreamOpenFile, but the stream is sparse: reads stop at
+ * holes in the file with VIR_STREAM_RECV_STOP_AT_HOLE, to be skipped
+ * with virStreamRecvHole, and holes sent with virStreamSendHole are
+ * punched into it */
+int virFDStreamOpenSparseFile(virStreamPtr st,
+                              const char *path,
+                              unsigned long long offset,
+                              unsigned long long length,
+                              int oflags)
+{
+    if (oflags & O_CREAT) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Attempt to create %s without specifying mode"),
+                       path);
+        return -1;
+    }
+    return virFDStreamOpenFileInternal(st, path,
+                                       offset, length,
+                                       oflags, 0, true);
 }
 
 int virFDStreamCreateFile(virStreamPtr st,
@@ -714,7 +1123,7 @@ int virFDStreamCreateFile(virStreamPtr st,
 {
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
-                                       oflags | O_CREAT, mode);
+                                       oflags | O_CREAT, mode, false);
 }
 
 #ifdef HAVE_CFMAKERAW
@@ -729,7 +1138,7 @@ int virFDStreamOpenPTY(virStreamPtr st,
 
     if (virFDStreamOpenFileInternal(st, path,
                                     offset, length,
-                                    oflags | O_CREAT, 0) < 0)
+                                    oflags | O_CREAT, 0, false) < 0)
         return -1;
 
     fdst = st->privateData;
@@ -765,7 +1174,7 @@ int virFDStreamOpenPTY(virStreamPtr st,
 {
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
-                                       oflags | O_CREAT, 0);
+                                       oflags | O_CREAT, 0, false);
 }
 #endif /* !HAVE_CFMAKERAW */
 
@@ -8932,6 +8932,296 @@ virConnectListAllDomains(virConnectPtr conn,
 }
 
 
+/**
+ * virConnectGetAllDomainStats:
+ * @conn: pointer to the hypervisor connection
+ * @stats: stats to return, binary-OR of virDomainStatsTypes
+ * @retStats: Pointer that will be filled with the array of returned stats
+ * @flags: extra flags; binary-OR of virConnectGetAllDomainStatsFlags
+ *
+ * Query statistics for all domains on a given connection.
+ *
+ * Report statistics of various parameters for a running VM according to @stats
+ * field. The statistics are returned as an array of structures for each queried
+ * domain. The structure contains an array of typed parameters containing the
+ * individual statistics. The typed parameter name for each statistic field
+ * consists of a dot-separated string containing name of the requested group
+ * followed by a group specific description of the statistic value.
+ *
+ * The statistic groups are enabled using the @stats parameter which is a
+ * binary-OR of enum virDomainStatsTypes. The following groups are available
+ * (although not necessarily implemented for each hypervisor):
+ *
+ * VIR_DOMAIN_STATS_STATE: Return domain state and reason for entering that
+ * state. The typed parameter keys are in this format:
+ * "state.state" - state of the VM, returned as int from virDomainState enum
+ * "state.reason" - reason for entering given state, returned as int from
+ *                  virDomain*Reason enum corresponding to given state.
+ *
+ * VIR_DOMAIN_STATS_CPU_TOTAL: Return CPU statistics and usage information.
+ * The typed parameter keys are in this format:
+ * "cpu.time" - total cpu time spent for this domain in nanoseconds
+ *              as unsigned long long.
+ * "cpu.user" - user cpu time spent in nanoseconds as unsigned long long.
+ * "cpu.system" - system cpu time spent in nanoseconds as unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_BALLOON: Return memory balloon device information.
+ * The typed parameter keys are in this format:
+ * "balloon.current" - the memory in kiB currently used
+ *                     as unsigned long long.
+ * "balloon.maximum" - the maximum memory in kiB allowed
+ *                     as unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_VCPU: Return virtual CPU statistics.
+ * The typed parameter keys are in this format:
+ * "vcpu.current" - current number of online virtual CPUs as unsigned int.
+ * "vcpu.maximum" - maximum number of online virtual CPUs as unsigned int.
+ * "vcpu.<num>.state" - state of the virtual CPU <num>, as int
+ *                      from virVcpuState enum.
+ * "vcpu.<num>.time" - virtual cpu time spent by virtual CPU <num>
+ *                     as unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_INTERFACE: Return network interface statistics.
+ * The typed parameter keys are in this format:
+ * "net.count" - number of network interfaces on this domain
+ *               as unsigned int.
+ * "net.<num>.name" - name of the interface <num> as string.
+ * "net.<num>.rx.bytes" - bytes received as unsigned long long.
+ * "net.<num>.rx.pkts" - packets received as unsigned long long.
+ * "net.<num>.rx.errs" - receive errors as unsigned long long.
+ * "net.<num>.rx.drop" - receive packets dropped as unsigned long long.
+ * "net.<num>.tx.bytes" - bytes transmitted as unsigned long long.
+ * "net.<num>.tx.pkts" - packets transmitted as unsigned long long.
+ * "net.<num>.tx.errs" - transmission errors as unsigned long long.
+ * "net.<num>.tx.drop" - transmit packets dropped as unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_BLOCK: Return block devices statistics.
+ * The typed parameter keys are in this format:
+ * "block.count" - number of block devices on this domain
+ *                 as unsigned int.
+ * "block.<num>.name" - name of the block device <num> as string.
+ *                      matches the target name (vda/sda/hda) of the
+ *                      block device.
+ * "block.<num>.rd.reqs" - number of read requests as unsigned long long.
+ * "block.<num>.rd.bytes" - number of read bytes as unsigned long long.
+ * "block.<num>.rd.times" - total time (ns) spent on reads as
+ *                          unsigned long long.
+ * "block.<num>.wr.reqs" - number of write requests as unsigned long long.
+ * "block.<num>.wr.bytes" - number of written bytes as unsigned long long.
+ * "block.<num>.wr.times" - total time (ns) spent on writes as
+ *                          unsigned long long.
+ * "block.<num>.fl.reqs" - total flush requests as unsigned long long.
+ * "block.<num>.fl.times" - total time (ns) spent on cache flushing as
+ *                          unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_JOB_LATENCY: Return latency histograms of the jobs run
+ * on the domain and of the commands sent to its hypervisor monitor. Each
+ * histogram <hist> is reported as:
+ * "<hist>.count" - number of samples as unsigned int.
+ * "<hist>.bucket.<num>" - number of samples which took less than 2^<num>
+ *                         milliseconds and did not fit any lower bucket,
+ *                         as unsigned int. The last bucket is unbounded.
+ * The typed parameter keys are in this format:
+ * "job.queued" - number of jobs running or waiting to run as int.
+ * "job.wait" - histogram of the time spent waiting for a job to start.
+ * "job.hold.<name>" - histogram of the time jobs of type <name> were
+ *                     running.
+ * "job.async.<name>" - histogram of the time asynchronous jobs of type
+ *                      <name> were running.
+ * "monitor.cmd.<name>" - histogram of the round trip time of monitor
+ *                        command <name>.
+ *
+ * Note that entire stats groups or individual stat fields may be missing from
+ * the output in case they are not supported by the given hypervisor, are not
+ * applicable for the current state of the guest domain, or their retrieval
+ * was not successful. In particular, statistics which would require waiting
+ * for another job on the domain to finish are omitted rather than delaying
+ * the whole call.
+ *
+ * Using 0 for @stats returns all stats groups supported by the given
+ * hypervisor.
+ *
+ * Specifying VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS as @flags makes
+ * the function return error in case some of the stat types in @stats were
+ * not recognized by the daemon.
+ *
+ * Similarly to virConnectListAllDomains, @flags can contain various flags to
+ * filter the list of domains to provide stats for.
+ *
+ * VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE selects online domains while
+ * VIR_CONNECT_GET_ALL_DOMAINS_STATS_INACTIVE selects offline ones.
+ *
+ * VIR_CONNECT_GET_ALL_DOMAINS_STATS_PERSISTENT and
+ * VIR_CONNECT_GET_ALL_DOMAINS_STATS_TRANSIENT allow to filter the list
+ * according to their persistence.
+ *
+ * To filter the list of VMs by domain state @flags can contain
+ * VIR_CONNECT_GET_ALL_DOMAINS_STATS_RUNNING,
+ * VIR_CONNECT_GET_ALL_DOMAINS_STATS_PAUSED,
+ * VIR_CONNECT_GET_ALL_DOMAINS_STATS_SHUTOFF and/or
+ * VIR_CONNECT_GET_ALL_DOMAINS_STATS_OTHER for all other states.
+ *
+ * Returns the count of returned statistics structures on success, -1 on error.
+ * The requested data are returned in the @retStats parameter. The returned
+ * array should be freed by the caller. See virDomainStatsRecordListFree.
+ */
+int
+virConnectGetAllDomainStats(virConnectPtr conn,
+                            unsigned int stats,
+                            virDomainStatsRecordPtr **retStats,
+                            unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, stats=0x%x, retStats=%p, flags=0x%x",
+              conn, stats, retStats, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(retStats, cleanup);
+
+    *retStats = NULL;
+
+    if (!conn->driver->connectGetAllDomainStats) {
+        virReportUnsupportedError();
+        goto cleanup;
+    }
+
+    ret = conn->driver->connectGetAllDomainStats(conn, NULL, 0, stats,
+                                                 retStats, flags);
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(conn);
+
+    return ret;
+}
+
+
+/**
+ * virDomainListGetStats:
+ * @doms: NULL terminated array of domains
+ * @stats: stats to return, binary-OR of virDomainStatsTypes
+ * @retStats: Pointer that will be filled with the array of returned stats
+ * @flags: extra flags; binary-OR of virConnectGetAllDomainStatsFlags
+ *
+ * Query statistics for domains provided by @doms. Note that all domains in
+ * @doms must share the same connection.
+ *
+ * Report statistics of various parameters for a running VM according to @stats
+ * field. The statistics are returned as an array of structures for each queried
+ * domain. The structure contains an array of typed parameters containing the
+ * individual statistics. The typed parameter name for each statistic field
+ * consists of a dot-separated string containing name of the requested group
+ * followed by a group specific description of the statistic value.
+ *
+ * The statistic groups are enabled using the @stats parameter which is a
+ * binary-OR of enum virDomainStatsTypes. The stats groups are documented
+ * in virConnectGetAllDomainStats.
+ *
+ * Using 0 for @stats returns all stats groups supported by the given
+ * hypervisor.
+ *
+ * Specifying VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS as @flags makes
+ * the function return error in case some of the stat types in @stats were
+ * not recognized by the daemon.
+ *
+ * Note that any of the domain list filtering flags in @flags will be rejected
+ * by this function.
+ *
+ * Returns the count of returned statistics structures on success, -1 on error.
+ * The requested data are returned in the @retStats parameter. The returned
+ * array should be freed by the caller. See virDomainStatsRecordListFree.
+ * Note that the count of returned stats may be less than the domain count
+ * provided via @doms.
+ */
+int
+virDomainListGetStats(virDomainPtr *doms,
+                      unsigned int stats,
+                      virDomainStatsRecordPtr **retStats,
+                      unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    virDomainPtr *nextdom = doms;
+    unsigned int ndoms = 0;
+    int ret = -1;
+
+    VIR_DEBUG("doms=%p, stats=0x%x, retStats=%p, flags=0x%x",
+              doms, stats, retStats, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, cleanup);
+    virCheckNonNullArgGoto(retStats, cleanup);
+
+    *retStats = NULL;
+
+    if (!*doms) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("doms array must contain at least one domain"));
+        goto cleanup;
+    }
+
+    conn = doms[0]->conn;
+    virCheckConnectReturn(conn, -1);
+
+    if (!conn->driver->connectGetAllDomainStats) {
+        virReportUnsupportedError();
+        goto cleanup;
+    }
+
+    while (*nextdom) {
+        virDomainPtr dom = *nextdom;
+
+        virCheckDomainGoto(dom, cleanup);
+
+        if (dom->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("domains in 'doms' array must belong to a "
+                             "single connection"));
+            goto cleanup;
+        }
+
+        ndoms++;
+        nextdom++;
+    }
+
+    ret = conn->driver->connectGetAllDomainStats(conn, doms, ndoms,
+                                                 stats, retStats, flags);
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(conn);
+    return ret;
+}
+
+
+/**
+ * virDomainStatsRecordListFree:
+ * @stats: NULL terminated array of virDomainStatsRecords to free
+ *
+ * Convenience function to free a list of domain stats returned by
+ * virDomainListGetStats and virConnectGetAllDomainStats.
+ */
+void
+virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats)
+{
+    virDomainStatsRecordPtr *next;
+
+    if (!stats)
+        return;
+
+    for (next = stats; *next; next++) {
+        virTypedParamsFree((*next)->params, (*next)->nparams);
+        virDomainFree((*next)->dom);
+        VIR_FREE(*next);
+    }
+
+    VIR_FREE(stats);
+}
+
+
 /**
  * virDomainCreate:
  * @domain: pointer to a defined domain
@@ -13725,6 +14015,12 @@ virStorageVolCreateXML(virStoragePoolPtr pool,
  * qcow2 image files which don't support full preallocation,
  * by creating a sparse image file with metadata.
  *
+ * If @flags contains VIR_STORAGE_VOL_CREATE_ASYNC, the new volume is
+ * returned as soon as it was defined, and its contents are copied in
+ * the background. Use virStorageVolGetJobInfo() on the new volume to
+ * follow the copy, and virStorageVolAbortJob() to cancel it. The new
+ * volume is deleted if the copy fails or is cancelled.
+ *
  * Returns the storage volume, or NULL on error
  */
 virStorageVolPtr
@@ -13767,12 +14063,17 @@ virStorageVolCreateXMLFrom(virStoragePoolPtr pool,
  * @stream: stream to use as output
  * @offset: position in @vol to start reading from
  * @length: limit on amount of data to download
- * @flags: extra flags; not used yet, so callers should always pass 0
+ * @flags: bitwise-OR of virStorageVolDownloadFlags
  *
  * Download the content of the volume as a stream. If @length
  * is zero, then the remaining contents of the volume after
  * @offset will be downloaded.
  *
+ * With VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM, holes in the
+ * volume are not sent as zeros: the receiver can skip them
+ * with virStreamRecvFlags and virStreamRecvHole, or with
+ * virStreamSparseRecvAll.
+ *
  * This call sets up an asynchronous stream; subsequent use of
  * stream APIs is necessary to transfer the actual data,
  * determine how much data is successfully transferred, and
@@ -13831,7 +14132,7 @@ virStorageVolDownload(virStorageVolPtr vol,
  * @stream: stream to use as input
  * @offset: position to start writing to
  * @length: limit on amount of data to upload
- * @flags: extra flags; not used yet, so callers should always pass 0
+ * @flags: bitwise-OR of virStorageVolUploadFlags
  *
  * Upload new content to the volume from a stream. This call
  * will fail if @offset + @length exceeds the size of the
@@ -13839,6 +14140,10 @@ virStorageVolDownload(virStorageVolPtr vol,
  * will be raised if an attempt is made to upload greater
  * than @length bytes of data.
  *
+ * With VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, the sender can
+ * skip holes with virStreamSendHole, or virStreamSparseSendAll,
+ * which are then deallocated from the volume where possible.
+ *
  * This call sets up an asynchronous stream; subsequent use of
  * stream APIs is necessary to transfer the actual data,
  * determine how much data is successfully transferred, and
@@ -13933,10 +14238,13 @@ virStorageVolDelete(virStorageVolPtr vol,
 /**
  * virStorageVolWipe:
  * @vol: pointer to storage volume
- * @flags: extra flags; not used yet, so callers should always pass 0
+ * @flags: bitwise-OR of virStorageVolWipeFlags
  *
  * Ensure data previously on a volume is not accessible to future reads
  *
+ * If @flags contains VIR_STORAGE_VOL_WIPE_ASYNC, the function returns
+ * once the wipe was started; see virStorageVolGetJobInfo().
+ *
  * Returns 0 on success, or -1 on error
  */
 int
@@ -13974,7 +14282,7 @@ virStorageVolWipe(virStorageVolPtr vol,
  * virStorageVolWipePattern:
  * @vol: pointer to storage volume
  * @algorithm: one of virStorageVolWipeAlgorithm
- * @flags: future flags, use 0 for now
+ * @flags: bitwise-OR of virStorageVolWipeFlags
  *
  * Similar to virStorageVolWipe, but one can choose
  * between different wiping algorithms.
@@ -14220,6 +14528,9 @@ virStorageVolGetPath(virStorageVolPtr vol)
  * the absolute new size regardless of whether it is larger or smaller
  * than the current size.
  *
+ * If @flags contains VIR_STORAGE_VOL_RESIZE_ASYNC, the function returns
+ * once the resize was started; see virStorageVolGetJobInfo().
+ *
  * Returns 0 on success, or -1 on error.
  */
 int
@@ -14263,6 +14574,98 @@ virStorageVolResize(virStorageVolPtr vol,
 }
 
 
+/**
+ * virStorageVolGetJobInfo:
+ * @vol: pointer to storage volume
+ * @info: pointer at which to store the job information
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Fetches information about the last job run on @vol, that is the
+ * wipe, clone or resize started on it with virStorageVolWipePattern(),
+ * virStorageVolCreateXMLFrom() or virStorageVolResize(). The job may
+ * still be queued or running, or it may have finished already, in
+ * which case @info->state tells how it ended.
+ *
+ * Storage pools run a limited number of jobs at a time; jobs started
+ * while that limit is reached are queued.
+ *
+ * Returns 0 on success, or -1 on failure
+ */
+int
+virStorageVolGetJobInfo(virStorageVolPtr vol,
+                        virStorageVolJobInfoPtr info,
+                        unsigned int flags)
+{
+    virConnectPtr conn;
+    VIR_DEBUG("vol=%p, info=%p, flags=%x", vol, info, flags);
+
+    virResetLastError();
+
+    if (info)
+        memset(info, 0, sizeof(*info));
+
+    virCheckStorageVolReturn(vol, -1);
+    virCheckNonNullArgGoto(info, error);
+
+    conn = vol->conn;
+
+    if (conn->storageDriver && conn->storageDriver->storageVolGetJobInfo) {
+        int ret;
+        ret = conn->storageDriver->storageVolGetJobInfo(vol, info, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(vol->conn);
+    return -1;
+}
+
+
+/**
+ * virStorageVolAbortJob:
+ * @vol: pointer to storage volume
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Requests cancellation of the job running on @vol. The job stops at
+ * the next point it can do so safely; use virStorageVolGetJobInfo()
+ * to find out when it did.
+ *
+ * Returns 0 on success, or -1 on error (e.g. if no job is running)
+ */
+int
+virStorageVolAbortJob(virStorageVolPtr vol,
+                      unsigned int flags)
+{
+    virConnectPtr conn;
+    VIR_DEBUG("vol=%p, flags=%x", vol, flags);
+
+    virResetLastError();
+
+    virCheckStorageVolReturn(vol, -1);
+    conn = vol->conn;
+
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->storageDriver && conn->storageDriver->storageVolAbortJob) {
+        int ret;
+        ret = conn->storageDriver->storageVolAbortJob(vol, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(vol->conn);
+    return -1;
+}
+
+
 /**
  * virNodeNumOfDevices:
  * @conn: pointer to the hypervisor connection
@@ -15993,6 +16396,159 @@ virStreamRecv(virStreamPtr stream,
 }
 
 
+/**
+ * virStreamRecvFlags:
+ * @stream: pointer to the stream object
+ * @data: buffer to read into from stream
+ * @nbytes: size of @data buffer
+ * @flags: bitwise-OR of virStreamRecvFlagsValues
+ *
+ * Reads a series of bytes from the stream, like virStreamRecv.
+ *
+ * Holes in a sparse stream are read back as zeros, unless
+ * @flags has VIR_STREAM_RECV_STOP_AT_HOLE, in which case the
+ * data up to the hole is returned and, once at the hole, -3
+ * tells the caller to skip it with virStreamRecvHole.
+ *
+ * Returns the number of bytes read, which may be less
+ * than requested, 0 at the end of the stream, -1 upon
+ * error, -2 if there is no data pending to be read & the
+ * stream is marked as non-blocking, or -3 at a hole.
+ */
+int
+virStreamRecvFlags(virStreamPtr stream,
+                   char *data,
+                   size_t nbytes,
+                   unsigned int flags)
+{
+    VIR_DEBUG("stream=%p, data=%p, nbytes=%zi, flags=%x",
+              stream, data, nbytes, flags);
+
+    virResetLastError();
+
+    virCheckStreamReturn(stream, -1);
+    virCheckNonNullArgGoto(data, error);
+
+    if (stream->driver &&
+        stream->driver->streamRecvFlags) {
+        int ret;
+        ret = (stream->driver->streamRecvFlags)(stream, data, nbytes, flags);
+        if (ret == -2 || ret == -3)
+            return ret;
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    /* Without holes to stop at, this is a plain read */
+    if (stream->driver &&
+        stream->driver->streamRecv &&
+        !(flags & ~VIR_STREAM_RECV_STOP_AT_HOLE)) {
+        int ret;
+        ret = (stream->driver->streamRecv)(stream, data, nbytes);
+        if (ret == -2)
+            return -2;
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(stream->conn);
+    return -1;
+}
+
+
+/**
+ * virStreamSendHole:
+ * @stream: pointer to the stream object
+ * @length: number of bytes of the hole
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Skips @length bytes of a sparse stream, which the receiver
+ * reads back as zeros without them being sent. Sparse streams
+ * are requested from the API that opens the stream, as with
+ * VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, and any data sent so
+ * far must have been fully sent.
+ *
+ * Returns 0 on success, -1 upon error, at which time the
+ * stream will be marked as aborted, or -2 if the outgoing
+ * transmit buffers are full & the stream is marked as
+ * non-blocking.
+ */
+int
+virStreamSendHole(virStreamPtr stream,
+                  long long length,
+                  unsigned int flags)
+{
+    VIR_DEBUG("stream=%p, length=%lld, flags=%x", stream, length, flags);
+
+    virResetLastError();
+
+    virCheckStreamReturn(stream, -1);
+    virCheckPositiveArgGoto(length, error);
+
+    if (stream->driver &&
+        stream->driver->streamSendHole) {
+        int ret;
+        ret = (stream->driver->streamSendHole)(stream, length, flags);
+        if (ret == -2)
+            return -2;
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(stream->conn);
+    return -1;
+}
+
+
+/**
+ * virStreamRecvHole:
+ * @stream: pointer to the stream object
+ * @length: where to store the number of bytes of the hole
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Skips the hole a sparse stream is at, after
+ * virStreamRecvFlags returned -3, setting @length to how
+ * many bytes the receiver should read back as zeros. If
+ * the stream is not at a hole, @length is set to 0.
+ *
+ * Returns 0 on success, or -1 upon error
+ */
+int
+virStreamRecvHole(virStreamPtr stream,
+                  long long *length,
+                  unsigned int flags)
+{
+    VIR_DEBUG("stream=%p, length=%p, flags=%x", stream, length, flags);
+
+    virResetLastError();
+
+    virCheckStreamReturn(stream, -1);
+    virCheckNonNullArgGoto(length, error);
+
+    if (stream->driver &&
+        stream->driver->streamRecvHole) {
+        if ((stream->driver->streamRecvHole)(stream, length, flags) < 0)
+            goto error;
+        return 0;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(stream->conn);
+    return -1;
+}
+
+
 /**
  * virStreamSendAll:
  * @stream: pointer to the stream object
@@ -16180,6 +16736,193 @@ virStreamRecvAll(virStreamPtr stream,
 }
 
 
+/**
+ * virStreamSparseSendAll:
+ * @stream: pointer to the stream object
+ * @handler: source callback for reading data from application
+ * @holeHandler: source callback for finding holes
+ * @skipHandler: source callback for skipping holes
+ * @opaque: application defined data
+ *
+ * Like virStreamSendAll, but the holes @holeHandler finds in
+ * the source are sent with virStreamSendHole rather than read,
+ * and then skipped with @skipHandler.
+ *
+ * Returns 0 if all the data was successfully sent. The caller
+ * should invoke virStreamFinish(st) to flush the stream upon
+ * success and then virStreamFree
+ *
+ * Returns -1 upon any error, with virStreamAbort() already
+ * having been called,  so the caller need only call
+ * virStreamFree()
+ */
+int
+virStreamSparseSendAll(virStreamPtr stream,
+                       virStreamSourceFunc handler,
+                       virStreamSourceHoleFunc holeHandler,
+                       virStreamSourceSkipFunc skipHandler,
+                       void *opaque)
+{
+    char *bytes = NULL;
+    const int bufLen = 1024*64;
+    int ret = -1;
+    VIR_DEBUG("stream=%p, handler=%p, holeHandler=%p, skipHandler=%p, "
+              "opaque=%p", stream, handler, holeHandler, skipHandler, opaque);
+
+    virResetLastError();
+
+    virCheckStreamReturn(stream, -1);
+    virCheckNonNullArgGoto(handler, cleanup);
+    virCheckNonNullArgGoto(holeHandler, cleanup);
+    virCheckNonNullArgGoto(skipHandler, cleanup);
+
+    if (stream->flags & VIR_STREAM_NONBLOCK) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("data sources cannot be used for non-blocking streams"));
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(bytes, bufLen) < 0)
+        goto cleanup;
+
+    for (;;) {
+        int inData, got, offset = 0, want = bufLen;
+        long long sectionLen;
+
+        if ((holeHandler)(stream, &inData, &sectionLen, opaque) < 0) {
+            virStreamAbort(stream);
+            goto cleanup;
+        }
+
+        if (!inData) {
+            if (sectionLen == 0)
+                break;
+            if (virStreamSendHole(stream, sectionLen, 0) < 0)
+                goto cleanup;
+            if ((skipHandler)(stream, sectionLen, opaque) < 0) {
+                virStreamAbort(stream);
+                goto cleanup;
+            }
+            continue;
+        }
+
+        /* Don't read into the hole that follows */
+        if (sectionLen > 0 && sectionLen < want)
+            want = sectionLen;
+
+        got = (handler)(stream, bytes, want, opaque);
+        if (got < 0) {
+            virStreamAbort(stream);
+            goto cleanup;
+        }
+        if (got == 0)
+            break;
+        while (offset < got) {
+            int done;
+            done = virStreamSend(stream, bytes + offset, got - offset);
+            if (done < 0)
+                goto cleanup;
+            offset += done;
+        }
+    }
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(bytes);
+
+    if (ret != 0)
+        virDispatchError(stream->conn);
+
+    return ret;
+}
+
+
+/**
+ * virStreamSparseRecvAll:
+ * @stream: pointer to the stream object
+ * @handler: sink callback for writing data to application
+ * @holeHandler: sink callback for skipping holes
+ * @opaque: application defined data
+ *
+ * Like virStreamRecvAll, but the holes received are handed
+ * to @holeHandler rather than read back as zeros.
+ *
+ * Returns 0 if all the data was successfully received. The caller
+ * should invoke virStreamFinish(st) to flush the stream upon
+ * success and then virStreamFree
+ *
+ * Returns -1 upon any error, with virStreamAbort() already
+ * having been called,  so the caller need only call
+ * virStreamFree()
+ */
+int
+virStreamSparseRecvAll(virStreamPtr stream,
+                       virStreamSinkFunc handler,
+                       virStreamSinkHoleFunc holeHandler,
+                       void *opaque)
+{
+    char *bytes = NULL;
+    int want = 1024*64;
+    int ret = -1;
+    VIR_DEBUG("stream=%p, handler=%p, holeHandler=%p, opaque=%p",
+              stream, handler, holeHandler, opaque);
+
+    virResetLastError();
+
+    virCheckStreamReturn(stream, -1);
+    virCheckNonNullArgGoto(handler, cleanup);
+    virCheckNonNullArgGoto(holeHandler, cleanup);
+
+    if (stream->flags & VIR_STREAM_NONBLOCK) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("data sinks cannot be used for non-blocking streams"));
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(bytes, want) < 0)
+        goto cleanup;
+
+    for (;;) {
+        int got, offset = 0;
+        got = virStreamRecvFlags(stream, bytes, want,
+                                 VIR_STREAM_RECV_STOP_AT_HOLE);
+        if (got == -3) {
+            long long holeLen;
+
+            if (virStreamRecvHole(stream, &holeLen, 0) < 0)
+                goto cleanup;
+            if (holeLen && (holeHandler)(stream, holeLen, opaque) < 0) {
+                virStreamAbort(stream);
+                goto cleanup;
+            }
+            continue;
+        }
+        if (got < 0)
+            goto cleanup;
+        if (got == 0)
+            break;
+        while (offset < got) {
+            int done;
+            done = (handler)(stream, bytes + offset, got - offset, opaque);
+            if (done < 0) {
+                virStreamAbort(stream);
+                goto cleanup;
+            }
+            offset += done;
+        }
+    }
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(bytes);
+
+    if (ret != 0)
+        virDispatchError(stream->conn);
+
+    return ret;
+}
+
+
 /**
  * virStreamEventAddCallback:
  * @stream: pointer to the stream object
@@ -20048,6 +20791,54 @@ virConnectIsAlive(virConnectPtr conn)
 }
 
 
+/**
+ * virConnectGetStartupProgress:
+ * @conn: pointer to the connection object
+ * @completed: optional pointer to the number of finished steps (OUT)
+ * @total: optional pointer to the total number of steps (OUT)
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Determine whether the hypervisor driver has finished restoring its
+ * state after the daemon was started, for example reconnecting to all
+ * domains which kept running while the daemon was down. Until that is
+ * done, operations on the affected domains may block or fail.
+ *
+ * @completed and @total, if not NULL, are filled with the number of
+ * steps (e.g. domains) processed so far and the number of steps to be
+ * done in total, which can be used to report progress.
+ *
+ * Returns 1 if the driver is ready, 0 if it is still starting up,
+ * -1 on error
+ */
+int
+virConnectGetStartupProgress(virConnectPtr conn,
+                             unsigned int *completed,
+                             unsigned int *total,
+                             unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, completed=%p, total=%p, flags=%x",
+              conn, completed, total, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+
+    if (conn->driver->connectGetStartupProgress) {
+        int ret = conn->driver->connectGetStartupProgress(conn, completed,
+                                                          total, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virConnectRegisterCloseCallback:
  * @conn: pointer to connection object
@@ -120,6 +120,12 @@ enum {
      * Support for server-side event filtering via callback ids in events.
      */
     VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK = 14,
+
+    /*
+     * Support for stream data sent raw, outside of the RPC messages,
+     * over plain sockets. Asking for it enables it for the connection.
+     */
+    VIR_DRV_FEATURE_REMOTE_STREAM_RAW = 15,
 };
 
 
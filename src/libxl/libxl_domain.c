@@ -882,6 +882,7 @@ libxlDomainCleanup(libxlDriverPrivatePtr driver,
             VIR_DEBUG("Failed to remove domain XML for %s", vm->def->name);
         VIR_FREE(file);
     }
+    VIR_FREE(vm->statusXML);
 
     if (vm->newDef) {
         virDomainDefFree(vm->def);
@@ -5666,6 +5666,391 @@ lxcDomainGetCPUStats(virDomainPtr dom,
 }
 
 
+typedef int
+(*lxcDomainGetStatsFunc)(virDomainObjPtr dom,
+                         virDomainStatsRecordPtr record,
+                         int *maxparams);
+
+struct lxcDomainGetStatsWorker {
+    lxcDomainGetStatsFunc func;
+    unsigned int stats;
+};
+
+
+#define LXC_ADD_COUNT_PARAM(record, maxparams, type, count)              \
+    do {                                                                 \
+        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];                   \
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.count", type); \
+        if (virTypedParamsAddUInt(&(record)->params,                     \
+                                  &(record)->nparams,                    \
+                                  maxparams,                             \
+                                  param_name,                            \
+                                  count) < 0)                            \
+            return -1;                                                   \
+    } while (0)
+
+#define LXC_ADD_NAME_PARAM(record, maxparams, type, num, name)           \
+    do {                                                                 \
+        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];                   \
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,               \
+                 "%s.%zu.name", type, num);                              \
+        if (virTypedParamsAddString(&(record)->params,                   \
+                                    &(record)->nparams,                  \
+                                    maxparams,                           \
+                                    param_name,                          \
+                                    name) < 0)                           \
+            return -1;                                                   \
+    } while (0)
+
+#define LXC_ADD_NUM_PARAM(record, maxparams, type, num, name, value)     \
+    do {                                                                 \
+        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];                   \
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,               \
+                 "%s.%zu.%s", type, num, name);                          \
+        if (value >= 0 &&                                                \
+            virTypedParamsAddULLong(&(record)->params,                   \
+                                    &(record)->nparams,                  \
+                                    maxparams,                           \
+                                    param_name,                          \
+                                    value) < 0)                          \
+            return -1;                                                   \
+    } while (0)
+
+
+static int
+lxcDomainGetStatsState(virDomainObjPtr dom,
+                       virDomainStatsRecordPtr record,
+                       int *maxparams)
+{
+    if (virTypedParamsAddInt(&record->params,
+                             &record->nparams,
+                             maxparams,
+                             "state.state",
+                             dom->state.state) < 0 ||
+        virTypedParamsAddInt(&record->params,
+                             &record->nparams,
+                             maxparams,
+                             "state.reason",
+                             dom->state.reason) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+lxcDomainGetStatsCpu(virDomainObjPtr dom,
+                     virDomainStatsRecordPtr record,
+                     int *maxparams)
+{
+    virLXCDomainObjPrivatePtr priv = dom->privateData;
+    unsigned long long cpu_time;
+    unsigned long long user_time;
+    unsigned long long sys_time;
+
+    if (!virDomainObjIsActive(dom) ||
+        !virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUACCT))
+        return 0;
+
+    if (virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time) < 0 ||
+        virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time) < 0) {
+        virResetLastError();
+        return 0;
+    }
+
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "cpu.time",
+                                cpu_time) < 0 ||
+        virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "cpu.user",
+                                user_time) < 0 ||
+        virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "cpu.system",
+                                sys_time) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+lxcDomainGetStatsBalloon(virDomainObjPtr dom,
+                         virDomainStatsRecordPtr record,
+                         int *maxparams)
+{
+    virLXCDomainObjPrivatePtr priv = dom->privateData;
+    unsigned long long cur_balloon = dom->def->mem.cur_balloon;
+
+    if (virDomainObjIsActive(dom)) {
+        unsigned long usage;
+
+        if (virCgroupGetMemoryUsage(priv->cgroup, &usage) < 0)
+            virResetLastError();
+        else
+            cur_balloon = usage;
+    }
+
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "balloon.current",
+                                cur_balloon) < 0 ||
+        virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "balloon.maximum",
+                                dom->def->mem.max_balloon) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+lxcDomainGetStatsVcpu(virDomainObjPtr dom,
+                      virDomainStatsRecordPtr record,
+                      int *maxparams)
+{
+    if (virTypedParamsAddUInt(&record->params,
+                              &record->nparams,
+                              maxparams,
+                              "vcpu.current",
+                              (unsigned) dom->def->vcpus) < 0 ||
+        virTypedParamsAddUInt(&record->params,
+                              &record->nparams,
+                              maxparams,
+                              "vcpu.maximum",
+                              (unsigned) dom->def->maxvcpus) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+lxcDomainGetStatsInterface(virDomainObjPtr dom,
+                           virDomainStatsRecordPtr record,
+                           int *maxparams)
+{
+    size_t i;
+    struct _virDomainInterfaceStats tmp;
+
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    LXC_ADD_COUNT_PARAM(record, maxparams, "net", dom->def->nnets);
+
+    for (i = 0; i < dom->def->nnets; i++) {
+        virDomainNetDefPtr net = dom->def->nets[i];
+
+        if (!net->ifname)
+            continue;
+
+        LXC_ADD_NAME_PARAM(record, maxparams, "net", i, net->ifname);
+
+#ifdef __linux__
+        memset(&tmp, 0, sizeof(tmp));
+        if (linuxDomainInterfaceStats(net->ifname, &tmp) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        LXC_ADD_NUM_PARAM(record, maxparams, "net", i, "rx.bytes", tmp.rx_bytes);
+        LXC_ADD_NUM_PARAM(record, maxparams, "net", i, "rx.pkts", tmp.rx_packets);
+        LXC_ADD_NUM_PARAM(record, maxparams, "net", i, "rx.errs", tmp.rx_errs);
+        LXC_ADD_NUM_PARAM(record, maxparams, "net", i, "rx.drop", tmp.rx_drop);
+        LXC_ADD_NUM_PARAM(record, maxparams, "net", i, "tx.bytes", tmp.tx_bytes);
+        LXC_ADD_NUM_PARAM(record, maxparams, "net", i, "tx.pkts", tmp.tx_packets);
+        LXC_ADD_NUM_PARAM(record, maxparams, "net", i, "tx.errs", tmp.tx_errs);
+        LXC_ADD_NUM_PARAM(record, maxparams, "net", i, "tx.drop", tmp.tx_drop);
+#else
+        (void) tmp;
+#endif
+    }
+
+    return 0;
+}
+
+
+static int
+lxcDomainGetStatsBlock(virDomainObjPtr dom,
+                       virDomainStatsRecordPtr record,
+                       int *maxparams)
+{
+    virLXCDomainObjPrivatePtr priv = dom->privateData;
+    size_t i;
+
+    if (!virDomainObjIsActive(dom) ||
+        !virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_BLKIO))
+        return 0;
+
+    LXC_ADD_COUNT_PARAM(record, maxparams, "block", dom->def->ndisks);
+
+    for (i = 0; i < dom->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = dom->def->disks[i];
+        long long rd_req, rd_bytes, wr_req, wr_bytes;
+
+        LXC_ADD_NAME_PARAM(record, maxparams, "block", i, disk->dst);
+
+        if (!disk->info.alias)
+            continue;
+
+        if (virCgroupGetBlkioIoDeviceServiced(priv->cgroup,
+                                              disk->info.alias,
+                                              &rd_bytes, &wr_bytes,
+                                              &rd_req, &wr_req) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        LXC_ADD_NUM_PARAM(record, maxparams, "block", i, "rd.reqs", rd_req);
+        LXC_ADD_NUM_PARAM(record, maxparams, "block", i, "rd.bytes", rd_bytes);
+        LXC_ADD_NUM_PARAM(record, maxparams, "block", i, "wr.reqs", wr_req);
+        LXC_ADD_NUM_PARAM(record, maxparams, "block", i, "wr.bytes", wr_bytes);
+    }
+
+    return 0;
+}
+
+#undef LXC_ADD_NUM_PARAM
+#undef LXC_ADD_NAME_PARAM
+#undef LXC_ADD_COUNT_PARAM
+
+static struct lxcDomainGetStatsWorker lxcDomainGetStatsWorkers[] = {
+    { lxcDomainGetStatsState, VIR_DOMAIN_STATS_STATE },
+    { lxcDomainGetStatsCpu, VIR_DOMAIN_STATS_CPU_TOTAL },
+    { lxcDomainGetStatsBalloon, VIR_DOMAIN_STATS_BALLOON },
+    { lxcDomainGetStatsVcpu, VIR_DOMAIN_STATS_VCPU },
+    { lxcDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE },
+    { lxcDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK },
+    { NULL, 0 }
+};
+
+
+static int
+lxcConnectGetAllDomainStats(virConnectPtr conn,
+                            virDomainPtr *doms,
+                            unsigned int ndoms,
+                            unsigned int stats,
+                            virDomainStatsRecordPtr **retStats,
+                            unsigned int flags)
+{
+    virLXCDriverPtr driver = conn->privateData;
+    virDomainPtr *domlist = NULL;
+    int ndomlist = 0;
+    virDomainStatsRecordPtr *tmpstats = NULL;
+    virDomainStatsRecordPtr tmp = NULL;
+    unsigned int supportedstats = 0;
+    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
+    size_t nstats = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
+
+    if (virConnectGetAllDomainStatsEnsureACL(conn) < 0)
+        return -1;
+
+    for (i = 0; lxcDomainGetStatsWorkers[i].func; i++)
+        supportedstats |= lxcDomainGetStatsWorkers[i].stats;
+
+    if (!stats) {
+        stats = supportedstats;
+    } else if ((flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS) &&
+               (stats & ~supportedstats)) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                       _("Stats types bits 0x%x are not supported by this daemon"),
+                       stats & ~supportedstats);
+        return -1;
+    }
+
+    if (ndoms) {
+        if (lflags) {
+            virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                           _("filtering flags are not supported together "
+                             "with an explicit list of domains"));
+            return -1;
+        }
+
+        if (VIR_ALLOC_N(domlist, ndoms + 1) < 0)
+            return -1;
+
+        for (i = 0; i < ndoms; i++)
+            domlist[i] = virObjectRef(doms[i]);
+        ndomlist = ndoms;
+    } else {
+        if ((ndomlist = virDomainObjListExport(driver->domains, conn, &domlist,
+                                               virConnectGetAllDomainStatsCheckACL,
+                                               lflags)) < 0)
+            return -1;
+    }
+
+    if (VIR_ALLOC_N(tmpstats, ndomlist + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndomlist; i++) {
+        virDomainObjPtr dom;
+        int maxparams = 0;
+
+        /* The domain may have vanished since the list was made */
+        if (!(dom = virDomainObjListFindByUUID(driver->domains,
+                                               domlist[i]->uuid)))
+            continue;
+
+        if (ndoms && !virConnectGetAllDomainStatsCheckACL(conn, dom->def)) {
+            virObjectUnlock(dom);
+            continue;
+        }
+
+        if (VIR_ALLOC(tmp) < 0) {
+            virObjectUnlock(dom);
+            goto cleanup;
+        }
+
+        for (j = 0; lxcDomainGetStatsWorkers[j].func; j++) {
+            if (stats & lxcDomainGetStatsWorkers[j].stats &&
+                lxcDomainGetStatsWorkers[j].func(dom, tmp, &maxparams) < 0) {
+                virObjectUnlock(dom);
+                goto cleanup;
+            }
+        }
+        virObjectUnlock(dom);
+
+        tmp->dom = virObjectRef(domlist[i]);
+        tmpstats[nstats++] = tmp;
+        tmp = NULL;
+    }
+
+    *retStats = tmpstats;
+    tmpstats = NULL;
+    ret = nstats;
+
+ cleanup:
+    if (tmp) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        VIR_FREE(tmp);
+    }
+    virDomainStatsRecordListFree(tmpstats);
+    if (domlist) {
+        for (i = 0; i < ndomlist; i++)
+            virObjectUnref(domlist[i]);
+        VIR_FREE(domlist);
+    }
+    return ret;
+}
+
 /* Function Tables */
 static virDriver lxcDriver = {
     .no = VIR_DRV_LXC,
@@ -5755,6 +6140,7 @@ static virDriver lxcDriver = {
     .domainShutdownFlags = lxcDomainShutdownFlags, /* 1.0.1 */
     .domainReboot = lxcDomainReboot, /* 1.0.1 */
     .domainLxcOpenNamespace = lxcDomainLxcOpenNamespace, /* 1.0.2 */
+    .connectGetAllDomainStats = lxcConnectGetAllDomainStats, /* 1.2.4 */
 };
 
 static virStateDriver lxcStateDriver = {
@@ -58,13 +58,13 @@ parallelsStoragePoolGetAlloc(virStoragePoolDefPtr def);
 static void
 parallelsStorageLock(virStorageDriverStatePtr driver)
 {
-    virMutexLock(&driver->lock);
+    virRWLockWrite(&driver->lock);
 }
 
 static void
 parallelsStorageUnlock(virStorageDriverStatePtr driver)
 {
-    virMutexUnlock(&driver->lock);
+    virRWLockUnlock(&driver->lock);
 }
 
 static int
@@ -80,7 +80,7 @@ parallelsStorageClose(virConnectPtr conn)
     VIR_FREE(storageState->configDir);
     VIR_FREE(storageState->autostartDir);
     parallelsStorageUnlock(storageState);
-    virMutexDestroy(&storageState->lock);
+    virRWLockDestroy(&storageState->lock);
     VIR_FREE(storageState);
 
     return 0;
@@ -465,7 +465,7 @@ parallelsStorageOpen(virConnectPtr conn,
     if (VIR_ALLOC(storageState) < 0)
         return VIR_DRV_OPEN_ERROR;
 
-    if (virMutexInit(&storageState->lock) < 0) {
+    if (virRWLockInit(&storageState->lock) < 0) {
         VIR_FREE(storageState);
         return VIR_DRV_OPEN_ERROR;
     }
@@ -39,6 +39,9 @@
 #include "virnodesuspend.h"
 #include "qemu_monitor.h"
 #include "virstring.h"
+#include "viratomic.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -271,6 +274,7 @@ struct _virQEMUCaps {
 
     char *binary;
     time_t ctime;
+    time_t mtime;
 
     virBitmapPtr flags;
 
@@ -918,6 +922,184 @@ virQEMUCapsInitCPU(virCapsPtr caps,
 }
 
 
+/* Upper limit on QEMU binaries probed in parallel */
+#define QEMU_CAPS_PROBE_MAX_WORKERS 8
+
+struct virQEMUCapsProbeData {
+    virQEMUCapsCachePtr cache;
+    char **binaries;
+    size_t nbinaries;
+
+    virMutex lock;
+    size_t next;        /* Next binary to be probed */
+};
+
+
+static void
+virQEMUCapsProbeThread(void *opaque)
+{
+    struct virQEMUCapsProbeData *data = opaque;
+    virQEMUCapsCachePtr cache = data->cache;
+
+    while (true) {
+        const char *binary;
+        virQEMUCapsPtr qemuCaps;
+
+        virMutexLock(&data->lock);
+        if (data->next == data->nbinaries) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        binary = data->binaries[data->next++];
+        virMutexUnlock(&data->lock);
+
+        virMutexLock(&cache->lock);
+        qemuCaps = virHashLookup(cache->binaries, binary);
+        virMutexUnlock(&cache->lock);
+        if (qemuCaps)
+            continue;
+
+        /* The cache lock is not held while probing so that other
+         * binaries can be probed meanwhile. Failures are reported
+         * once more by the lookup done when adding the guest */
+        if (!(qemuCaps = virQEMUCapsNewForBinary(binary, cache->libDir,
+                                                 cache->cacheDir,
+                                                 cache->runUid,
+                                                 cache->runGid))) {
+            virResetLastError();
+            continue;
+        }
+
+        virMutexLock(&cache->lock);
+        if (virHashLookup(cache->binaries, binary) ||
+            virHashAddEntry(cache->binaries, binary, qemuCaps) < 0) {
+            virObjectUnref(qemuCaps);
+            virResetLastError();
+        }
+        virMutexUnlock(&cache->lock);
+    }
+}
+
+
+static int
+virQEMUCapsProbeAddBinary(char ***binaries,
+                          size_t *nbinaries,
+                          char *binary)
+{
+    size_t i;
+
+    if (!binary)
+        return 0;
+
+    for (i = 0; i < *nbinaries; i++) {
+        if (STREQ((*binaries)[i], binary)) {
+            VIR_FREE(binary);
+            return 0;
+        }
+    }
+
+    if (VIR_APPEND_ELEMENT(*binaries, *nbinaries, binary) < 0) {
+        VIR_FREE(binary);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virQEMUCapsCacheFill:
+ * @cache: capabilities cache
+ * @binaries: list of QEMU binaries
+ * @nbinaries: number of items in @binaries
+ *
+ * Make sure @cache holds capabilities of all @binaries. Binaries
+ * whose capabilities stored on disk are still valid are cheap to
+ * load, but each of the others means starting QEMU and talking to it
+ * over QMP, which takes long enough to be worth doing in parallel.
+ *
+ * Binaries which fail to be probed are skipped; the error is
+ * reported again when they are looked up.
+ */
+void
+virQEMUCapsCacheFill(virQEMUCapsCachePtr cache,
+                     char **binaries,
+                     size_t nbinaries)
+{
+    struct virQEMUCapsProbeData data;
+    size_t nworkers;
+    unsigned long long start = 0;
+    unsigned long long end = 0;
+
+    if (nbinaries == 0)
+        return;
+
+    memset(&data, 0, sizeof(data));
+    data.cache = cache;
+    data.binaries = binaries;
+    data.nbinaries = nbinaries;
+
+    ignore_value(virTimeMillisNow(&start));
+
+    if (virMutexInit(&data.lock) < 0)
+        goto cleanup;
+
+    nworkers = MIN(nbinaries, QEMU_CAPS_PROBE_MAX_WORKERS);
+    virThreadRunWorkers(nworkers, virQEMUCapsProbeThread, &data);
+
+    ignore_value(virTimeMillisNow(&end));
+    VIR_INFO("Capabilities of %zu QEMU binaries obtained in %llu ms "
+             "using up to %zu threads",
+             nbinaries, end - start, nworkers);
+
+    virMutexDestroy(&data.lock);
+ cleanup:
+    /* Whatever went wrong here, lookups will simply
+     * probe the binaries one by one */
+    virResetLastError();
+}
+
+
+/*
+ * Fill @cache with capabilities of all QEMU binaries
+ * that virQEMUCapsInitGuest is going to look at.
+ */
+static void
+virQEMUCapsProbeAll(virQEMUCapsCachePtr cache,
+                    virArch hostarch)
+{
+    const char *const kvmbins[] = { "/usr/libexec/qemu-kvm",
+                                    "qemu-kvm",
+                                    "kvm" };
+    char **binaries = NULL;
+    size_t nbinaries = 0;
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        if (virQEMUCapsProbeAddBinary(&binaries, &nbinaries,
+                                      virQEMUCapsFindBinaryForArch(hostarch,
+                                                                   i)) < 0)
+            goto cleanup;
+    }
+
+    if (virQEMUCapsIsValidForKVM(hostarch, hostarch)) {
+        for (i = 0; i < ARRAY_CARDINALITY(kvmbins); i++) {
+            if (virQEMUCapsProbeAddBinary(&binaries, &nbinaries,
+                                          virFindFileInPath(kvmbins[i])) < 0)
+                goto cleanup;
+        }
+    }
+
+    virQEMUCapsCacheFill(cache, binaries, nbinaries);
+
+ cleanup:
+    virResetLastError();
+    for (i = 0; i < nbinaries; i++)
+        VIR_FREE(binaries[i]);
+    VIR_FREE(binaries);
+}
+
+
 virCapsPtr virQEMUCapsInit(virQEMUCapsCachePtr cache)
 {
     virCapsPtr caps;
@@ -948,6 +1130,8 @@ virCapsPtr virQEMUCapsInit(virQEMUCapsCachePtr cache)
     virCapabilitiesAddHostMigrateTransport(caps,
                                            "tcp");
 
+    virQEMUCapsProbeAll(cache, hostarch);
+
     /* QEMU can support pretty much every arch that exists,
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
@@ -2379,7 +2563,9 @@ int virQEMUCapsProbeQMP(virQEMUCapsPtr qemuCaps,
  *
  * <qemuCaps>
  *   <qemuctime>234235253</qemuctime>
+ *   <qemumtime>234235253</qemumtime>
  *   <selfctime>234235253</selfctime>
+ *   <selfvers>1002006</selfvers>
  *   <usedQMP/>
  *   <flag name='foo'/>
  *   <flag name='bar'/>
@@ -2392,7 +2578,8 @@ int virQEMUCapsProbeQMP(virQEMUCapsPtr qemuCaps,
  */
 static int
 virQEMUCapsLoadCache(virQEMUCapsPtr qemuCaps, const char *filename,
-                     time_t *qemuctime, time_t *selfctime)
+                     time_t *qemuctime, time_t *qemumtime,
+                     time_t *selfctime, unsigned long *selfvers)
 {
     xmlDocPtr doc = NULL;
     int ret = -1;
@@ -2428,6 +2615,12 @@ virQEMUCapsLoadCache(virQEMUCapsPtr qemuCaps, const char *filename,
     }
     *qemuctime = (time_t)l;
 
+    /* Caches written by older daemons lack these, which makes
+     * them look outdated and causes a reprobe */
+    *qemumtime = 0;
+    if (virXPathLongLong("string(./qemumtime)", ctxt, &l) == 0)
+        *qemumtime = (time_t)l;
+
     if (virXPathLongLong("string(./selfctime)", ctxt, &l) < 0) {
         virReportError(VIR_ERR_XML_ERROR, "%s",
                        _("missing selfctime in QEMU capabilities XML"));
@@ -2435,6 +2628,10 @@ virQEMUCapsLoadCache(virQEMUCapsPtr qemuCaps, const char *filename,
     }
     *selfctime = (time_t)l;
 
+    *selfvers = 0;
+    if (virXPathLongLong("string(./selfvers)", ctxt, &l) == 0)
+        *selfvers = l;
+
     qemuCaps->usedQMP = virXPathBoolean("count(./usedQMP) > 0",
                                         ctxt) > 0;
 
@@ -2568,8 +2765,12 @@ virQEMUCapsSaveCache(virQEMUCapsPtr qemuCaps, const char *filename)
 
     virBufferAsprintf(&buf, "<qemuctime>%llu</qemuctime>\n",
                       (long long)qemuCaps->ctime);
+    virBufferAsprintf(&buf, "<qemumtime>%llu</qemumtime>\n",
+                      (long long)qemuCaps->mtime);
     virBufferAsprintf(&buf, "<selfctime>%llu</selfctime>\n",
                       (long long)virGetSelfLastChanged());
+    virBufferAsprintf(&buf, "<selfvers>%lu</selfvers>\n",
+                      (unsigned long)LIBVIR_VERSION_NUMBER);
 
     if (qemuCaps->usedQMP)
         virBufferAddLit(&buf, "<usedQMP/>\n");
@@ -2705,7 +2906,9 @@ virQEMUCapsInitCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
     char *binaryhash = NULL;
     struct stat sb;
     time_t qemuctime;
+    time_t qemumtime;
     time_t selfctime;
+    unsigned long selfvers;
 
     if (virAsprintf(&capsdir, "%s/capabilities", cacheDir) < 0)
         goto cleanup;
@@ -2738,7 +2941,8 @@ virQEMUCapsInitCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
         goto cleanup;
     }
 
-    if (virQEMUCapsLoadCache(qemuCaps, capsfile, &qemuctime, &selfctime) < 0) {
+    if (virQEMUCapsLoadCache(qemuCaps, capsfile, &qemuctime, &qemumtime,
+                             &selfctime, &selfvers) < 0) {
         virErrorPtr err = virGetLastError();
         VIR_WARN("Failed to load cached caps from '%s' for '%s': %s",
                  capsfile, qemuCaps->binary, err ? NULLSTR(err->message) :
@@ -2749,14 +2953,19 @@ virQEMUCapsInitCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
         goto cleanup;
     }
 
-    /* Discard if cache is older that QEMU binary */
+    /* Discard if cache is older that QEMU binary, or was
+     * written by a different libvirt */
     if (qemuctime != qemuCaps->ctime ||
-        selfctime < virGetSelfLastChanged()) {
+        qemumtime != qemuCaps->mtime ||
+        selfctime < virGetSelfLastChanged() ||
+        selfvers != LIBVIR_VERSION_NUMBER) {
         VIR_DEBUG("Outdated cached capabilities '%s' for '%s' "
-                  "(%lld vs %lld, %lld vs %lld)",
+                  "(%lld vs %lld, %lld vs %lld, %lld vs %lld, %lu vs %lu)",
                   capsfile, qemuCaps->binary,
                   (long long)qemuctime, (long long)qemuCaps->ctime,
-                  (long long)selfctime, (long long)virGetSelfLastChanged());
+                  (long long)qemumtime, (long long)qemuCaps->mtime,
+                  (long long)selfctime, (long long)virGetSelfLastChanged(),
+                  selfvers, (unsigned long)LIBVIR_VERSION_NUMBER);
         ignore_value(unlink(capsfile));
         virQEMUCapsReset(qemuCaps);
         ret = 0;
@@ -3042,6 +3251,10 @@ virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
     return ret;
 }
 
+/* Binaries may be probed in parallel, so each probe gets its own
+ * monitor socket and pidfile */
+static int virQEMUCapsProbeSerial;
+
 static int
 virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
                    const char *libDir,
@@ -3049,6 +3262,7 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
                    gid_t runGid)
 {
     int ret = -1;
+    int serial = virAtomicIntInc(&virQEMUCapsProbeSerial);
     virCommandPtr cmd = NULL;
     qemuMonitorPtr mon = NULL;
     int status = 0;
@@ -3063,7 +3277,8 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
     /* the ".sock" sufix is important to avoid a possible clash with a qemu
      * domain called "capabilities"
      */
-    if (virAsprintf(&monpath, "%s/%s", libDir, "capabilities.monitor.sock") < 0)
+    if (virAsprintf(&monpath, "%s/capabilities.%d.monitor.sock",
+                    libDir, serial) < 0)
         goto cleanup;
     if (virAsprintf(&monarg, "unix:%s,server,nowait", monpath) < 0)
         goto cleanup;
@@ -3074,7 +3289,8 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
      * -daemonize we need QEMU to be allowed to create them, rather
      * than libvirtd. So we're using libDir which QEMU can write to
      */
-    if (virAsprintf(&pidfile, "%s/%s", libDir, "capabilities.pidfile") < 0)
+    if (virAsprintf(&pidfile, "%s/capabilities.%d.pidfile",
+                    libDir, serial) < 0)
         goto cleanup;
 
     memset(&config, 0, sizeof(config));
@@ -3235,6 +3451,7 @@ virQEMUCapsPtr virQEMUCapsNewForBinary(const char *binary,
         goto error;
     }
     qemuCaps->ctime = sb.st_ctime;
+    qemuCaps->mtime = sb.st_mtime;
 
     /* Make sure the binary we are about to try exec'ing exists.
      * Technically we could catch the exec() failure, but that's
@@ -3284,7 +3501,8 @@ bool virQEMUCapsIsValid(virQEMUCapsPtr qemuCaps)
     if (stat(qemuCaps->binary, &sb) < 0)
         return false;
 
-    return sb.st_ctime == qemuCaps->ctime;
+    return sb.st_ctime == qemuCaps->ctime &&
+        sb.st_mtime == qemuCaps->mtime;
 }
 
 
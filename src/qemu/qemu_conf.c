@@ -251,6 +251,8 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
     cfg->securityDefaultConfined = true;
     cfg->securityRequireConfined = false;
 
+    cfg->maxReconnectWorkers = 8;
+
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
     cfg->seccompSandbox = -1;
@@ -568,6 +570,13 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
     GET_VALUE_STR("lock_manager", cfg->lockManagerName);
 
     GET_VALUE_LONG("max_queued", cfg->maxQueuedJobs);
+    GET_VALUE_LONG("max_reconnect_workers", cfg->maxReconnectWorkers);
+    if (cfg->maxReconnectWorkers < 1) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("%s: max_reconnect_workers must be at least 1"),
+                       filename);
+        goto cleanup;
+    }
 
     GET_VALUE_LONG("keepalive_interval", cfg->keepAliveInterval);
     GET_VALUE_LONG("keepalive_count", cfg->keepAliveCount);
@@ -144,6 +144,8 @@ struct _virQEMUDriverConfig {
 
     int maxQueuedJobs;
 
+    unsigned int maxReconnectWorkers;
+
     char **securityDriverNames;
     bool securityDefaultConfined;
     bool securityRequireConfined;
@@ -186,6 +188,11 @@ struct _virQEMUDriver {
     /* Atomic inc/dec only */
     unsigned int nactive;
 
+    /* Atomic access only. Number of running domains found at
+     * startup and how many of them were reconnected so far */
+    int reconnectTotal;
+    int reconnectDone;
+
     /* Immutable pointers. Caller must provide locking */
     virStateInhibitCallback inhibitCallback;
     void *inhibitOpaque;
@@ -38,12 +38,17 @@
 #include "virtime.h"
 #include "virstoragefile.h"
 #include "virstring.h"
+#include "virprobe.h"
 
 #include <sys/time.h>
 #include <fcntl.h>
 
 #include <libxml/xpathInternals.h>
 
+#ifdef WITH_DTRACE_PROBES
+# include "libvirt_qemu_probes.h"
+#endif
+
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
 VIR_LOG_INIT("qemu.qemu_domain");
@@ -149,6 +154,7 @@ qemuDomainObjResetJob(qemuDomainObjPrivatePtr priv)
 
     job->active = QEMU_JOB_NONE;
     job->owner = 0;
+    job->started = 0;
 }
 
 static void
@@ -161,6 +167,7 @@ qemuDomainObjResetAsyncJob(qemuDomainObjPrivatePtr priv)
     job->phase = 0;
     job->mask = DEFAULT_JOB_MASK;
     job->start = 0;
+    job->asyncStarted = 0;
     job->dump_memory_only = false;
     job->asyncAbort = false;
     memset(&job->status, 0, sizeof(job->status));
@@ -229,6 +236,7 @@ qemuDomainObjPrivateAlloc(void)
         goto error;
 
     priv->migMaxBandwidth = QEMU_DOMAIN_MIG_BANDWIDTH_MAX;
+    priv->procStatFd = -1;
 
     return priv;
 
@@ -252,6 +260,7 @@ qemuDomainObjPrivateFree(void *data)
     VIR_FREE(priv->vcpupids);
     VIR_FREE(priv->lockState);
     VIR_FREE(priv->origname);
+    VIR_FORCE_CLOSE(priv->procStatFd);
 
     virCondDestroy(&priv->unplugFinished);
     virChrdevFree(priv->devs);
@@ -1036,6 +1045,37 @@ qemuDomainJobAllowed(qemuDomainObjPrivatePtr priv, enum qemuDomainJob job)
     return !priv->job.active && qemuDomainNestedJobAllowed(priv, job);
 }
 
+/*
+ * obj must be locked before calling
+ *
+ * Accounts the time the job which is just being released was held.
+ */
+static void
+qemuDomainObjJobReleased(virDomainObjPtr obj,
+                         enum qemuDomainJob job,
+                         enum qemuDomainAsyncJob asyncJob,
+                         unsigned long long started)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+    unsigned long long now;
+    unsigned long long hold;
+
+    if (!started || virTimeMillisNow(&now) < 0)
+        return;
+
+    hold = now - started;
+    if (job == QEMU_JOB_ASYNC)
+        virTimeHistogramAdd(&priv->asyncJobHold[asyncJob], hold);
+    else
+        virTimeHistogramAdd(&priv->jobHold[job], hold);
+
+    PROBE(QEMU_JOB_RELEASE,
+          "vm=%p job=%s asyncJob=%s hold=%llu",
+          obj, qemuDomainJobTypeToString(job),
+          qemuDomainAsyncJobTypeToString(asyncJob), hold);
+}
+
+
 /* Give up waiting for mutex after 30 seconds */
 #define QEMU_JOB_WAIT_TIME (1000ull * 30)
 
@@ -1051,6 +1091,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = obj->privateData;
     unsigned long long now;
     unsigned long long then;
+    unsigned long long acquired;
     bool nested = job == QEMU_JOB_ASYNC_NESTED;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
@@ -1096,6 +1137,15 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
 
     qemuDomainObjResetJob(priv);
 
+    if (virTimeMillisNow(&acquired) < 0)
+        acquired = now;
+    virTimeHistogramAdd(&priv->jobWait, acquired - now);
+    PROBE(QEMU_JOB_ACQUIRE,
+          "vm=%p job=%s asyncJob=%s wait=%llu queued=%d",
+          obj, qemuDomainJobTypeToString(job),
+          qemuDomainAsyncJobTypeToString(asyncJob),
+          acquired - now, priv->jobs_queued);
+
     if (job != QEMU_JOB_ASYNC) {
         VIR_DEBUG("Started job: %s (async=%s vm=%p name=%s)",
                    qemuDomainJobTypeToString(job),
@@ -1103,6 +1153,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
                   obj, obj->def->name);
         priv->job.active = job;
         priv->job.owner = virThreadSelfID();
+        priv->job.started = acquired;
     } else {
         VIR_DEBUG("Started async job: %s (vm=%p name=%s)",
                   qemuDomainAsyncJobTypeToString(asyncJob),
@@ -1111,6 +1162,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
         priv->job.asyncJob = asyncJob;
         priv->job.asyncOwner = virThreadSelfID();
         priv->job.start = now;
+        priv->job.asyncStarted = acquired;
     }
 
     if (qemuDomainTrackJob(job))
@@ -1216,6 +1268,14 @@ bool qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    /* Any job but a query may have changed the domain in any way.
+     * Queries which do update the definition bump the generation
+     * themselves, when something actually changed. */
+    if (job != QEMU_JOB_QUERY)
+        virDomainObjBumpGeneration(obj);
+
+    qemuDomainObjJobReleased(obj, job, QEMU_ASYNC_JOB_NONE,
+                             priv->job.started);
     qemuDomainObjResetJob(priv);
     if (qemuDomainTrackJob(job))
         qemuDomainObjSaveJob(driver, obj);
@@ -1235,6 +1295,10 @@ qemuDomainObjEndAsyncJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    virDomainObjBumpGeneration(obj);
+
+    qemuDomainObjJobReleased(obj, QEMU_JOB_ASYNC, priv->job.asyncJob,
+                             priv->job.asyncStarted);
     qemuDomainObjResetAsyncJob(priv);
     qemuDomainObjSaveJob(driver, obj);
     virCondBroadcast(&priv->job.asyncCond);
@@ -1316,6 +1380,9 @@ qemuDomainObjExitMonitorInternal(virQEMUDriverPtr driver,
         priv->mon = NULL;
 
     if (priv->job.active == QEMU_JOB_ASYNC_NESTED) {
+        virDomainObjBumpGeneration(obj);
+        qemuDomainObjJobReleased(obj, QEMU_JOB_ASYNC_NESTED,
+                                 priv->job.asyncJob, priv->job.started);
         qemuDomainObjResetJob(priv);
         qemuDomainObjSaveJob(driver, obj);
         virCondSignal(&priv->job.cond);
@@ -2234,6 +2301,68 @@ qemuDomainCheckDiskStartupPolicy(virQEMUDriverPtr driver,
     return -1;
 }
 
+#define QEMU_DOMAIN_DISK_CHAIN_MAX_WORKERS 8
+
+typedef struct _qemuDomainDiskChainData qemuDomainDiskChainData;
+struct _qemuDomainDiskChainData {
+    virMutex lock;
+    virQEMUDriverPtr driver;
+    virDomainObjPtr vm;
+    size_t next;
+};
+
+static void
+qemuDomainDiskChainThread(void *opaque)
+{
+    qemuDomainDiskChainData *data = opaque;
+    virDomainDiskDefPtr disk;
+
+    for (;;) {
+        virMutexLock(&data->lock);
+        if (data->next >= data->vm->def->ndisks) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        disk = data->vm->def->disks[data->next++];
+        virMutexUnlock(&data->lock);
+
+        /* Failures are reported again by the caller, which takes
+         * the startup policy of the disk into account */
+        if (qemuDomainDetermineDiskChain(data->driver, data->vm,
+                                         disk, false) < 0)
+            virResetLastError();
+    }
+}
+
+/*
+ * Probe the backing chains of all disks of @vm, in parallel when there
+ * are several of them, as probing each chain is bound by the latency
+ * of the storage holding the images.
+ */
+static void
+qemuDomainDetermineDiskChains(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm)
+{
+    qemuDomainDiskChainData data;
+
+    if (vm->def->ndisks < 2)
+        return;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virResetLastError();
+        return;
+    }
+    data.driver = driver;
+    data.vm = vm;
+    data.next = 0;
+
+    virThreadRunWorkers(MIN(vm->def->ndisks,
+                            QEMU_DOMAIN_DISK_CHAIN_MAX_WORKERS),
+                        qemuDomainDiskChainThread, &data);
+
+    virMutexDestroy(&data.lock);
+}
+
 int
 qemuDomainCheckDiskPresence(virQEMUDriverPtr driver,
                             virDomainObjPtr vm,
@@ -2244,6 +2373,8 @@ qemuDomainCheckDiskPresence(virQEMUDriverPtr driver,
     virDomainDiskDefPtr disk;
 
     VIR_DEBUG("Checking for disk presence");
+    qemuDomainDetermineDiskChains(driver, vm);
+
     for (i = vm->def->ndisks; i > 0; i--) {
         disk = vm->def->disks[i - 1];
 
@@ -33,6 +33,7 @@
 # include "qemu_conf.h"
 # include "qemu_capabilities.h"
 # include "virchrdev.h"
+# include "virtime.h"
 
 # define QEMU_EXPECTED_VIRT_TYPES      \
     ((1 << VIR_DOMAIN_VIRT_QEMU) |     \
@@ -110,6 +111,8 @@ struct qemuDomainJobObj {
     int phase;                          /* Job phase (mainly for migrations) */
     unsigned long long mask;            /* Jobs allowed during async job */
     unsigned long long start;           /* When the async job started */
+    unsigned long long started;         /* When the current job was acquired */
+    unsigned long long asyncStarted;    /* When the async job was acquired */
     bool dump_memory_only;              /* use dump-guest-memory to do dump */
     qemuMonitorMigrationStatus status;  /* Raw async job progress data */
     virDomainJobInfo info;              /* Processed async job progress data */
@@ -142,6 +145,7 @@ struct _qemuDomainObjPrivate {
     bool gotShutdown;
     bool beingDestroyed;
     char *pidfile;
+    int procStatFd; /* /proc/<pid>/stat of the emulator, kept open */
 
     int nvcpupids;
     int *vcpupids;
@@ -157,6 +161,11 @@ struct _qemuDomainObjPrivate {
 
     int jobs_queued;
 
+    /* Time spent waiting for the job condition and holding each job */
+    virTimeHistogram jobWait;
+    virTimeHistogram jobHold[QEMU_JOB_LAST];
+    virTimeHistogram asyncJobHold[QEMU_ASYNC_JOB_LAST];
+
     unsigned long migMaxBandwidth;
     char *origname;
     int nbdPort; /* Port used for migration with NBD */
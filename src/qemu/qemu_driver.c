@@ -95,6 +95,8 @@
 #include "viraccessapicheckqemu.h"
 #include "storage/storage_driver.h"
 #include "virhostdev.h"
+#include "viratomic.h"
+#include "vircompress.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -1252,42 +1254,18 @@ static char *qemuConnectGetCapabilities(virConnectPtr conn) {
 }
 
 
+/* Parse the contents of /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat */
 static int
-qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
-                   pid_t pid, int tid)
+qemuParseProcessStat(const char *stat,
+                     unsigned long long *cpuTime, int *lastCpu, long *vm_rss)
 {
-    char *proc;
-    FILE *pidinfo;
     unsigned long long usertime, systime;
     long rss;
     int cpu;
-    int ret;
-
-    /* In general, we cannot assume pid_t fits in int; but /proc parsing
-     * is specific to Linux where int works fine.  */
-    if (tid)
-        ret = virAsprintf(&proc, "/proc/%d/task/%d/stat", (int) pid, tid);
-    else
-        ret = virAsprintf(&proc, "/proc/%d/stat", (int) pid);
-    if (ret < 0)
-        return -1;
-
-    if (!(pidinfo = fopen(proc, "r"))) {
-        /* VM probably shut down, so fake 0 */
-        if (cpuTime)
-            *cpuTime = 0;
-        if (lastCpu)
-            *lastCpu = 0;
-        if (vm_rss)
-            *vm_rss = 0;
-        VIR_FREE(proc);
-        return 0;
-    }
-    VIR_FREE(proc);
 
     /* See 'man proc' for information about what all these fields are. We're
      * only interested in a very few of them */
-    if (fscanf(pidinfo,
+    if (sscanf(stat,
                /* pid -> stime */
                "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
                /* cutime -> endcode */
@@ -1295,7 +1273,6 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
                /* startstack -> processor */
                "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
                &usertime, &systime, &rss, &cpu) != 4) {
-        VIR_FORCE_FCLOSE(pidinfo);
         VIR_WARN("cannot parse process status data");
         errno = -EINVAL;
         return -1;
@@ -1319,12 +1296,94 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
         *vm_rss = rss * (sysconf(_SC_PAGESIZE) >> 10);
 
 
-    VIR_DEBUG("Got status for %d/%d user=%llu sys=%llu cpu=%d rss=%ld",
-              (int) pid, tid, usertime, systime, cpu, rss);
+    VIR_DEBUG("Got status user=%llu sys=%llu cpu=%d rss=%ld",
+              usertime, systime, cpu, rss);
+
+    return 0;
+}
+
+
+static void
+qemuFakeProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss)
+{
+    if (cpuTime)
+        *cpuTime = 0;
+    if (lastCpu)
+        *lastCpu = 0;
+    if (vm_rss)
+        *vm_rss = 0;
+}
+
+
+static int
+qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
+                   pid_t pid, int tid)
+{
+    char *proc;
+    FILE *pidinfo;
+    char buf[4096];
+    int ret;
 
+    /* In general, we cannot assume pid_t fits in int; but /proc parsing
+     * is specific to Linux where int works fine.  */
+    if (tid)
+        ret = virAsprintf(&proc, "/proc/%d/task/%d/stat", (int) pid, tid);
+    else
+        ret = virAsprintf(&proc, "/proc/%d/stat", (int) pid);
+    if (ret < 0)
+        return -1;
+
+    if (!(pidinfo = fopen(proc, "r"))) {
+        /* VM probably shut down, so fake 0 */
+        qemuFakeProcessInfo(cpuTime, lastCpu, vm_rss);
+        VIR_FREE(proc);
+        return 0;
+    }
+    VIR_FREE(proc);
+
+    if (!fgets(buf, sizeof(buf), pidinfo))
+        buf[0] = '\0';
     VIR_FORCE_FCLOSE(pidinfo);
 
-    return 0;
+    return qemuParseProcessStat(buf, cpuTime, lastCpu, vm_rss);
+}
+
+
+/*
+ * Like qemuGetProcessInfo() for the emulator process of @vm, but keep
+ * its /proc/<pid>/stat open so that polling costs a single pread().
+ * The file stays bound to the process it was opened for, a recycled
+ * pid can't be mistaken for it.
+ */
+static int
+qemuDomainGetProcessInfo(virDomainObjPtr vm,
+                         unsigned long long *cpuTime, int *lastCpu,
+                         long *vm_rss)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    char buf[4096];
+    ssize_t got = -1;
+    char *proc;
+
+    if (priv->procStatFd < 0) {
+        if (virAsprintf(&proc, "/proc/%d/stat", (int) vm->pid) < 0)
+            return -1;
+        priv->procStatFd = open(proc, O_RDONLY | O_CLOEXEC);
+        VIR_FREE(proc);
+    }
+
+    if (priv->procStatFd >= 0)
+        got = pread(priv->procStatFd, buf, sizeof(buf) - 1, 0);
+
+    if (got <= 0) {
+        /* VM probably shut down, so fake 0 */
+        VIR_FORCE_CLOSE(priv->procStatFd);
+        qemuFakeProcessInfo(cpuTime, lastCpu, vm_rss);
+        return 0;
+    }
+    buf[got] = '\0';
+
+    return qemuParseProcessStat(buf, cpuTime, lastCpu, vm_rss);
 }
 
 
@@ -2485,7 +2544,7 @@ static int qemuDomainGetInfo(virDomainPtr dom,
     if (!virDomainObjIsActive(vm)) {
         info->cpuTime = 0;
     } else {
-        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL, vm->pid, 0) < 0) {
+        if (qemuDomainGetProcessInfo(vm, &(info->cpuTime), NULL, NULL) < 0) {
             virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                            _("cannot read cputime for domain"));
             goto cleanup;
@@ -2502,7 +2561,10 @@ static int qemuDomainGetInfo(virDomainPtr dom,
             info->memory = vm->def->mem.max_balloon;
         } else if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BALLOON_EVENT)) {
             info->memory = vm->def->mem.cur_balloon;
-        } else if (qemuDomainJobAllowed(priv, QEMU_JOB_QUERY)) {
+        } else if (priv->job.active == QEMU_JOB_NONE &&
+                   qemuDomainJobAllowed(priv, QEMU_JOB_QUERY)) {
+            /* Don't wait for whoever holds the job, which may be stuck on
+             * the monitor; use the most recent data instead */
             if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
                 goto cleanup;
             if (!virDomainObjIsActive(vm))
@@ -2644,6 +2706,8 @@ typedef enum {
      */
     QEMU_SAVE_FORMAT_XZ = 3,
     QEMU_SAVE_FORMAT_LZOP = 4,
+    QEMU_SAVE_FORMAT_ZSTD = 5,
+    QEMU_SAVE_FORMAT_ZLIB = 6,
     /* Note: add new members only at the end.
        These values are used in the on-disk format.
        Do not change or re-use numbers. */
@@ -2657,7 +2721,15 @@ VIR_ENUM_IMPL(qemuSaveCompression, QEMU_SAVE_FORMAT_LAST,
               "gzip",
               "bzip2",
               "xz",
-              "lzop")
+              "lzop",
+              "zstd",
+              "zlib")
+
+/* QEMU_SAVE_FORMAT_ZLIB images are compressed by libvirtd itself, in
+ * frames of this size which are compressed and decompressed in up to
+ * QEMU_SAVE_WORKERS_MAX threads */
+#define QEMU_SAVE_FRAME_SIZE (1024 * 1024)
+#define QEMU_SAVE_WORKERS_MAX 16
 
 VIR_ENUM_DECL(qemuDumpFormat)
 VIR_ENUM_IMPL(qemuDumpFormat, VIR_DOMAIN_CORE_DUMP_FORMAT_LAST,
@@ -2674,7 +2746,11 @@ struct _virQEMUSaveHeader {
     uint32_t xml_len;
     uint32_t was_running;
     uint32_t compressed;
-    uint32_t unused[15];
+    /* For QEMU_SAVE_FORMAT_ZLIB, the frames follow the XML and are
+     * followed by their index, see vircompress.c */
+    uint32_t frame_size;
+    uint32_t frames;
+    uint32_t unused[13];
 };
 
 static inline void
@@ -2684,6 +2760,8 @@ bswap_header(virQEMUSaveHeaderPtr hdr)
     hdr->xml_len = bswap_32(hdr->xml_len);
     hdr->was_running = bswap_32(hdr->was_running);
     hdr->compressed = bswap_32(hdr->compressed);
+    hdr->frame_size = bswap_32(hdr->frame_size);
+    hdr->frames = bswap_32(hdr->frames);
 }
 
 
@@ -2717,10 +2795,26 @@ qemuDomainSaveHeader(int fd, const char *path, const char *xml,
 static const char *
 qemuCompressProgramName(int compress)
 {
-    return (compress == QEMU_SAVE_FORMAT_RAW ? NULL :
+    return (compress == QEMU_SAVE_FORMAT_RAW ||
+            compress == QEMU_SAVE_FORMAT_ZLIB ? NULL :
             qemuSaveCompressionTypeToString(compress));
 }
 
+/* Number of threads to compress or decompress a
+ * QEMU_SAVE_FORMAT_ZLIB image in */
+static size_t
+qemuCompressWorkers(void)
+{
+    int ncpus;
+
+    if ((ncpus = nodeGetCPUCount()) < 0) {
+        virResetLastError();
+        return 1;
+    }
+
+    return MIN(ncpus, QEMU_SAVE_WORKERS_MAX);
+}
+
 static virCommandPtr
 qemuCompressGetCommand(virQEMUSaveFormat compression)
 {
@@ -2907,9 +3001,14 @@ qemuDomainSaveMemory(virQEMUDriverPtr driver,
                      enum qemuDomainAsyncJob asyncJob)
 {
     virQEMUSaveHeader header;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virCompressJobPtr compressJob = NULL;
+    int pipeFD[2] = { -1, -1 };
+    size_t frames = 0;
     bool bypassSecurityDriver = false;
     bool needUnlink = false;
     int ret = -1;
+    int rc;
     int fd = -1;
     int directFlag = 0;
     virFileWrapperFdPtr wrapperFd = NULL;
@@ -2925,6 +3024,17 @@ qemuDomainSaveMemory(virQEMUDriverPtr driver,
     header.was_running = was_running ? 1 : 0;
 
     header.compressed = compressed;
+    if (compressed == QEMU_SAVE_FORMAT_ZLIB) {
+        /* The data has to come through a pipe for us to compress it */
+        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATE_QEMU_FD) ||
+            priv->monConfig->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("zlib save image format is not supported "
+                             "with this QEMU binary"));
+            goto cleanup;
+        }
+        header.frame_size = QEMU_SAVE_FRAME_SIZE;
+    }
 
     len = strlen(domXML) + 1;
     offset = sizeof(header) + len;
@@ -2970,11 +3080,41 @@ qemuDomainSaveMemory(virQEMUDriverPtr driver,
     if (qemuDomainSaveHeader(fd, path, xml, &header) < 0)
         goto cleanup;
 
+    if (compressed == QEMU_SAVE_FORMAT_ZLIB) {
+        if (pipe2(pipeFD, O_CLOEXEC) < 0) {
+            virReportSystemError(errno, "%s", _("unable to create pipe"));
+            goto cleanup;
+        }
+
+        if (!(compressJob = virCompressJobStart(&pipeFD[0], fd,
+                                                QEMU_SAVE_FRAME_SIZE,
+                                                qemuCompressWorkers())))
+            goto cleanup;
+    }
+
     /* Perform the migration */
-    if (qemuMigrationToFile(driver, vm, fd, offset, path,
-                            qemuCompressProgramName(compressed),
-                            bypassSecurityDriver,
-                            asyncJob) < 0)
+    rc = qemuMigrationToFile(driver, vm, compressJob ? pipeFD[1] : fd,
+                             offset, path,
+                             qemuCompressProgramName(compressed),
+                             bypassSecurityDriver,
+                             asyncJob);
+
+    if (compressJob) {
+        /* Once qemu and we are done with the pipe, the job sees the
+         * end of the data, compresses the rest and writes the index */
+        VIR_FORCE_CLOSE(pipeFD[1]);
+        if (rc < 0) {
+            virErrorPtr orig_err = virSaveLastError();
+            ignore_value(virCompressJobFinish(compressJob, NULL));
+            virSetError(orig_err);
+            virFreeError(orig_err);
+        } else if (virCompressJobFinish(compressJob, &frames) < 0) {
+            rc = -1;
+        }
+        header.frames = frames;
+    }
+
+    if (rc < 0)
         goto cleanup;
 
     /* Touch up file header to mark image complete. */
@@ -3009,6 +3149,8 @@ qemuDomainSaveMemory(virQEMUDriverPtr driver,
     ret = 0;
 
  cleanup:
+    VIR_FORCE_CLOSE(pipeFD[0]);
+    VIR_FORCE_CLOSE(pipeFD[1]);
     VIR_FORCE_CLOSE(fd);
     virFileWrapperFdFree(wrapperFd);
     VIR_FREE(xml);
@@ -3150,6 +3292,14 @@ qemuCompressProgramAvailable(virQEMUSaveFormat compress)
     if (compress == QEMU_SAVE_FORMAT_RAW)
         return true;
 
+    if (compress == QEMU_SAVE_FORMAT_ZLIB) {
+#if WITH_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    }
+
     if (!(path = virFindFileInPath(qemuSaveCompressionTypeToString(compress))))
         return false;
 
@@ -3524,6 +3674,12 @@ getCompressionType(virQEMUDriverPtr driver)
             ret = QEMU_SAVE_FORMAT_RAW;
             goto cleanup;
         }
+        if (ret == QEMU_SAVE_FORMAT_ZLIB) {
+            VIR_WARN("%s", _("zlib format is only supported for save "
+                             "images, using raw for dump image"));
+            ret = QEMU_SAVE_FORMAT_RAW;
+            goto cleanup;
+        }
         if (!qemuCompressProgramAvailable(ret)) {
             VIR_WARN("%s", _("Compression program for dump image format "
                              "in configuration file isn't available, "
@@ -5381,11 +5537,32 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
     virObjectEventPtr event;
     int intermediatefd = -1;
     virCommandPtr cmd = NULL;
+    virCompressJobPtr decompressJob = NULL;
     char *errbuf = NULL;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     if ((header->version == 2) &&
-        (header->compressed != QEMU_SAVE_FORMAT_RAW)) {
+        (header->compressed == QEMU_SAVE_FORMAT_ZLIB)) {
+        int pipeFD[2];
+
+        if (pipe2(pipeFD, O_CLOEXEC) < 0) {
+            virReportSystemError(errno, "%s", _("unable to create pipe"));
+            goto cleanup;
+        }
+
+        if (!(decompressJob = virDecompressJobStart(*fd, &pipeFD[1],
+                                                    header->frame_size,
+                                                    header->frames,
+                                                    qemuCompressWorkers()))) {
+            VIR_FORCE_CLOSE(pipeFD[0]);
+            VIR_FORCE_CLOSE(pipeFD[1]);
+            goto cleanup;
+        }
+
+        intermediatefd = *fd;
+        *fd = pipeFD[0];
+    } else if ((header->version == 2) &&
+               (header->compressed != QEMU_SAVE_FORMAT_RAW)) {
         if (!(cmd = qemuCompressGetCommand(header->compressed)))
             goto cleanup;
 
@@ -5408,7 +5585,21 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
                            VIR_NETDEV_VPORT_PROFILE_OP_RESTORE,
                            VIR_QEMU_PROCESS_START_PAUSED);
 
-    if (intermediatefd != -1) {
+    if (decompressJob) {
+        /* qemu has its own copy of the pipe, if it stops reading
+         * early the job must fail writing rather than block */
+        VIR_FORCE_CLOSE(*fd);
+
+        if (ret < 0) {
+            virErrorPtr orig_err = virSaveLastError();
+            ignore_value(virCompressJobFinish(decompressJob, NULL));
+            virSetError(orig_err);
+            virFreeError(orig_err);
+        } else if (virCompressJobFinish(decompressJob, NULL) < 0) {
+            qemuProcessStop(driver, vm, VIR_DOMAIN_SHUTOFF_FAILED, 0);
+            ret = -1;
+        }
+    } else if (intermediatefd != -1) {
         if (ret < 0) {
             /* if there was an error setting up qemu, the intermediate
              * process will wait forever to write to stdout, so we
@@ -5756,8 +5947,10 @@ static char *qemuDomainGetXMLDesc(virDomainPtr dom,
             }
             if (err < 0)
                 goto cleanup;
-            if (err > 0)
+            if (err > 0 && vm->def->mem.cur_balloon != balloon) {
                 vm->def->mem.cur_balloon = balloon;
+                virDomainObjBumpGeneration(vm);
+            }
             /* err == 0 indicates no balloon support, so ignore it */
         }
     }
@@ -5765,7 +5958,14 @@ static char *qemuDomainGetXMLDesc(virDomainPtr dom,
     if ((flags & VIR_DOMAIN_XML_MIGRATABLE))
         flags |= QEMU_DOMAIN_FORMAT_LIVE_FLAGS;
 
-    ret = qemuDomainFormatXML(driver, vm, flags);
+    /* The updated guest CPU depends on the host, not just on @vm */
+    if (!(flags & VIR_DOMAIN_XML_UPDATE_CPU) &&
+        virDomainObjGetCachedXML(vm, flags, &ret) != 0)
+        goto cleanup;
+
+    if ((ret = qemuDomainFormatXML(driver, vm, flags)) &&
+        !(flags & VIR_DOMAIN_XML_UPDATE_CPU))
+        virDomainObjCacheXML(vm, flags, ret);
 
  cleanup:
     if (vm)
@@ -6238,6 +6438,7 @@ static virDomainPtr qemuDomainDefineXML(virConnectPtr conn, const char *xml)
             else
                 vm->def = oldDef;
             oldDef = NULL;
+            virDomainObjBumpGeneration(vm);
         } else {
             /* Brand new domain. Remove it */
             VIR_INFO("Deleting domain '%s'", vm->def->name);
@@ -7715,6 +7916,9 @@ qemuDomainSetBlkioParameters(virDomainPtr dom,
                                         &persistentDef) < 0)
         goto cleanup;
 
+    /* Whatever gets applied below makes formatted XML stale */
+    virDomainObjBumpGeneration(vm);
+
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
         if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_BLKIO)) {
             virReportError(VIR_ERR_OPERATION_INVALID, "%s",
@@ -8363,6 +8567,9 @@ qemuDomainSetMemoryParameters(virDomainPtr dom,
                                         &persistentDef) < 0)
         goto cleanup;
 
+    /* Whatever gets applied below makes formatted XML stale */
+    virDomainObjBumpGeneration(vm);
+
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
         if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_MEMORY)) {
             virReportError(VIR_ERR_OPERATION_INVALID,
@@ -8723,6 +8930,9 @@ qemuDomainSetNumaParameters(virDomainPtr dom,
                                         &persistentDef) < 0)
         goto cleanup;
 
+    /* Whatever gets applied below makes formatted XML stale */
+    virDomainObjBumpGeneration(vm);
+
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
         if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUSET)) {
             virReportError(VIR_ERR_OPERATION_INVALID, "%s",
@@ -9037,6 +9247,9 @@ qemuDomainSetSchedulerParametersFlags(virDomainPtr dom,
                                         &vmdef) < 0)
         goto cleanup;
 
+    /* Whatever gets applied below makes formatted XML stale */
+    virDomainObjBumpGeneration(vm);
+
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
         /* Make a copy for updated domain. */
         vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
@@ -9846,6 +10059,9 @@ qemuDomainSetInterfaceParameters(virDomainPtr dom,
                                         &persistentDef) < 0)
         goto cleanup;
 
+    /* Whatever gets applied below makes formatted XML stale */
+    virDomainObjBumpGeneration(vm);
+
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
         net = virDomainNetFind(vm->def, device);
         if (!net) {
@@ -10122,7 +10338,7 @@ qemuDomainMemoryStats(virDomainPtr dom,
 
         if (ret >= 0 && ret < nr_stats) {
             long rss;
-            if (qemuGetProcessInfo(NULL, NULL, &rss, vm->pid, 0) < 0) {
+            if (qemuDomainGetProcessInfo(vm, NULL, NULL, &rss) < 0) {
                 virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                                _("cannot get RSS for domain"));
             } else {
@@ -11648,6 +11864,13 @@ qemuDomainGetJobStats(virDomainPtr dom,
                                 priv->job.info.memRemaining) < 0)
         goto cleanup;
 
+    if (priv->job.info.timeElapsed &&
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_MEMORY_BPS,
+                                priv->job.info.memProcessed * 1000ULL /
+                                priv->job.info.timeElapsed) < 0)
+        goto cleanup;
+
     if (priv->job.status.ram_duplicate_set) {
         if (virTypedParamsAddULLong(&par, &npar, &maxpar,
                                     VIR_DOMAIN_JOB_MEMORY_CONSTANT,
@@ -16461,6 +16684,837 @@ qemuConnectGetCPUModelNames(virConnectPtr conn,
 }
 
 
+/* Flags describing the context in which domain stats are gathered */
+enum qemuDomainStatsFlags {
+    QEMU_DOMAIN_STATS_HAVE_JOB = (1 << 0), /* job is entered, monitor can be
+                                              accessed */
+};
+
+
+typedef int
+(*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
+                          virDomainObjPtr dom,
+                          virDomainStatsRecordPtr record,
+                          int *maxparams,
+                          unsigned int flags);
+
+struct qemuDomainGetStatsWorker {
+    qemuDomainGetStatsFunc func;
+    unsigned int stats;
+    bool monitor; /* func may want to talk to the monitor */
+};
+
+
+#define QEMU_ADD_COUNT_PARAM(record, maxparams, type, count)             \
+    do {                                                                 \
+        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];                   \
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.count", type); \
+        if (virTypedParamsAddUInt(&(record)->params,                     \
+                                  &(record)->nparams,                    \
+                                  maxparams,                             \
+                                  param_name,                            \
+                                  count) < 0)                            \
+            return -1;                                                   \
+    } while (0)
+
+#define QEMU_ADD_NAME_PARAM(record, maxparams, type, num, name)          \
+    do {                                                                 \
+        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];                   \
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,               \
+                 "%s.%zu.name", type, num);                              \
+        if (virTypedParamsAddString(&(record)->params,                   \
+                                    &(record)->nparams,                  \
+                                    maxparams,                           \
+                                    param_name,                          \
+                                    name) < 0)                           \
+            return -1;                                                   \
+    } while (0)
+
+#define QEMU_ADD_NUM_PARAM(record, maxparams, type, num, name, value)    \
+    do {                                                                 \
+        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];                   \
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,               \
+                 "%s.%zu.%s", type, num, name);                          \
+        if (value >= 0 &&                                                \
+            virTypedParamsAddULLong(&(record)->params,                   \
+                                    &(record)->nparams,                  \
+                                    maxparams,                           \
+                                    param_name,                          \
+                                    value) < 0)                          \
+            return -1;                                                   \
+    } while (0)
+
+
+static int
+qemuDomainGetStatsState(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                        virDomainObjPtr dom,
+                        virDomainStatsRecordPtr record,
+                        int *maxparams,
+                        unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    if (virTypedParamsAddInt(&record->params,
+                             &record->nparams,
+                             maxparams,
+                             "state.state",
+                             dom->state.state) < 0)
+        return -1;
+
+    if (virTypedParamsAddInt(&record->params,
+                             &record->nparams,
+                             maxparams,
+                             "state.reason",
+                             dom->state.reason) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsCpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                      virDomainObjPtr dom,
+                      virDomainStatsRecordPtr record,
+                      int *maxparams,
+                      unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    unsigned long long cpu_time = 0;
+    unsigned long long user_time = 0;
+    unsigned long long sys_time = 0;
+
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    /* Prefer the cgroup accounting, which covers all threads of the
+     * domain and is a plain file read rather than a /proc scan */
+    if (virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUACCT)) {
+        if (virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time) < 0 ||
+            virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time) < 0) {
+            virResetLastError();
+            return 0;
+        }
+    } else {
+        if (qemuDomainGetProcessInfo(dom, &cpu_time, NULL, NULL) < 0) {
+            virResetLastError();
+            return 0;
+        }
+    }
+
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "cpu.time",
+                                cpu_time) < 0)
+        return -1;
+
+    if (user_time || sys_time) {
+        if (virTypedParamsAddULLong(&record->params,
+                                    &record->nparams,
+                                    maxparams,
+                                    "cpu.user",
+                                    user_time) < 0)
+            return -1;
+
+        if (virTypedParamsAddULLong(&record->params,
+                                    &record->nparams,
+                                    maxparams,
+                                    "cpu.system",
+                                    sys_time) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
+                          virDomainObjPtr dom,
+                          virDomainStatsRecordPtr record,
+                          int *maxparams,
+                          unsigned int privflags)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    unsigned long long cur_balloon = dom->def->mem.cur_balloon;
+    int err;
+
+    if (dom->def->memballoon &&
+        dom->def->memballoon->model == VIR_DOMAIN_MEMBALLOON_MODEL_NONE) {
+        cur_balloon = dom->def->mem.max_balloon;
+    } else if (virDomainObjIsActive(dom) &&
+               !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BALLOON_EVENT) &&
+               (privflags & QEMU_DOMAIN_STATS_HAVE_JOB)) {
+        unsigned long long balloon;
+
+        qemuDomainObjEnterMonitor(driver, dom);
+        err = qemuMonitorGetBalloonInfo(priv->mon, &balloon);
+        qemuDomainObjExitMonitor(driver, dom);
+
+        if (err < 0)
+            virResetLastError();
+        else if (err == 0)
+            cur_balloon = dom->def->mem.max_balloon;
+        else
+            cur_balloon = balloon;
+    }
+
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "balloon.current",
+                                cur_balloon) < 0)
+        return -1;
+
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "balloon.maximum",
+                                dom->def->mem.max_balloon) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsVcpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                       virDomainObjPtr dom,
+                       virDomainStatsRecordPtr record,
+                       int *maxparams,
+                       unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    size_t i;
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+    if (virTypedParamsAddUInt(&record->params,
+                              &record->nparams,
+                              maxparams,
+                              "vcpu.current",
+                              (unsigned) dom->def->vcpus) < 0)
+        return -1;
+
+    if (virTypedParamsAddUInt(&record->params,
+                              &record->nparams,
+                              maxparams,
+                              "vcpu.maximum",
+                              (unsigned) dom->def->maxvcpus) < 0)
+        return -1;
+
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    for (i = 0; i < priv->nvcpupids; i++) {
+        unsigned long long cpu_time = 0;
+
+        if (qemuGetProcessInfo(&cpu_time, NULL, NULL,
+                               dom->pid, priv->vcpupids[i]) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "vcpu.%zu.state", i);
+        if (virTypedParamsAddInt(&record->params,
+                                 &record->nparams,
+                                 maxparams,
+                                 param_name,
+                                 VIR_VCPU_RUNNING) < 0)
+            return -1;
+
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "vcpu.%zu.time", i);
+        if (virTypedParamsAddULLong(&record->params,
+                                    &record->nparams,
+                                    maxparams,
+                                    param_name,
+                                    cpu_time) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+#define QEMU_ADD_NET_PARAM(record, maxparams, num, name, value)         \
+    QEMU_ADD_NUM_PARAM(record, maxparams, "net", num, name, value)
+
+static int
+qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                            virDomainObjPtr dom,
+                            virDomainStatsRecordPtr record,
+                            int *maxparams,
+                            unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    size_t i;
+    struct _virDomainInterfaceStats tmp;
+
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    QEMU_ADD_COUNT_PARAM(record, maxparams, "net", dom->def->nnets);
+
+    /* Report the traffic counters of each interface that has a host
+     * side device; interfaces whose counters can't be read are only
+     * reported by name. */
+    for (i = 0; i < dom->def->nnets; i++) {
+        virDomainNetDefPtr net = dom->def->nets[i];
+
+        if (!net->ifname)
+            continue;
+
+        QEMU_ADD_NAME_PARAM(record, maxparams, "net", i, net->ifname);
+
+#ifdef __linux__
+        memset(&tmp, 0, sizeof(tmp));
+        if (linuxDomainInterfaceStats(net->ifname, &tmp) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "rx.bytes", tmp.rx_bytes);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "rx.pkts", tmp.rx_packets);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "rx.errs", tmp.rx_errs);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "rx.drop", tmp.rx_drop);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "tx.bytes", tmp.tx_bytes);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "tx.pkts", tmp.tx_packets);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "tx.errs", tmp.tx_errs);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "tx.drop", tmp.tx_drop);
+#else
+        (void) tmp;
+#endif
+    }
+
+    return 0;
+}
+
+#undef QEMU_ADD_NET_PARAM
+
+
+#define QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, num, name, value)    \
+    QEMU_ADD_NUM_PARAM(record, maxparams, "block", num, name, value)
+
+static int
+qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
+                        virDomainObjPtr dom,
+                        virDomainStatsRecordPtr record,
+                        int *maxparams,
+                        unsigned int privflags)
+{
+    size_t i;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+
+    if (!virDomainObjIsActive(dom) ||
+        !(privflags & QEMU_DOMAIN_STATS_HAVE_JOB))
+        return 0; /* it's ok, just go ahead silently */
+
+    QEMU_ADD_COUNT_PARAM(record, maxparams, "block", dom->def->ndisks);
+
+    for (i = 0; i < dom->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = dom->def->disks[i];
+        long long rd_req = -1, rd_bytes = -1, rd_total_times = -1;
+        long long wr_req = -1, wr_bytes = -1, wr_total_times = -1;
+        long long flush_req = -1, flush_total_times = -1;
+        long long errs = -1;
+        int rc;
+
+        QEMU_ADD_NAME_PARAM(record, maxparams, "block", i, disk->dst);
+
+        if (!disk->info.alias)
+            continue;
+
+        qemuDomainObjEnterMonitor(driver, dom);
+        rc = qemuMonitorGetBlockStatsInfo(priv->mon,
+                                          disk->info.alias,
+                                          &rd_req, &rd_bytes,
+                                          &rd_total_times,
+                                          &wr_req, &wr_bytes,
+                                          &wr_total_times,
+                                          &flush_req,
+                                          &flush_total_times,
+                                          &errs);
+        qemuDomainObjExitMonitor(driver, dom);
+
+        if (rc < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, i,
+                                "rd.reqs", rd_req);
+        QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, i,
+                                "rd.bytes", rd_bytes);
+        QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, i,
+                                "rd.times", rd_total_times);
+        QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, i,
+                                "wr.reqs", wr_req);
+        QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, i,
+                                "wr.bytes", wr_bytes);
+        QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, i,
+                                "wr.times", wr_total_times);
+        QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, i,
+                                "fl.reqs", flush_req);
+        QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, i,
+                                "fl.times", flush_total_times);
+    }
+
+    return 0;
+}
+
+#undef QEMU_ADD_BLOCK_PARAM_LL
+
+
+static int
+qemuDomainGetStatsHistogram(virDomainStatsRecordPtr record,
+                            int *maxparams,
+                            const char *prefix,
+                            virTimeHistogramPtr hist)
+{
+    size_t i;
+    char bucket_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+    QEMU_ADD_COUNT_PARAM(record, maxparams, prefix,
+                         virAtomicIntGet(&hist->count));
+
+    for (i = 0; i < VIR_TIME_HISTOGRAM_BUCKETS; i++) {
+        snprintf(bucket_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "%s.bucket.%zu", prefix, i);
+        if (virTypedParamsAddUInt(&record->params,
+                                  &record->nparams,
+                                  maxparams,
+                                  bucket_name,
+                                  virAtomicIntGet(&hist->buckets[i])) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsJobHistogram(virDomainStatsRecordPtr record,
+                               int *maxparams,
+                               const char *type,
+                               const char *name,
+                               virTimeHistogramPtr hist)
+{
+    char prefix[VIR_TYPED_PARAM_FIELD_LENGTH];
+    char *tmp;
+
+    if (!virAtomicIntGet(&hist->count))
+        return 0;
+
+    snprintf(prefix, sizeof(prefix), "job.%s.%s", type, name);
+    /* Some job names contain spaces */
+    for (tmp = prefix; *tmp; tmp++) {
+        if (*tmp == ' ')
+            *tmp = '_';
+    }
+
+    return qemuDomainGetStatsHistogram(record, maxparams, prefix, hist);
+}
+
+
+struct qemuDomainGetStatsMonitorData {
+    virDomainStatsRecordPtr record;
+    int *maxparams;
+    int ret;
+};
+
+static void
+qemuDomainGetStatsMonitorCommand(void *payload,
+                                 const void *name,
+                                 void *opaque)
+{
+    struct qemuDomainGetStatsMonitorData *data = opaque;
+    char prefix[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+    if (data->ret < 0)
+        return;
+
+    snprintf(prefix, sizeof(prefix), "monitor.cmd.%s", (const char *)name);
+    if (qemuDomainGetStatsHistogram(data->record, data->maxparams,
+                                    prefix, payload) < 0)
+        data->ret = -1;
+}
+
+
+static int
+qemuDomainGetStatsJobLatency(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                             virDomainObjPtr dom,
+                             virDomainStatsRecordPtr record,
+                             int *maxparams,
+                             unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    struct qemuDomainGetStatsMonitorData data = { record, maxparams, 0 };
+    size_t i;
+
+    if (virTypedParamsAddInt(&record->params,
+                             &record->nparams,
+                             maxparams,
+                             "job.queued",
+                             priv->jobs_queued) < 0)
+        return -1;
+
+    if (qemuDomainGetStatsHistogram(record, maxparams, "job.wait",
+                                    &priv->jobWait) < 0)
+        return -1;
+
+    for (i = 0; i < QEMU_JOB_LAST; i++) {
+        if (qemuDomainGetStatsJobHistogram(record, maxparams, "hold",
+                                           qemuDomainJobTypeToString(i),
+                                           &priv->jobHold[i]) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < QEMU_ASYNC_JOB_LAST; i++) {
+        if (qemuDomainGetStatsJobHistogram(record, maxparams, "async",
+                                           qemuDomainAsyncJobTypeToString(i),
+                                           &priv->asyncJobHold[i]) < 0)
+            return -1;
+    }
+
+    /* The monitor is only locked for reading its counters, so
+     * this does not need to wait for any job on the domain */
+    if (priv->mon &&
+        (qemuMonitorGetCommandLatency(priv->mon,
+                                      qemuDomainGetStatsMonitorCommand,
+                                      &data) < 0 ||
+         data.ret < 0))
+        return -1;
+
+    return 0;
+}
+
+#undef QEMU_ADD_NUM_PARAM
+#undef QEMU_ADD_NAME_PARAM
+#undef QEMU_ADD_COUNT_PARAM
+
+static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
+    { qemuDomainGetStatsState, VIR_DOMAIN_STATS_STATE, false },
+    { qemuDomainGetStatsCpu, VIR_DOMAIN_STATS_CPU_TOTAL, false },
+    { qemuDomainGetStatsBalloon, VIR_DOMAIN_STATS_BALLOON, true },
+    { qemuDomainGetStatsVcpu, VIR_DOMAIN_STATS_VCPU, false },
+    { qemuDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE, false },
+    { qemuDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK, true },
+    { qemuDomainGetStatsJobLatency, VIR_DOMAIN_STATS_JOB_LATENCY, false },
+    { NULL, 0, false }
+};
+
+
+static int
+qemuDomainGetStatsCheckSupport(unsigned int *stats,
+                               bool enforce)
+{
+    unsigned int supportedstats = 0;
+    size_t i;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
+        supportedstats |= qemuDomainGetStatsWorkers[i].stats;
+
+    if (*stats == 0) {
+        *stats = supportedstats;
+        return 0;
+    }
+
+    if (enforce &&
+        *stats & ~supportedstats) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                       _("Stats types bits 0x%x are not supported by this daemon"),
+                       *stats & ~supportedstats);
+        return -1;
+    }
+
+    *stats &= supportedstats;
+    return 0;
+}
+
+
+static bool
+qemuDomainGetStatsNeedMonitor(unsigned int stats)
+{
+    size_t i;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        if (qemuDomainGetStatsWorkers[i].monitor &&
+            stats & qemuDomainGetStatsWorkers[i].stats)
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Gathers the requested @stats of a single domain into @record.
+ * If the domain disappeared in the meantime, or the caller is not
+ * allowed to see it, 0 is returned and @record is left NULL.
+ */
+static int
+qemuDomainGetStats(virConnectPtr conn,
+                   virDomainPtr domain,
+                   bool checkACL,
+                   unsigned int stats,
+                   virDomainStatsRecordPtr *record)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    virDomainObjPtr dom;
+    qemuDomainObjPrivatePtr priv;
+    virDomainStatsRecordPtr tmp = NULL;
+    unsigned int privflags = 0;
+    int maxparams = 0;
+    size_t i;
+    int ret = -1;
+
+    *record = NULL;
+
+    if (!(dom = virDomainObjListFindByUUID(driver->domains, domain->uuid)))
+        return 0;
+
+    if (checkACL && !virConnectGetAllDomainStatsCheckACL(conn, dom->def)) {
+        virObjectUnlock(dom);
+        return 0;
+    }
+
+    priv = dom->privateData;
+
+    /* Rather than waiting for a job which may be running for a long
+     * time (e.g. migration), skip anything needing the monitor */
+    if (virDomainObjIsActive(dom) &&
+        qemuDomainGetStatsNeedMonitor(stats) &&
+        qemuDomainJobAllowed(priv, QEMU_JOB_QUERY)) {
+        if (qemuDomainObjBeginJob(driver, dom, QEMU_JOB_QUERY) < 0)
+            virResetLastError();
+        else
+            privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    }
+
+    if (VIR_ALLOC(tmp) < 0)
+        goto endjob;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        if (stats & qemuDomainGetStatsWorkers[i].stats) {
+            if (qemuDomainGetStatsWorkers[i].func(driver, dom, tmp,
+                                                  &maxparams, privflags) < 0)
+                goto endjob;
+        }
+    }
+
+    if (!(tmp->dom = virGetDomain(conn, dom->def->name, dom->def->uuid)))
+        goto endjob;
+    tmp->dom->id = dom->def->id;
+
+    *record = tmp;
+    tmp = NULL;
+    ret = 0;
+
+ endjob:
+    if ((privflags & QEMU_DOMAIN_STATS_HAVE_JOB) &&
+        !qemuDomainObjEndJob(driver, dom))
+        dom = NULL;
+
+    if (tmp) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        VIR_FREE(tmp);
+    }
+    if (dom)
+        virObjectUnlock(dom);
+    return ret;
+}
+
+
+/* Upper limit on threads gathering domain stats in parallel */
+#define QEMU_DOMAIN_STATS_MAX_WORKERS 8
+
+struct qemuDomainGetStatsData {
+    virConnectPtr conn;
+    virDomainPtr *doms;
+    size_t ndoms;
+    bool checkACL;
+    unsigned int stats;
+    virDomainStatsRecordPtr *records;
+
+    virMutex lock;
+    size_t next;        /* Next domain to be processed */
+    virErrorPtr err;    /* First error hit by any of the threads */
+};
+
+
+static void
+qemuDomainGetStatsThread(void *opaque)
+{
+    struct qemuDomainGetStatsData *data = opaque;
+
+    while (true) {
+        size_t idx;
+        int rc;
+
+        virMutexLock(&data->lock);
+        if (data->err || data->next == data->ndoms) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        idx = data->next++;
+        virMutexUnlock(&data->lock);
+
+        rc = qemuDomainGetStats(data->conn, data->doms[idx], data->checkACL,
+                                data->stats, &data->records[idx]);
+
+        if (rc < 0) {
+            virMutexLock(&data->lock);
+            if (!data->err)
+                data->err = virSaveLastError();
+            virMutexUnlock(&data->lock);
+            break;
+        }
+    }
+}
+
+
+static int
+qemuConnectGetAllDomainStats(virConnectPtr conn,
+                             virDomainPtr *doms,
+                             unsigned int ndoms,
+                             unsigned int stats,
+                             virDomainStatsRecordPtr **retStats,
+                             unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    virDomainPtr *domlist = NULL;
+    int ndomlist = 0;
+    struct qemuDomainGetStatsData data;
+    bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
+    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
+
+    memset(&data, 0, sizeof(data));
+
+    if (virConnectGetAllDomainStatsEnsureACL(conn) < 0)
+        return -1;
+
+    if (qemuDomainGetStatsCheckSupport(&stats, enforce) < 0)
+        return -1;
+
+    if (ndoms) {
+        if (lflags) {
+            virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                           _("filtering flags are not supported together "
+                             "with an explicit list of domains"));
+            return -1;
+        }
+
+        if (VIR_ALLOC_N(domlist, ndoms + 1) < 0)
+            return -1;
+
+        for (i = 0; i < ndoms; i++)
+            domlist[i] = virObjectRef(doms[i]);
+        ndomlist = ndoms;
+        data.checkACL = true;
+    } else {
+        if ((ndomlist = virDomainObjListExport(driver->domains, conn, &domlist,
+                                               virConnectGetAllDomainStatsCheckACL,
+                                               lflags)) < 0)
+            return -1;
+    }
+
+    data.conn = conn;
+    data.doms = domlist;
+    data.ndoms = ndomlist;
+    data.stats = stats;
+
+    if (VIR_ALLOC_N(data.records, ndomlist + 1) < 0)
+        goto cleanup;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        goto cleanup;
+    }
+
+    /* Gathering stats mostly means waiting for monitors and reading
+     * files, so spread the domains over a few threads. The calling
+     * thread does its share of work too. */
+    virThreadRunWorkers(MIN(ndomlist, QEMU_DOMAIN_STATS_MAX_WORKERS),
+                        qemuDomainGetStatsThread, &data);
+
+    if (data.err) {
+        virSetError(data.err);
+        goto destroy;
+    }
+
+    /* Squash out domains which vanished or were filtered out */
+    for (i = 0, j = 0; i < ndomlist; i++) {
+        if (data.records[i])
+            data.records[j++] = data.records[i];
+    }
+    for (i = j; i < ndomlist; i++)
+        data.records[i] = NULL;
+
+    *retStats = data.records;
+    data.records = NULL;
+    ret = j;
+
+ destroy:
+    virMutexDestroy(&data.lock);
+
+ cleanup:
+    virFreeError(data.err);
+    virDomainStatsRecordListFree(data.records);
+    if (domlist) {
+        for (i = 0; i < ndomlist; i++)
+            virObjectUnref(domlist[i]);
+        VIR_FREE(domlist);
+    }
+
+    return ret;
+}
+
+
+static int
+qemuConnectGetStartupProgress(virConnectPtr conn,
+                              unsigned int *completed,
+                              unsigned int *total,
+                              unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    int done;
+    int all;
+
+    virCheckFlags(0, -1);
+
+    if (virConnectGetStartupProgressEnsureACL(conn) < 0)
+        return -1;
+
+    all = virAtomicIntGet(&driver->reconnectTotal);
+    done = virAtomicIntGet(&driver->reconnectDone);
+
+    if (completed)
+        *completed = done;
+    if (total)
+        *total = all;
+
+    return done >= all;
+}
+
+
 static virDriver qemuDriver = {
     .no = VIR_DRV_QEMU,
     .name = QEMU_DRIVER_NAME,
@@ -16651,6 +17705,8 @@ static virDriver qemuDriver = {
     .domainMigrateFinish3Params = qemuDomainMigrateFinish3Params, /* 1.1.0 */
     .domainMigrateConfirm3Params = qemuDomainMigrateConfirm3Params, /* 1.1.0 */
     .connectGetCPUModelNames = qemuConnectGetCPUModelNames, /* 1.1.3 */
+    .connectGetAllDomainStats = qemuConnectGetAllDomainStats, /* 1.2.4 */
+    .connectGetStartupProgress = qemuConnectGetStartupProgress, /* 1.2.4 */
 };
 
 
@@ -4742,8 +4742,16 @@ qemuMigrationToFile(virQEMUDriverPtr driver, virDomainObjPtr vm,
         const char *args[] = {
             prog,
             "-c",
+            NULL,
             NULL
         };
+
+        /* zstd compresses on all available CPUs, so it can keep up
+         * with qemu. The output is still a single frame, which is
+         * decompressed by one thread on restore */
+        if (STREQ(prog, "zstd"))
+            args[2] = "-T0";
+
         if (pipeFD[0] != -1) {
             cmd = virCommandNewArgs(args);
             virCommandSetInputFD(cmd, pipeFD[0]);
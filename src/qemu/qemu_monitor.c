@@ -42,6 +42,7 @@
 #include "virobject.h"
 #include "virprobe.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #ifdef WITH_DTRACE_PROBES
 # include "libvirt_qemu_probes.h"
@@ -78,6 +79,11 @@ struct _qemuMonitor {
     size_t bufferLength;
     char *buffer;
 
+    /* Incremental parser for QMP data, and how much of the
+     * start of @buffer it has already been fed */
+    virJSONStreamParserPtr jsonParser;
+    size_t jsonParsed;
+
     /* If anything went wrong, this will be fed back
      * the next monitor msg */
     virError lastError;
@@ -96,6 +102,9 @@ struct _qemuMonitor {
 
     /* Log file fd of the qemu process to dig for usable info */
     int logfd;
+
+    /* Round trip times per command name, as virTimeHistogram */
+    virHashTablePtr commandLatency;
 };
 
 static virClassPtr qemuMonitorClass;
@@ -263,9 +272,11 @@ static void qemuMonitorDispose(void *obj)
     virResetError(&mon->lastError);
     virCondDestroy(&mon->notify);
     VIR_FREE(mon->buffer);
+    virJSONStreamParserFree(mon->jsonParser);
     virJSONValueFree(mon->options);
     VIR_FREE(mon->balloonpath);
     VIR_FORCE_CLOSE(mon->logfd);
+    virHashFree(mon->commandLatency);
 }
 
 
@@ -400,6 +411,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
 
     if (mon->json)
         len = qemuMonitorJSONIOProcess(mon,
+                                       mon->jsonParser, &mon->jsonParsed,
                                        mon->buffer, mon->bufferOffset,
                                        msg);
     else
@@ -781,6 +793,8 @@ qemuMonitorOpenInternal(virDomainObjPtr vm,
 
     mon->fd = -1;
     mon->logfd = -1;
+    if (!(mon->commandLatency = virHashCreate(10, virHashValueFree)))
+        goto cleanup;
     if (virCondInit(&mon->notify) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("cannot initialize monitor condition"));
@@ -790,8 +804,11 @@ qemuMonitorOpenInternal(virDomainObjPtr vm,
     mon->hasSendFD = hasSendFD;
     mon->vm = virObjectRef(vm);
     mon->json = json;
-    if (json)
+    if (json) {
         mon->waitGreeting = true;
+        if (!(mon->jsonParser = virJSONStreamParserNew()))
+            goto cleanup;
+    }
     mon->cb = cb;
     mon->callbackOpaque = opaque;
 
@@ -948,10 +965,47 @@ char *qemuMonitorNextCommandID(qemuMonitorPtr mon)
 }
 
 
+static void
+qemuMonitorRecordCommand(qemuMonitorPtr mon,
+                         const char *name,
+                         unsigned long long ms)
+{
+    virTimeHistogramPtr hist;
+
+    PROBE(QEMU_MONITOR_CMD_DONE,
+          "mon=%p cmd=%s ms=%llu", mon, name, ms);
+
+    if (!(hist = virHashLookup(mon->commandLatency, name))) {
+        /* Statistics are best effort, don't clobber the error
+         * the command itself may have reported */
+        virErrorPtr err = virSaveLastError();
+        int rc = -1;
+
+        if (VIR_ALLOC_QUIET(hist) == 0 &&
+            (rc = virHashAddEntry(mon->commandLatency, name, hist)) < 0)
+            VIR_FREE(hist);
+
+        if (err) {
+            virSetError(err);
+            virFreeError(err);
+        } else {
+            virResetLastError();
+        }
+        if (rc < 0)
+            return;
+    }
+
+    virTimeHistogramAdd(hist, ms);
+}
+
+
 int qemuMonitorSend(qemuMonitorPtr mon,
                     qemuMonitorMessagePtr msg)
 {
     int ret = -1;
+    unsigned long long then = 0;
+    unsigned long long now;
+    bool timed = false;
 
     /* Check whether qemu quit unexpectedly */
     if (mon->lastError.code != VIR_ERR_OK) {
@@ -961,6 +1015,10 @@ int qemuMonitorSend(qemuMonitorPtr mon,
         return -1;
     }
 
+    /* Failing to read the clock only costs us the latency sample */
+    if (msg->txName && virTimeMillisNowRaw(&then) == 0)
+        timed = true;
+
     mon->msg = msg;
     qemuMonitorUpdateWatch(mon);
 
@@ -989,6 +1047,35 @@ int qemuMonitorSend(qemuMonitorPtr mon,
     mon->msg = NULL;
     qemuMonitorUpdateWatch(mon);
 
+    if (timed && virTimeMillisNowRaw(&now) == 0)
+        qemuMonitorRecordCommand(mon, msg->txName, now - then);
+
+    return ret;
+}
+
+
+/**
+ * qemuMonitorGetCommandLatency:
+ * @mon: monitor object
+ * @iter: callback invoked for each command
+ * @opaque: data passed to @iter
+ *
+ * Calls @iter for every command sent over @mon so far with the
+ * command name as key and its virTimeHistogramPtr as payload.
+ *
+ * Returns the number of commands visited, -1 on error.
+ */
+int
+qemuMonitorGetCommandLatency(qemuMonitorPtr mon,
+                             virHashIterator iter,
+                             void *opaque)
+{
+    int ret;
+
+    virObjectLock(mon);
+    ret = virHashForEach(mon->commandLatency, iter, opaque);
+    virObjectUnlock(mon);
+
     return ret;
 }
 
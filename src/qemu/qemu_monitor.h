@@ -58,6 +58,14 @@ struct _qemuMonitorMessage {
     int rxLength;
     /* Used by the JSON monitor to hold reply / error */
     void *rxObject;
+    /* Used by the JSON monitor to only build the listed parts
+     * of the reply, see virJSONStreamParserSetFilter */
+    const char *const *rxFilter;
+    bool rxFilterSet;
+
+    /* Command name to account the round trip time to,
+     * or NULL to skip the latency statistics */
+    const char *txName;
 
     /* True if rxBuffer / rxObject are ready, or a
      * fatal error occurred on the monitor channel
@@ -222,6 +230,11 @@ int qemuMonitorSetLink(qemuMonitorPtr mon,
                        const char *name,
                        enum virDomainNetInterfaceLinkState state);
 
+int qemuMonitorGetCommandLatency(qemuMonitorPtr mon,
+                                 virHashIterator iter,
+                                 void *opaque)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 /* These APIs are for use by the internal Text/JSON monitor impl code only */
 char *qemuMonitorNextCommandID(qemuMonitorPtr mon);
 int qemuMonitorSend(qemuMonitorPtr mon,
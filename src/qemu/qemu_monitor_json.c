@@ -31,6 +31,7 @@
 #include <string.h>
 #include <sys/time.h>
 
+#include "c-ctype.h"
 #include "qemu_monitor_text.h"
 #include "qemu_monitor_json.h"
 #include "qemu_command.h"
@@ -170,17 +171,14 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
 
 static int
 qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
+                             virJSONValuePtr obj,
                              const char *line,
                              qemuMonitorMessagePtr msg)
 {
-    virJSONValuePtr obj = NULL;
     int ret = -1;
 
     VIR_DEBUG("Line [%s]", line);
 
-    if (!(obj = virJSONValueFromString(line)))
-        goto cleanup;
-
     if (obj->type != VIR_JSON_TYPE_OBJECT) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Parsed JSON reply '%s' isn't an object"), line);
@@ -216,7 +214,16 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
     return ret;
 }
 
+/*
+ * QMP data is fed to @parser as it arrives, so that replies are built
+ * incrementally instead of being parsed in one go once the final line
+ * ending shows up. The text of a message is kept in the monitor buffer
+ * until the message is complete, *@parsed tracks how much of it the
+ * parser has seen already.
+ */
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
+                             virJSONStreamParserPtr parser,
+                             size_t *parsed,
                              const char *data,
                              size_t len,
                              qemuMonitorMessagePtr msg)
@@ -224,49 +231,90 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
     int used = 0;
     /*VIR_DEBUG("Data %d bytes [%s]", len, data);*/
 
-    while (used < len) {
-        char *nl = strstr(data + used, LINE_ENDING);
+    if (msg && msg->rxFilter && !msg->rxFilterSet) {
+        if (virJSONStreamParserSetFilter(parser, msg->rxFilter) < 0)
+            return -1;
+        msg->rxFilterSet = true;
+    }
 
-        if (nl) {
-            int got = nl - (data + used);
-            char *line;
-            if (VIR_STRNDUP(line, data + used, got) < 0)
-                return -1;
-            used += got + strlen(LINE_ENDING);
-            line[got] = '\0'; /* kill \n */
-            if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0) {
-                VIR_FREE(line);
-                return -1;
-            }
+    while (*parsed < len) {
+        virJSONValuePtr obj;
+        ssize_t got;
+        char *line;
+        int ret;
 
-            VIR_FREE(line);
-        } else {
+        if ((got = virJSONStreamParserFeed(parser, data + *parsed,
+                                           len - *parsed, &obj)) < 0)
+            return -1;
+        *parsed += got;
+
+        if (!obj)
             break;
+
+        while (used < *parsed && c_isspace(data[used]))
+            used++;
+        if (VIR_STRNDUP(line, data + used, *parsed - used) < 0) {
+            virJSONValueFree(obj);
+            return -1;
         }
+        used = *parsed;
+
+        ret = qemuMonitorJSONIOProcessLine(mon, obj, line, msg);
+        VIR_FREE(line);
+        if (ret < 0)
+            return -1;
+
+        if (msg && msg->finished && msg->rxFilterSet &&
+            virJSONStreamParserSetFilter(parser, NULL) < 0)
+            return -1;
     }
 
+    *parsed -= used;
+
     VIR_DEBUG("Total used %d bytes out of %zd available in buffer", used, len);
     return used;
 }
 
+/* Members of QMP messages which must survive any reply filter */
+static const char *qemuMonitorJSONFilterBase[] = {
+    "QMP", "event", "data", "timestamp", "error", "id",
+};
+
 static int
-qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
-                             virJSONValuePtr cmd,
-                             int scm_fd,
-                             virJSONValuePtr *reply)
+qemuMonitorJSONCommandFull(qemuMonitorPtr mon,
+                           virJSONValuePtr cmd,
+                           int scm_fd,
+                           const char *const *filter,
+                           virJSONValuePtr *reply)
 {
     int ret = -1;
     qemuMonitorMessage msg;
-    char *cmdstr = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
     char *id = NULL;
     virJSONValuePtr exe;
+    const char **paths = NULL;
+    size_t npaths = 0;
 
     *reply = NULL;
 
     memset(&msg, 0, sizeof(msg));
 
+    if (filter) {
+        size_t i;
+
+        if (VIR_ALLOC_N(paths, ARRAY_CARDINALITY(qemuMonitorJSONFilterBase) +
+                        virStringListLength((char **)filter) + 1) < 0)
+            goto cleanup;
+        for (i = 0; i < ARRAY_CARDINALITY(qemuMonitorJSONFilterBase); i++)
+            paths[npaths++] = qemuMonitorJSONFilterBase[i];
+        for (i = 0; filter[i]; i++)
+            paths[npaths++] = filter[i];
+        msg.rxFilter = paths;
+    }
+
     exe = virJSONValueObjectGet(cmd, "execute");
     if (exe) {
+        msg.txName = virJSONValueGetString(exe);
         if (!(id = qemuMonitorNextCommandID(mon)))
             goto cleanup;
         if (virJSONValueObjectAppendString(cmd, "id", id) < 0) {
@@ -276,14 +324,19 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
         }
     }
 
-    if (!(cmdstr = virJSONValueToString(cmd, false)))
+    if (virJSONValueToBuffer(cmd, &buf, false) < 0)
         goto cleanup;
-    if (virAsprintf(&msg.txBuffer, "%s\r\n", cmdstr) < 0)
+    virBufferAddLit(&buf, "\r\n");
+    if (virBufferError(&buf)) {
+        virReportOOMError();
         goto cleanup;
-    msg.txLength = strlen(msg.txBuffer);
+    }
+    msg.txLength = virBufferUse(&buf);
+    msg.txBuffer = virBufferContentAndReset(&buf);
     msg.txFD = scm_fd;
 
-    VIR_DEBUG("Send command '%s' for write with FD %d", cmdstr, scm_fd);
+    VIR_DEBUG("Send command '%.*s' for write with FD %d",
+              msg.txLength - 2, msg.txBuffer, scm_fd);
 
     ret = qemuMonitorSend(mon, &msg);
 
@@ -303,13 +356,24 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
 
  cleanup:
     VIR_FREE(id);
-    VIR_FREE(cmdstr);
+    virBufferFreeAndReset(&buf);
     VIR_FREE(msg.txBuffer);
+    VIR_FREE(paths);
 
     return ret;
 }
 
 
+static int
+qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
+                             virJSONValuePtr cmd,
+                             int scm_fd,
+                             virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, scm_fd, NULL, reply);
+}
+
+
 static int
 qemuMonitorJSONCommand(qemuMonitorPtr mon,
                        virJSONValuePtr cmd,
@@ -318,6 +382,22 @@ qemuMonitorJSONCommand(qemuMonitorPtr mon,
     return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
 }
 
+
+/*
+ * Like qemuMonitorJSONCommand, but only the parts of the "return"
+ * data named by @filter (see virJSONStreamParserSetFilter) are built,
+ * which avoids allocating large replies of which the caller only
+ * needs a few fields.
+ */
+static int
+qemuMonitorJSONCommandFiltered(qemuMonitorPtr mon,
+                               virJSONValuePtr cmd,
+                               const char *const *filter,
+                               virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, -1, filter, reply);
+}
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -1629,6 +1709,12 @@ int qemuMonitorJSONGetBlockInfo(qemuMonitorPtr mon,
 }
 
 
+static const char *qemuMonitorJSONBlockStatsFilter[] = {
+    "return/*/device",
+    "return/*/stats",
+    NULL
+};
+
 int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
                                      const char *dev_name,
                                      long long *rd_req,
@@ -1664,7 +1750,9 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
     if (!cmd)
         return -1;
 
-    ret = qemuMonitorJSONCommand(mon, cmd, &reply);
+    ret = qemuMonitorJSONCommandFiltered(mon, cmd,
+                                         qemuMonitorJSONBlockStatsFilter,
+                                         &reply);
 
     if (ret == 0)
         ret = qemuMonitorJSONCheckError(cmd, reply);
@@ -1789,6 +1877,11 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
+static const char *qemuMonitorJSONBlockStatsParamsFilter[] = {
+    "return/*/stats",
+    NULL
+};
+
 int qemuMonitorJSONGetBlockStatsParamsNumber(qemuMonitorPtr mon,
                                              int *nparams)
 {
@@ -1804,7 +1897,9 @@ int qemuMonitorJSONGetBlockStatsParamsNumber(qemuMonitorPtr mon,
     if (!cmd)
         return -1;
 
-    ret = qemuMonitorJSONCommand(mon, cmd, &reply);
+    ret = qemuMonitorJSONCommandFiltered(mon, cmd,
+                                         qemuMonitorJSONBlockStatsParamsFilter,
+                                         &reply);
 
     if (ret == 0)
         ret = qemuMonitorJSONCheckError(cmd, reply);
@@ -1862,6 +1957,12 @@ int qemuMonitorJSONGetBlockStatsParamsNumber(qemuMonitorPtr mon,
     return ret;
 }
 
+static const char *qemuMonitorJSONBlockExtentFilter[] = {
+    "return/*/device",
+    "return/*/parent/stats/wr_highest_offset",
+    NULL
+};
+
 int qemuMonitorJSONGetBlockExtent(qemuMonitorPtr mon,
                                   const char *dev_name,
                                   unsigned long long *extent)
@@ -1879,7 +1980,9 @@ int qemuMonitorJSONGetBlockExtent(qemuMonitorPtr mon,
     if (!cmd)
         return -1;
 
-    ret = qemuMonitorJSONCommand(mon, cmd, &reply);
+    ret = qemuMonitorJSONCommandFiltered(mon, cmd,
+                                         qemuMonitorJSONBlockExtentFilter,
+                                         &reply);
 
     if (ret == 0)
         ret = qemuMonitorJSONCheckError(cmd, reply);
@@ -4398,6 +4501,12 @@ int qemuMonitorJSONGetEvents(qemuMonitorPtr mon,
 }
 
 
+static const char *qemuMonitorJSONCommandLineOptionsFilter[] = {
+    "return/*/option",
+    "return/*/parameters/*/name",
+    NULL
+};
+
 int
 qemuMonitorJSONGetCommandLineOptionParameters(qemuMonitorPtr mon,
                                               const char *option,
@@ -4422,7 +4531,9 @@ qemuMonitorJSONGetCommandLineOptionParameters(qemuMonitorPtr mon,
                                                NULL)))
             return -1;
 
-        ret = qemuMonitorJSONCommand(mon, cmd, &reply);
+        ret = qemuMonitorJSONCommandFiltered(mon, cmd,
+                                             qemuMonitorJSONCommandLineOptionsFilter,
+                                             &reply);
 
         if (ret == 0) {
             if (qemuMonitorJSONHasError(reply, "CommandNotFound"))
@@ -32,6 +32,8 @@
 # include "cpu/cpu.h"
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
+                             virJSONStreamParserPtr parser,
+                             size_t *parsed,
                              const char *data,
                              size_t len,
                              qemuMonitorMessagePtr msg);
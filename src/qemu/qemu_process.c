@@ -99,6 +99,7 @@ qemuProcessRemoveDomainStatus(virQEMUDriverPtr driver,
         VIR_WARN("Failed to remove domain XML for %s: %s",
                  vm->def->name, virStrerror(errno, ebuf, sizeof(ebuf)));
     VIR_FREE(file);
+    VIR_FREE(vm->statusXML);
 
     if (priv->pidfile &&
         unlink(priv->pidfile) < 0 &&
@@ -3337,13 +3338,130 @@ qemuProcessReconnect(void *opaque)
     virObjectUnref(cfg);
 }
 
+/* Domains waiting to be reconnected after daemon startup, shared by
+ * the threads doing the work */
+struct qemuProcessReconnectQueue {
+    virMutex lock;
+    virConnectPtr conn;
+    virQEMUDriverPtr driver;
+
+    struct qemuProcessReconnectData **items;
+    size_t nitems;
+    size_t next;            /* Next item to be processed */
+
+    char **emulators;       /* Binaries whose capabilities are needed */
+    size_t nemulators;
+
+    size_t nthreads;        /* Threads still processing the queue */
+    unsigned long long start;
+};
+
+
+static void
+qemuProcessReconnectQueueFree(struct qemuProcessReconnectQueue *queue)
+{
+    size_t i;
+
+    if (!queue)
+        return;
+
+    for (i = 0; i < queue->nemulators; i++)
+        VIR_FREE(queue->emulators[i]);
+    VIR_FREE(queue->emulators);
+    VIR_FREE(queue->items);
+    virMutexDestroy(&queue->lock);
+    VIR_FREE(queue);
+}
+
+
+static void
+qemuProcessReconnectWorker(void *opaque)
+{
+    struct qemuProcessReconnectQueue *queue = opaque;
+    virQEMUDriverPtr driver = queue->driver;
+    unsigned long long end = 0;
+    bool last;
+
+    while (true) {
+        struct qemuProcessReconnectData *data;
+
+        virMutexLock(&queue->lock);
+        if (queue->next == queue->nitems)
+            break;
+        data = queue->items[queue->next];
+        queue->items[queue->next++] = NULL;
+        virMutexUnlock(&queue->lock);
+
+        qemuProcessReconnect(data);
+        virAtomicIntInc(&driver->reconnectDone);
+    }
+
+    /* Still holding the queue lock here */
+    last = --queue->nthreads == 0;
+    virMutexUnlock(&queue->lock);
+
+    if (!last)
+        return;
+
+    ignore_value(virTimeMillisNow(&end));
+    VIR_INFO("Reconnected to %zu domains in %llu ms",
+             queue->nitems, end - queue->start);
+
+    qemuProcessReconnectQueueFree(queue);
+}
+
+
+/*
+ * Reconnecting a domain mostly means waiting for its monitor, so the
+ * domains are spread over up to max_reconnect_workers threads. Before
+ * that, capabilities of the emulators they need are looked up once in
+ * a batch, rather than each thread probing them while holding the
+ * capabilities cache lock.
+ */
+static void
+qemuProcessReconnectStart(void *opaque)
+{
+    struct qemuProcessReconnectQueue *queue = opaque;
+    virQEMUDriverPtr driver = queue->driver;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    size_t want = MIN(queue->nitems, cfg->maxReconnectWorkers);
+    size_t i;
+
+    virObjectUnref(cfg);
+
+    virQEMUCapsCacheFill(driver->qemuCapsCache,
+                         queue->emulators, queue->nemulators);
+
+    /* This thread does its share of work too */
+    for (i = 1; i < want; i++) {
+        virThread thread;
+
+        virMutexLock(&queue->lock);
+        queue->nthreads++;
+        virMutexUnlock(&queue->lock);
+
+        if (virThreadCreate(&thread, false,
+                            qemuProcessReconnectWorker, queue) < 0) {
+            VIR_WARN("Failed to create domain reconnect thread");
+            virMutexLock(&queue->lock);
+            queue->nthreads--;
+            virMutexUnlock(&queue->lock);
+            break;
+        }
+    }
+
+    qemuProcessReconnectWorker(queue);
+}
+
+
 static int
 qemuProcessReconnectHelper(virDomainObjPtr obj,
                            void *opaque)
 {
-    virThread thread;
-    struct qemuProcessReconnectData *src = opaque;
+    struct qemuProcessReconnectQueue *queue = opaque;
     struct qemuProcessReconnectData *data;
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+    size_t i;
 
     if (!obj->pid)
         return 0;
@@ -3351,11 +3469,12 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
     if (VIR_ALLOC(data) < 0)
         return -1;
 
-    memcpy(data, src, sizeof(*data));
+    data->conn = queue->conn;
+    data->driver = queue->driver;
     data->payload = obj;
 
     /*
-     * We create a separate thread to run qemuProcessReconnect in it.
+     * qemuProcessReconnect is run from one of the reconnect threads.
      * However, qemuProcessReconnect needs to:
      * 1. just before monitor reconnect do lightweight MonitorEnter
      *    (increase VM refcount, unlock VM & driver)
@@ -3373,30 +3492,48 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
 
     qemuDomainObjRestoreJob(obj, &data->oldjob);
 
-    if (qemuDomainObjBeginJob(src->driver, obj, QEMU_JOB_MODIFY) < 0)
+    if (qemuDomainObjBeginJob(queue->driver, obj, QEMU_JOB_MODIFY) < 0)
         goto error;
 
+    /* If upgrading from old libvirtd we won't have found any caps
+     * in the domain status, so they need to be looked up */
+    if (!priv->qemuCaps && obj->def->emulator) {
+        char *emulator = NULL;
+
+        for (i = 0; i < queue->nemulators; i++) {
+            if (STREQ(queue->emulators[i], obj->def->emulator))
+                break;
+        }
+
+        if (i == queue->nemulators &&
+            (VIR_STRDUP(emulator, obj->def->emulator) < 0 ||
+             VIR_APPEND_ELEMENT(queue->emulators, queue->nemulators,
+                                emulator) < 0)) {
+            VIR_FREE(emulator);
+            virResetLastError();
+        }
+    }
+
     /* Since we close the connection later on, we have to make sure
      * that the threads we start see a valid connection throughout their
      * lifetime. We simply increase the reference counter here.
      */
     virObjectRef(data->conn);
 
-    if (virThreadCreate(&thread, false, qemuProcessReconnect, data) < 0) {
+    if (VIR_APPEND_ELEMENT(queue->items, queue->nitems, data) < 0) {
 
         virObjectUnref(data->conn);
 
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Could not create thread. QEMU initialization "
-                         "might be incomplete"));
-        if (!qemuDomainObjEndJob(src->driver, obj)) {
+                       _("Could not queue domain reconnect. QEMU "
+                         "initialization might be incomplete"));
+        if (!qemuDomainObjEndJob(queue->driver, obj)) {
             obj = NULL;
         } else if (virObjectUnref(obj)) {
-           /* We can't spawn a thread and thus connect to monitor.
-            * Kill qemu */
-            qemuProcessStop(src->driver, obj, VIR_DOMAIN_SHUTOFF_FAILED, 0);
+           /* We can't connect to monitor. Kill qemu */
+            qemuProcessStop(queue->driver, obj, VIR_DOMAIN_SHUTOFF_FAILED, 0);
             if (!obj->persistent)
-                qemuDomainRemoveInactive(src->driver, obj);
+                qemuDomainRemoveInactive(queue->driver, obj);
             else
                 virObjectUnlock(obj);
         }
@@ -3416,13 +3553,45 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
  * qemuProcessReconnectAll
  *
  * Try to re-open the resources for live VMs that we care
- * about.
+ * about. This returns once all of them have been queued;
+ * driver->reconnectDone tracks how many were processed.
  */
 void
 qemuProcessReconnectAll(virConnectPtr conn, virQEMUDriverPtr driver)
 {
-    struct qemuProcessReconnectData data = {.conn = conn, .driver = driver};
-    virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, &data);
+    struct qemuProcessReconnectQueue *queue;
+    virThread thread;
+
+    if (VIR_ALLOC(queue) < 0)
+        return;
+
+    if (virMutexInit(&queue->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        VIR_FREE(queue);
+        return;
+    }
+
+    queue->conn = conn;
+    queue->driver = driver;
+    queue->nthreads = 1;
+    ignore_value(virTimeMillisNow(&queue->start));
+
+    virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, queue);
+
+    virAtomicIntSet(&driver->reconnectTotal, queue->nitems);
+    virAtomicIntSet(&driver->reconnectDone, 0);
+
+    if (queue->nitems == 0) {
+        qemuProcessReconnectQueueFree(queue);
+        return;
+    }
+
+    if (virThreadCreate(&thread, false, qemuProcessReconnectStart, queue) < 0) {
+        VIR_WARN("Failed to create domain reconnect thread, "
+                 "reconnecting synchronously");
+        qemuProcessReconnectStart(queue);
+    }
 }
 
 static int
@@ -4473,6 +4642,7 @@ void qemuProcessStop(virQEMUDriverPtr driver,
 
     vm->taint = 0;
     vm->pid = -1;
+    VIR_FORCE_CLOSE(priv->procStatFd);
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, reason);
     VIR_FREE(priv->vcpupids);
     priv->nvcpupids = 0;
@@ -4496,6 +4666,7 @@ void qemuProcessStop(virQEMUDriverPtr driver,
         vm->def = vm->newDef;
         vm->def->id = -1;
         vm->newDef = NULL;
+        virDomainObjBumpGeneration(vm);
     }
 
     if (orig_err) {
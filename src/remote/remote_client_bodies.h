@@ -2544,7 +2544,7 @@ remoteDomainMigratePrepareTunnel(virConnectPtr conn, virStreamPtr st, unsigned l
 
     remoteDriverLock(priv);
 
-    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_DOMAIN_MIGRATE_PREPARE_TUNNEL, priv->counter)))
+    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_DOMAIN_MIGRATE_PREPARE_TUNNEL, priv->counter, false)))
         goto done;
 
     if (virNetClientAddStream(priv->client, netst) < 0) {
@@ -2664,7 +2664,7 @@ remoteDomainOpenChannel(virDomainPtr dom, const char *name, virStreamPtr st, uns
 
     remoteDriverLock(priv);
 
-    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_DOMAIN_OPEN_CHANNEL, priv->counter)))
+    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_DOMAIN_OPEN_CHANNEL, priv->counter, false)))
         goto done;
 
     if (virNetClientAddStream(priv->client, netst) < 0) {
@@ -2705,7 +2705,7 @@ remoteDomainOpenConsole(virDomainPtr dom, const char *dev_name, virStreamPtr st,
 
     remoteDriverLock(priv);
 
-    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_DOMAIN_OPEN_CONSOLE, priv->counter)))
+    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_DOMAIN_OPEN_CONSOLE, priv->counter, false)))
         goto done;
 
     if (virNetClientAddStream(priv->client, netst) < 0) {
@@ -3124,7 +3124,7 @@ remoteDomainScreenshot(virDomainPtr dom, virStreamPtr st, unsigned int screen, u
 
     remoteDriverLock(priv);
 
-    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_DOMAIN_SCREENSHOT, priv->counter)))
+    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_DOMAIN_SCREENSHOT, priv->counter, false)))
         goto done;
 
     if (virNetClientAddStream(priv->client, netst) < 0) {
@@ -6171,6 +6171,31 @@ done:
     return rv;
 }
 
+static int
+remoteStorageVolAbortJob(virStorageVolPtr vol, unsigned int flags)
+{
+    int rv = -1;
+    struct private_data *priv = vol->conn->storagePrivateData;
+    remote_storage_vol_abort_job_args args;
+
+    remoteDriverLock(priv);
+
+    make_nonnull_storage_vol(&args.vol, vol);
+    args.flags = flags;
+
+    if (call(vol->conn, priv, 0, REMOTE_PROC_STORAGE_VOL_ABORT_JOB,
+             (xdrproc_t)xdr_remote_storage_vol_abort_job_args, (char *)&args,
+             (xdrproc_t)xdr_void, (char *)NULL) == -1) {
+        goto done;
+    }
+
+    rv = 0;
+
+done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 static virStorageVolPtr
 remoteStorageVolCreateXML(virStoragePoolPtr pool, const char *xml, unsigned int flags)
 {
@@ -6267,7 +6292,7 @@ remoteStorageVolDownload(virStorageVolPtr vol, virStreamPtr st, unsigned long lo
 
     remoteDriverLock(priv);
 
-    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_STORAGE_VOL_DOWNLOAD, priv->counter)))
+    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_STORAGE_VOL_DOWNLOAD, priv->counter, flags & VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM)))
         goto done;
 
     if (virNetClientAddStream(priv->client, netst) < 0) {
@@ -6329,6 +6354,40 @@ done:
     return rv;
 }
 
+static int
+remoteStorageVolGetJobInfo(virStorageVolPtr vol, virStorageVolJobInfoPtr result, unsigned int flags)
+{
+    int rv = -1;
+    struct private_data *priv = vol->conn->storagePrivateData;
+    remote_storage_vol_get_job_info_args args;
+    remote_storage_vol_get_job_info_ret ret;
+
+    remoteDriverLock(priv);
+
+    make_nonnull_storage_vol(&args.vol, vol);
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    if (call(vol->conn, priv, 0, REMOTE_PROC_STORAGE_VOL_GET_JOB_INFO,
+             (xdrproc_t)xdr_remote_storage_vol_get_job_info_args, (char *)&args,
+             (xdrproc_t)xdr_remote_storage_vol_get_job_info_ret, (char *)&ret) == -1) {
+        goto done;
+    }
+
+    result->type = ret.type;
+    result->state = ret.state;
+    result->elapsed = ret.elapsed;
+    result->processed = ret.processed;
+    result->total = ret.total;
+    result->bandwidth = ret.bandwidth;
+    rv = 0;
+
+done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 static char *
 remoteStorageVolGetPath(virStorageVolPtr vol)
 {
@@ -6505,7 +6564,7 @@ remoteStorageVolUpload(virStorageVolPtr vol, virStreamPtr st, unsigned long long
 
     remoteDriverLock(priv);
 
-    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_STORAGE_VOL_UPLOAD, priv->counter)))
+    if (!(netst = virNetClientStreamNew(priv->remoteProgram, REMOTE_PROC_STORAGE_VOL_UPLOAD, priv->counter, flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM)))
         goto done;
 
     if (virNetClientAddStream(priv->client, netst) < 0) {
@@ -79,6 +79,7 @@ typedef remote_nonnull_string *remote_string;
 #define REMOTE_DOMAIN_MIGRATE_PARAM_LIST_MAX 64
 #define REMOTE_DOMAIN_JOB_STATS_MAX 64
 #define REMOTE_CONNECT_CPU_MODELS_MAX 8192
+#define REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX 4096
 
 typedef char remote_uuid[VIR_UUID_BUFLEN];
 
@@ -3555,6 +3556,67 @@ struct remote_network_event_lifecycle_msg {
         int detail;
 };
 typedef struct remote_network_event_lifecycle_msg remote_network_event_lifecycle_msg;
+
+struct remote_domain_stats_record {
+        remote_nonnull_domain dom;
+        struct {
+                u_int params_len;
+                remote_typed_param *params_val;
+        } params;
+};
+typedef struct remote_domain_stats_record remote_domain_stats_record;
+
+struct remote_connect_get_all_domain_stats_args {
+        struct {
+                u_int doms_len;
+                remote_nonnull_domain *doms_val;
+        } doms;
+        u_int stats;
+        u_int flags;
+};
+typedef struct remote_connect_get_all_domain_stats_args remote_connect_get_all_domain_stats_args;
+
+struct remote_connect_get_all_domain_stats_ret {
+        struct {
+                u_int retStats_len;
+                remote_domain_stats_record *retStats_val;
+        } retStats;
+};
+typedef struct remote_connect_get_all_domain_stats_ret remote_connect_get_all_domain_stats_ret;
+
+struct remote_connect_get_startup_progress_args {
+        u_int flags;
+};
+typedef struct remote_connect_get_startup_progress_args remote_connect_get_startup_progress_args;
+
+struct remote_connect_get_startup_progress_ret {
+        u_int completed;
+        u_int total;
+        int ret;
+};
+typedef struct remote_connect_get_startup_progress_ret remote_connect_get_startup_progress_ret;
+
+struct remote_storage_vol_get_job_info_args {
+        remote_nonnull_storage_vol vol;
+        u_int flags;
+};
+typedef struct remote_storage_vol_get_job_info_args remote_storage_vol_get_job_info_args;
+
+struct remote_storage_vol_get_job_info_ret {
+        int type;
+        int state;
+        uint64_t elapsed;
+        uint64_t processed;
+        uint64_t total;
+        uint64_t bandwidth;
+};
+typedef struct remote_storage_vol_get_job_info_ret remote_storage_vol_get_job_info_ret;
+
+struct remote_storage_vol_abort_job_args {
+        remote_nonnull_storage_vol vol;
+        u_int flags;
+};
+typedef struct remote_storage_vol_abort_job_args remote_storage_vol_abort_job_args;
 #define REMOTE_PROGRAM 0x20008086
 #define REMOTE_PROTOCOL_VERSION 1
 
@@ -3893,6 +3955,10 @@ enum remote_procedure {
         REMOTE_PROC_DOMAIN_EVENT_CALLBACK_PMSUSPEND_DISK = 332,
         REMOTE_PROC_DOMAIN_EVENT_CALLBACK_DEVICE_REMOVED = 333,
         REMOTE_PROC_DOMAIN_CORE_DUMP_WITH_FORMAT = 334,
+        REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS = 335,
+        REMOTE_PROC_CONNECT_GET_STARTUP_PROGRESS = 336,
+        REMOTE_PROC_STORAGE_VOL_GET_JOB_INFO = 337,
+        REMOTE_PROC_STORAGE_VOL_ABORT_JOB = 338,
 };
 typedef enum remote_procedure remote_procedure;
 
@@ -4429,6 +4495,14 @@ extern  bool_t xdr_remote_connect_network_event_register_any_args (XDR *, remote
 extern  bool_t xdr_remote_connect_network_event_register_any_ret (XDR *, remote_connect_network_event_register_any_ret*);
 extern  bool_t xdr_remote_connect_network_event_deregister_any_args (XDR *, remote_connect_network_event_deregister_any_args*);
 extern  bool_t xdr_remote_network_event_lifecycle_msg (XDR *, remote_network_event_lifecycle_msg*);
+extern  bool_t xdr_remote_domain_stats_record (XDR *, remote_domain_stats_record*);
+extern  bool_t xdr_remote_connect_get_all_domain_stats_args (XDR *, remote_connect_get_all_domain_stats_args*);
+extern  bool_t xdr_remote_connect_get_all_domain_stats_ret (XDR *, remote_connect_get_all_domain_stats_ret*);
+extern  bool_t xdr_remote_connect_get_startup_progress_args (XDR *, remote_connect_get_startup_progress_args*);
+extern  bool_t xdr_remote_connect_get_startup_progress_ret (XDR *, remote_connect_get_startup_progress_ret*);
+extern  bool_t xdr_remote_storage_vol_get_job_info_args (XDR *, remote_storage_vol_get_job_info_args*);
+extern  bool_t xdr_remote_storage_vol_get_job_info_ret (XDR *, remote_storage_vol_get_job_info_ret*);
+extern  bool_t xdr_remote_storage_vol_abort_job_args (XDR *, remote_storage_vol_abort_job_args*);
 extern  bool_t xdr_remote_procedure (XDR *, remote_procedure*);
 
 #else /* K&R C */
@@ -4962,6 +5036,14 @@ extern bool_t xdr_remote_connect_network_event_register_any_args ();
 extern bool_t xdr_remote_connect_network_event_register_any_ret ();
 extern bool_t xdr_remote_connect_network_event_deregister_any_args ();
 extern bool_t xdr_remote_network_event_lifecycle_msg ();
+extern bool_t xdr_remote_domain_stats_record ();
+extern bool_t xdr_remote_connect_get_all_domain_stats_args ();
+extern bool_t xdr_remote_connect_get_all_domain_stats_ret ();
+extern bool_t xdr_remote_connect_get_startup_progress_args ();
+extern bool_t xdr_remote_connect_get_startup_progress_ret ();
+extern bool_t xdr_remote_storage_vol_get_job_info_args ();
+extern bool_t xdr_remote_storage_vol_get_job_info_ret ();
+extern bool_t xdr_remote_storage_vol_abort_job_args ();
 extern bool_t xdr_remote_procedure ();
 
 #endif /* K&R C */
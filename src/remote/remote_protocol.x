@@ -235,6 +235,9 @@ const REMOTE_DOMAIN_JOB_STATS_MAX = 64;
 /* Upper limit on number of CPU models */
 const REMOTE_CONNECT_CPU_MODELS_MAX = 8192;
 
+/* Upper limit on number of stats returned for a single domain */
+const REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX = 4096;
+
 /* UUID.  VIR_UUID_BUFLEN definition comes from libvirt.h */
 typedef opaque remote_uuid[VIR_UUID_BUFLEN];
 
@@ -2959,6 +2962,50 @@ struct remote_network_event_lifecycle_msg {
     int detail;
 };
 
+struct remote_domain_stats_record {
+    remote_nonnull_domain dom;
+    remote_typed_param params<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+};
+
+struct remote_connect_get_all_domain_stats_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int stats;
+    unsigned int flags;
+};
+
+struct remote_connect_get_all_domain_stats_ret {
+    remote_domain_stats_record retStats<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_connect_get_startup_progress_args {
+    unsigned int flags;
+};
+
+struct remote_connect_get_startup_progress_ret {
+    unsigned int completed;
+    unsigned int total;
+    int ret;
+};
+
+struct remote_storage_vol_get_job_info_args {
+    remote_nonnull_storage_vol vol;
+    unsigned int flags;
+};
+
+struct remote_storage_vol_get_job_info_ret { /* insert@1 */
+    int type;
+    int state;
+    unsigned hyper elapsed;
+    unsigned hyper processed;
+    unsigned hyper total;
+    unsigned hyper bandwidth;
+};
+
+struct remote_storage_vol_abort_job_args {
+    remote_nonnull_storage_vol vol;
+    unsigned int flags;
+};
+
 
 
 /*----- Protocol. -----*/
@@ -2985,6 +3032,11 @@ enum remote_procedure {
      *   <paramnumber> specifies at which offset the stream parameter is inserted
      *   in the function parameter list.
      *
+     * - @sparseflag: <flagname>
+     *
+     *   For streams, the flag which asks for a sparse stream, where holes
+     *   are skipped rather than sent as zeros.
+     *
      * - @priority: low|high
      *
      *   Each API that might eventually access hypervisor's monitor (and thus
@@ -4445,6 +4497,7 @@ enum remote_procedure {
     /**
      * @generate: both
      * @writestream: 1
+     * @sparseflag: VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM
      * @acl: storage_vol:data_write
      */
     REMOTE_PROC_STORAGE_VOL_UPLOAD = 208,
@@ -4452,6 +4505,7 @@ enum remote_procedure {
     /**
      * @generate: both
      * @readstream: 1
+     * @sparseflag: VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM
      * @acl: storage_vol:data_read
      */
     REMOTE_PROC_STORAGE_VOL_DOWNLOAD = 209,
@@ -5275,5 +5329,30 @@ enum remote_procedure {
      * @generate: both
      * @acl: domain:core_dump
      */
-    REMOTE_PROC_DOMAIN_CORE_DUMP_WITH_FORMAT = 334
+    REMOTE_PROC_DOMAIN_CORE_DUMP_WITH_FORMAT = 334,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS = 335,
+
+    /**
+     * @generate: none
+     * @acl: connect:read
+     */
+    REMOTE_PROC_CONNECT_GET_STARTUP_PROGRESS = 336,
+
+    /**
+     * @generate: both
+     * @acl: storage_vol:read
+     */
+    REMOTE_PROC_STORAGE_VOL_GET_JOB_INFO = 337,
+
+    /**
+     * @generate: both
+     * @acl: storage_vol:data_write
+     */
+    REMOTE_PROC_STORAGE_VOL_ABORT_JOB = 338
 };
@@ -258,6 +258,12 @@ while (<PROTOCOL>) {
             $calls{$name}->{streamflag} = "none";
         }
 
+        if (exists $opts{sparseflag}) {
+            die "\@sparseflag annotation without a stream for $constname"
+                if $calls{$name}->{streamflag} eq "none";
+            $calls{$name}->{sparseflag} = $opts{sparseflag};
+        }
+
         $calls{$name}->{acl} = $opts{acl};
         $calls{$name}->{aclfilter} = $opts{aclfilter};
 
@@ -908,7 +914,9 @@ elsif ($mode eq "server") {
             print "    if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))\n";
             print "        goto cleanup;\n";
             print "\n";
-            print "    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header)))\n";
+            my $sparse = "false";
+            $sparse = "args->flags & $call->{sparseflag}" if exists $call->{sparseflag};
+            print "    if (!(stream = daemonCreateClientStream(client, st, remoteProgram, &msg->header, $sparse)))\n";
             print "        goto cleanup;\n";
             print "\n";
         }
@@ -1491,7 +1499,9 @@ elsif ($mode eq "client") {
 
         if ($call->{streamflag} ne "none") {
             print "\n";
-            print "    if (!(netst = virNetClientStreamNew(priv->remoteProgram, $call->{constname}, priv->counter)))\n";
+            my $sparse = "false";
+            $sparse = "flags & $call->{sparseflag}" if exists $call->{sparseflag};
+            print "    if (!(netst = virNetClientStreamNew(priv->remoteProgram, $call->{constname}, priv->counter, $sparse)))\n";
             print "        goto done;\n";
             print "\n";
             print "    if (virNetClientAddStream(priv->client, netst) < 0) {\n";
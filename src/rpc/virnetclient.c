@@ -82,6 +82,11 @@ struct _virNetClient {
 
     /* For incoming message packets */
     virNetMessage msg;
+    /* Raw stream data following msg, see VIR_NET_STREAM_RAW */
+    size_t msgRaw;
+
+    /* Whether stream data is sent raw too */
+    bool rawStreams;
 
 #if WITH_SASL
     virNetSASLSessionPtr sasl;
@@ -859,6 +864,29 @@ bool virNetClientIsEncrypted(virNetClientPtr client)
 }
 
 
+/*
+ * Sends stream data raw, following VIR_NET_STREAM_RAW messages,
+ * once the server agreed to it
+ */
+void virNetClientSetRawStreams(virNetClientPtr client, bool enable)
+{
+    virObjectLock(client);
+    client->rawStreams = enable;
+    virObjectUnlock(client);
+}
+
+
+bool virNetClientHasRawStreams(virNetClientPtr client)
+{
+    bool ret;
+
+    virObjectLock(client);
+    ret = client->rawStreams;
+    virObjectUnlock(client);
+    return ret;
+}
+
+
 bool virNetClientIsOpen(virNetClientPtr client)
 {
     bool ret;
@@ -974,10 +1002,13 @@ virNetClientCallDispatchReply(virNetClientPtr client)
         return -1;
     }
 
-    if (VIR_REALLOC_N(thecall->msg->buffer, client->msg.bufferLength) < 0)
-        return -1;
-
-    memcpy(thecall->msg->buffer, client->msg.buffer, client->msg.bufferLength);
+    /* Hand over the receive buffer rather than copying it,
+     * the next read will pick up a fresh one from the pool */
+    virNetMessageFreeBuffer(thecall->msg);
+    thecall->msg->buffer = client->msg.buffer;
+    thecall->msg->bufferAlloc = client->msg.bufferAlloc;
+    client->msg.buffer = NULL;
+    client->msg.bufferAlloc = 0;
     memcpy(&thecall->msg->header, &client->msg.header, sizeof(client->msg.header));
     thecall->msg->bufferLength = client->msg.bufferLength;
     thecall->msg->bufferOffset = client->msg.bufferOffset;
@@ -1134,6 +1165,7 @@ virNetClientCallDispatch(virNetClientPtr client)
         return virNetClientCallDispatchMessage(client);
 
     case VIR_NET_STREAM: /* Stream protocol */
+    case VIR_NET_STREAM_HOLE: /* Sparse stream protocol */
         return virNetClientCallDispatchStream(client);
 
     default:
@@ -1175,7 +1207,7 @@ virNetClientIOWriteMessage(virNetClientPtr client,
         thecall->msg->donefds = 0;
         thecall->msg->bufferOffset = thecall->msg->bufferLength = 0;
         VIR_FREE(thecall->msg->fds);
-        VIR_FREE(thecall->msg->buffer);
+        virNetMessageFreeBuffer(thecall->msg);
         if (thecall->expectReply)
             thecall->mode = VIR_NET_CLIENT_MODE_WAIT_RX;
         else
@@ -1224,7 +1256,8 @@ virNetClientIOReadMessage(virNetClientPtr client)
     /* Start by reading length word */
     if (client->msg.bufferLength == 0) {
         client->msg.bufferLength = 4;
-        if (VIR_ALLOC_N(client->msg.buffer, client->msg.bufferLength) < 0)
+        if (virNetMessageAllocBuffer(&client->msg,
+                                     client->msg.bufferLength) < 0)
             return -ENOMEM;
     }
 
@@ -1274,32 +1307,59 @@ virNetClientIOHandleInput(virNetClientPtr client)
                  * next iteration.
                  */
             } else {
-                if (virNetMessageDecodeHeader(&client->msg) < 0)
-                    return -1;
-
-                if (client->msg.header.type == VIR_NET_REPLY_WITH_FDS) {
-                    size_t i;
-
-                    if (client->msg.nfds == 0 &&
-                        virNetMessageDecodeNumFDs(&client->msg) < 0)
+                if (client->msgRaw) {
+                    /* All of the raw data following a VIR_NET_STREAM_RAW
+                     * message is in, pass it on as a regular stream packet */
+                    client->msg.bufferOffset = client->msg.bufferLength -
+                                               client->msgRaw;
+                    client->msg.header.type = VIR_NET_STREAM;
+                    client->msgRaw = 0;
+                } else {
+                    if (virNetMessageDecodeHeader(&client->msg) < 0)
                         return -1;
 
-                    for (i = client->msg.donefds; i < client->msg.nfds; i++) {
-                        int rv;
-                        if ((rv = virNetSocketRecvFD(client->sock, &(client->msg.fds[i]))) < 0)
+                    if (client->msg.header.type == VIR_NET_STREAM_RAW) {
+                        size_t len;
+
+                        /* Carry on reading the raw data into the same
+                         * buffer, right after the message */
+                        if (virNetMessageDecodeRawLength(&client->msg,
+                                                         &len) < 0)
+                            return -1;
+                        client->msg.bufferOffset = client->msg.bufferLength;
+                        if (virNetMessageAllocBuffer(&client->msg,
+                                                     client->msg.bufferLength +
+                                                     len) < 0)
                             return -1;
-                        if (rv == 0) /* Blocking */
-                            break;
-                        client->msg.donefds++;
+                        client->msg.bufferLength += len;
+                        client->msgRaw = len;
+                        continue;
                     }
 
-                    if (client->msg.donefds < client->msg.nfds) {
-                        /* Because DecodeHeader/NumFDs reset bufferOffset, we
-                         * put it back to what it was, so everything works
-                         * again next time we run this method
-                         */
-                        client->msg.bufferOffset = client->msg.bufferLength;
-                        return 0; /* Blocking on more fds */
+                    if (client->msg.header.type == VIR_NET_REPLY_WITH_FDS) {
+                        size_t i;
+
+                        if (client->msg.nfds == 0 &&
+                            virNetMessageDecodeNumFDs(&client->msg) < 0)
+                            return -1;
+
+                        for (i = client->msg.donefds; i < client->msg.nfds; i++) {
+                            int rv;
+                            if ((rv = virNetSocketRecvFD(client->sock, &(client->msg.fds[i]))) < 0)
+                                return -1;
+                            if (rv == 0) /* Blocking */
+                                break;
+                            client->msg.donefds++;
+                        }
+
+                        if (client->msg.donefds < client->msg.nfds) {
+                            /* Because DecodeHeader/NumFDs reset bufferOffset, we
+                             * put it back to what it was, so everything works
+                             * again next time we run this method
+                             */
+                            client->msg.bufferOffset = client->msg.bufferLength;
+                            return 0; /* Blocking on more fds */
+                        }
                     }
                 }
 
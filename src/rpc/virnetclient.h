@@ -119,6 +119,9 @@ int virNetClientSetTLSSession(virNetClientPtr client,
 bool virNetClientIsEncrypted(virNetClientPtr client);
 bool virNetClientIsOpen(virNetClientPtr client);
 
+void virNetClientSetRawStreams(virNetClientPtr client, bool enable);
+bool virNetClientHasRawStreams(virNetClientPtr client);
+
 const char *virNetClientLocalAddrString(virNetClientPtr client);
 const char *virNetClientRemoteAddrString(virNetClientPtr client);
 
@@ -42,18 +42,21 @@ struct _virNetClientStream {
 
     virError err;
 
-    /* XXX this buffer is unbounded if the client
+    /* XXX this queue is unbounded if the client
      * app has domain events registered, since packets
      * may be read off wire, while app isn't ready to
      * recv them. Figure out how to address this some
      * time by stopping consuming any incoming data
      * off the socket....
      */
-    char *incoming;
-    size_t incomingOffset;
-    size_t incomingLength;
+    virNetMessagePtr rx;
     bool incomingEOF;
 
+    /* Holes are only exchanged on sparse streams, @holeRemaining
+     * is what is left of the one at the head of @rx */
+    bool allowSkip;
+    long long holeRemaining;
+
     virNetClientStreamEventCallback cb;
     void *cbOpaque;
     virFreeCallback cbFree;
@@ -86,9 +89,9 @@ virNetClientStreamEventTimerUpdate(virNetClientStreamPtr st)
     if (!st->cb)
         return;
 
-    VIR_DEBUG("Check timer offset=%zu %d", st->incomingOffset, st->cbEvents);
+    VIR_DEBUG("Check timer rx=%p %d", st->rx, st->cbEvents);
 
-    if (((st->incomingOffset || st->incomingEOF) &&
+    if (((st->rx || st->incomingEOF) &&
          (st->cbEvents & VIR_STREAM_EVENT_READABLE)) ||
         (st->cbEvents & VIR_STREAM_EVENT_WRITABLE)) {
         VIR_DEBUG("Enabling event timer");
@@ -110,13 +113,13 @@ virNetClientStreamEventTimer(int timer ATTRIBUTE_UNUSED, void *opaque)
 
     if (st->cb &&
         (st->cbEvents & VIR_STREAM_EVENT_READABLE) &&
-        (st->incomingOffset || st->incomingEOF))
+        (st->rx || st->incomingEOF))
         events |= VIR_STREAM_EVENT_READABLE;
     if (st->cb &&
         (st->cbEvents & VIR_STREAM_EVENT_WRITABLE))
         events |= VIR_STREAM_EVENT_WRITABLE;
 
-    VIR_DEBUG("Got Timer dispatch %d %d offset=%zu", events, st->cbEvents, st->incomingOffset);
+    VIR_DEBUG("Got Timer dispatch %d %d rx=%p", events, st->cbEvents, st->rx);
     if (events) {
         virNetClientStreamEventCallback cb = st->cb;
         void *cbOpaque = st->cbOpaque;
@@ -137,7 +140,8 @@ virNetClientStreamEventTimer(int timer ATTRIBUTE_UNUSED, void *opaque)
 
 virNetClientStreamPtr virNetClientStreamNew(virNetClientProgramPtr prog,
                                             int proc,
-                                            unsigned serial)
+                                            unsigned serial,
+                                            bool allowSkip)
 {
     virNetClientStreamPtr st;
 
@@ -150,6 +154,7 @@ virNetClientStreamPtr virNetClientStreamNew(virNetClientProgramPtr prog,
     st->prog = prog;
     st->proc = proc;
     st->serial = serial;
+    st->allowSkip = allowSkip;
 
     virObjectRef(prog);
 
@@ -161,7 +166,10 @@ void virNetClientStreamDispose(void *obj)
     virNetClientStreamPtr st = obj;
 
     virResetError(&st->err);
-    VIR_FREE(st->incoming);
+    while (st->rx) {
+        virNetMessagePtr msg = virNetMessageQueueServe(&st->rx);
+        virNetMessageFree(msg);
+    }
     virObjectUnref(st->prog);
 }
 
@@ -261,41 +269,82 @@ int virNetClientStreamSetError(virNetClientStreamPtr st,
 }
 
 
+static int
+virNetClientStreamDecodeHole(virNetMessagePtr msg,
+                             long long *length)
+{
+    virNetStreamHole data;
+    size_t offset = msg->bufferOffset;
+    size_t len = msg->bufferLength;
+    int rc;
+
+    /* Leave the message as it was, it is decoded once queued and
+     * again once at the head of the queue */
+    memset(&data, 0, sizeof(data));
+    rc = virNetMessageDecodePayload(msg, (xdrproc_t)xdr_virNetStreamHole,
+                                    &data);
+    msg->bufferOffset = offset;
+    msg->bufferLength = len;
+    if (rc < 0)
+        return -1;
+
+    if (data.length <= 0 || data.flags) {
+        virReportError(VIR_ERR_RPC,
+                       _("malformed stream hole length %lld flags %u"),
+                       (long long) data.length, data.flags);
+        return -1;
+    }
+
+    *length = data.length;
+    return 0;
+}
+
+
 int virNetClientStreamQueuePacket(virNetClientStreamPtr st,
                                   virNetMessagePtr msg)
 {
+    virNetMessagePtr tmp_msg;
     int ret = -1;
-    size_t need;
 
     virObjectLock(st);
-    need = msg->bufferLength - msg->bufferOffset;
-    if (need) {
-        size_t avail = st->incomingLength - st->incomingOffset;
-        if (need > avail) {
-            size_t extra = need - avail;
-            if (VIR_REALLOC_N(st->incoming,
-                              st->incomingLength + extra) < 0) {
-                VIR_DEBUG("Out of memory handling stream data");
-                goto cleanup;
-            }
-            st->incomingLength += extra;
-        }
 
-        memcpy(st->incoming + st->incomingOffset,
-               msg->buffer + msg->bufferOffset,
-               msg->bufferLength - msg->bufferOffset);
-        st->incomingOffset += (msg->bufferLength - msg->bufferOffset);
-    } else {
+    if (msg->header.type == VIR_NET_STREAM_HOLE) {
+        long long length;
+
+        if (!st->allowSkip) {
+            virReportError(VIR_ERR_RPC, "%s",
+                           _("unexpected stream hole"));
+            goto cleanup;
+        }
+        if (virNetClientStreamDecodeHole(msg, &length) < 0)
+            goto cleanup;
+    } else if (msg->bufferLength == msg->bufferOffset) {
         st->incomingEOF = true;
+        ret = 0;
+        goto done;
     }
 
-    VIR_DEBUG("Stream incoming data offset %zu length %zu EOF %d",
-              st->incomingOffset, st->incomingLength,
-              st->incomingEOF);
-    virNetClientStreamEventTimerUpdate(st);
+    if (!(tmp_msg = virNetMessageNew(false)))
+        goto cleanup;
 
+    /* Hand over the receive buffer rather than copying it,
+     * the next read will pick up a fresh one from the pool */
+    tmp_msg->buffer = msg->buffer;
+    tmp_msg->bufferAlloc = msg->bufferAlloc;
+    tmp_msg->bufferLength = msg->bufferLength;
+    tmp_msg->bufferOffset = msg->bufferOffset;
+    tmp_msg->header = msg->header;
+    msg->buffer = NULL;
+    msg->bufferAlloc = 0;
+    msg->bufferLength = msg->bufferOffset = 0;
+
+    virNetMessageQueuePush(&st->rx, tmp_msg);
     ret = 0;
 
+ done:
+    VIR_DEBUG("Stream incoming rx=%p EOF %d", st->rx, st->incomingEOF);
+    virNetClientStreamEventTimerUpdate(st);
+
  cleanup:
     virObjectUnlock(st);
     return ret;
@@ -309,8 +358,15 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
                                  size_t nbytes)
 {
     virNetMessagePtr msg;
+    bool raw;
     VIR_DEBUG("st=%p status=%d data=%p nbytes=%zu", st, status, data, nbytes);
 
+    /* Where the server agreed, data goes raw after the packet
+     * rather than inside it */
+    raw = status == VIR_NET_CONTINUE && nbytes &&
+        nbytes <= VIR_NET_MESSAGE_PAYLOAD_MAX &&
+        virNetClientHasRawStreams(client);
+
     if (!(msg = virNetMessageNew(false)))
         return -1;
 
@@ -319,7 +375,7 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
     msg->header.prog = virNetClientProgramGetProgram(st->prog);
     msg->header.vers = virNetClientProgramGetVersion(st->prog);
     msg->header.status = status;
-    msg->header.type = VIR_NET_STREAM;
+    msg->header.type = raw ? VIR_NET_STREAM_RAW : VIR_NET_STREAM;
     msg->header.serial = st->serial;
     msg->header.proc = st->proc;
 
@@ -332,8 +388,17 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
      * need a synchronous confirmation
      */
     if (status == VIR_NET_CONTINUE) {
-        if (virNetMessageEncodePayloadRaw(msg, data, nbytes) < 0)
+        if (raw) {
+            virNetStreamRaw rawData = { nbytes };
+
+            if (virNetMessageEncodePayload(msg,
+                                           (xdrproc_t)xdr_virNetStreamRaw,
+                                           &rawData) < 0 ||
+                virNetMessageAppendRaw(msg, data, nbytes) < 0)
+                goto error;
+        } else if (virNetMessageEncodePayloadRaw(msg, data, nbytes) < 0) {
             goto error;
+        }
 
         if (virNetClientSendNoReply(client, msg) < 0)
             goto error;
@@ -355,17 +420,71 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
     return -1;
 }
 
+int virNetClientStreamSendHole(virNetClientStreamPtr st,
+                               virNetClientPtr client,
+                               long long length,
+                               unsigned int flags)
+{
+    virNetMessagePtr msg;
+    virNetStreamHole data;
+
+    VIR_DEBUG("st=%p length=%lld flags=%x", st, length, flags);
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+
+    virObjectLock(st);
+
+    msg->header.prog = virNetClientProgramGetProgram(st->prog);
+    msg->header.vers = virNetClientProgramGetVersion(st->prog);
+    msg->header.status = VIR_NET_CONTINUE;
+    msg->header.type = VIR_NET_STREAM_HOLE;
+    msg->header.serial = st->serial;
+    msg->header.proc = st->proc;
+
+    virObjectUnlock(st);
+
+    memset(&data, 0, sizeof(data));
+    data.length = length;
+    data.flags = flags;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto error;
+
+    if (virNetMessageEncodePayload(msg,
+                                   (xdrproc_t) xdr_virNetStreamHole,
+                                   &data) < 0)
+        goto error;
+
+    /* Like data packets, holes are async fire&forget */
+    if (virNetClientSendNoReply(client, msg) < 0)
+        goto error;
+
+    virNetMessageFree(msg);
+    return 0;
+
+ error:
+    virNetMessageFree(msg);
+    return -1;
+}
+
+
 int virNetClientStreamRecvPacket(virNetClientStreamPtr st,
                                  virNetClientPtr client,
                                  char *data,
                                  size_t nbytes,
-                                 bool nonblock)
+                                 bool nonblock,
+                                 unsigned int flags)
 {
     int rv = -1;
-    VIR_DEBUG("st=%p client=%p data=%p nbytes=%zu nonblock=%d",
-              st, client, data, nbytes, nonblock);
+    size_t got = 0;
+
+    virCheckFlags(VIR_STREAM_RECV_STOP_AT_HOLE, -1);
+
+    VIR_DEBUG("st=%p client=%p data=%p nbytes=%zu nonblock=%d flags=%x",
+              st, client, data, nbytes, nonblock, flags);
     virObjectLock(st);
-    if (!st->incomingOffset && !st->incomingEOF) {
+    if (!st->rx && !st->incomingEOF) {
         virNetMessagePtr msg;
         int ret;
 
@@ -395,23 +514,40 @@ int virNetClientStreamRecvPacket(virNetClientStreamPtr st,
             goto cleanup;
     }
 
-    VIR_DEBUG("After IO %zu", st->incomingOffset);
-    if (st->incomingOffset) {
-        int want = st->incomingOffset;
-        if (want > nbytes)
-            want = nbytes;
-        memcpy(data, st->incoming, want);
-        if (want < st->incomingOffset) {
-            memmove(st->incoming, st->incoming + want, st->incomingOffset - want);
-            st->incomingOffset -= want;
+    VIR_DEBUG("After IO rx=%p", st->rx);
+    while (got < nbytes && st->rx) {
+        virNetMessagePtr msg = st->rx;
+        size_t len;
+
+        if (msg->header.type == VIR_NET_STREAM_HOLE) {
+            if (!st->holeRemaining &&
+                virNetClientStreamDecodeHole(msg, &st->holeRemaining) < 0)
+                goto cleanup;
+
+            /* Return the data up to the hole first, the caller is
+             * then to skip the hole with virNetClientStreamRecvHole */
+            if (flags & VIR_STREAM_RECV_STOP_AT_HOLE) {
+                if (got == 0)
+                    rv = -3;
+                break;
+            }
+
+            len = MIN(nbytes - got, st->holeRemaining);
+            memset(data + got, 0, len);
+            st->holeRemaining -= len;
+            if (st->holeRemaining == 0)
+                virNetMessageFree(virNetMessageQueueServe(&st->rx));
         } else {
-            VIR_FREE(st->incoming);
-            st->incomingOffset = st->incomingLength = 0;
+            len = MIN(nbytes - got, msg->bufferLength - msg->bufferOffset);
+            memcpy(data + got, msg->buffer + msg->bufferOffset, len);
+            msg->bufferOffset += len;
+            if (msg->bufferOffset == msg->bufferLength)
+                virNetMessageFree(virNetMessageQueueServe(&st->rx));
         }
-        rv = want;
-    } else {
-        rv = 0;
+        got += len;
     }
+    if (rv != -3)
+        rv = got;
 
     virNetClientStreamEventTimerUpdate(st);
 
@@ -421,6 +557,34 @@ int virNetClientStreamRecvPacket(virNetClientStreamPtr st,
 }
 
 
+int virNetClientStreamRecvHole(virNetClientStreamPtr st,
+                               long long *length)
+{
+    int ret = -1;
+
+    virObjectLock(st);
+
+    *length = 0;
+    if (st->rx && st->rx->header.type == VIR_NET_STREAM_HOLE) {
+        if (!st->holeRemaining &&
+            virNetClientStreamDecodeHole(st->rx, &st->holeRemaining) < 0)
+            goto cleanup;
+
+        *length = st->holeRemaining;
+        st->holeRemaining = 0;
+        virNetMessageFree(virNetMessageQueueServe(&st->rx));
+    }
+
+    VIR_DEBUG("st=%p length=%lld", st, *length);
+    virNetClientStreamEventTimerUpdate(st);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(st);
+    return ret;
+}
+
+
 int virNetClientStreamEventAddCallback(virNetClientStreamPtr st,
                                        int events,
                                        virNetClientStreamEventCallback cb,
@@ -34,7 +34,8 @@ typedef void (*virNetClientStreamEventCallback)(virNetClientStreamPtr stream,
 
 virNetClientStreamPtr virNetClientStreamNew(virNetClientProgramPtr prog,
                                             int proc,
-                                            unsigned serial);
+                                            unsigned serial,
+                                            bool allowSkip);
 
 bool virNetClientStreamRaiseError(virNetClientStreamPtr st);
 
@@ -53,11 +54,20 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
                                  const char *data,
                                  size_t nbytes);
 
+int virNetClientStreamSendHole(virNetClientStreamPtr st,
+                               virNetClientPtr client,
+                               long long length,
+                               unsigned int flags);
+
 int virNetClientStreamRecvPacket(virNetClientStreamPtr st,
                                  virNetClientPtr client,
                                  char *data,
                                  size_t nbytes,
-                                 bool nonblock);
+                                 bool nonblock,
+                                 unsigned int flags);
+
+int virNetClientStreamRecvHole(virNetClientStreamPtr st,
+                               long long *length);
 
 int virNetClientStreamEventAddCallback(virNetClientStreamPtr st,
                                        int events,
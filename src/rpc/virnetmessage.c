@@ -23,18 +23,195 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-#include "virnetmessage.h"
+#define __VIR_NET_MESSAGE_PRIV_H_ALLOW__
+#include "virnetmessagepriv.h"
 #include "viralloc.h"
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
 #include "virutil.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/*
+ * Message buffers are recycled through a small set of size
+ * classes instead of being freed once the message has been
+ * sent or dispatched. The classes match the sizes that
+ * virNetMessageEncodePayload grows the buffer through, so
+ * the common case of a message with a small payload never
+ * hits malloc/realloc once the daemon / client has warmed up.
+ *
+ * Released buffers are kept on a singly linked free list,
+ * using the first bytes of the buffer itself as the link.
+ * Requests larger than the biggest class are allocated on
+ * demand and freed immediately after use.
+ */
+typedef struct _virNetMessageBufferClass virNetMessageBufferClass;
+typedef virNetMessageBufferClass *virNetMessageBufferClassPtr;
+struct _virNetMessageBufferClass {
+    size_t size;
+    size_t max;     /* Max number of idle buffers to retain */
+    size_t nfree;
+    char *free;
+};
+
+static virNetMessageBufferClass virNetMessageBufferClasses[] = {
+    { VIR_NET_MESSAGE_LEN_MAX + VIR_NET_MESSAGE_INITIAL, 32, 0, NULL },
+    { VIR_NET_MESSAGE_LEN_MAX + VIR_NET_MESSAGE_INITIAL * 4, 8, 0, NULL },
+    { VIR_NET_MESSAGE_LEN_MAX + VIR_NET_MESSAGE_INITIAL * 16, 2, 0, NULL },
+    { VIR_NET_MESSAGE_LEN_MAX + VIR_NET_MESSAGE_INITIAL * 64, 1, 0, NULL },
+};
+
+static virMutex virNetMessageBufferLock = VIR_MUTEX_INITIALIZER;
+
+
+static virNetMessageBufferClassPtr
+virNetMessageBufferClassFind(size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_CARDINALITY(virNetMessageBufferClasses); i++) {
+        if (len <= virNetMessageBufferClasses[i].size)
+            return &virNetMessageBufferClasses[i];
+    }
+
+    return NULL;
+}
+
+
+/*
+ * @msg: the message whose buffer to release
+ *
+ * Releases the message buffer, returning it to the pool of
+ * idle buffers if it was allocated by virNetMessageAllocBuffer
+ * and the pool for its size class is not already full.
+ */
+void virNetMessageFreeBuffer(virNetMessagePtr msg)
+{
+    virNetMessageBufferClassPtr klass = NULL;
+
+    if (!msg->buffer)
+        return;
+
+    if (msg->bufferAlloc &&
+        (klass = virNetMessageBufferClassFind(msg->bufferAlloc)) &&
+        klass->size == msg->bufferAlloc) {
+        virMutexLock(&virNetMessageBufferLock);
+        if (klass->nfree < klass->max) {
+            memcpy(msg->buffer, &klass->free, sizeof(klass->free));
+            klass->free = msg->buffer;
+            klass->nfree++;
+            msg->buffer = NULL;
+        }
+        virMutexUnlock(&virNetMessageBufferLock);
+    }
+
+    VIR_FREE(msg->buffer);
+    msg->bufferAlloc = 0;
+}
+
+
+/*
+ * @msg: the message whose buffer to grow
+ * @len: the minimum required buffer size
+ *
+ * Ensures that the message buffer is at least @len bytes
+ * long, taking a recycled buffer from the pool if one is
+ * available. The first bufferOffset bytes of any existing
+ * buffer contents are preserved. The caller remains responsible
+ * for updating bufferLength.
+ *
+ * returns 0 on success, -1 on OOM
+ */
+int virNetMessageAllocBuffer(virNetMessagePtr msg, size_t len)
+{
+    virNetMessageBufferClassPtr klass;
+    char *buffer = NULL;
+    size_t size = len;
+
+    if (msg->buffer && msg->bufferAlloc >= len)
+        return 0;
+
+    if ((klass = virNetMessageBufferClassFind(len))) {
+        size = klass->size;
+        virMutexLock(&virNetMessageBufferLock);
+        if (klass->free) {
+            buffer = klass->free;
+            memcpy(&klass->free, buffer, sizeof(klass->free));
+            klass->nfree--;
+        }
+        virMutexUnlock(&virNetMessageBufferLock);
+    }
+
+    if (!buffer && VIR_ALLOC_N(buffer, size) < 0)
+        return -1;
+
+    if (msg->buffer && msg->bufferOffset)
+        memcpy(buffer, msg->buffer, msg->bufferOffset);
+
+    virNetMessageFreeBuffer(msg);
+    msg->buffer = buffer;
+    msg->bufferAlloc = size;
+
+    VIR_DEBUG("msg=%p buffer size=%zu (wanted %zu)", msg, size, len);
+    return 0;
+}
+
+
+/*
+ * @len: a buffer size
+ * @size: filled with the size of buffers in the class serving @len
+ * @nfree: filled with the number of idle buffers of that class
+ * @max: filled with the number of idle buffers the class retains
+ *
+ * returns 0 on success, -1 if buffers of @len bytes are not pooled
+ */
+int virNetMessageBufferPoolGetStats(size_t len,
+                                    size_t *size,
+                                    size_t *nfree,
+                                    size_t *max)
+{
+    virNetMessageBufferClassPtr klass;
+
+    if (!(klass = virNetMessageBufferClassFind(len)))
+        return -1;
+
+    virMutexLock(&virNetMessageBufferLock);
+    *size = klass->size;
+    *nfree = klass->nfree;
+    *max = klass->max;
+    virMutexUnlock(&virNetMessageBufferLock);
+
+    return 0;
+}
+
+
+/*
+ * Frees all idle buffers of every size class.
+ */
+void virNetMessageBufferPoolDrain(void)
+{
+    size_t i;
+    char *buffer;
+
+    virMutexLock(&virNetMessageBufferLock);
+    for (i = 0; i < ARRAY_CARDINALITY(virNetMessageBufferClasses); i++) {
+        virNetMessageBufferClassPtr klass = &virNetMessageBufferClasses[i];
+
+        while ((buffer = klass->free)) {
+            memcpy(&klass->free, buffer, sizeof(klass->free));
+            VIR_FREE(buffer);
+        }
+        klass->nfree = 0;
+    }
+    virMutexUnlock(&virNetMessageBufferLock);
+}
+
+
 virNetMessagePtr virNetMessageNew(bool tracked)
 {
     virNetMessagePtr msg;
@@ -59,7 +236,9 @@ void virNetMessageClear(virNetMessagePtr msg)
     for (i = 0; i < msg->nfds; i++)
         VIR_FORCE_CLOSE(msg->fds[i]);
     VIR_FREE(msg->fds);
-    VIR_FREE(msg->buffer);
+    if (msg->rawLength)
+        VIR_FORCE_CLOSE(msg->rawFD);
+    virNetMessageFreeBuffer(msg);
     memset(msg, 0, sizeof(*msg));
     msg->tracked = tracked;
 }
@@ -78,7 +257,9 @@ void virNetMessageFree(virNetMessagePtr msg)
 
     for (i = 0; i < msg->nfds; i++)
         VIR_FORCE_CLOSE(msg->fds[i]);
-    VIR_FREE(msg->buffer);
+    if (msg->rawLength)
+        VIR_FORCE_CLOSE(msg->rawFD);
+    virNetMessageFreeBuffer(msg);
     VIR_FREE(msg->fds);
     VIR_FREE(msg);
 }
@@ -144,7 +325,7 @@ int virNetMessageDecodeLength(virNetMessagePtr msg)
     /* Extend our declared buffer length and carry
        on reading the header + payload */
     msg->bufferLength += len;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageAllocBuffer(msg, msg->bufferLength) < 0)
         goto cleanup;
 
     VIR_DEBUG("Got length, now need %zu total (%u more)",
@@ -220,10 +401,11 @@ int virNetMessageEncodeHeader(virNetMessagePtr msg)
     int ret = -1;
     unsigned int len = 0;
 
-    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
-        return ret;
     msg->bufferOffset = 0;
+    if (virNetMessageAllocBuffer(msg, VIR_NET_MESSAGE_INITIAL +
+                                 VIR_NET_MESSAGE_LEN_MAX) < 0)
+        return ret;
+    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
 
     /* Format the header. */
     xdrmem_create(&xdr,
@@ -348,19 +530,34 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
 
     /* Try to encode the payload. If the buffer is too small increase it. */
     while (!(*filter)(&xdr, data, 0)) {
+#if HAVE_XDR_SIZEOF
+        /* Rather than repeatedly growing the buffer and re-encoding
+         * the whole payload each time, ask XDR how much space the
+         * payload needs and grow straight to that size */
+        unsigned long payloadlen = xdr_sizeof(filter, data);
+        unsigned int newlen = msg->bufferOffset - VIR_NET_MESSAGE_LEN_MAX;
+
+        if (payloadlen == 0 ||
+            payloadlen > VIR_NET_MESSAGE_MAX - newlen ||
+            msg->bufferOffset + payloadlen <= msg->bufferLength) {
+            virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message payload"));
+            goto error;
+        }
+        newlen += payloadlen;
+#else
         unsigned int newlen = (msg->bufferLength - VIR_NET_MESSAGE_LEN_MAX) * 4;
 
         if (newlen > VIR_NET_MESSAGE_MAX) {
             virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message payload"));
             goto error;
         }
+#endif
 
         xdr_destroy(&xdr);
 
-        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageAllocBuffer(msg, newlen + VIR_NET_MESSAGE_LEN_MAX) < 0)
             goto error;
+        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
 
         xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
                       msg->bufferLength - msg->bufferOffset, XDR_ENCODE);
@@ -420,13 +617,21 @@ int virNetMessageDecodePayload(virNetMessagePtr msg,
 }
 
 
-int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
-                                  const char *data,
-                                  size_t len)
+/*
+ * @msg: the outgoing message, whose header has been encoded
+ * @len: the amount of raw payload data to make room for
+ *
+ * Ensures there is space for @len bytes of raw payload after the
+ * message header and returns a pointer to where it should be
+ * written. This allows stream data to be read directly into the
+ * message buffer, after which virNetMessageEncodePayloadRawCommit
+ * must be called with the amount of data actually written.
+ *
+ * returns pointer to the payload area, or NULL on error
+ */
+char *virNetMessageEncodePayloadRawReserve(virNetMessagePtr msg,
+                                           size_t len)
 {
-    XDR xdr;
-    unsigned int msglen;
-
     /* If the message buffer is too small for the payload increase it accordingly. */
     if ((msg->bufferLength - msg->bufferOffset) < len) {
         if ((msg->bufferOffset + len) >
@@ -438,37 +643,49 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
                            VIR_NET_MESSAGE_MAX +
                            VIR_NET_MESSAGE_LEN_MAX -
                            msg->bufferOffset);
-            return -1;
+            return NULL;
         }
 
         msg->bufferLength = msg->bufferOffset + len;
 
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
-            return -1;
+        if (virNetMessageAllocBuffer(msg, msg->bufferLength) < 0)
+            return NULL;
 
         VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
     }
 
-    memcpy(msg->buffer + msg->bufferOffset, data, len);
-    msg->bufferOffset += len;
+    return msg->buffer + msg->bufferOffset;
+}
 
-    /* Re-encode the length word. */
-    VIR_DEBUG("Encode length as %zu", msg->bufferOffset);
-    xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
-    msglen = msg->bufferOffset;
-    if (!xdr_u_int(&xdr, &msglen)) {
-        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message length"));
-        goto error;
+
+int virNetMessageEncodePayloadRawCommit(virNetMessagePtr msg,
+                                        size_t len)
+{
+    if ((msg->bufferLength - msg->bufferOffset) < len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Raw payload length %zu exceeds reserved space %zu"),
+                       len, msg->bufferLength - msg->bufferOffset);
+        return -1;
     }
-    xdr_destroy(&xdr);
 
-    msg->bufferLength = msg->bufferOffset;
-    msg->bufferOffset = 0;
-    return 0;
+    msg->bufferOffset += len;
 
- error:
-    xdr_destroy(&xdr);
-    return -1;
+    return virNetMessageEncodePayloadEmpty(msg);
+}
+
+
+int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
+                                  const char *data,
+                                  size_t len)
+{
+    char *payload;
+
+    if (!(payload = virNetMessageEncodePayloadRawReserve(msg, len)))
+        return -1;
+
+    memcpy(payload, data, len);
+
+    return virNetMessageEncodePayloadRawCommit(msg, len);
 }
 
 
@@ -497,6 +714,73 @@ int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 }
 
 
+/*
+ * @msg: the outgoing message, fully encoded
+ * @data: the raw stream data to send after the message
+ * @len: the length of @data
+ *
+ * Appends @data to the message buffer, following the message
+ * rather than as part of it, the way the data announced by a
+ * VIR_NET_STREAM_RAW message goes on the wire
+ *
+ * returns 0 on success, -1 on OOM
+ */
+int virNetMessageAppendRaw(virNetMessagePtr msg,
+                           const char *data,
+                           size_t len)
+{
+    size_t msglen = msg->bufferLength;
+
+    /* AllocBuffer only keeps the bufferOffset first bytes */
+    msg->bufferOffset = msglen;
+    if (virNetMessageAllocBuffer(msg, msglen + len) < 0) {
+        msg->bufferOffset = 0;
+        return -1;
+    }
+
+    memcpy(msg->buffer + msglen, data, len);
+    msg->bufferLength = msglen + len;
+    msg->bufferOffset = 0;
+    return 0;
+}
+
+
+/*
+ * @msg: the incoming VIR_NET_STREAM_RAW message, whose header is decoded
+ * @len: filled with the amount of raw data following the message
+ *
+ * Decodes the payload of the message, leaving the message as it
+ * was so that it can be decoded again.
+ *
+ * returns 0 on success, -1 if the payload is invalid
+ */
+int virNetMessageDecodeRawLength(virNetMessagePtr msg,
+                                 size_t *len)
+{
+    size_t offset = msg->bufferOffset;
+    size_t length = msg->bufferLength;
+    virNetStreamRaw data;
+    int ret;
+
+    memset(&data, 0, sizeof(data));
+    ret = virNetMessageDecodePayload(msg, (xdrproc_t)xdr_virNetStreamRaw,
+                                     &data);
+    msg->bufferOffset = offset;
+    msg->bufferLength = length;
+    if (ret < 0)
+        return -1;
+
+    if (data.length == 0 || data.length > VIR_NET_MESSAGE_PAYLOAD_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("invalid raw stream data length %u"), data.length);
+        return -1;
+    }
+
+    *len = data.length;
+    return 0;
+}
+
+
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
 {
     /* This func may be called several times & the first
@@ -38,6 +38,7 @@ struct _virNetMessage {
                   /* Maximum   VIR_NET_MESSAGE_MAX     + VIR_NET_MESSAGE_LEN_MAX */
     size_t bufferLength;
     size_t bufferOffset;
+    size_t bufferAlloc; /* Allocated size, if from virNetMessageAllocBuffer */
 
     virNetMessageHeader header;
 
@@ -48,6 +49,12 @@ struct _virNetMessage {
     int *fds;
     size_t donefds;
 
+    /* Stream data sent raw after the message, see VIR_NET_STREAM_RAW:
+     * @rawLength bytes are still to be spliced from @rawFD, which the
+     * message owns for as long as that is non-zero */
+    int rawFD;
+    size_t rawLength;
+
     virNetMessagePtr next;
 };
 
@@ -58,6 +65,11 @@ void virNetMessageClear(virNetMessagePtr);
 
 void virNetMessageFree(virNetMessagePtr msg);
 
+int virNetMessageAllocBuffer(virNetMessagePtr msg, size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+void virNetMessageFreeBuffer(virNetMessagePtr msg)
+    ATTRIBUTE_NONNULL(1);
+
 virNetMessagePtr virNetMessageQueueServe(virNetMessagePtr *queue)
     ATTRIBUTE_NONNULL(1);
 void virNetMessageQueuePush(virNetMessagePtr *queue,
@@ -83,10 +95,24 @@ int virNetMessageDecodePayload(virNetMessagePtr msg,
 int virNetMessageEncodeNumFDs(virNetMessagePtr msg);
 int virNetMessageDecodeNumFDs(virNetMessagePtr msg);
 
+int virNetMessageAppendRaw(virNetMessagePtr msg,
+                           const char *data,
+                           size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageDecodeRawLength(virNetMessagePtr msg,
+                                 size_t *len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+
 int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
                                   const char *buf,
                                   size_t len)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+char *virNetMessageEncodePayloadRawReserve(virNetMessagePtr msg,
+                                           size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageEncodePayloadRawCommit(virNetMessagePtr msg,
+                                        size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
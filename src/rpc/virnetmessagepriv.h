@@ -0,0 +1,39 @@
+/*
+ * virnetmessagepriv.h: Functions for testing the message buffer pool
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_NET_MESSAGE_PRIV_H_ALLOW__
+# error "virnetmessagepriv.h may only be included by virnetmessage.c or test suites"
+#endif
+
+#ifndef __VIR_NET_MESSAGE_PRIV_H__
+# define __VIR_NET_MESSAGE_PRIV_H__
+
+# include "virnetmessage.h"
+
+int virNetMessageBufferPoolGetStats(size_t len,
+                                    size_t *size,
+                                    size_t *nfree,
+                                    size_t *max)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3) ATTRIBUTE_NONNULL(4);
+
+void virNetMessageBufferPoolDrain(void);
+
+#endif /* __VIR_NET_MESSAGE_PRIV_H__ */
@@ -107,6 +107,12 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *  - type == VIR_NET_STREAM
  *      * serial matches that from the corresponding VIR_NET_CALL
  *
+ *  - type == VIR_NET_STREAM_HOLE
+ *      * serial matches that from the corresponding VIR_NET_CALL
+ *
+ *  - type == VIR_NET_STREAM_RAW
+ *      * serial matches that from the corresponding VIR_NET_CALL
+ *
  * and the 'status' field varies according to:
  *
  *  - type == VIR_NET_CALL
@@ -124,6 +130,12 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *     * VIR_NET_OK if stream is complete
  *     * VIR_NET_ERROR if stream had an error
  *
+ *  - type == VIR_NET_STREAM_HOLE
+ *     * VIR_NET_CONTINUE always
+ *
+ *  - type == VIR_NET_STREAM_RAW
+ *     * VIR_NET_CONTINUE always
+ *
  * Payload varies according to type and status:
  *
  *  - type == VIR_NET_CALL
@@ -147,6 +159,15 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *     * status == VIR_NET_OK
  *          <empty>
  *
+ *  - type == VIR_NET_STREAM_HOLE
+ *     * status == VIR_NET_CONTINUE
+ *          virNetStreamHole  hole to skip, in place of as many zeros
+ *
+ *  - type == VIR_NET_STREAM_RAW
+ *     * status == VIR_NET_CONTINUE
+ *          virNetStreamRaw   amount of stream data that follows the
+ *                            message on the wire, outside its length
+ *
  *  - type == VIR_NET_CALL_WITH_FDS
  *          int8 - number of FDs
  *          XXX_args  for procedure
@@ -171,7 +192,12 @@ enum virNetMessageType {
     /* client -> server. args from a method call, with passed FDs */
     VIR_NET_CALL_WITH_FDS = 4,
     /* server -> client. reply/error from a method call, with passed FDs */
-    VIR_NET_REPLY_WITH_FDS = 5
+    VIR_NET_REPLY_WITH_FDS = 5,
+    /* either direction. stream hole, only on sparse streams */
+    VIR_NET_STREAM_HOLE = 6,
+    /* either direction. stream data sent raw after the message, only
+     * once VIR_DRV_FEATURE_REMOTE_STREAM_RAW has been negotiated */
+    VIR_NET_STREAM_RAW = 7
 };
 
 enum virNetMessageStatus {
@@ -251,3 +277,15 @@ struct virNetMessageError {
     int int2;
     virNetMessageNetwork net; /* unused */
 };
+
+/* Hole in a sparse stream, see virStreamSendHole */
+struct virNetStreamHole {
+    hyper length;
+    unsigned int flags;
+};
+
+/* Raw stream data, the @length bytes of which directly follow the
+ * message. At most VIR_NET_MESSAGE_PAYLOAD_MAX */
+struct virNetStreamRaw {
+    unsigned int length;
+};
@@ -38,6 +38,7 @@
 #include "virprobe.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "virfile.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -105,6 +106,16 @@ struct _virNetServerClient
     virNetServerClientDispatchFunc dispatchFunc;
     void *dispatchOpaque;
 
+    /* Stream data may follow messages raw, see VIR_NET_STREAM_RAW.
+     * No message is read while @rawPending bytes of such data are
+     * left in the socket, which is then only watched for @rawFunc or
+     * to throw the data away */
+    bool rawStreams;
+    size_t rawPending;
+    bool rawDiscard;
+    virNetServerClientRawFunc rawFunc;
+    void *rawOpaque;
+
     void *privateData;
     virFreeCallback privateDataFreeFunc;
     virNetServerClientPrivPreExecRestart privateDataPreExecRestart;
@@ -134,6 +145,7 @@ VIR_ONCE_GLOBAL_INIT(virNetServerClient)
 static void virNetServerClientDispatchEvent(virNetSocketPtr sock, int events, void *opaque);
 static void virNetServerClientUpdateEvent(virNetServerClientPtr client);
 static void virNetServerClientDispatchRead(virNetServerClientPtr client);
+static void virNetServerClientDispatchRaw(virNetServerClientPtr client);
 static int virNetServerClientSendMessageLocked(virNetServerClientPtr client,
                                                virNetMessagePtr msg);
 
@@ -178,9 +190,14 @@ virNetServerClientCalculateHandleMode(virNetServerClientPtr client)
 #endif
         /* If there is a message on the rx queue, and
          * we're not in middle of a delayedClose, then
-         * we're wanting more input */
-        if (client->rx && !client->delayedClose)
+         * we're wanting more input. Raw stream data has
+         * to be out of the way first though */
+        if (client->rawPending) {
+            if (client->rawFunc || client->rawDiscard)
+                mode |= VIR_EVENT_HANDLE_READABLE;
+        } else if (client->rx && !client->delayedClose) {
             mode |= VIR_EVENT_HANDLE_READABLE;
+        }
 
         /* If there are one or more messages to send back to client,
            then monitor for writability on socket */
@@ -379,7 +396,7 @@ virNetServerClientNewInternal(virNetSocketPtr sock,
     if (!(client->rx = virNetMessageNew(true)))
         goto error;
     client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_ALLOC_N(client->rx->buffer, client->rx->bufferLength) < 0)
+    if (virNetMessageAllocBuffer(client->rx, client->rx->bufferLength) < 0)
         goto error;
     client->nrequests = 1;
 
@@ -1203,6 +1220,21 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
             return;
         }
 
+        /* The raw data following the message stays in the socket
+         * until the stream it is for takes it */
+        if (msg->header.type == VIR_NET_STREAM_RAW) {
+            if (!client->rawStreams)
+                virReportError(VIR_ERR_RPC, "%s",
+                               _("raw stream data was not negotiated"));
+            if (!client->rawStreams ||
+                virNetMessageDecodeRawLength(msg, &client->rawPending) < 0) {
+                virNetMessageQueueServe(&client->rx);
+                virNetMessageFree(msg);
+                client->wantClose = true;
+                return;
+            }
+        }
+
         /* Definitely finished reading, so remove from queue */
         virNetMessageQueueServe(&client->rx);
         PROBE(RPC_SERVER_CLIENT_MSG_RX,
@@ -1244,6 +1276,10 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
 
         /* Send off to for normal dispatch to workers */
         if (msg) {
+            /* No stream wants the raw data */
+            if (msg->header.type == VIR_NET_STREAM_RAW)
+                client->rawDiscard = true;
+
             virObjectRef(client);
             if (!client->dispatchFunc ||
                 client->dispatchFunc(client, msg, client->dispatchOpaque) < 0) {
@@ -1260,8 +1296,8 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
                 client->wantClose = true;
             } else {
                 client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                if (VIR_ALLOC_N(client->rx->buffer,
-                                client->rx->bufferLength) < 0) {
+                if (virNetMessageAllocBuffer(client->rx,
+                                             client->rx->bufferLength) < 0) {
                     client->wantClose = true;
                 } else {
                     client->nrequests++;
@@ -1273,6 +1309,57 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
 }
 
 
+/*
+ * Raw stream data is pending in the socket, and the socket became
+ * readable: tell the stream taking the data, or throw the data away
+ * if there is no such stream
+ */
+static void virNetServerClientDispatchRaw(virNetServerClientPtr client)
+{
+    char *buf = NULL;
+    size_t len = client->rawPending;
+    ssize_t ret;
+
+    if (client->rawFunc) {
+        virNetServerClientRawFunc func = client->rawFunc;
+        void *opaque = client->rawOpaque;
+
+        client->rawFunc = NULL;
+        client->rawOpaque = NULL;
+        virNetServerClientUpdateEvent(client);
+
+        virObjectRef(client);
+        virObjectUnlock(client);
+        func(client, opaque);
+        virObjectLock(client);
+        virObjectUnref(client);
+        return;
+    }
+
+    if (!client->rawDiscard)
+        return;
+
+    if (len > VIR_NET_MESSAGE_INITIAL)
+        len = VIR_NET_MESSAGE_INITIAL;
+    if (VIR_ALLOC_N(buf, len) < 0) {
+        client->wantClose = true;
+        return;
+    }
+
+    if ((ret = virNetSocketRead(client->sock, buf, len)) < 0) {
+        client->wantClose = true;
+    } else {
+        client->rawPending -= ret;
+        if (!client->rawPending) {
+            client->rawDiscard = false;
+            virNetServerClientUpdateEvent(client);
+        }
+    }
+
+    VIR_FREE(buf);
+}
+
+
 /*
  * Send client->tx using no encoding
  *
@@ -1341,6 +1428,24 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                 client->tx->donefds++;
             }
 
+            /* Raw stream data goes right after the message */
+            while (client->tx->rawLength) {
+                ssize_t ret;
+
+                ret = virNetSocketSpliceFrom(client->sock,
+                                             client->tx->rawFD,
+                                             client->tx->rawLength);
+                if (ret < 0) {
+                    client->wantClose = true;
+                    return;
+                }
+                if (ret == 0)
+                    return; /* Would block on write EAGAIN */
+                client->tx->rawLength -= ret;
+                if (!client->tx->rawLength)
+                    VIR_FORCE_CLOSE(client->tx->rawFD);
+            }
+
 #if WITH_SASL
             /* Completed this 'tx' operation, so now read for all
              * future rx/tx to be under a SASL SSF layer
@@ -1363,7 +1468,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                     /* Ready to recv more messages */
                     virNetMessageClear(msg);
                     msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0) {
+                    if (virNetMessageAllocBuffer(msg, msg->bufferLength) < 0) {
                         virNetMessageFree(msg);
                         return;
                     }
@@ -1433,9 +1538,12 @@ virNetServerClientDispatchEvent(virNetSocketPtr sock, int events, void *opaque)
 #endif
             if (events & VIR_EVENT_HANDLE_WRITABLE)
                 virNetServerClientDispatchWrite(client);
-            if (events & VIR_EVENT_HANDLE_READABLE &&
-                client->rx)
-                virNetServerClientDispatchRead(client);
+            if (events & VIR_EVENT_HANDLE_READABLE) {
+                if (client->rawPending)
+                    virNetServerClientDispatchRaw(client);
+                else if (client->rx)
+                    virNetServerClientDispatchRead(client);
+            }
 #if WITH_GNUTLS
         }
 #endif
@@ -1489,6 +1597,151 @@ int virNetServerClientSendMessage(virNetServerClientPtr client,
 }
 
 
+/*
+ * @client: the client to enable raw stream data for
+ *
+ * Lets stream data be exchanged raw with the client, following
+ * VIR_NET_STREAM_RAW messages. That is only possible when nothing
+ * encodes the data on the socket.
+ *
+ * Returns true if raw stream data is enabled
+ */
+bool virNetServerClientEnableRawStreams(virNetServerClientPtr client)
+{
+    bool enabled;
+
+    virObjectLock(client);
+    if (client->sock &&
+#if WITH_SASL
+        !client->sasl &&
+#endif
+        virNetSocketCanSplice(client->sock))
+        client->rawStreams = true;
+    enabled = client->rawStreams;
+    virObjectUnlock(client);
+
+    return enabled;
+}
+
+
+bool virNetServerClientHasRawStreams(virNetServerClientPtr client)
+{
+    bool enabled;
+
+    virObjectLock(client);
+    enabled = client->rawStreams;
+    virObjectUnlock(client);
+
+    return enabled;
+}
+
+
+/*
+ * Returns how much of the raw data following the last
+ * VIR_NET_STREAM_RAW message from the client is still to be taken
+ */
+size_t virNetServerClientGetRawPending(virNetServerClientPtr client)
+{
+    size_t pending;
+
+    virObjectLock(client);
+    pending = client->rawPending;
+    virObjectUnlock(client);
+
+    return pending;
+}
+
+
+/*
+ * @client: the client with raw stream data pending
+ * @fd: a pipe to move the data to, or -1
+ * @buf: where to read the data to if @fd is -1
+ * @len: the most data to take
+ *
+ * Takes raw stream data sent by the client, either splicing it
+ * from the socket to @fd or reading it into @buf. Messages are
+ * read from the client again once all of the data is taken.
+ *
+ * Returns the amount of data taken, 0 if the client did not send
+ * any more yet, -2 if @fd is full, or -1 on error
+ */
+ssize_t virNetServerClientRecvRaw(virNetServerClientPtr client,
+                                  int fd,
+                                  char *buf,
+                                  size_t len)
+{
+    ssize_t ret = -1;
+
+    virObjectLock(client);
+
+    if (!client->sock || client->wantClose) {
+        virReportError(VIR_ERR_RPC, "%s", _("client is closed"));
+        goto cleanup;
+    }
+
+    if (!client->rawPending) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("no raw stream data pending"));
+        goto cleanup;
+    }
+
+    if (len > client->rawPending)
+        len = client->rawPending;
+
+    if (fd < 0)
+        ret = virNetSocketRead(client->sock, buf, len);
+    else
+        ret = virNetSocketSpliceTo(client->sock, fd, len);
+
+    if (ret > 0) {
+        client->rawPending -= ret;
+        if (!client->rawPending)
+            virNetServerClientUpdateEvent(client);
+    }
+
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+/*
+ * @client: the client with raw stream data pending
+ * @func: the function to call
+ * @opaque: data for @func
+ *
+ * Has @func called, once, when more raw stream data from the client
+ * can be taken. It is called without the client being locked.
+ */
+void virNetServerClientWaitRaw(virNetServerClientPtr client,
+                               virNetServerClientRawFunc func,
+                               void *opaque)
+{
+    virObjectLock(client);
+    client->rawFunc = func;
+    client->rawOpaque = opaque;
+    virNetServerClientUpdateEvent(client);
+    virObjectUnlock(client);
+}
+
+
+/*
+ * @client: the client with raw stream data pending
+ *
+ * Throws away the raw stream data that is left, when the
+ * stream it is for is gone
+ */
+void virNetServerClientDiscardRaw(virNetServerClientPtr client)
+{
+    virObjectLock(client);
+    if (client->rawPending) {
+        client->rawDiscard = true;
+        virNetServerClientUpdateEvent(client);
+    }
+    virObjectUnlock(client);
+}
+
+
 bool virNetServerClientNeedAuth(virNetServerClientPtr client)
 {
     bool need = false;
@@ -49,6 +49,9 @@ typedef void *(*virNetServerClientPrivNewPostExecRestart)(virNetServerClientPtr
 typedef void *(*virNetServerClientPrivNew)(virNetServerClientPtr client,
                                            void *opaque);
 
+typedef void (*virNetServerClientRawFunc)(virNetServerClientPtr client,
+                                          void *opaque);
+
 virNetServerClientPtr virNetServerClientNew(virNetSocketPtr sock,
                                             int auth,
                                             bool readonly,
@@ -141,5 +144,17 @@ int virNetServerClientSendMessage(virNetServerClientPtr client,
 
 bool virNetServerClientNeedAuth(virNetServerClientPtr client);
 
+bool virNetServerClientEnableRawStreams(virNetServerClientPtr client);
+bool virNetServerClientHasRawStreams(virNetServerClientPtr client);
+size_t virNetServerClientGetRawPending(virNetServerClientPtr client);
+ssize_t virNetServerClientRecvRaw(virNetServerClientPtr client,
+                                  int fd,
+                                  char *buf,
+                                  size_t len);
+void virNetServerClientWaitRaw(virNetServerClientPtr client,
+                               virNetServerClientRawFunc func,
+                               void *opaque);
+void virNetServerClientDiscardRaw(virNetServerClientPtr client);
+
 
 #endif /* __VIR_NET_SERVER_CLIENT_H__ */
@@ -207,7 +207,10 @@ virNetServerProgramSendReplyError(virNetServerProgramPtr prog,
                                         msg,
                                         rerr,
                                         req->proc,
-                                        req->type == VIR_NET_STREAM ? VIR_NET_STREAM : VIR_NET_REPLY,
+                                        (req->type == VIR_NET_STREAM ||
+                                         req->type == VIR_NET_STREAM_HOLE ||
+                                         req->type == VIR_NET_STREAM_RAW) ?
+                                        VIR_NET_STREAM : VIR_NET_REPLY,
                                         req->serial);
 }
 
@@ -308,6 +311,8 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
         break;
 
     case VIR_NET_STREAM:
+    case VIR_NET_STREAM_HOLE:
+    case VIR_NET_STREAM_RAW:
         /* Since stream data is non-acked, async, we may continue to receive
          * stream packets after we closed down a stream. Just drop & ignore
          * these.
@@ -548,6 +553,126 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
 }
 
 
+int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
+                                      virNetServerClientPtr client,
+                                      virNetMessagePtr msg,
+                                      int procedure,
+                                      int serial,
+                                      long long length,
+                                      unsigned int flags)
+{
+    virNetStreamHole data;
+
+    VIR_DEBUG("client=%p msg=%p length=%lld", client, msg, length);
+
+    memset(&data, 0, sizeof(data));
+    data.length = length;
+    data.flags = flags;
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM_HOLE;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        return -1;
+
+    if (virNetMessageEncodePayload(msg,
+                                   (xdrproc_t) xdr_virNetStreamHole,
+                                   &data) < 0)
+        return -1;
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
+/*
+ * Sends @len bytes of stream data raw, spliced from the pipe @fd
+ * to the client right after the packet, rather than inside it.
+ * The message takes over @fd.
+ */
+int virNetServerProgramSendStreamRaw(virNetServerProgramPtr prog,
+                                     virNetServerClientPtr client,
+                                     virNetMessagePtr msg,
+                                     int procedure,
+                                     int serial,
+                                     int fd,
+                                     size_t len)
+{
+    virNetStreamRaw data;
+
+    VIR_DEBUG("client=%p msg=%p fd=%d len=%zu", client, msg, fd, len);
+
+    memset(&data, 0, sizeof(data));
+    data.length = len;
+
+    msg->rawFD = fd;
+    msg->rawLength = len;
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM_RAW;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        return -1;
+
+    if (virNetMessageEncodePayload(msg,
+                                   (xdrproc_t) xdr_virNetStreamRaw,
+                                   &data) < 0)
+        return -1;
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
+/*
+ * Encodes the header of a stream data packet and reserves room for
+ * up to @len bytes of payload, returning a pointer to where the
+ * caller should place the data. This lets the stream source read
+ * straight into the message buffer, avoiding an intermediate copy.
+ * The packet is sent with virNetServerProgramSendStreamDataReserved
+ */
+char *virNetServerProgramReserveStreamData(virNetServerProgramPtr prog,
+                                           virNetMessagePtr msg,
+                                           int procedure,
+                                           int serial,
+                                           size_t len)
+{
+    VIR_DEBUG("msg=%p len=%zu", msg, len);
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        return NULL;
+
+    return virNetMessageEncodePayloadRawReserve(msg, len);
+}
+
+
+int virNetServerProgramSendStreamDataReserved(virNetServerClientPtr client,
+                                              virNetMessagePtr msg,
+                                              size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p len=%zu", client, msg, len);
+
+    if (virNetMessageEncodePayloadRawCommit(msg, len) < 0)
+        return -1;
+    VIR_DEBUG("Total %zu", msg->bufferLength);
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 void virNetServerProgramDispose(void *obj ATTRIBUTE_UNUSED)
 {
 }
@@ -101,4 +101,29 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       const char *data,
                                       size_t len);
 
+int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
+                                      virNetServerClientPtr client,
+                                      virNetMessagePtr msg,
+                                      int procedure,
+                                      int serial,
+                                      long long length,
+                                      unsigned int flags);
+
+int virNetServerProgramSendStreamRaw(virNetServerProgramPtr prog,
+                                     virNetServerClientPtr client,
+                                     virNetMessagePtr msg,
+                                     int procedure,
+                                     int serial,
+                                     int fd,
+                                     size_t len);
+
+char *virNetServerProgramReserveStreamData(virNetServerProgramPtr prog,
+                                           virNetMessagePtr msg,
+                                           int procedure,
+                                           int serial,
+                                           size_t len);
+int virNetServerProgramSendStreamDataReserved(virNetServerClientPtr client,
+                                              virNetMessagePtr msg,
+                                              size_t len);
+
 #endif /* __VIR_NET_SERVER_PROGRAM_H__ */
@@ -30,6 +30,7 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 
 #ifdef HAVE_NETINET_TCP_H
 # include <netinet/tcp.h>
@@ -1630,6 +1631,127 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+/*
+ * Returns true if what is written to or read from the socket FD is
+ * what goes over the wire, with no TLS, SASL or SSH session in between,
+ * so that data can be spliced to and from it
+ */
+bool virNetSocketCanSplice(virNetSocketPtr sock ATTRIBUTE_UNUSED)
+{
+    bool ret = false;
+#if HAVE_SPLICE
+    virObjectLock(sock);
+    ret = true;
+# if WITH_GNUTLS
+    if (sock->tlsSession)
+        ret = false;
+# endif
+# if WITH_SASL
+    if (sock->saslSession)
+        ret = false;
+# endif
+# if WITH_SSH2
+    if (sock->sshSession)
+        ret = false;
+# endif
+    virObjectUnlock(sock);
+#endif
+    return ret;
+}
+
+
+#if HAVE_SPLICE
+/*
+ * Moves up to @len bytes from the pipe @fd to the socket, without
+ * copying them through userspace
+ *
+ * Returns the number of bytes moved, 0 if the socket would block,
+ * -1 on error
+ */
+ssize_t virNetSocketSpliceFrom(virNetSocketPtr sock, int fd, size_t len)
+{
+    ssize_t ret;
+
+    virObjectLock(sock);
+ retry:
+    ret = splice(fd, NULL, sock->fd, NULL, len,
+                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto retry;
+        if (errno == EAGAIN) {
+            ret = 0;
+        } else {
+            virReportSystemError(errno, "%s",
+                                 _("Cannot splice data to socket"));
+        }
+    } else if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while splicing data to socket"));
+        ret = -1;
+    }
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
+/*
+ * Moves up to @len bytes from the socket to the pipe @fd, without
+ * copying them through userspace
+ *
+ * Returns the number of bytes moved, 0 if the socket has no data
+ * yet, -2 if the pipe is full, -1 on error
+ */
+ssize_t virNetSocketSpliceTo(virNetSocketPtr sock, int fd, size_t len)
+{
+    ssize_t ret;
+
+    virObjectLock(sock);
+ retry:
+    ret = splice(sock->fd, NULL, fd, NULL, len,
+                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (ret < 0) {
+        struct pollfd pfd = { .fd = sock->fd, .events = POLLIN };
+
+        if (errno == EINTR)
+            goto retry;
+        if (errno == EAGAIN) {
+            /* Either end may be the one that would block */
+            ret = poll(&pfd, 1, 0) > 0 ? -2 : 0;
+        } else {
+            virReportSystemError(errno, "%s",
+                                 _("Cannot splice data from socket"));
+        }
+    } else if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while reading data"));
+        ret = -1;
+    }
+    virObjectUnlock(sock);
+    return ret;
+}
+#else /* !HAVE_SPLICE */
+ssize_t virNetSocketSpliceFrom(virNetSocketPtr sock ATTRIBUTE_UNUSED,
+                               int fd ATTRIBUTE_UNUSED,
+                               size_t len ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Splicing data is not supported on this platform"));
+    return -1;
+}
+
+
+ssize_t virNetSocketSpliceTo(virNetSocketPtr sock ATTRIBUTE_UNUSED,
+                             int fd ATTRIBUTE_UNUSED,
+                             size_t len ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Splicing data is not supported on this platform"));
+    return -1;
+}
+#endif /* !HAVE_SPLICE */
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
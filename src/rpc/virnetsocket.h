@@ -127,6 +127,10 @@ int virNetSocketSetBlocking(virNetSocketPtr sock,
 ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len);
 ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len);
 
+bool virNetSocketCanSplice(virNetSocketPtr sock);
+ssize_t virNetSocketSpliceFrom(virNetSocketPtr sock, int fd, size_t len);
+ssize_t virNetSocketSpliceTo(virNetSocketPtr sock, int fd, size_t len);
+
 int virNetSocketSendFD(virNetSocketPtr sock, int fd);
 int virNetSocketRecvFD(virNetSocketPtr sock, int *fd);
 
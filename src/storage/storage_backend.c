@@ -38,6 +38,9 @@
 # include <sys/ioctl.h>
 # include <linux/fs.h>
 #endif
+#if HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 
 #if WITH_SELINUX
 # include <selinux/selinux.h>
@@ -53,8 +56,11 @@
 #include "storage_backend.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virendian.h"
+#include "virhash.h"
 #include "stat-time.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virxml.h"
 
 #if WITH_STORAGE_LVM
@@ -146,6 +152,235 @@ enum {
 #define READ_BLOCK_SIZE_DEFAULT  (1024 * 1024)
 #define WRITE_BLOCK_SIZE_DEFAULT (4 * 1024)
 
+/* Volumes are copied in chunks of at most READ_BLOCK_SIZE_DEFAULT
+ * bytes by up to this many threads */
+#define COPY_MAX_WORKERS 4
+
+struct virStorageBackendCopyData {
+    int inputfd;
+    int fd;
+    off_t end;
+    bool want_sparse;
+    size_t wbytes;              /* Granularity of zero block detection */
+    virStorageVolJobPtr job;    /* Job to report progress to, or NULL */
+
+    virMutex lock;
+    off_t next;                 /* Start of the next chunk to copy */
+    bool seekData;              /* SEEK_DATA and SEEK_HOLE work on inputfd */
+    bool copyRange;             /* copy_file_range may work */
+    int err;                    /* errno of the first failure */
+    bool readErr;               /* The failure was reading the input */
+};
+
+
+/*
+ * Pick the next chunk to copy, starting at data->next which must be
+ * less than data->end. Chunks never straddle a hole of the input, so
+ * that holes can be skipped or zeroed as a whole. Must be called with
+ * data->lock held.
+ */
+static void
+virStorageBackendCopyNextChunk(struct virStorageBackendCopyData *data,
+                               off_t *pos,
+                               size_t *len,
+                               bool *hole)
+{
+    off_t end = MIN(data->next + READ_BLOCK_SIZE_DEFAULT, data->end);
+
+    *pos = data->next;
+    *hole = false;
+
+#ifdef SEEK_DATA
+    if (data->seekData) {
+        off_t start = lseek(data->inputfd, *pos, SEEK_DATA);
+
+        if (start < 0 && errno == ENXIO)
+            start = data->end;
+
+        if (start < 0) {
+            data->seekData = false;
+        } else if (start > *pos) {
+            *hole = true;
+            end = MIN(start, data->end);
+            /* Holes which have to be written out are split as well */
+            if (!data->want_sparse)
+                end = MIN(end, *pos + READ_BLOCK_SIZE_DEFAULT);
+        } else if ((start = lseek(data->inputfd, *pos, SEEK_HOLE)) > *pos) {
+            end = MIN(end, start);
+        }
+    }
+#endif
+
+    *len = end - *pos;
+    data->next = end;
+}
+
+
+/*
+ * Copy @len bytes at @pos of the input with copy_file_range, which
+ * lets the kernel or a network filesystem server do it without the
+ * data going through libvirtd. Returns the number of bytes copied,
+ * which is less than @len if the kernel cannot do it for these files,
+ * or -1 on error.
+ */
+static ssize_t
+virStorageBackendCopyRange(struct virStorageBackendCopyData *data ATTRIBUTE_UNUSED,
+                           off_t pos ATTRIBUTE_UNUSED,
+                           size_t len ATTRIBUTE_UNUSED)
+{
+    size_t done = 0;
+
+#if defined(__linux__) && HAVE_SYS_SYSCALL_H && defined(SYS_copy_file_range)
+    while (done < len) {
+        loff_t inoff = pos + done;
+        loff_t outoff = pos + done;
+        ssize_t r = syscall(SYS_copy_file_range, data->inputfd, &inoff,
+                            data->fd, &outoff, len - done, 0);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0 && (errno == ENOSYS || errno == EXDEV ||
+                      errno == EINVAL || errno == EOPNOTSUPP ||
+                      errno == EBADF)) {
+            virMutexLock(&data->lock);
+            data->copyRange = false;
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        if (r < 0)
+            return -1;
+        if (r == 0)
+            break;
+        done += r;
+    }
+#endif
+
+    return done;
+}
+
+
+static void
+virStorageBackendCopyThread(void *opaque)
+{
+    struct virStorageBackendCopyData *data = opaque;
+    char *buf = NULL;
+    char *zerobuf = NULL;
+
+    if (VIR_ALLOC_N_QUIET(buf, READ_BLOCK_SIZE_DEFAULT) < 0 ||
+        VIR_ALLOC_N_QUIET(zerobuf, data->wbytes) < 0) {
+        virMutexLock(&data->lock);
+        if (!data->err)
+            data->err = ENOMEM;
+        virMutexUnlock(&data->lock);
+        goto cleanup;
+    }
+
+    while (true) {
+        off_t pos;
+        size_t len;
+        size_t copied = 0;
+        size_t done;
+        size_t offset;
+        bool hole;
+        bool copyRange;
+        ssize_t r;
+        int err = 0;
+        bool readErr = false;
+
+        virMutexLock(&data->lock);
+        if (data->err || data->next >= data->end) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        virStorageBackendCopyNextChunk(data, &pos, &len, &hole);
+        copyRange = data->copyRange;
+        virMutexUnlock(&data->lock);
+
+        if (hole) {
+            if (data->want_sparse ||
+                virFileZeroRange(data->fd, pos, len) == 0)
+                goto progress;
+            memset(buf, 0, len);
+        } else {
+            if (copyRange) {
+                if ((r = virStorageBackendCopyRange(data, pos, len)) < 0) {
+                    err = errno;
+                    goto error;
+                }
+                copied = r;
+                if (copied == len)
+                    goto progress;
+            }
+
+            /* Read the rest of the chunk */
+            for (done = copied; done < len;) {
+                r = pread(data->inputfd, buf + done, len - done, pos + done);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r < 0) {
+                    err = errno;
+                    readErr = true;
+                    goto error;
+                }
+                if (r == 0)
+                    break;
+                done += r;
+            }
+            len = done;
+        }
+
+        /* Write it out in wbytes increments, skipping the ones which
+         * are all zeros if a sparse copy was asked for */
+        for (offset = copied; offset < len; offset += data->wbytes) {
+            size_t interval = MIN(data->wbytes, len - offset);
+            size_t written = 0;
+
+            if (!hole && data->want_sparse &&
+                memcmp(buf + offset, zerobuf, interval) == 0)
+                continue;
+
+            while (written < interval) {
+                r = pwrite(data->fd, buf + offset + written,
+                           interval - written, pos + offset + written);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r <= 0) {
+                    err = r < 0 ? errno : EIO;
+                    goto error;
+                }
+                written += r;
+            }
+        }
+
+     progress:
+        if (virStorageVolJobProgress(data->job, len) < 0) {
+            err = ECANCELED;
+            goto error;
+        }
+        continue;
+
+     error:
+        virMutexLock(&data->lock);
+        if (!data->err) {
+            data->err = err;
+            data->readErr = readErr;
+        }
+        virMutexUnlock(&data->lock);
+        break;
+    }
+
+ cleanup:
+    VIR_FREE(zerobuf);
+    VIR_FREE(buf);
+}
+
+
+/*
+ * Copy up to *@total bytes of @inputvol to the start of @fd using
+ * several threads, decreasing *@total by the amount copied. Holes of
+ * the input, and blocks of zeros if @want_sparse, are skipped when
+ * @want_sparse is true and zeroed otherwise.
+ */
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
@@ -153,16 +388,16 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           unsigned long long *total,
                           bool want_sparse)
 {
+    struct virStorageBackendCopyData data;
+    bool mutex = false;
     int inputfd = -1;
-    int amtread = -1;
     int ret = 0;
-    size_t rbytes = READ_BLOCK_SIZE_DEFAULT;
     int wbytes = 0;
-    int interval;
-    char *zerobuf = NULL;
-    char *buf = NULL;
+    off_t size;
     struct stat st;
 
+    memset(&data, 0, sizeof(data));
+
     if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0) {
         ret = -errno;
         virReportSystemError(errno,
@@ -181,56 +416,54 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
     if (wbytes < WRITE_BLOCK_SIZE_DEFAULT)
         wbytes = WRITE_BLOCK_SIZE_DEFAULT;
 
-    if (VIR_ALLOC_N(zerobuf, wbytes) < 0) {
+    if ((size = lseek(inputfd, 0, SEEK_END)) < 0) {
         ret = -errno;
+        virReportSystemError(errno,
+                             _("cannot get size of file '%s'"),
+                             inputvol->target.path);
         goto cleanup;
     }
 
-    if (VIR_ALLOC_N(buf, rbytes) < 0) {
+    data.inputfd = inputfd;
+    data.fd = fd;
+    data.end = MIN(*total, size);
+    data.want_sparse = want_sparse;
+    data.wbytes = wbytes;
+    data.job = vol->job;
+    data.seekData = true;
+#if defined(__linux__) && HAVE_SYS_SYSCALL_H && defined(SYS_copy_file_range)
+    data.copyRange = true;
+#endif
+
+    if (virMutexInit(&data.lock) < 0) {
         ret = -errno;
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
         goto cleanup;
     }
+    mutex = true;
 
-    while (amtread != 0) {
-        int amtleft;
-
-        if (*total < rbytes)
-            rbytes = *total;
+    virThreadRunWorkers(MIN((data.end + READ_BLOCK_SIZE_DEFAULT - 1) /
+                            READ_BLOCK_SIZE_DEFAULT, COPY_MAX_WORKERS),
+                        virStorageBackendCopyThread, &data);
 
-        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
-            ret = -errno;
-            virReportSystemError(errno,
+    if (data.err) {
+        ret = -data.err;
+        if (data.err == ECANCELED)
+            virReportError(VIR_ERR_OPERATION_ABORTED,
+                           _("copy to '%s' was cancelled"),
+                           vol->target.path);
+        else if (data.readErr)
+            virReportSystemError(data.err,
                                  _("failed reading from file '%s'"),
                                  inputvol->target.path);
-            goto cleanup;
-        }
-        *total -= amtread;
-
-        /* Loop over amt read in 512 byte increments, looking for sparse
-         * blocks */
-        amtleft = amtread;
-        do {
-            interval = ((wbytes > amtleft) ? amtleft : wbytes);
-            int offset = amtread - amtleft;
-
-            if (want_sparse && memcmp(buf+offset, zerobuf, interval) == 0) {
-                if (lseek(fd, interval, SEEK_CUR) < 0) {
-                    ret = -errno;
-                    virReportSystemError(errno,
-                                         _("cannot extend file '%s'"),
-                                         vol->target.path);
-                    goto cleanup;
-                }
-            } else if (safewrite(fd, buf+offset, interval) < 0) {
-                ret = -errno;
-                virReportSystemError(errno,
-                                     _("failed writing to file '%s'"),
-                                     vol->target.path);
-                goto cleanup;
-
-            }
-        } while ((amtleft -= interval) > 0);
+        else
+            virReportSystemError(data.err,
+                                 _("failed writing to file '%s'"),
+                                 vol->target.path);
+        goto cleanup;
     }
+    *total -= data.end;
 
     if (fdatasync(fd) < 0) {
         ret = -errno;
@@ -251,11 +484,47 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
 
  cleanup:
     VIR_FORCE_CLOSE(inputfd);
+    if (mutex)
+        virMutexDestroy(&data.lock);
 
-    VIR_FREE(zerobuf);
-    VIR_FREE(buf);
+    return ret;
+}
+
+
+/*
+ * Make the empty file @fd share the data blocks of @inputvol, which
+ * copies it in constant time on filesystems able to (btrfs, XFS).
+ * Returns 0 on success, -1 without reporting an error otherwise.
+ */
+static int
+virStorageBackendReflinkToFD(virStorageVolDefPtr vol ATTRIBUTE_UNUSED,
+                             virStorageVolDefPtr inputvol ATTRIBUTE_UNUSED,
+                             int fd ATTRIBUTE_UNUSED)
+{
+#if defined(__linux__) && defined(FICLONE)
+    int inputfd;
+    struct stat st;
+    int ret = -1;
+
+    if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0)
+        return -1;
 
+    /* Shared blocks are only allocated once, so the clone costs no
+     * space whatever allocation was asked for */
+    if (fstat(inputfd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size <= vol->target.capacity &&
+        ioctl(fd, FICLONE, inputfd) == 0) {
+        VIR_DEBUG("Cloned '%s' to '%s' with reflink",
+                  inputvol->target.path, vol->target.path);
+        ignore_value(virStorageVolJobProgress(vol->job, st.st_size));
+        ret = 0;
+    }
+
+    VIR_FORCE_CLOSE(inputfd);
     return ret;
+#else
+    return -1;
+#endif
 }
 
 static int
@@ -340,9 +609,15 @@ createRawFile(int fd, virStorageVolDefPtr vol,
               virStorageVolDefPtr inputvol)
 {
     bool need_alloc = true;
+    bool reflinked = false;
     int ret = 0;
     unsigned long long remain;
 
+    /* Sharing the blocks of the input, when possible, makes cloning
+     * golden images near-instant */
+    if (inputvol && virStorageBackendReflinkToFD(vol, inputvol, fd) == 0)
+        reflinked = true;
+
     /* Seek to the final size, so the capacity is available upfront
      * for progress reporting */
     if (ftruncate(fd, vol->target.capacity) < 0) {
@@ -353,6 +628,9 @@ createRawFile(int fd, virStorageVolDefPtr vol,
         goto cleanup;
     }
 
+    if (reflinked)
+        goto sync;
+
 /* Avoid issues with older kernel's <linux/fs.h> namespace pollution. */
 #if HAVE_FALLOCATE - 0
     /* Try to preallocate all requested disk space, but fall back to
@@ -399,6 +677,7 @@ createRawFile(int fd, virStorageVolDefPtr vol,
         }
     }
 
+ sync:
     if (fsync(fd) < 0) {
         ret = -errno;
         virReportSystemError(errno, _("cannot sync data to file '%s'"),
@@ -665,7 +944,7 @@ virStorageBackendQemuImgSupportsCompat(const char *qemuimg)
 }
 
 static int
-virStorageBackendQEMUImgBackingFormat(const char *qemuimg)
+virStorageBackendQEMUImgProbeBackingFormat(const char *qemuimg)
 {
     char *help = NULL;
     char *start;
@@ -710,6 +989,92 @@ virStorageBackendQEMUImgBackingFormat(const char *qemuimg)
     return ret;
 }
 
+/*
+ * Probing qemu-img takes up to two runs of it, so the result is kept
+ * per binary until the binary is replaced.
+ */
+typedef struct _virStorageBackendQEMUImgCaps virStorageBackendQEMUImgCaps;
+typedef virStorageBackendQEMUImgCaps *virStorageBackendQEMUImgCapsPtr;
+struct _virStorageBackendQEMUImgCaps {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    int imgformat;
+};
+
+static virMutex virStorageBackendQEMUImgCapsLock;
+static virHashTablePtr virStorageBackendQEMUImgCapsCache;
+
+static int
+virStorageBackendQEMUImgCapsOnceInit(void)
+{
+    if (virMutexInit(&virStorageBackendQEMUImgCapsLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        return -1;
+    }
+
+    if (!(virStorageBackendQEMUImgCapsCache =
+          virHashCreate(4, virHashValueFree)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStorageBackendQEMUImgCaps)
+
+static int
+virStorageBackendQEMUImgBackingFormat(const char *qemuimg)
+{
+    virStorageBackendQEMUImgCapsPtr caps;
+    struct stat sb;
+    int ret = -1;
+
+    if (virStorageBackendQEMUImgCapsInitialize() < 0)
+        return -1;
+
+    if (stat(qemuimg, &sb) < 0) {
+        virReportSystemError(errno, _("cannot stat '%s'"), qemuimg);
+        return -1;
+    }
+
+    virMutexLock(&virStorageBackendQEMUImgCapsLock);
+    if ((caps = virHashLookup(virStorageBackendQEMUImgCapsCache, qemuimg)) &&
+        caps->dev == sb.st_dev &&
+        caps->ino == sb.st_ino &&
+        caps->size == sb.st_size &&
+        caps->mtime.tv_sec == get_stat_mtime(&sb).tv_sec &&
+        caps->mtime.tv_nsec == get_stat_mtime(&sb).tv_nsec)
+        ret = caps->imgformat;
+    virMutexUnlock(&virStorageBackendQEMUImgCapsLock);
+
+    if (ret >= 0)
+        return ret;
+
+    /* Probe without the lock held; racing probes of the same binary
+     * just store the same result twice */
+    if ((ret = virStorageBackendQEMUImgProbeBackingFormat(qemuimg)) < 0)
+        return -1;
+
+    if (VIR_ALLOC_QUIET(caps) < 0)
+        return ret;
+
+    caps->dev = sb.st_dev;
+    caps->ino = sb.st_ino;
+    caps->size = sb.st_size;
+    caps->mtime = get_stat_mtime(&sb);
+    caps->imgformat = ret;
+
+    virMutexLock(&virStorageBackendQEMUImgCapsLock);
+    if (virHashUpdateEntry(virStorageBackendQEMUImgCapsCache,
+                           qemuimg, caps) < 0)
+        VIR_FREE(caps);
+    virMutexUnlock(&virStorageBackendQEMUImgCapsLock);
+
+    return ret;
+}
+
 static int
 virStorageBackendCreateQemuImgOpts(char **opts,
                                    const char *backingType,
@@ -978,6 +1343,289 @@ virStorageBackendCreateQemuImgCmd(virConnectPtr conn,
     return cmd;
 }
 
+/* Layout of the qcow2 images written without qemu-img, matching the
+ * defaults of qemu-img: 64k clusters and 16 bit refcounts */
+#define QCOW2_CREATE_CLUSTER_BITS 16
+#define QCOW2_CREATE_CLUSTER_SIZE (1ULL << QCOW2_CREATE_CLUSTER_BITS)
+#define QCOW2_CREATE_REFCOUNT_ORDER 4
+#define QCOW2_CREATE_OFLAG_COPIED (1ULL << 63)
+#define QCOW2_CREATE_V2_HEADER_SIZE 72
+#define QCOW2_CREATE_V3_HEADER_SIZE 104
+/* Largest L1 table qemu opens, in bytes */
+#define QCOW2_CREATE_MAX_L1_SIZE (32 * 1024 * 1024)
+
+/*
+ * Check whether @vol is an empty qcow2 image simple enough to be
+ * written in-process: no input volume, backing store or encryption,
+ * a capacity whose L1 table qemu accepts, and a compat level and
+ * features this code knows about.
+ *
+ * Returns the qcow2 version to write, or 0 if qemu-img is needed.
+ */
+static int
+virStorageBackendQcow2CreateVersion(virStorageVolDefPtr vol,
+                                    virStorageVolDefPtr inputvol)
+{
+    /* Guest bytes mapped by each L1 entry */
+    const unsigned long long l2_span =
+        QCOW2_CREATE_CLUSTER_SIZE * (QCOW2_CREATE_CLUSTER_SIZE / 8);
+    int version;
+    bool b;
+    size_t i;
+
+    if (inputvol ||
+        vol->type != VIR_STORAGE_VOL_FILE ||
+        vol->target.format != VIR_STORAGE_FILE_QCOW2 ||
+        vol->backingStore.path ||
+        vol->target.encryption)
+        return 0;
+
+    /* Images too large for qemu are left to qemu-img to refuse */
+    if (vol->target.capacity / l2_span +
+        !!(vol->target.capacity % l2_span) > QCOW2_CREATE_MAX_L1_SIZE / 8)
+        return 0;
+
+    if (!vol->target.compat || STREQ(vol->target.compat, "0.10"))
+        version = 2;
+    else if (STREQ(vol->target.compat, "1.1"))
+        version = 3;
+    else
+        return 0;
+
+    if (vol->target.features) {
+        for (i = 0; i < VIR_STORAGE_FILE_FEATURE_LAST; i++) {
+            ignore_value(virBitmapGetBit(vol->target.features, i, &b));
+            if (!b)
+                continue;
+            switch ((enum virStorageFileFeature) i) {
+            case VIR_STORAGE_FILE_FEATURE_LAZY_REFCOUNTS:
+                /* qemu-img reports the conflict with compat 0.10 */
+                if (version < 3)
+                    return 0;
+                break;
+
+            /* coverity[dead_error_begin] */
+            case VIR_STORAGE_FILE_FEATURE_LAST:
+                ;
+            }
+        }
+    }
+
+    return version;
+}
+
+/*
+ * Write one cluster of the qcow2 image being created, containing the
+ * big-endian table @entries of @entry_size bytes each. Entry @j holds
+ * @start + @step * (@first + @j), or 0 once @first + @j reaches @count.
+ */
+static int
+virStorageBackendQcow2WriteTable(int fd,
+                                 const char *path,
+                                 unsigned char *buf,
+                                 size_t entry_size,
+                                 unsigned long long first,
+                                 unsigned long long count,
+                                 unsigned long long start,
+                                 unsigned long long step)
+{
+    size_t nentries = QCOW2_CREATE_CLUSTER_SIZE / entry_size;
+    size_t j;
+
+    memset(buf, 0, QCOW2_CREATE_CLUSTER_SIZE);
+    for (j = 0; j < nentries && first + j < count; j++) {
+        unsigned long long val = start + step * (first + j);
+
+        if (entry_size == 8)
+            virWriteBufInt64BE(buf + j * 8, val);
+        else
+            virWriteBufInt16BE(buf + j * 2, val);
+    }
+
+    if (safewrite(fd, buf, QCOW2_CREATE_CLUSTER_SIZE) < 0) {
+        virReportSystemError(errno, _("cannot write to file '%s'"), path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Create the empty qcow2 image @vol without running qemu-img, which
+ * is otherwise forked twice per volume. With metadata preallocation,
+ * all L2 tables are written and every guest cluster is mapped, like
+ * qemu-img does, leaving the data clusters sparse.
+ *
+ * The image is laid out as the header, the refcount table, the
+ * refcount blocks, the L1 table, the L2 tables and the data clusters.
+ */
+static int
+virStorageBackendCreateQcow2(virStoragePoolObjPtr pool,
+                             virStorageVolDefPtr vol,
+                             int version,
+                             unsigned int flags)
+{
+    const unsigned long long cluster = QCOW2_CREATE_CLUSTER_SIZE;
+    const unsigned long long l2_entries = cluster / 8;
+    const unsigned long long refcount_entries = cluster / 2;
+    const unsigned long long copied = QCOW2_CREATE_OFLAG_COPIED;
+    bool preallocate = !!(flags & VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA);
+    unsigned long long data_clusters;
+    unsigned long long l1_size;
+    unsigned long long l1_clusters;
+    unsigned long long l2_clusters;
+    unsigned long long rt_clusters = 1;
+    unsigned long long rb_clusters = 1;
+    unsigned long long total;
+    unsigned long long rb_offset;
+    unsigned long long l1_offset;
+    unsigned long long l2_offset;
+    unsigned long long data_offset;
+    unsigned long long i;
+    unsigned char *buf = NULL;
+    bool b;
+    int operation_flags;
+    int fd = -1;
+    int ret = -1;
+
+    data_clusters = VIR_DIV_UP(vol->target.capacity, cluster);
+    /* Bounded by virStorageBackendQcow2CreateVersion */
+    l1_size = VIR_DIV_UP(data_clusters, l2_entries);
+    l1_clusters = MAX(1, VIR_DIV_UP(l1_size * 8, cluster));
+    l2_clusters = preallocate ? l1_size : 0;
+    if (!preallocate)
+        data_clusters = 0;
+
+    /* The refcount structures have to account for themselves too */
+    for (;;) {
+        unsigned long long rb, rt;
+
+        total = 1 + rt_clusters + rb_clusters + l1_clusters + l2_clusters +
+            data_clusters;
+        rb = VIR_DIV_UP(total, refcount_entries);
+        rt = VIR_DIV_UP(rb, l2_entries);
+        if (rb == rb_clusters && rt == rt_clusters)
+            break;
+        rb_clusters = MAX(rb, rb_clusters);
+        rt_clusters = MAX(rt, rt_clusters);
+    }
+
+    rb_offset = (1 + rt_clusters) * cluster;
+    l1_offset = rb_offset + rb_clusters * cluster;
+    l2_offset = l1_offset + l1_clusters * cluster;
+    data_offset = l2_offset + l2_clusters * cluster;
+
+    VIR_DEBUG("Creating qcow2 v%d image '%s' capacity=%llu clusters=%llu "
+              "prealloc=%d", version, vol->target.path,
+              vol->target.capacity, total, preallocate);
+
+    operation_flags = VIR_FILE_OPEN_FORCE_MODE | VIR_FILE_OPEN_FORCE_OWNER;
+    if (pool->def->type == VIR_STORAGE_POOL_NETFS)
+        operation_flags |= VIR_FILE_OPEN_FORK;
+
+    if ((fd = virFileOpenAs(vol->target.path,
+                            O_RDWR | O_CREAT | O_EXCL,
+                            vol->target.perms->mode,
+                            vol->target.perms->uid,
+                            vol->target.perms->gid,
+                            operation_flags)) < 0) {
+        virReportSystemError(-fd,
+                             _("Failed to create file '%s'"),
+                             vol->target.path);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(buf, cluster) < 0)
+        goto cleanup;
+
+    /* Header; for v2 the zeroed rest of the cluster doubles as the
+     * end of the header extensions */
+    memcpy(buf, "QFI\xfb", 4);
+    virWriteBufInt32BE(buf + 4, version);
+    virWriteBufInt32BE(buf + 20, QCOW2_CREATE_CLUSTER_BITS);
+    virWriteBufInt64BE(buf + 24, vol->target.capacity);
+    virWriteBufInt32BE(buf + 36, l1_size);
+    virWriteBufInt64BE(buf + 40, l1_offset);
+    virWriteBufInt64BE(buf + 48, cluster);
+    virWriteBufInt32BE(buf + 56, rt_clusters);
+    if (version >= 3) {
+        unsigned long long compatible = 0;
+
+        if (vol->target.features &&
+            virBitmapGetBit(vol->target.features,
+                            VIR_STORAGE_FILE_FEATURE_LAZY_REFCOUNTS, &b) == 0 &&
+            b)
+            compatible |= 1;
+
+        virWriteBufInt64BE(buf + 80, compatible);
+        virWriteBufInt32BE(buf + 96, QCOW2_CREATE_REFCOUNT_ORDER);
+        virWriteBufInt32BE(buf + 100, QCOW2_CREATE_V3_HEADER_SIZE);
+    }
+    if (safewrite(fd, buf, cluster) < 0) {
+        virReportSystemError(errno, _("cannot write to file '%s'"),
+                             vol->target.path);
+        goto cleanup;
+    }
+
+    for (i = 0; i < rt_clusters; i++) {
+        if (virStorageBackendQcow2WriteTable(fd, vol->target.path, buf, 8,
+                                             i * l2_entries, rb_clusters,
+                                             rb_offset, cluster) < 0)
+            goto cleanup;
+    }
+
+    /* Every cluster in use, data included, is referenced once */
+    for (i = 0; i < rb_clusters; i++) {
+        if (virStorageBackendQcow2WriteTable(fd, vol->target.path, buf, 2,
+                                             i * refcount_entries, total,
+                                             1, 0) < 0)
+            goto cleanup;
+    }
+
+    /* The tables are only referenced once too, so all entries carry
+     * the copied flag */
+    for (i = 0; i < l1_clusters; i++) {
+        if (virStorageBackendQcow2WriteTable(fd, vol->target.path, buf, 8,
+                                             i * l2_entries,
+                                             preallocate ? l1_size : 0,
+                                             l2_offset | copied, cluster) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < l2_clusters; i++) {
+        if (virStorageBackendQcow2WriteTable(fd, vol->target.path, buf, 8,
+                                             i * l2_entries, data_clusters,
+                                             data_offset | copied,
+                                             cluster) < 0)
+            goto cleanup;
+    }
+
+    if (ftruncate(fd, total * cluster) < 0) {
+        virReportSystemError(errno, _("cannot extend file '%s'"),
+                             vol->target.path);
+        goto cleanup;
+    }
+
+    if (fsync(fd) < 0) {
+        virReportSystemError(errno, _("cannot sync data to file '%s'"),
+                             vol->target.path);
+        goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0) {
+        virReportSystemError(errno, _("cannot close file '%s'"),
+                             vol->target.path);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(buf);
+    return ret;
+}
+
 static int
 virStorageBackendCreateQemuImg(virConnectPtr conn,
                                virStoragePoolObjPtr pool,
@@ -988,10 +1636,16 @@ virStorageBackendCreateQemuImg(virConnectPtr conn,
     int ret = -1;
     char *create_tool;
     int imgformat;
+    int version;
     virCommandPtr cmd;
 
     virCheckFlags(VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA, -1);
 
+    /* Mass provisioning of empty images shouldn't pay for forking
+     * qemu-img, so they are written directly */
+    if ((version = virStorageBackendQcow2CreateVersion(vol, inputvol)) > 0)
+        return virStorageBackendCreateQcow2(pool, vol, version, flags);
+
     /* KVM is usually ahead of qemu on features, so try that first */
     create_tool = virFindFileInPath("kvm-img");
     if (!create_tool)
@@ -1083,6 +1737,18 @@ virStorageBackendCreateQcowCreate(virConnectPtr conn ATTRIBUTE_UNUSED,
     return ret;
 }
 
+/*
+ * Return the function writing @vol in-process, or NULL if creating
+ * it needs an image tool.
+ */
+virStorageBackendBuildVolFrom
+virStorageBackendGetBuildQcow2Function(virStorageVolDefPtr vol)
+{
+    if (virStorageBackendQcow2CreateVersion(vol, NULL) > 0)
+        return virStorageBackendCreateQemuImg;
+    return NULL;
+}
+
 virStorageBackendBuildVolFrom
 virStorageBackendFSImageToolTypeToFunc(int tool_type)
 {
@@ -44,6 +44,10 @@ typedef int (*virStorageBackendBuildPool)(virConnectPtr conn,
                                           unsigned int flags);
 typedef int (*virStorageBackendRefreshPool)(virConnectPtr conn,
                                             virStoragePoolObjPtr pool);
+typedef int (*virStorageBackendRefreshPoolVols)(virConnectPtr conn,
+                                                virStoragePoolObjPtr pool,
+                                                const char *const *names,
+                                                size_t nnames);
 typedef int (*virStorageBackendStopPool)(virConnectPtr conn,
                                          virStoragePoolObjPtr pool);
 typedef int (*virStorageBackendDeletePool)(virConnectPtr conn,
@@ -83,6 +87,8 @@ int virStorageBackendCreateRaw(virConnectPtr conn,
 virStorageBackendBuildVolFrom
 virStorageBackendGetBuildVolFromFunction(virStorageVolDefPtr vol,
                                          virStorageVolDefPtr inputvol);
+virStorageBackendBuildVolFrom
+virStorageBackendGetBuildQcow2Function(virStorageVolDefPtr vol);
 int virStorageBackendFindFSImageTool(char **tool);
 virStorageBackendBuildVolFrom
 virStorageBackendFSImageToolTypeToFunc(int tool_type);
@@ -105,6 +111,15 @@ struct _virStorageBackend {
     virStorageBackendStartPool startPool;
     virStorageBackendBuildPool buildPool;
     virStorageBackendRefreshPool refreshPool; /* Must be non-NULL */
+    /* Optional; refreshes an active pool keeping the volumes it
+     * already lists. Called with pool->refreshing set, so it may
+     * unlock the pool while scanning. */
+    virStorageBackendRefreshPool refreshPoolIncremental;
+    /* Optional; like refreshPoolIncremental, but only looks at the
+     * volumes called @names, adding, probing or dropping them as their
+     * files appeared, changed or vanished. Backends providing it have
+     * their pool target directory watched for changes. */
+    virStorageBackendRefreshPoolVols refreshPoolVols;
     virStorageBackendStopPool stopPool;
     virStorageBackendDeletePool deletePool;
 
@@ -51,6 +51,8 @@
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "stat-time.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -842,111 +844,429 @@ virStorageBackendFileSystemBuild(virConnectPtr conn ATTRIBUTE_UNUSED,
 }
 
 
+/* Upper limit on threads probing volumes in parallel during a refresh */
+#define VIR_STORAGE_BACKEND_FS_REFRESH_MAX_WORKERS 8
+
+enum {
+    VIR_STORAGE_BACKEND_FS_ENTRY_SKIP = 0, /* not a volume */
+    VIR_STORAGE_BACKEND_FS_ENTRY_UNCHANGED, /* cached volume is up to date */
+    VIR_STORAGE_BACKEND_FS_ENTRY_PROBED,    /* freshly probed into @vol */
+    VIR_STORAGE_BACKEND_FS_ENTRY_ERROR,     /* probing failed with @err */
+};
+
+/* One directory entry seen by a pool refresh */
+struct virStorageBackendFileSystemEntry {
+    char *name;
+    int state;
+    virStorageVolDefPtr vol;
+    virErrorPtr err;
+};
+
+struct virStorageBackendFileSystemRefreshData {
+    const char *path;
+    virHashTablePtr stamps;     /* name -> virStorageVolStamp of the
+                                 * volumes known before the refresh */
+
+    struct virStorageBackendFileSystemEntry *entries;
+    size_t nentries;
+
+    virMutex lock;
+    size_t next;                /* Next entry to be probed */
+};
+
+
+static void
+virStorageBackendFileSystemStamp(virStorageVolStampPtr stamp,
+                                 const struct stat *sb)
+{
+    stamp->ino = sb->st_ino;
+    stamp->size = sb->st_size;
+    stamp->mtime = get_stat_mtime(sb);
+    stamp->ctime = get_stat_ctime(sb);
+}
+
+
+static int
+virStorageBackendFileSystemProbeEntry(struct virStorageBackendFileSystemRefreshData *data,
+                                      struct virStorageBackendFileSystemEntry *entry)
+{
+    virStorageVolDefPtr vol = NULL;
+    virStorageVolStampPtr cached;
+    virStorageVolStamp stamp;
+    struct stat sb;
+    char *backingStore;
+    int backingStoreFormat;
+    int ret;
+
+    if (VIR_ALLOC(vol) < 0)
+        goto error;
+
+    if (VIR_STRDUP(vol->name, entry->name) < 0)
+        goto error;
+
+    vol->type = VIR_STORAGE_VOL_FILE;
+    vol->target.format = VIR_STORAGE_FILE_RAW; /* Real value is filled in during probe */
+    if (virAsprintf(&vol->target.path, "%s/%s",
+                    data->path, vol->name) == -1)
+        goto error;
+
+    /* Files which still look the same as when they were last probed
+     * are not probed again */
+    if (stat(vol->target.path, &sb) == 0) {
+        virStorageBackendFileSystemStamp(&stamp, &sb);
+        if ((cached = virHashLookup(data->stamps, entry->name)) &&
+            cached->ino == stamp.ino &&
+            cached->size == stamp.size &&
+            cached->mtime.tv_sec == stamp.mtime.tv_sec &&
+            cached->mtime.tv_nsec == stamp.mtime.tv_nsec &&
+            cached->ctime.tv_sec == stamp.ctime.tv_sec &&
+            cached->ctime.tv_nsec == stamp.ctime.tv_nsec) {
+            virStorageVolDefFree(vol);
+            entry->state = VIR_STORAGE_BACKEND_FS_ENTRY_UNCHANGED;
+            return 0;
+        }
+    } else {
+        memset(&stamp, 0, sizeof(stamp));
+    }
+
+    if (VIR_STRDUP(vol->key, vol->target.path) < 0)
+        goto error;
+
+    if ((ret = virStorageBackendProbeTarget(&vol->target,
+                                            &backingStore,
+                                            &backingStoreFormat,
+                                            &vol->target.encryption)) < 0) {
+        if (ret == -2) {
+            /* Silently ignore non-regular files,
+             * eg '.' '..', 'lost+found', dangling symbolic link */
+            virStorageVolDefFree(vol);
+            entry->state = VIR_STORAGE_BACKEND_FS_ENTRY_SKIP;
+            return 0;
+        } else if (ret == -3) {
+            /* The backing file is currently unavailable, its format is not
+             * explicitly specified, the probe to auto detect the format
+             * failed: continue with faked RAW format, since AUTO will
+             * break virStorageVolTargetDefFormat() generating the line
+             * <format type='...'/>. */
+            backingStoreFormat = VIR_STORAGE_FILE_RAW;
+        } else
+            goto error;
+    }
+
+    /* directory based volume */
+    if (vol->target.format == VIR_STORAGE_FILE_DIR)
+        vol->type = VIR_STORAGE_VOL_DIR;
+
+    if (backingStore != NULL) {
+        vol->backingStore.path = backingStore;
+        vol->backingStore.format = backingStoreFormat;
+
+        ignore_value(virStorageBackendUpdateVolTargetInfo(
+                                           &vol->backingStore, false,
+                                           VIR_STORAGE_VOL_OPEN_DEFAULT));
+        /* If this failed, the backing file is currently unavailable,
+         * the capacity, allocation, owner, group and mode are unknown.
+         * An error message was raised, but we just continue. */
+    }
+
+    vol->stamp = stamp;
+    entry->vol = vol;
+    entry->state = VIR_STORAGE_BACKEND_FS_ENTRY_PROBED;
+    return 0;
+
+ error:
+    virStorageVolDefFree(vol);
+    entry->state = VIR_STORAGE_BACKEND_FS_ENTRY_ERROR;
+    entry->err = virSaveLastError();
+    return -1;
+}
+
+
+static void
+virStorageBackendFileSystemProbeThread(void *opaque)
+{
+    struct virStorageBackendFileSystemRefreshData *data = opaque;
+
+    while (true) {
+        struct virStorageBackendFileSystemEntry *entry;
+
+        virMutexLock(&data->lock);
+        if (data->next == data->nentries) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        entry = &data->entries[data->next++];
+        virMutexUnlock(&data->lock);
+
+        if (virStorageBackendFileSystemProbeEntry(data, entry) < 0)
+            virResetLastError();
+    }
+}
+
+
+/*
+ * Apply the probed @data to the volumes of the locked @pool. Volumes
+ * which were not known before the refresh started are left alone, as
+ * they were created while the pool was unlocked.
+ */
+static int
+virStorageBackendFileSystemUpdateVols(virStoragePoolObjPtr pool,
+                                      struct virStorageBackendFileSystemRefreshData *data)
+{
+    virHashTablePtr seen = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (!(seen = virHashCreate(data->nentries + 1, NULL)))
+        return -1;
+
+    for (i = 0; i < data->nentries; i++) {
+        struct virStorageBackendFileSystemEntry *entry = &data->entries[i];
+        virStorageVolDefPtr old;
+        bool known = virHashLookup(data->stamps, entry->name) != NULL;
+
+        if (entry->state == VIR_STORAGE_BACKEND_FS_ENTRY_SKIP)
+            continue;
+
+        if (virHashAddEntry(seen, entry->name, entry) < 0)
+            goto cleanup;
+
+        old = virStorageVolDefFindByName(pool, entry->name);
+
+        /* Deleted while unlocked, or created meanwhile */
+        if (known ? !old : !!old)
+            continue;
+        if (old && (old->building || old->in_use))
+            continue;
+
+        if (entry->state == VIR_STORAGE_BACKEND_FS_ENTRY_UNCHANGED)
+            continue;
+
+        if (old) {
+            virStoragePoolObjRemoveVol(pool, old);
+            virStorageVolDefFree(old);
+        }
+        if (virStoragePoolObjAddVol(pool, entry->vol) < 0)
+            goto cleanup;
+        entry->vol = NULL;
+    }
+
+    /* Drop volumes whose files have disappeared */
+    for (i = 0; i < pool->volumes.count;) {
+        virStorageVolDefPtr vol = pool->volumes.objs[i];
+
+        if (vol->building || vol->in_use ||
+            !virHashLookup(data->stamps, vol->name) ||
+            virHashLookup(seen, vol->name)) {
+            i++;
+            continue;
+        }
+
+        virStoragePoolObjRemoveVol(pool, vol);
+        virStorageVolDefFree(vol);
+    }
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(seen);
+    return ret;
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
+ *
+ * Volumes already listed in the pool are kept and only files whose
+ * inode, size, modification or change time differ from when they were
+ * last probed are probed again, using several threads. If @unlock is
+ * true, the pool is unlocked while the directory is read and probed;
+ * the caller must then have set pool->refreshing. Volumes used by a
+ * job are left untouched.
+ *
+ * If @names is not NULL, only the @nnames files it lists are looked
+ * at instead of the whole directory, and files which fail to probe
+ * keep their current volume rather than failing the refresh.
  */
 static int
-virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                   virStoragePoolObjPtr pool)
+virStorageBackendFileSystemRefreshInternal(virStoragePoolObjPtr pool,
+                                           const char *const *names,
+                                           size_t nnames,
+                                           bool unlock)
 {
-    DIR *dir;
+    struct virStorageBackendFileSystemRefreshData data;
+    DIR *dir = NULL;
     struct dirent *ent;
     struct statvfs sb;
-    virStorageVolDefPtr vol = NULL;
+    bool locked = true;
+    bool mutex = false;
+    size_t i;
+    int ret = -1;
 
-    if (!(dir = opendir(pool->def->target.path))) {
-        virReportSystemError(errno,
-                             _("cannot open path '%s'"),
-                             pool->def->target.path);
-        goto cleanup;
-    }
+    memset(&data, 0, sizeof(data));
+    data.path = pool->def->target.path;
 
-    while ((ent = readdir(dir)) != NULL) {
-        int ret;
-        char *backingStore;
-        int backingStoreFormat;
+    if (!(data.stamps = virHashCreate(pool->volumes.count + 1,
+                                      virHashValueFree)))
+        return -1;
 
-        if (VIR_ALLOC(vol) < 0)
-            goto cleanup;
+    for (i = 0; i < (names ? nnames : pool->volumes.count); i++) {
+        virStorageVolDefPtr vol;
+        virStorageVolStampPtr stamp;
 
-        if (VIR_STRDUP(vol->name, ent->d_name) < 0)
-            goto cleanup;
+        if (!names)
+            vol = pool->volumes.objs[i];
+        else if (!(vol = virStorageVolDefFindByName(pool, names[i])))
+            continue;
 
-        vol->type = VIR_STORAGE_VOL_FILE;
-        vol->target.format = VIR_STORAGE_FILE_RAW; /* Real value is filled in during probe */
-        if (virAsprintf(&vol->target.path, "%s/%s",
-                        pool->def->target.path,
-                        vol->name) == -1)
-            goto cleanup;
+        if (vol->building || vol->in_use ||
+            virHashLookup(data.stamps, vol->name))
+            continue;
 
-        if (VIR_STRDUP(vol->key, vol->target.path) < 0)
+        if (VIR_ALLOC(stamp) < 0)
+            goto cleanup;
+        *stamp = vol->stamp;
+        if (virHashAddEntry(data.stamps, vol->name, stamp) < 0) {
+            VIR_FREE(stamp);
             goto cleanup;
+        }
+    }
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        goto cleanup;
+    }
+    mutex = true;
 
-        if ((ret = virStorageBackendProbeTarget(&vol->target,
-                                                &backingStore,
-                                                &backingStoreFormat,
-                                                &vol->target.encryption)) < 0) {
-            if (ret == -2) {
-                /* Silently ignore non-regular files,
-                 * eg '.' '..', 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            } else if (ret == -3) {
-                /* The backing file is currently unavailable, its format is not
-                 * explicitly specified, the probe to auto detect the format
-                 * failed: continue with faked RAW format, since AUTO will
-                 * break virStorageVolTargetDefFormat() generating the line
-                 * <format type='...'/>. */
-                backingStoreFormat = VIR_STORAGE_FILE_RAW;
-            } else
+    if (unlock) {
+        virStoragePoolObjUnlock(pool);
+        locked = false;
+    }
+
+    if (names) {
+        if (VIR_ALLOC_N(data.entries, nnames) < 0)
+            goto cleanup;
+        for (data.nentries = 0; data.nentries < nnames; data.nentries++) {
+            if (VIR_STRDUP(data.entries[data.nentries].name,
+                           names[data.nentries]) < 0)
                 goto cleanup;
         }
+    } else {
+        if (!(dir = opendir(data.path))) {
+            virReportSystemError(errno,
+                                 _("cannot open path '%s'"),
+                                 data.path);
+            goto cleanup;
+        }
 
-        /* directory based volume */
-        if (vol->target.format == VIR_STORAGE_FILE_DIR)
-            vol->type = VIR_STORAGE_VOL_DIR;
+        while ((ent = readdir(dir)) != NULL) {
+            char *name;
 
-        if (backingStore != NULL) {
-            vol->backingStore.path = backingStore;
-            vol->backingStore.format = backingStoreFormat;
+            if (VIR_STRDUP(name, ent->d_name) < 0)
+                goto cleanup;
 
-            ignore_value(virStorageBackendUpdateVolTargetInfo(
-                                               &vol->backingStore, false,
-                                               VIR_STORAGE_VOL_OPEN_DEFAULT));
-            /* If this failed, the backing file is currently unavailable,
-             * the capacity, allocation, owner, group and mode are unknown.
-             * An error message was raised, but we just continue. */
+            if (VIR_EXPAND_N(data.entries, data.nentries, 1) < 0) {
+                VIR_FREE(name);
+                goto cleanup;
+            }
+            data.entries[data.nentries - 1].name = name;
         }
+        closedir(dir);
+        dir = NULL;
+    }
+
+    virThreadRunWorkers(MIN(data.nentries,
+                            VIR_STORAGE_BACKEND_FS_REFRESH_MAX_WORKERS),
+                        virStorageBackendFileSystemProbeThread, &data);
 
+    for (i = 0; i < data.nentries; i++) {
+        struct virStorageBackendFileSystemEntry *entry = &data.entries[i];
 
-        if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0)
+        if (entry->state != VIR_STORAGE_BACKEND_FS_ENTRY_ERROR)
+            continue;
+
+        if (!names) {
+            virSetError(entry->err);
             goto cleanup;
-    }
-    closedir(dir);
+        }
 
+        /* The file may still be being written to */
+        VIR_WARN("Failed to probe volume '%s' of pool '%s': %s",
+                 entry->name, pool->def->name,
+                 entry->err && entry->err->message ?
+                 entry->err->message : _("no error message found"));
+        entry->state = VIR_STORAGE_BACKEND_FS_ENTRY_UNCHANGED;
+    }
 
-    if (statvfs(pool->def->target.path, &sb) < 0) {
+    if (statvfs(data.path, &sb) < 0) {
         virReportSystemError(errno,
                              _("cannot statvfs path '%s'"),
-                             pool->def->target.path);
-        return -1;
+                             data.path);
+        goto cleanup;
     }
+
+    if (!locked) {
+        virStoragePoolObjLock(pool);
+        locked = true;
+    }
+
+    if (virStorageBackendFileSystemUpdateVols(pool, &data) < 0)
+        goto cleanup;
+
     pool->def->capacity = ((unsigned long long)sb.f_frsize *
                            (unsigned long long)sb.f_blocks);
     pool->def->available = ((unsigned long long)sb.f_bfree *
                             (unsigned long long)sb.f_frsize);
     pool->def->allocation = pool->def->capacity - pool->def->available;
 
-    return 0;
+    ret = 0;
 
  cleanup:
     if (dir)
         closedir(dir);
-    virStorageVolDefFree(vol);
-    virStoragePoolObjClearVols(pool);
-    return -1;
+    if (!locked)
+        virStoragePoolObjLock(pool);
+    for (i = 0; i < data.nentries; i++) {
+        VIR_FREE(data.entries[i].name);
+        virStorageVolDefFree(data.entries[i].vol);
+        virFreeError(data.entries[i].err);
+    }
+    VIR_FREE(data.entries);
+    virHashFree(data.stamps);
+    if (mutex)
+        virMutexDestroy(&data.lock);
+    if (ret < 0 && !names)
+        virStoragePoolObjClearVols(pool);
+    return ret;
+}
+
+
+static int
+virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                   virStoragePoolObjPtr pool)
+{
+    return virStorageBackendFileSystemRefreshInternal(pool, NULL, 0, false);
+}
+
+
+static int
+virStorageBackendFileSystemRefreshIncremental(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                              virStoragePoolObjPtr pool)
+{
+    return virStorageBackendFileSystemRefreshInternal(pool, NULL, 0, true);
+}
+
+
+static int
+virStorageBackendFileSystemRefreshVols(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                       virStoragePoolObjPtr pool,
+                                       const char *const *names,
+                                       size_t nnames)
+{
+    return virStorageBackendFileSystemRefreshInternal(pool, names, nnames,
+                                                      true);
 }
 
 
@@ -1088,6 +1408,8 @@ _virStorageBackendFileSystemVolBuild(virConnectPtr conn,
         create_func = virStorageBackendCreateRaw;
     } else if (vol->target.format == VIR_STORAGE_FILE_DIR) {
         create_func = createFileDir;
+    } else if ((create_func = virStorageBackendGetBuildQcow2Function(vol))) {
+        /* Written in-process, no image tool needed */
     } else if ((tool_type = virStorageBackendFindFSImageTool(NULL)) != -1) {
         create_func = virStorageBackendFSImageToolTypeToFunc(tool_type);
 
@@ -1297,6 +1619,8 @@ virStorageBackend virStorageBackendDirectory = {
     .buildPool = virStorageBackendFileSystemBuild,
     .checkPool = virStorageBackendFileSystemCheck,
     .refreshPool = virStorageBackendFileSystemRefresh,
+    .refreshPoolIncremental = virStorageBackendFileSystemRefreshIncremental,
+    .refreshPoolVols = virStorageBackendFileSystemRefreshVols,
     .deletePool = virStorageBackendFileSystemDelete,
     .buildVol = virStorageBackendFileSystemVolBuild,
     .buildVolFrom = virStorageBackendFileSystemVolBuildFrom,
@@ -1314,6 +1638,8 @@ virStorageBackend virStorageBackendFileSystem = {
     .checkPool = virStorageBackendFileSystemCheck,
     .startPool = virStorageBackendFileSystemStart,
     .refreshPool = virStorageBackendFileSystemRefresh,
+    .refreshPoolIncremental = virStorageBackendFileSystemRefreshIncremental,
+    .refreshPoolVols = virStorageBackendFileSystemRefreshVols,
     .stopPool = virStorageBackendFileSystemStop,
     .deletePool = virStorageBackendFileSystemDelete,
     .buildVol = virStorageBackendFileSystemVolBuild,
@@ -1331,6 +1657,8 @@ virStorageBackend virStorageBackendNetFileSystem = {
     .startPool = virStorageBackendFileSystemStart,
     .findPoolSources = virStorageBackendFileSystemNetFindPoolSources,
     .refreshPool = virStorageBackendFileSystemRefresh,
+    .refreshPoolIncremental = virStorageBackendFileSystemRefreshIncremental,
+    .refreshPoolVols = virStorageBackendFileSystemRefreshVols,
     .stopPool = virStorageBackendFileSystemStop,
     .deletePool = virStorageBackendFileSystemDelete,
     .buildVol = virStorageBackendFileSystemVolBuild,
@@ -39,6 +39,9 @@
 #include "virlog.h"
 #include "virfile.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -46,6 +49,59 @@ VIR_LOG_INIT("storage.storage_backend_logical");
 
 #define PV_BLANK_SECTOR_SIZE 512
 
+/*
+ * Every lvs and vgs run scans all the physical volumes of the host, so
+ * rather than querying the volume group of each pool separately, the
+ * refreshes of all pools at autostart share a report of all volume
+ * groups, which is gathered at once and kept for
+ * VIR_STORAGE_LOGICAL_REPORT_TTL milliseconds or until libvirt itself
+ * changes a volume group. Other refreshes, asked for by users who
+ * expect to see the current state of LVM, always query it directly.
+ */
+#define VIR_STORAGE_LOGICAL_REPORT_TTL 2000
+#define VIR_STORAGE_LOGICAL_LV_FIELDS 10
+
+typedef struct _virStorageBackendLogicalVG virStorageBackendLogicalVG;
+typedef virStorageBackendLogicalVG *virStorageBackendLogicalVGPtr;
+struct _virStorageBackendLogicalVG {
+    char *size;
+    char *free;
+
+    /* VIR_STORAGE_LOGICAL_LV_FIELDS columns of lvs output per segment */
+    size_t nsegs;
+    char **segs;
+};
+
+static virMutex virStorageBackendLogicalReportLock;
+static virHashTablePtr virStorageBackendLogicalReport;
+static unsigned long long virStorageBackendLogicalReportStamp;
+
+static int
+virStorageBackendLogicalReportOnceInit(void)
+{
+    if (virMutexInit(&virStorageBackendLogicalReportLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        return -1;
+    }
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStorageBackendLogicalReport)
+
+
+/* Make the next pool refresh query LVM again */
+static void
+virStorageBackendLogicalReportInvalidate(void)
+{
+    if (virStorageBackendLogicalReportInitialize() < 0)
+        return;
+
+    virMutexLock(&virStorageBackendLogicalReportLock);
+    virStorageBackendLogicalReportStamp = 0;
+    virMutexUnlock(&virStorageBackendLogicalReportLock);
+}
+
 
 static int
 virStorageBackendLogicalSetActive(virStoragePoolObjPtr pool,
@@ -60,6 +116,7 @@ virStorageBackendLogicalSetActive(virStoragePoolObjPtr pool,
 
     ret = virCommandRun(cmd, NULL);
     virCommandFree(cmd);
+    virStorageBackendLogicalReportInvalidate();
     return ret;
 }
 
@@ -257,8 +314,7 @@ virStorageBackendLogicalMakeVol(char **const groups,
         vol->source.nextent++;
     }
 
-    if (is_new_vol &&
-        VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0)
+    if (is_new_vol && virStoragePoolObjAddVol(pool, vol) < 0)
         goto cleanup;
 
     ret = 0;
@@ -351,6 +407,239 @@ virStorageBackendLogicalRefreshPoolFunc(char **const groups,
 }
 
 
+static void
+virStorageBackendLogicalVGFree(void *payload,
+                               const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageBackendLogicalVGPtr vg = payload;
+    size_t i;
+
+    for (i = 0; i < vg->nsegs * VIR_STORAGE_LOGICAL_LV_FIELDS; i++)
+        VIR_FREE(vg->segs[i]);
+    VIR_FREE(vg->segs);
+    VIR_FREE(vg->size);
+    VIR_FREE(vg->free);
+    VIR_FREE(vg);
+}
+
+
+static virStorageBackendLogicalVGPtr
+virStorageBackendLogicalReportGetVG(virHashTablePtr report,
+                                    const char *name)
+{
+    virStorageBackendLogicalVGPtr vg;
+
+    if ((vg = virHashLookup(report, name)))
+        return vg;
+
+    if (VIR_ALLOC(vg) < 0)
+        return NULL;
+
+    if (virHashAddEntry(report, name, vg) < 0) {
+        VIR_FREE(vg);
+        return NULL;
+    }
+
+    return vg;
+}
+
+
+static int
+virStorageBackendLogicalReportLVFunc(char **const groups,
+                                     void *data)
+{
+    virHashTablePtr report = data;
+    const char *vgname = groups[VIR_STORAGE_LOGICAL_LV_FIELDS];
+    virStorageBackendLogicalVGPtr vg;
+    size_t first;
+    size_t i;
+
+    if (!(vg = virStorageBackendLogicalReportGetVG(report, vgname)))
+        return -1;
+
+    first = vg->nsegs * VIR_STORAGE_LOGICAL_LV_FIELDS;
+    if (VIR_EXPAND_N(vg->segs, first, VIR_STORAGE_LOGICAL_LV_FIELDS) < 0)
+        return -1;
+    first -= VIR_STORAGE_LOGICAL_LV_FIELDS;
+    vg->nsegs++;
+
+    for (i = 0; i < VIR_STORAGE_LOGICAL_LV_FIELDS; i++) {
+        if (VIR_STRDUP(vg->segs[first + i], groups[i]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virStorageBackendLogicalReportVGFunc(char **const groups,
+                                     void *data)
+{
+    virHashTablePtr report = data;
+    virStorageBackendLogicalVGPtr vg;
+
+    if (!(vg = virStorageBackendLogicalReportGetVG(report, groups[0])))
+        return -1;
+
+    VIR_FREE(vg->size);
+    VIR_FREE(vg->free);
+    if (VIR_STRDUP(vg->size, groups[1]) < 0 ||
+        VIR_STRDUP(vg->free, groups[2]) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/*
+ * Run lvs and vgs once for all volume groups of the host, see
+ * virStorageBackendLogicalFindLVs and virStorageBackendLogicalRefreshPool
+ * for the format of their output, and sort it by volume group.
+ */
+static virHashTablePtr
+virStorageBackendLogicalReportGather(void)
+{
+    const char *lvregexes[] = {
+       "^\\s*(\\S+)#(\\S*)#(\\S+)#(\\S+)#(\\S+)#([0-9]+)#(\\S+)#([0-9]+)#([0-9]+)#(\\S+)#(\\S+)#?\\s*$"
+    };
+    int lvvars[] = {
+        VIR_STORAGE_LOGICAL_LV_FIELDS + 1
+    };
+    const char *vgregexes[] = {
+        "^\\s*(\\S+):([0-9]+):([0-9]+):?\\s*$"
+    };
+    int vgvars[] = {
+        3
+    };
+    virHashTablePtr report = NULL;
+    virCommandPtr cmd = NULL;
+
+    if (!(report = virHashCreate(16, virStorageBackendLogicalVGFree)))
+        goto error;
+
+    cmd = virCommandNewArgList(LVS,
+                               "--separator", "#",
+                               "--noheadings",
+                               "--units", "b",
+                               "--unbuffered",
+                               "--nosuffix",
+                               "--options",
+                               "lv_name,origin,uuid,devices,segtype,stripes,seg_size,vg_extent_size,size,lv_attr,vg_name",
+                               NULL);
+    if (virCommandRunRegex(cmd, 1, lvregexes, lvvars,
+                           virStorageBackendLogicalReportLVFunc,
+                           report, "lvs") < 0)
+        goto error;
+    virCommandFree(cmd);
+
+    cmd = virCommandNewArgList(VGS,
+                               "--separator", ":",
+                               "--noheadings",
+                               "--units", "b",
+                               "--unbuffered",
+                               "--nosuffix",
+                               "--options", "vg_name,vg_size,vg_free",
+                               NULL);
+    if (virCommandRunRegex(cmd, 1, vgregexes, vgvars,
+                           virStorageBackendLogicalReportVGFunc,
+                           report, "vgs") < 0)
+        goto error;
+    virCommandFree(cmd);
+
+    return report;
+
+ error:
+    virCommandFree(cmd);
+    virHashFree(report);
+    return NULL;
+}
+
+
+/*
+ * Refresh @pool from the shared report of all volume groups, gathering
+ * it again if it is too old.
+ *
+ * Returns 1 if the pool was refreshed, 0 if its volume group is not in
+ * the report and the caller should query it directly, -1 on error.
+ */
+static int
+virStorageBackendLogicalRefreshFromReport(virStoragePoolObjPtr pool)
+{
+    struct virStorageBackendLogicalPoolVolData cbdata = {
+        .pool = pool,
+        .vol = NULL,
+    };
+    virStorageBackendLogicalVGPtr vg;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+
+    if (virStorageBackendLogicalReportInitialize() < 0 ||
+        virTimeMillisNow(&now) < 0)
+        return -1;
+
+    virMutexLock(&virStorageBackendLogicalReportLock);
+
+    if (virStorageBackendLogicalReportStamp == 0 ||
+        now - virStorageBackendLogicalReportStamp >
+        VIR_STORAGE_LOGICAL_REPORT_TTL) {
+        virHashFree(virStorageBackendLogicalReport);
+        /* On failure, don't try again until the report would have
+         * expired, as every pool falls back to its own query */
+        if (!(virStorageBackendLogicalReport =
+              virStorageBackendLogicalReportGather())) {
+            VIR_WARN("Failed to query all volume groups: %s",
+                     virGetLastErrorMessage());
+            virResetLastError();
+        }
+        virStorageBackendLogicalReportStamp = now;
+    }
+
+    if (!virStorageBackendLogicalReport ||
+        !(vg = virHashLookup(virStorageBackendLogicalReport,
+                             pool->def->source.name)) ||
+        !vg->size) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    for (i = 0; i < vg->nsegs; i++) {
+        char *groups[VIR_STORAGE_LOGICAL_LV_FIELDS];
+        char *devices = NULL;
+        int rc;
+
+        /* The volume parser modifies the devices column in place */
+        memcpy(groups, vg->segs + i * VIR_STORAGE_LOGICAL_LV_FIELDS,
+               sizeof(groups));
+        if (VIR_STRDUP(devices, groups[3]) < 0)
+            goto cleanup;
+        groups[3] = devices;
+
+        rc = virStorageBackendLogicalMakeVol(groups, &cbdata);
+        VIR_FREE(devices);
+        if (rc < 0)
+            goto cleanup;
+    }
+
+    {
+        char *groups[] = { vg->size, vg->free };
+        if (virStorageBackendLogicalRefreshPoolFunc(groups, pool) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("malformed size of volume group '%s'"),
+                           pool->def->source.name);
+            goto cleanup;
+        }
+    }
+
+    ret = 1;
+
+ cleanup:
+    virMutexUnlock(&virStorageBackendLogicalReportLock);
+    return ret;
+}
+
+
 static int
 virStorageBackendLogicalFindPoolSourcesFunc(char **const groups,
                                             void *data)
@@ -561,6 +850,7 @@ virStorageBackendLogicalBuildPool(virConnectPtr conn ATTRIBUTE_UNUSED,
 
  cleanup:
     virCommandFree(vgcmd);
+    virStorageBackendLogicalReportInvalidate();
     return ret;
 }
 
@@ -585,9 +875,16 @@ virStorageBackendLogicalRefreshPool(virConnectPtr conn ATTRIBUTE_UNUSED,
     };
     virCommandPtr cmd = NULL;
     int ret = -1;
+    int rc;
 
     virFileWaitForDevices();
 
+    if (pool->batchRefresh &&
+        (rc = virStorageBackendLogicalRefreshFromReport(pool)) != 0) {
+        ret = rc < 0 ? -1 : 0;
+        goto cleanup;
+    }
+
     /* Get list of all logical volumes */
     if (virStorageBackendLogicalFindLVs(pool, NULL) < 0)
         goto cleanup;
@@ -655,6 +952,7 @@ virStorageBackendLogicalDeletePool(virConnectPtr conn ATTRIBUTE_UNUSED,
         goto cleanup;
     virCommandFree(cmd);
     cmd = NULL;
+    virStorageBackendLogicalReportInvalidate();
 
     /* now remove the pv devices and clear them out */
     ret = 0;
@@ -707,6 +1005,7 @@ virStorageBackendLogicalDeleteVol(virConnectPtr conn ATTRIBUTE_UNUSED,
  cleanup:
     virCommandFree(lvchange_cmd);
     virCommandFree(lvremove_cmd);
+    virStorageBackendLogicalReportInvalidate();
     return ret;
 }
 
@@ -762,6 +1061,7 @@ virStorageBackendLogicalCreateVol(virConnectPtr conn,
 
     virCommandFree(cmd);
     cmd = NULL;
+    virStorageBackendLogicalReportInvalidate();
 
     if ((fd = virStorageBackendVolOpen(vol->target.path, &sb,
                                        VIR_STORAGE_VOL_OPEN_DEFAULT)) < 0)
@@ -35,6 +35,9 @@
 #endif
 #include <errno.h>
 #include <string.h>
+#ifdef __linux__
+# include <sys/inotify.h>
+#endif
 
 #include "virerror.h"
 #include "datatypes.h"
@@ -49,6 +52,10 @@
 #include "configmake.h"
 #include "virstring.h"
 #include "viraccessapicheck.h"
+#include "virobject.h"
+#include "virthread.h"
+#include "virconf.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -57,15 +64,503 @@ VIR_LOG_INIT("storage.storage_driver");
 static virStorageDriverStatePtr driverState;
 
 static int storageStateCleanup(void);
+static int storageVolWipeInternal(virStorageVolDefPtr def,
+                                  unsigned int algorithm);
 
+/*
+ * Lock order is driver, then pool, then anything else. The driver lock
+ * is held for writing to add, remove or redefine pools and for reading
+ * to look them up, so that operations on different pools don't wait
+ * for each other. Pool locks are likewise held for reading by the
+ * operations that only look at a pool and its volumes.
+ */
 static void storageDriverLock(virStorageDriverStatePtr driver)
 {
-    virMutexLock(&driver->lock);
+    virRWLockWrite(&driver->lock);
+}
+static void storageDriverLockRead(virStorageDriverStatePtr driver)
+{
+    virRWLockRead(&driver->lock);
 }
 static void storageDriverUnlock(virStorageDriverStatePtr driver)
 {
-    virMutexUnlock(&driver->lock);
+    virRWLockUnlock(&driver->lock);
+}
+
+
+/*
+ * Find the pool with @uuid, or named @name if @uuid is NULL, and lock
+ * it for reading. The caller holds the driver lock, which is enough
+ * to compare pools without locking each of them, as they only get a
+ * new definition with the driver lock held for writing.
+ */
+static virStoragePoolObjPtr
+storagePoolObjFindRead(virStorageDriverStatePtr driver,
+                       const unsigned char *uuid,
+                       const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < driver->pools.count; i++) {
+        virStoragePoolObjPtr pool = driver->pools.objs[i];
+
+        if (uuid ? !memcmp(pool->def->uuid, uuid, VIR_UUID_BUFLEN) :
+            STREQ(pool->def->name, name)) {
+            virStoragePoolObjLockRead(pool);
+            return pool;
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Wake up everyone waiting on the driver's jobCond */
+static void
+storageDriverJobSignal(virStorageDriverStatePtr driver)
+{
+    virMutexLock(&driver->jobLock);
+    virCondBroadcast(&driver->jobCond);
+    virMutexUnlock(&driver->jobLock);
+}
+
+
+/*
+ * Find the pool with @uuid and lock it for writing, waiting first for
+ * any refresh or wipe running with the pool unlocked to finish, and if
+ * @jobs is true for all its asynchronous jobs too. The driver lock is taken for
+ * writing if @write is true, for reading otherwise, and is still held
+ * on return.
+ */
+static virStoragePoolObjPtr
+storagePoolObjFindIdle(virStorageDriverStatePtr driver,
+                       const unsigned char *uuid,
+                       bool write,
+                       bool jobs)
+{
+    virStoragePoolObjPtr pool;
+
+    for (;;) {
+        if (write)
+            storageDriverLock(driver);
+        else
+            storageDriverLockRead(driver);
+
+        if (!(pool = virStoragePoolObjFindByUUID(&driver->pools, uuid)) ||
+            !(pool->refreshing || pool->wipejobs > 0 ||
+              (jobs && pool->asyncjobs > 0)))
+            return pool;
+
+        /* A failed refresh may drop the pool, so look it up again */
+        virMutexLock(&driver->jobLock);
+        virStoragePoolObjUnlock(pool);
+        storageDriverUnlock(driver);
+        ignore_value(virCondWait(&driver->jobCond, &driver->jobLock));
+        virMutexUnlock(&driver->jobLock);
+    }
+}
+
+
+/* Clear the refreshing flag of the locked @pool and wake up those
+ * waiting for it */
+static void
+storagePoolRefreshDone(virStorageDriverStatePtr driver,
+                       virStoragePoolObjPtr pool)
+{
+    pool->refreshing = false;
+    storageDriverJobSignal(driver);
+}
+
+
+#ifdef __linux__
+/* Changes seen in a watched pool directory are applied this many
+ * milliseconds after the first of them, so that bursts of events,
+ * e.g. while an image is copied in, cost a single update */
+# define STORAGE_POOL_WATCH_DELAY 500
+
+/*
+ * Watcher keeping the volumes of an active pool in sync with its
+ * target directory, for backends which implement refreshPoolVols.
+ * The event loop handle and timer each hold a reference, as does the
+ * pool object until the watch is stopped. Lock ordering is pool, then
+ * watch.
+ */
+typedef struct _virStoragePoolWatch virStoragePoolWatch;
+typedef virStoragePoolWatch *virStoragePoolWatchPtr;
+struct _virStoragePoolWatch {
+    virObjectLockable parent;
+
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int fd;                     /* inotify instance */
+    int handle;                 /* event loop handle for @fd */
+    int timer;                  /* coalescing timer */
+    bool armed;                 /* @timer is enabled */
+    bool busy;                  /* an update thread is running */
+    bool stopped;
+
+    virHashTablePtr pending;    /* names of the files which changed */
+    bool rescan;                /* events were lost, rescan the pool */
+};
+
+static virClassPtr virStoragePoolWatchClass;
+
+static void
+virStoragePoolWatchDispose(void *obj)
+{
+    virStoragePoolWatchPtr watch = obj;
+
+    VIR_FORCE_CLOSE(watch->fd);
+    virHashFree(watch->pending);
+}
+
+static int
+virStoragePoolWatchOnceInit(void)
+{
+    if (!(virStoragePoolWatchClass = virClassNew(virClassForObjectLockable(),
+                                                 "virStoragePoolWatch",
+                                                 sizeof(virStoragePoolWatch),
+                                                 virStoragePoolWatchDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStoragePoolWatch)
+
+
+/* Must be called with @watch locked */
+static void
+storagePoolWatchArm(virStoragePoolWatchPtr watch)
+{
+    if (watch->stopped || watch->busy || watch->armed)
+        return;
+
+    if (!watch->rescan && virHashSize(watch->pending) == 0)
+        return;
+
+    virEventUpdateTimeout(watch->timer, STORAGE_POOL_WATCH_DELAY);
+    watch->armed = true;
+}
+
+
+/*
+ * Move the names of the changed files of the locked @watch to @names.
+ * Returns 0 on success, -1 on error.
+ */
+static int
+storagePoolWatchTakePending(virStoragePoolWatchPtr watch,
+                            char ***names,
+                            size_t *nnames)
+{
+    virHashKeyValuePairPtr items;
+    size_t n;
+    int ret = -1;
+
+    if (!(items = virHashGetItems(watch->pending, NULL)))
+        return -1;
+
+    for (n = 0; items[n].key; n++)
+        ;
+
+    if (n && VIR_ALLOC_N(*names, n) < 0)
+        goto cleanup;
+
+    for (*nnames = 0; *nnames < n; (*nnames)++) {
+        if (VIR_STRDUP((*names)[*nnames], items[*nnames].key) < 0)
+            goto cleanup;
+    }
+
+    virHashRemoveAll(watch->pending);
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(items);
+    return ret;
+}
+
+
+static void
+storagePoolWatchUpdate(void *opaque)
+{
+    virStoragePoolWatchPtr watch = opaque;
+    virStoragePoolObjPtr pool = NULL;
+    virStorageBackendPtr backend;
+    char **names = NULL;
+    size_t nnames = 0;
+    bool rescan = false;
+    int rc;
+
+    storageDriverLockRead(driverState);
+    if (!(pool = virStoragePoolObjFindByUUID(&driverState->pools,
+                                             watch->uuid)))
+        goto cleanup;
+
+    /* Retried once the jobs are over */
+    if (pool->watch != watch || pool->asyncjobs > 0 || pool->refreshing ||
+        !(backend = virStorageBackendForType(pool->def->type)))
+        goto cleanup;
+
+    virObjectLock(watch);
+    if (watch->rescan && backend->refreshPoolIncremental) {
+        rescan = true;
+        virHashRemoveAll(watch->pending);
+    } else if (storagePoolWatchTakePending(watch, &names, &nnames) < 0) {
+        virObjectUnlock(watch);
+        VIR_WARN("Failed to collect changes of storage pool '%s'",
+                 pool->def->name);
+        virResetLastError();
+        goto cleanup;
+    }
+    watch->rescan = false;
+    virObjectUnlock(watch);
+
+    if (!rescan && nnames == 0)
+        goto cleanup;
+
+    VIR_DEBUG("Updating %zu volumes of storage pool '%s'%s",
+              nnames, pool->def->name, rescan ? " (rescan)" : "");
+
+    pool->refreshing = true;
+    storageDriverUnlock(driverState);
+
+    if (rescan)
+        rc = backend->refreshPoolIncremental(NULL, pool);
+    else
+        rc = backend->refreshPoolVols(NULL, pool,
+                                      (const char *const *)names, nnames);
+
+    virStoragePoolObjUnlock(pool);
+    storageDriverLockRead(driverState);
+    virStoragePoolObjLock(pool);
+    storagePoolRefreshDone(driverState, pool);
+
+    if (rc < 0) {
+        virErrorPtr err = virGetLastError();
+        VIR_WARN("Failed to update storage pool '%s': %s",
+                 pool->def->name, err ? err->message :
+                 _("no error message found"));
+        virResetLastError();
+    }
+
+ cleanup:
+    if (pool)
+        virStoragePoolObjUnlock(pool);
+    storageDriverUnlock(driverState);
+
+    virObjectLock(watch);
+    watch->busy = false;
+    storagePoolWatchArm(watch);
+    virObjectUnlock(watch);
+    virObjectUnref(watch);
+
+    while (nnames)
+        VIR_FREE(names[--nnames]);
+    VIR_FREE(names);
+
+    /* Last use of driverState, which may be gone right after */
+    virMutexLock(&driverState->jobLock);
+    driverState->watchThreads--;
+    virCondBroadcast(&driverState->jobCond);
+    virMutexUnlock(&driverState->jobLock);
+}
+
+
+static void
+storagePoolWatchTimeout(int timer, void *opaque)
+{
+    virStoragePoolWatchPtr watch = opaque;
+    virThread thread;
+
+    virObjectLock(watch);
+    virEventUpdateTimeout(timer, -1);
+    watch->armed = false;
+
+    if (watch->stopped || watch->busy)
+        goto cleanup;
+
+    /* Probing volumes may take a while, keep it off the event loop.
+     * The thread is counted before it starts, while the watch can't
+     * be stopped, so that storageStateCleanup waits for it */
+    watch->busy = true;
+    virObjectRef(watch);
+    virMutexLock(&driverState->jobLock);
+    driverState->watchThreads++;
+    virMutexUnlock(&driverState->jobLock);
+    if (virThreadCreate(&thread, false, storagePoolWatchUpdate, watch) < 0) {
+        VIR_WARN("Failed to create storage pool update thread");
+        virResetLastError();
+        virMutexLock(&driverState->jobLock);
+        driverState->watchThreads--;
+        virMutexUnlock(&driverState->jobLock);
+        virObjectUnref(watch);
+        watch->busy = false;
+        storagePoolWatchArm(watch);
+    }
+
+ cleanup:
+    virObjectUnlock(watch);
+}
+
+
+static void
+storagePoolWatchEvent(int handle ATTRIBUTE_UNUSED,
+                      int fd,
+                      int events ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    virStoragePoolWatchPtr watch = opaque;
+    char buf[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t got;
+
+    virObjectLock(watch);
+    if (watch->stopped)
+        goto cleanup;
+
+    while ((got = read(fd, buf, sizeof(buf))) != 0) {
+        size_t off = 0;
+
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                watch->rescan = true;
+            break;
+        }
+
+        while (off + sizeof(struct inotify_event) <= (size_t)got) {
+            struct inotify_event *e = (struct inotify_event *)(buf + off);
+
+            off += sizeof(*e) + e->len;
+
+            if (e->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF |
+                           IN_MOVE_SELF | IN_IGNORED)) {
+                watch->rescan = true;
+            } else if (e->len &&
+                       virHashUpdateEntry(watch->pending, e->name,
+                                          watch) < 0) {
+                virResetLastError();
+                watch->rescan = true;
+            }
+        }
+    }
+
+    storagePoolWatchArm(watch);
+
+ cleanup:
+    virObjectUnlock(watch);
+}
+
+
+/*
+ * Start watching the target directory of the locked, active @pool so
+ * that files added, changed or removed behind libvirt's back show up
+ * in its volumes without an explicit refresh, if watch_pools is set in
+ * storage.conf. This is best effort: the pool works as before if the
+ * watch can't be set up.
+ */
+static void
+storagePoolWatchStart(virStoragePoolObjPtr pool,
+                      virStorageBackendPtr backend)
+{
+    virStoragePoolWatchPtr watch = NULL;
+    virErrorPtr err;
+
+    if (!driverState->watchPools || !backend->refreshPoolVols || pool->watch)
+        return;
+
+    if (virStoragePoolWatchInitialize() < 0 ||
+        !(watch = virObjectLockableNew(virStoragePoolWatchClass)))
+        goto error;
+
+    memcpy(watch->uuid, pool->def->uuid, VIR_UUID_BUFLEN);
+    watch->handle = -1;
+    watch->timer = -1;
+
+    if ((watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize inotify"));
+        goto error;
+    }
+
+    if (inotify_add_watch(watch->fd, pool->def->target.path,
+                          IN_CREATE | IN_DELETE | IN_CLOSE_WRITE |
+                          IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+                          IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) < 0) {
+        virReportSystemError(errno, _("cannot watch directory '%s'"),
+                             pool->def->target.path);
+        goto error;
+    }
+
+    if (!(watch->pending = virHashCreate(32, NULL)))
+        goto error;
+
+    virObjectRef(watch);
+    if ((watch->timer = virEventAddTimeout(-1, storagePoolWatchTimeout,
+                                           watch,
+                                           virObjectFreeCallback)) < 0) {
+        virObjectUnref(watch);
+        goto error;
+    }
+
+    virObjectRef(watch);
+    if ((watch->handle = virEventAddHandle(watch->fd,
+                                           VIR_EVENT_HANDLE_READABLE,
+                                           storagePoolWatchEvent,
+                                           watch,
+                                           virObjectFreeCallback)) < 0) {
+        virObjectUnref(watch);
+        goto error;
+    }
+
+    VIR_DEBUG("Watching storage pool '%s' in '%s'",
+              pool->def->name, pool->def->target.path);
+    pool->watch = watch;
+    return;
+
+ error:
+    err = virGetLastError();
+    VIR_WARN("Not watching storage pool '%s' for changes: %s",
+             pool->def->name, err ? err->message :
+             _("no event loop"));
+    virResetLastError();
+    if (watch) {
+        if (watch->timer >= 0)
+            virEventRemoveTimeout(watch->timer);
+        virObjectUnref(watch);
+    }
+}
+
+
+/* Stop the watch of the locked @pool, if any, before it is deactivated */
+static void
+storagePoolWatchStop(virStoragePoolObjPtr pool)
+{
+    virStoragePoolWatchPtr watch = pool->watch;
+
+    if (!watch)
+        return;
+    pool->watch = NULL;
+
+    virObjectLock(watch);
+    watch->stopped = true;
+    virEventRemoveHandle(watch->handle);
+    virEventRemoveTimeout(watch->timer);
+    virObjectUnlock(watch);
+    virObjectUnref(watch);
+}
+#else /* !__linux__ */
+static void
+storagePoolWatchStart(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED,
+                      virStorageBackendPtr backend ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+storagePoolWatchStop(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED)
+{
 }
+#endif /* !__linux__ */
 
 static void
 storageDriverAutostart(virStorageDriverStatePtr driver)
@@ -118,7 +613,12 @@ storageDriverAutostart(virStorageDriverStatePtr driver)
         }
 
         if (started) {
-            if (backend->refreshPool(conn, pool) < 0) {
+            int rc;
+
+            pool->batchRefresh = driver->lvmSharedReport;
+            rc = backend->refreshPool(conn, pool);
+            pool->batchRefresh = false;
+            if (rc < 0) {
                 virErrorPtr err = virGetLastError();
                 if (backend->stopPool)
                     backend->stopPool(conn, pool);
@@ -129,6 +629,7 @@ storageDriverAutostart(virStorageDriverStatePtr driver)
                 continue;
             }
             pool->active = 1;
+            storagePoolWatchStart(pool, backend);
         }
         virStoragePoolObjUnlock(pool);
     }
@@ -136,6 +637,45 @@ storageDriverAutostart(virStorageDriverStatePtr driver)
     virObjectUnref(conn);
 }
 
+/*
+ * Load the settings of the storage driver from @filename, keeping the
+ * defaults if it can't be read.
+ */
+static int
+storageDriverLoadConfig(virStorageDriverStatePtr driver,
+                        const char *filename)
+{
+    virConfPtr conf;
+    virConfValuePtr p;
+
+    /* Avoid error from non-existant or unreadable file. */
+    if (access(filename, R_OK) == -1)
+        return 0;
+    if (!(conf = virConfReadFile(filename, 0)))
+        return 0;
+
+#define CHECK_TYPE(name, typ) if (p && p->type != (typ)) {              \
+        virReportError(VIR_ERR_INTERNAL_ERROR,                          \
+                       "%s: %s: expected type " #typ,                   \
+                       filename, (name));                               \
+        virConfFree(conf);                                              \
+        return -1;                                                      \
+    }
+
+    p = virConfGetValue(conf, "watch_pools");
+    CHECK_TYPE("watch_pools", VIR_CONF_LONG);
+    if (p) driver->watchPools = p->l;
+
+    p = virConfGetValue(conf, "lvm_shared_report");
+    CHECK_TYPE("lvm_shared_report", VIR_CONF_LONG);
+    if (p) driver->lvmSharedReport = p->l;
+
+#undef CHECK_TYPE
+
+    virConfFree(conf);
+    return 0;
+}
+
 /**
  * virStorageStartup:
  *
@@ -147,16 +687,39 @@ storageStateInitialize(bool privileged,
                        void *opaque ATTRIBUTE_UNUSED)
 {
     char *base = NULL;
+    char *configFile = NULL;
 
     if (VIR_ALLOC(driverState) < 0)
         return -1;
 
-    if (virMutexInit(&driverState->lock) < 0) {
+    if (virRWLockInitPreferWriter(&driverState->lock) < 0) {
+        VIR_FREE(driverState);
+        return -1;
+    }
+    if (virMutexInit(&driverState->hintsLock) < 0) {
+        virRWLockDestroy(&driverState->lock);
+        VIR_FREE(driverState);
+        return -1;
+    }
+    if (virMutexInit(&driverState->jobLock) < 0) {
+        virMutexDestroy(&driverState->hintsLock);
+        virRWLockDestroy(&driverState->lock);
+        VIR_FREE(driverState);
+        return -1;
+    }
+    if (virCondInit(&driverState->jobCond) < 0) {
+        virMutexDestroy(&driverState->jobLock);
+        virMutexDestroy(&driverState->hintsLock);
+        virRWLockDestroy(&driverState->lock);
         VIR_FREE(driverState);
         return -1;
     }
     storageDriverLock(driverState);
 
+    if (!(driverState->volKeyPools = virHashCreate(64, virHashValueFree)) ||
+        !(driverState->volPathPools = virHashCreate(64, virHashValueFree)))
+        goto error;
+
     if (privileged) {
         if (VIR_STRDUP(base, SYSCONFDIR "/libvirt") < 0)
             goto error;
@@ -166,6 +729,12 @@ storageStateInitialize(bool privileged,
             goto error;
     }
     driverState->privileged = privileged;
+    driverState->lvmSharedReport = true;
+
+    if (virAsprintf(&configFile, "%s/storage.conf", base) < 0 ||
+        storageDriverLoadConfig(driverState, configFile) < 0)
+        goto error;
+    VIR_FREE(configFile);
 
     /* Configuration paths are either $USER_CONFIG_HOME/libvirt/storage/... (session) or
      * /etc/libvirt/storage/... (system).
@@ -189,6 +758,7 @@ storageStateInitialize(bool privileged,
     return 0;
 
  error:
+    VIR_FREE(configFile);
     VIR_FREE(base);
     storageDriverUnlock(driverState);
     storageStateCleanup();
@@ -242,18 +812,68 @@ storageStateReload(void)
 static int
 storageStateCleanup(void)
 {
+    size_t i;
+
     if (!driverState)
         return -1;
 
     storageDriverLock(driverState);
 
+    for (i = 0; i < driverState->pools.count; i++) {
+        virStoragePoolObjPtr pool = driverState->pools.objs[i];
+
+        virStoragePoolObjLock(pool);
+        storagePoolWatchStop(pool);
+        virStoragePoolObjUnlock(pool);
+    }
+
+    /* Volume jobs still queued or running are cancelled, those which
+     * can't be interrupted are left to finish. Jobs only end with the
+     * pool locked for writing, so the state read here holds. */
+    for (i = 0; i < driverState->pools.count; i++) {
+        virStoragePoolObjPtr pool = driverState->pools.objs[i];
+        size_t j;
+
+        virStoragePoolObjLockRead(pool);
+        for (j = 0; j < pool->volumes.count; j++) {
+            virStorageVolJobPtr job = pool->volumes.objs[j]->job;
+            virStorageVolJobInfo info;
+
+            if (!job)
+                continue;
+            virStorageVolJobGetInfo(job, &info);
+            if (info.state == VIR_STORAGE_VOL_JOB_STATE_QUEUED ||
+                info.state == VIR_STORAGE_VOL_JOB_STATE_RUNNING)
+                ignore_value(virStorageVolJobAbort(job));
+        }
+        virStoragePoolObjUnlock(pool);
+    }
+
+    /* No watcher thread starts once the watches are stopped, wait for
+     * the running ones and for the job threads, which need the driver
+     * lock to notice */
+    storageDriverUnlock(driverState);
+    virMutexLock(&driverState->jobLock);
+    virCondBroadcast(&driverState->jobCond);
+    while (driverState->watchThreads > 0 ||
+           driverState->jobThreads > 0)
+        ignore_value(virCondWait(&driverState->jobCond,
+                                 &driverState->jobLock));
+    virMutexUnlock(&driverState->jobLock);
+    storageDriverLock(driverState);
+
     /* free inactive pools */
     virStoragePoolObjListFree(&driverState->pools);
+    virHashFree(driverState->volKeyPools);
+    virHashFree(driverState->volPathPools);
 
     VIR_FREE(driverState->configDir);
     VIR_FREE(driverState->autostartDir);
     storageDriverUnlock(driverState);
-    virMutexDestroy(&driverState->lock);
+    virCondDestroy(&driverState->jobCond);
+    virMutexDestroy(&driverState->jobLock);
+    virMutexDestroy(&driverState->hintsLock);
+    virRWLockDestroy(&driverState->lock);
     VIR_FREE(driverState);
 
     return 0;
@@ -269,8 +889,8 @@ storagePoolLookupByUUID(virConnectPtr conn,
     virStoragePoolObjPtr pool;
     virStoragePoolPtr ret = NULL;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, uuid);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, uuid, NULL);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -299,8 +919,8 @@ storagePoolLookupByName(virConnectPtr conn,
     virStoragePoolObjPtr pool;
     virStoragePoolPtr ret = NULL;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByName(&driver->pools, name);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, NULL, name);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -328,8 +948,8 @@ storagePoolLookupByVolume(virStorageVolPtr vol)
     virStoragePoolObjPtr pool;
     virStoragePoolPtr ret = NULL;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByName(&driver->pools, vol->pool);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, NULL, vol->pool);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -381,10 +1001,10 @@ storageConnectNumOfStoragePools(virConnectPtr conn)
     if (virConnectNumOfStoragePoolsEnsureACL(conn) < 0)
         return -1;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     for (i = 0; i < driver->pools.count; i++) {
         virStoragePoolObjPtr obj = driver->pools.objs[i];
-        virStoragePoolObjLock(obj);
+        virStoragePoolObjLockRead(obj);
         if (virConnectNumOfStoragePoolsCheckACL(conn, obj->def) &&
             virStoragePoolObjIsActive(obj))
             nactive++;
@@ -407,10 +1027,10 @@ storageConnectListStoragePools(virConnectPtr conn,
     if (virConnectListStoragePoolsEnsureACL(conn) < 0)
         return -1;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     for (i = 0; i < driver->pools.count && got < nnames; i++) {
         virStoragePoolObjPtr obj = driver->pools.objs[i];
-        virStoragePoolObjLock(obj);
+        virStoragePoolObjLockRead(obj);
         if (virConnectListStoragePoolsCheckACL(conn, obj->def) &&
             virStoragePoolObjIsActive(obj)) {
             if (VIR_STRDUP(names[got], obj->def->name) < 0) {
@@ -442,10 +1062,10 @@ storageConnectNumOfDefinedStoragePools(virConnectPtr conn)
     if (virConnectNumOfDefinedStoragePoolsEnsureACL(conn) < 0)
         return -1;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     for (i = 0; i < driver->pools.count; i++) {
         virStoragePoolObjPtr obj = driver->pools.objs[i];
-        virStoragePoolObjLock(obj);
+        virStoragePoolObjLockRead(obj);
         if (virConnectNumOfDefinedStoragePoolsCheckACL(conn, obj->def) &&
             !virStoragePoolObjIsActive(obj))
             nactive++;
@@ -468,10 +1088,10 @@ storageConnectListDefinedStoragePools(virConnectPtr conn,
     if (virConnectListDefinedStoragePoolsEnsureACL(conn) < 0)
         return -1;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     for (i = 0; i < driver->pools.count && got < nnames; i++) {
         virStoragePoolObjPtr obj = driver->pools.objs[i];
-        virStoragePoolObjLock(obj);
+        virStoragePoolObjLockRead(obj);
         if (virConnectListDefinedStoragePoolsCheckACL(conn, obj->def) &&
             !virStoragePoolObjIsActive(obj)) {
             if (VIR_STRDUP(names[got], obj->def->name) < 0) {
@@ -540,8 +1160,8 @@ static int storagePoolIsActive(virStoragePoolPtr pool)
     virStoragePoolObjPtr obj;
     int ret = -1;
 
-    storageDriverLock(driver);
-    obj = virStoragePoolObjFindByUUID(&driver->pools, pool->uuid);
+    storageDriverLockRead(driver);
+    obj = storagePoolObjFindRead(driver, pool->uuid, NULL);
     storageDriverUnlock(driver);
     if (!obj) {
         virReportError(VIR_ERR_NO_STORAGE_POOL, NULL);
@@ -565,8 +1185,8 @@ static int storagePoolIsPersistent(virStoragePoolPtr pool)
     virStoragePoolObjPtr obj;
     int ret = -1;
 
-    storageDriverLock(driver);
-    obj = virStoragePoolObjFindByUUID(&driver->pools, pool->uuid);
+    storageDriverLockRead(driver);
+    obj = storagePoolObjFindRead(driver, pool->uuid, NULL);
     storageDriverUnlock(driver);
     if (!obj) {
         virReportError(VIR_ERR_NO_STORAGE_POOL, NULL);
@@ -634,6 +1254,7 @@ storagePoolCreateXML(virConnectPtr conn,
     }
     VIR_INFO("Creating storage pool '%s'", pool->def->name);
     pool->active = 1;
+    storagePoolWatchStart(pool, backend);
 
     ret = virGetStoragePool(conn, pool->def->name, pool->def->uuid,
                             NULL, NULL);
@@ -703,8 +1324,7 @@ storagePoolUndefine(virStoragePoolPtr obj)
     virStoragePoolObjPtr pool;
     int ret = -1;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    pool = storagePoolObjFindIdle(driver, obj->uuid, true, false);
     if (!pool) {
         virReportError(VIR_ERR_NO_STORAGE_POOL,
                        _("no storage pool with matching uuid %s"), obj->uuid);
@@ -763,7 +1383,7 @@ storagePoolCreate(virStoragePoolPtr obj,
 
     virCheckFlags(0, -1);
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
     storageDriverUnlock(driver);
 
@@ -797,6 +1417,7 @@ storagePoolCreate(virStoragePoolPtr obj,
 
     VIR_INFO("Starting up storage pool '%s'", pool->def->name);
     pool->active = 1;
+    storagePoolWatchStart(pool, backend);
     ret = 0;
 
  cleanup:
@@ -814,7 +1435,7 @@ storagePoolBuild(virStoragePoolPtr obj,
     virStorageBackendPtr backend;
     int ret = -1;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
     storageDriverUnlock(driver);
 
@@ -857,8 +1478,7 @@ storagePoolDestroy(virStoragePoolPtr obj)
     virStorageBackendPtr backend;
     int ret = -1;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    pool = storagePoolObjFindIdle(driver, obj->uuid, true, false);
 
     if (!pool) {
         virReportError(VIR_ERR_NO_STORAGE_POOL,
@@ -889,6 +1509,7 @@ storagePoolDestroy(virStoragePoolPtr obj)
         backend->stopPool(obj->conn, pool) < 0)
         goto cleanup;
 
+    storagePoolWatchStop(pool);
     virStoragePoolObjClearVols(pool);
 
     pool->active = 0;
@@ -920,8 +1541,7 @@ storagePoolDelete(virStoragePoolPtr obj,
     virStorageBackendPtr backend;
     int ret = -1;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    pool = storagePoolObjFindIdle(driver, obj->uuid, false, false);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -975,11 +1595,14 @@ storagePoolRefresh(virStoragePoolPtr obj,
     virStoragePoolObjPtr pool;
     virStorageBackendPtr backend;
     int ret = -1;
+    int rc;
 
     virCheckFlags(0, -1);
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    /* Other refreshes and jobs of the pool are waited for rather than
+     * failed */
+    pool = storagePoolObjFindIdle(driver, obj->uuid, false, true);
+    storageDriverUnlock(driver);
 
     if (!pool) {
         virReportError(VIR_ERR_NO_STORAGE_POOL,
@@ -999,15 +1622,25 @@ storagePoolRefresh(virStoragePoolPtr obj,
         goto cleanup;
     }
 
-    if (pool->asyncjobs > 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pool '%s' has asynchronous jobs running."),
-                       pool->def->name);
-        goto cleanup;
+    /* Other pools remain usable while the backend scans this one, as
+     * do the volumes of this one if the backend can refresh it
+     * incrementally */
+    pool->refreshing = true;
+    if (backend->refreshPoolIncremental) {
+        rc = backend->refreshPoolIncremental(obj->conn, pool);
+    } else {
+        virStoragePoolObjClearVols(pool);
+        rc = backend->refreshPool(obj->conn, pool);
     }
 
-    virStoragePoolObjClearVols(pool);
-    if (backend->refreshPool(obj->conn, pool) < 0) {
+    /* Dropping a transient pool takes the driver lock for writing */
+    virStoragePoolObjUnlock(pool);
+    storageDriverLock(driver);
+    virStoragePoolObjLock(pool);
+    storagePoolRefreshDone(driver, pool);
+
+    if (rc < 0) {
+        storagePoolWatchStop(pool);
         if (backend->stopPool)
             backend->stopPool(obj->conn, pool);
 
@@ -1017,14 +1650,14 @@ storagePoolRefresh(virStoragePoolPtr obj,
             virStoragePoolObjRemove(&driver->pools, pool);
             pool = NULL;
         }
-        goto cleanup;
+    } else {
+        ret = 0;
     }
-    ret = 0;
+    storageDriverUnlock(driver);
 
  cleanup:
     if (pool)
         virStoragePoolObjUnlock(pool);
-    storageDriverUnlock(driver);
     return ret;
 }
 
@@ -1037,8 +1670,8 @@ storagePoolGetInfo(virStoragePoolPtr obj,
     virStoragePoolObjPtr pool;
     int ret = -1;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, obj->uuid, NULL);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -1080,8 +1713,8 @@ storagePoolGetXMLDesc(virStoragePoolPtr obj,
 
     virCheckFlags(VIR_STORAGE_XML_INACTIVE, NULL);
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, obj->uuid, NULL);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -1114,8 +1747,8 @@ storagePoolGetAutostart(virStoragePoolPtr obj,
     virStoragePoolObjPtr pool;
     int ret = -1;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, obj->uuid, NULL);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -1148,7 +1781,7 @@ storagePoolSetAutostart(virStoragePoolPtr obj,
     virStoragePoolObjPtr pool;
     int ret = -1;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
 
     if (!pool) {
@@ -1212,8 +1845,8 @@ storagePoolNumOfVolumes(virStoragePoolPtr obj)
     int ret = -1;
     size_t i;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, obj->uuid, NULL);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -1255,8 +1888,8 @@ storagePoolListVolumes(virStoragePoolPtr obj,
 
     memset(names, 0, maxnames * sizeof(*names));
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, obj->uuid, NULL);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -1310,8 +1943,8 @@ storagePoolListAllVolumes(virStoragePoolPtr pool,
 
     virCheckFlags(0, -1);
 
-    storageDriverLock(driver);
-    obj = virStoragePoolObjFindByUUID(&driver->pools, pool->uuid);
+    storageDriverLockRead(driver);
+    obj = storagePoolObjFindRead(driver, pool->uuid, NULL);
     storageDriverUnlock(driver);
 
     if (!obj) {
@@ -1379,8 +2012,8 @@ storageVolLookupByName(virStoragePoolPtr obj,
     virStorageVolDefPtr vol;
     virStorageVolPtr ret = NULL;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, obj->uuid, NULL);
     storageDriverUnlock(driver);
 
     if (!pool) {
@@ -1417,52 +2050,272 @@ storageVolLookupByName(virStoragePoolPtr obj,
 }
 
 
+/* Remember that the volume with @id was first found in @pool by a
+ * scan of all pools started when virStoragePoolObjGetVolAdditions
+ * returned @stamp, so that the next lookup can try it first. Failing
+ * to do so is not fatal. */
+static void
+storageDriverRememberVolPool(virStorageDriverStatePtr driver,
+                             virHashTablePtr hints,
+                             const char *id,
+                             virStoragePoolObjPtr pool,
+                             unsigned int stamp)
+{
+    char *name;
+
+    if (VIR_STRDUP_QUIET(name, pool->def->name) < 0)
+        return;
+
+    virMutexLock(&driver->hintsLock);
+    /* A volume added since the scan started may now be found in an
+     * earlier pool, which lookups must keep returning */
+    if (stamp != driver->hintsStamp ||
+        virHashUpdateEntry(hints, id, name) < 0) {
+        VIR_FREE(name);
+        virResetLastError();
+    }
+    virMutexUnlock(&driver->hintsLock);
+}
+
+
+/* Forget the pool @hints remember for @id */
+static void
+storageDriverForgetVolPool(virStorageDriverStatePtr driver,
+                           virHashTablePtr hints,
+                           const char *id)
+{
+    virMutexLock(&driver->hintsLock);
+    ignore_value(virHashRemoveEntry(hints, id));
+    virMutexUnlock(&driver->hintsLock);
+}
+
+
+/* Try the pool @hints remember for @id first; returns the pool
+ * locked for reading, or NULL if there is no usable hint or the pool
+ * is busy, which sets @busy. @stamp is the value of
+ * virStoragePoolObjGetVolAdditions read before. The caller holds the
+ * driver lock. */
+static virStoragePoolObjPtr
+storageDriverHintedVolPool(virStorageDriverStatePtr driver,
+                           virHashTablePtr hints,
+                           const char *id,
+                           unsigned int stamp,
+                           bool *busy)
+{
+    virStoragePoolObjPtr pool = NULL;
+    char *name = NULL;
+    size_t i;
+
+    virMutexLock(&driver->hintsLock);
+    /* Any volume added since the hints were recorded may shadow the
+     * ones they point to */
+    if (driver->hintsStamp != stamp) {
+        virHashRemoveAll(driver->volKeyPools);
+        virHashRemoveAll(driver->volPathPools);
+        driver->hintsStamp = stamp;
+    }
+    ignore_value(VIR_STRDUP_QUIET(name, virHashLookup(hints, id)));
+    virMutexUnlock(&driver->hintsLock);
+
+    if (!name)
+        return NULL;
+
+    for (i = 0; i < driver->pools.count; i++) {
+        if (STREQ(driver->pools.objs[i]->def->name, name)) {
+            pool = driver->pools.objs[i];
+            if (!virStoragePoolObjTryLockRead(pool)) {
+                *busy = true;
+                pool = NULL;
+            }
+            break;
+        }
+    }
+
+    VIR_FREE(name);
+    return pool;
+}
+
+
+/* Volume lookups scanning all pools don't wait for a pool held for
+ * writing, e.g. while it is started, with the driver lock held, as
+ * that would hold up every change to the list of pools and with it
+ * every other lookup. They drop the driver lock and look again after
+ * this many milliseconds, or once a refresh or volume job ends. */
+#define STORAGE_VOL_LOOKUP_RETRY 50
+
+static void
+storageDriverVolLookupWait(virStorageDriverStatePtr driver)
+{
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0)
+        now = 0;
+
+    virMutexLock(&driver->jobLock);
+    ignore_value(virCondWaitUntil(&driver->jobCond, &driver->jobLock,
+                                  now + STORAGE_VOL_LOOKUP_RETRY));
+    virMutexUnlock(&driver->jobLock);
+}
+
+
+/*
+ * @pool must be locked. Returns 1 and fills @ret if @pool has a
+ * volume with @key, 0 if it has none and -1 on error.
+ */
+static int
+storageVolLookupByKeyInPool(virConnectPtr conn,
+                            virStoragePoolObjPtr pool,
+                            const char *key,
+                            virStorageVolPtr *ret)
+{
+    virStorageVolDefPtr vol;
+
+    if (!virStoragePoolObjIsActive(pool) ||
+        !(vol = virStorageVolDefFindByKey(pool, key)))
+        return 0;
+
+    if (virStorageVolLookupByKeyEnsureACL(conn, pool->def, vol) < 0)
+        return -1;
+
+    if (!(*ret = virGetStorageVol(conn, pool->def->name, vol->name,
+                                  vol->key, NULL, NULL)))
+        return -1;
+
+    return 1;
+}
+
+
 static virStorageVolPtr
 storageVolLookupByKey(virConnectPtr conn,
                       const char *key)
 {
     virStorageDriverStatePtr driver = conn->storagePrivateData;
+    virStoragePoolObjPtr pool;
     size_t i;
+    int rc = 0;
+    unsigned int stamp;
     virStorageVolPtr ret = NULL;
 
-    storageDriverLock(driver);
-    for (i = 0; i < driver->pools.count && !ret; i++) {
-        virStoragePoolObjLock(driver->pools.objs[i]);
-        if (virStoragePoolObjIsActive(driver->pools.objs[i])) {
-            virStorageVolDefPtr vol =
-                virStorageVolDefFindByKey(driver->pools.objs[i], key);
-
-            if (vol) {
-                if (virStorageVolLookupByKeyEnsureACL(conn, driver->pools.objs[i]->def, vol) < 0) {
-                    virStoragePoolObjUnlock(driver->pools.objs[i]);
-                    goto cleanup;
-                }
+    for (;;) {
+        bool busy = false;
+
+        storageDriverLockRead(driver);
+        stamp = virStoragePoolObjGetVolAdditions();
+        if ((pool = storageDriverHintedVolPool(driver, driver->volKeyPools,
+                                               key, stamp, &busy))) {
+            rc = storageVolLookupByKeyInPool(conn, pool, key, &ret);
+            virStoragePoolObjUnlock(pool);
+        }
+
+        if (rc == 0 && !busy)
+            storageDriverForgetVolPool(driver, driver->volKeyPools, key);
+
+        /* The first pool holding the volume wins, so a busy pool
+         * can't be skipped */
+        for (i = 0; i < driver->pools.count && rc == 0 && !busy; i++) {
+            pool = driver->pools.objs[i];
 
-                ret = virGetStorageVol(conn,
-                                       driver->pools.objs[i]->def->name,
-                                       vol->name,
-                                       vol->key,
-                                       NULL, NULL);
+            if (!virStoragePoolObjTryLockRead(pool)) {
+                busy = true;
+                break;
             }
+            rc = storageVolLookupByKeyInPool(conn, pool, key, &ret);
+            if (rc > 0)
+                storageDriverRememberVolPool(driver, driver->volKeyPools,
+                                             key, pool, stamp);
+            virStoragePoolObjUnlock(pool);
         }
-        virStoragePoolObjUnlock(driver->pools.objs[i]);
+
+        storageDriverUnlock(driver);
+        if (rc != 0 || !busy)
+            break;
+        storageDriverVolLookupWait(driver);
     }
 
-    if (!ret)
+    if (rc == 0)
         virReportError(VIR_ERR_NO_STORAGE_VOL,
                        _("no storage vol with matching key %s"), key);
 
- cleanup:
-    storageDriverUnlock(driver);
     return ret;
 }
 
+
+/*
+ * @pool must be locked. Returns 1 and fills @ret if @pool has a
+ * volume at @path (sanitized as @cleanpath), 0 if it has none and
+ * -1 on error.
+ */
+static int
+storageVolLookupByPathInPool(virConnectPtr conn,
+                             virStoragePoolObjPtr pool,
+                             const char *path,
+                             const char *cleanpath,
+                             virStorageVolPtr *ret)
+{
+    virStorageVolDefPtr vol;
+    char *stable_path = NULL;
+
+    if (!virStoragePoolObjIsActive(pool))
+        return 0;
+
+    switch ((enum virStoragePoolType) pool->def->type) {
+        case VIR_STORAGE_POOL_DIR:
+        case VIR_STORAGE_POOL_FS:
+        case VIR_STORAGE_POOL_NETFS:
+        case VIR_STORAGE_POOL_LOGICAL:
+        case VIR_STORAGE_POOL_DISK:
+        case VIR_STORAGE_POOL_ISCSI:
+        case VIR_STORAGE_POOL_SCSI:
+        case VIR_STORAGE_POOL_MPATH:
+            stable_path = virStorageBackendStablePath(pool,
+                                                      cleanpath,
+                                                      false);
+            if (stable_path == NULL) {
+                /* Don't break the whole lookup process if it fails on
+                 * getting the stable path for some of the pools.
+                 */
+                VIR_WARN("Failed to get stable path for pool '%s'",
+                         pool->def->name);
+                return 0;
+            }
+            break;
+
+        case VIR_STORAGE_POOL_GLUSTER:
+        case VIR_STORAGE_POOL_RBD:
+        case VIR_STORAGE_POOL_SHEEPDOG:
+        case VIR_STORAGE_POOL_LAST:
+            if (VIR_STRDUP(stable_path, path) < 0)
+                return -1;
+            break;
+    }
+
+    vol = virStorageVolDefFindByPath(pool, stable_path);
+    VIR_FREE(stable_path);
+
+    if (!vol)
+        return 0;
+
+    if (virStorageVolLookupByPathEnsureACL(conn, pool->def, vol) < 0)
+        return -1;
+
+    if (!(*ret = virGetStorageVol(conn, pool->def->name,
+                                  vol->name, vol->key,
+                                  NULL, NULL)))
+        return -1;
+
+    return 1;
+}
+
+
 static virStorageVolPtr
 storageVolLookupByPath(virConnectPtr conn,
                        const char *path)
 {
     virStorageDriverStatePtr driver = conn->storagePrivateData;
+    virStoragePoolObjPtr pool;
     size_t i;
+    int rc = 0;
+    unsigned int stamp;
     virStorageVolPtr ret = NULL;
     char *cleanpath;
 
@@ -1470,71 +2323,46 @@ storageVolLookupByPath(virConnectPtr conn,
     if (!cleanpath)
         return NULL;
 
-    storageDriverLock(driver);
-    for (i = 0; i < driver->pools.count && !ret; i++) {
-        virStoragePoolObjPtr pool = driver->pools.objs[i];
-        virStorageVolDefPtr vol;
-        char *stable_path = NULL;
-
-        virStoragePoolObjLock(pool);
+    for (;;) {
+        bool busy = false;
 
-        if (!virStoragePoolObjIsActive(pool)) {
-           virStoragePoolObjUnlock(pool);
-           continue;
+        storageDriverLockRead(driver);
+        stamp = virStoragePoolObjGetVolAdditions();
+        if ((pool = storageDriverHintedVolPool(driver, driver->volPathPools,
+                                               cleanpath, stamp, &busy))) {
+            rc = storageVolLookupByPathInPool(conn, pool, path, cleanpath,
+                                              &ret);
+            virStoragePoolObjUnlock(pool);
         }
 
-        switch ((enum virStoragePoolType) pool->def->type) {
-            case VIR_STORAGE_POOL_DIR:
-            case VIR_STORAGE_POOL_FS:
-            case VIR_STORAGE_POOL_NETFS:
-            case VIR_STORAGE_POOL_LOGICAL:
-            case VIR_STORAGE_POOL_DISK:
-            case VIR_STORAGE_POOL_ISCSI:
-            case VIR_STORAGE_POOL_SCSI:
-            case VIR_STORAGE_POOL_MPATH:
-                stable_path = virStorageBackendStablePath(pool,
-                                                          cleanpath,
-                                                          false);
-                if (stable_path == NULL) {
-                    /* Don't break the whole lookup process if it fails on
-                     * getting the stable path for some of the pools.
-                     */
-                    VIR_WARN("Failed to get stable path for pool '%s'",
-                             pool->def->name);
-                    virStoragePoolObjUnlock(pool);
-                    continue;
-                }
-                break;
+        if (rc == 0 && !busy)
+            storageDriverForgetVolPool(driver, driver->volPathPools,
+                                       cleanpath);
 
-            case VIR_STORAGE_POOL_GLUSTER:
-            case VIR_STORAGE_POOL_RBD:
-            case VIR_STORAGE_POOL_SHEEPDOG:
-            case VIR_STORAGE_POOL_LAST:
-                if (VIR_STRDUP(stable_path, path) < 0) {
-                     virStoragePoolObjUnlock(pool);
-                    goto cleanup;
-                }
-                break;
-        }
-
-        vol = virStorageVolDefFindByPath(pool, stable_path);
-        VIR_FREE(stable_path);
+        /* The first pool holding the volume wins, so a busy pool
+         * can't be skipped */
+        for (i = 0; i < driver->pools.count && rc == 0 && !busy; i++) {
+            pool = driver->pools.objs[i];
 
-        if (vol) {
-            if (virStorageVolLookupByPathEnsureACL(conn, pool->def, vol) < 0) {
-                virStoragePoolObjUnlock(pool);
-                goto cleanup;
+            if (!virStoragePoolObjTryLockRead(pool)) {
+                busy = true;
+                break;
             }
-
-            ret = virGetStorageVol(conn, pool->def->name,
-                                   vol->name, vol->key,
-                                   NULL, NULL);
+            rc = storageVolLookupByPathInPool(conn, pool, path, cleanpath,
+                                              &ret);
+            if (rc > 0)
+                storageDriverRememberVolPool(driver, driver->volPathPools,
+                                             cleanpath, pool, stamp);
+            virStoragePoolObjUnlock(pool);
         }
 
-        virStoragePoolObjUnlock(pool);
+        storageDriverUnlock(driver);
+        if (rc != 0 || !busy)
+            break;
+        storageDriverVolLookupWait(driver);
     }
 
-    if (!ret) {
+    if (rc == 0) {
         if (STREQ(path, cleanpath)) {
             virReportError(VIR_ERR_NO_STORAGE_VOL,
                            _("no storage vol with matching path '%s'"), path);
@@ -1545,13 +2373,34 @@ storageVolLookupByPath(virConnectPtr conn,
         }
     }
 
- cleanup:
     VIR_FREE(cleanpath);
-    storageDriverUnlock(driver);
     return ret;
 }
 
 
+/* Report an error if @vol is being allocated or used by a job which
+ * released the pool lock */
+static int
+storageVolCheckBusy(virStorageVolDefPtr vol)
+{
+    if (vol->building) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("volume '%s' is still being allocated."),
+                       vol->name);
+        return -1;
+    }
+
+    if (vol->in_use) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("volume '%s' is in use by another job."),
+                       vol->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 storageVolDeleteInternal(virStorageVolPtr obj,
                          virStorageBackendPtr backend,
@@ -1573,27 +2422,334 @@ storageVolDeleteInternal(virStorageVolPtr obj,
     if (backend->deleteVol(obj->conn, pool, vol, flags) < 0)
         goto cleanup;
 
-    /* Update pool metadata - don't update meta data from error paths
-     * in this module since the allocation/available weren't adjusted yet
-     */
-    if (updateMeta) {
-        pool->def->allocation -= vol->target.allocation;
-        pool->def->available += vol->target.allocation;
-    }
+    /* Update pool metadata - don't update meta data from error paths
+     * in this module since the allocation/available weren't adjusted yet
+     */
+    if (updateMeta) {
+        pool->def->allocation -= vol->target.allocation;
+        pool->def->available += vol->target.allocation;
+    }
+
+    for (i = 0; i < pool->volumes.count; i++) {
+        if (pool->volumes.objs[i] == vol) {
+            VIR_INFO("Deleting volume '%s' from storage pool '%s'",
+                     vol->name, pool->def->name);
+            virStoragePoolObjRemoveVol(pool, vol);
+            virStorageVolDefFree(vol);
+            break;
+        }
+    }
+    ret = 0;
+
+ cleanup:
+    return ret;
+}
+
+
+/* Number of volume jobs which may run at the same time in one pool.
+ * Further jobs are queued, so that they don't slow each other down by
+ * competing for the same disks. */
+#define STORAGE_POOL_MAX_RUNNING_JOBS 2
+
+typedef struct _storageVolJobData storageVolJobData;
+typedef storageVolJobData *storageVolJobDataPtr;
+struct _storageVolJobData {
+    virConnectPtr conn;
+    virStorageDriverStatePtr driver;
+    virStorageBackendPtr backend;
+    virStoragePoolObjPtr pool;
+    virStorageVolDefPtr vol;            /* Volume written by the job */
+    virStorageVolJobPtr job;            /* @vol's job */
+    bool async;
+
+    /* Clone source, and the pool holding it if not @pool */
+    virStoragePoolObjPtr origpool;
+    virStorageVolDefPtr origvol;
+    virStorageVolPtr volobj;            /* Clone being created */
+
+    unsigned int algorithm;             /* Wipe algorithm */
+    unsigned long long capacity;        /* New capacity of a resize */
+    unsigned int flags;                 /* Flags for the backend */
+};
+
+
+static void
+storageVolJobDataFree(storageVolJobDataPtr data)
+{
+    if (!data)
+        return;
+
+    virObjectUnref(data->volobj);
+    virObjectUnref(data->conn);
+    VIR_FREE(data);
+}
+
+
+/*
+ * Set up a job of @type on @vol, and mark the volumes and pools it
+ * uses busy, so that the pool locks can be released while it runs.
+ * The caller holds the locks of @pool and @origpool, if any, for
+ * writing and made sure the volumes are not busy.
+ */
+static storageVolJobDataPtr
+storageVolJobBegin(int type,
+                   virConnectPtr conn,
+                   virStorageBackendPtr backend,
+                   virStoragePoolObjPtr pool,
+                   virStorageVolDefPtr vol,
+                   virStoragePoolObjPtr origpool,
+                   virStorageVolDefPtr origvol,
+                   unsigned long long total)
+{
+    storageVolJobDataPtr data;
+    virStorageVolJobPtr job;
+
+    if (VIR_ALLOC(data) < 0)
+        return NULL;
+
+    if (!(job = virStorageVolJobNew(type, total))) {
+        VIR_FREE(data);
+        return NULL;
+    }
+
+    virStorageVolJobFree(vol->job);
+    vol->job = job;
+
+    data->conn = virObjectRef(conn);
+    data->driver = conn->storagePrivateData;
+    data->backend = backend;
+    data->pool = pool;
+    data->vol = vol;
+    data->job = job;
+    data->origpool = origpool;
+    data->origvol = origvol;
+
+    pool->asyncjobs++;
+    if (type == VIR_STORAGE_VOL_JOB_WIPE)
+        pool->wipejobs++;
+    if (type == VIR_STORAGE_VOL_JOB_CLONE)
+        vol->building = 1;
+    else
+        vol->in_use++;
+    if (origvol)
+        origvol->in_use++;
+    if (origpool)
+        origpool->asyncjobs++;
+
+    return data;
+}
+
+
+/*
+ * Wait until the pool can run another job, then run @data's job.
+ * Called without any pool lock held.
+ */
+static int
+storageVolJobRun(storageVolJobDataPtr data)
+{
+    virStorageDriverStatePtr driver = data->driver;
+    virStoragePoolObjPtr pool = data->pool;
+    int ret = -1;
+
+    virMutexLock(&driver->jobLock);
+    while (pool->runningjobs >= STORAGE_POOL_MAX_RUNNING_JOBS &&
+           !virStorageVolJobIsAborted(data->job))
+        ignore_value(virCondWait(&driver->jobCond, &driver->jobLock));
+
+    if (virStorageVolJobIsAborted(data->job)) {
+        virMutexUnlock(&driver->jobLock);
+        virReportError(VIR_ERR_OPERATION_ABORTED,
+                       _("job on volume '%s' was cancelled before it started"),
+                       data->vol->name);
+        return -1;
+    }
+    pool->runningjobs++;
+    virMutexUnlock(&driver->jobLock);
+
+    virStorageVolJobSetState(data->job, VIR_STORAGE_VOL_JOB_STATE_RUNNING);
+
+    switch ((virStorageVolJobType) data->job->type) {
+    case VIR_STORAGE_VOL_JOB_WIPE:
+        ret = storageVolWipeInternal(data->vol, data->algorithm);
+        break;
+
+    case VIR_STORAGE_VOL_JOB_CLONE:
+        ret = data->backend->buildVolFrom(data->conn, pool, data->vol,
+                                          data->origvol, data->flags);
+        break;
+
+    case VIR_STORAGE_VOL_JOB_RESIZE:
+        ret = data->backend->resizeVol(data->conn, pool, data->vol,
+                                       data->capacity, data->flags);
+        break;
+
+    case VIR_STORAGE_VOL_JOB_NONE:
+    case VIR_STORAGE_VOL_JOB_LAST:
+        break;
+    }
+
+    virMutexLock(&driver->jobLock);
+    pool->runningjobs--;
+    virCondBroadcast(&driver->jobCond);
+    virMutexUnlock(&driver->jobLock);
+
+    return ret < 0 ? -1 : 0;
+}
+
+
+/*
+ * Record the outcome @rc of @data's job, and update the volume and
+ * pool with its result once the pools are locked again. A clone which
+ * failed is deleted. Returns @rc.
+ */
+static int
+storageVolJobEnd(storageVolJobDataPtr data,
+                 int rc)
+{
+    virStorageDriverStatePtr driver = data->driver;
+    virStoragePoolObjPtr pool = data->pool;
+    virStorageVolDefPtr vol = data->vol;
+    int type = data->job->type;
+    int state;
+
+    if (rc == 0)
+        state = VIR_STORAGE_VOL_JOB_STATE_COMPLETED;
+    else if (virStorageVolJobIsAborted(data->job))
+        state = VIR_STORAGE_VOL_JOB_STATE_CANCELLED;
+    else
+        state = VIR_STORAGE_VOL_JOB_STATE_FAILED;
+
+    if (state == VIR_STORAGE_VOL_JOB_STATE_FAILED && data->async) {
+        virErrorPtr err = virGetLastError();
+        VIR_WARN("Job on volume '%s' in storage pool '%s' failed: %s",
+                 vol->name, pool->def->name,
+                 err && err->message ? err->message : _("unknown error"));
+    } else {
+        VIR_INFO("Job on volume '%s' in storage pool '%s' %s",
+                 vol->name, pool->def->name,
+                 state == VIR_STORAGE_VOL_JOB_STATE_COMPLETED ? "completed" :
+                 state == VIR_STORAGE_VOL_JOB_STATE_CANCELLED ?
+                 "was cancelled" : "failed");
+    }
+
+    /* Taking two pool locks must not race with another thread doing
+     * it the other way around */
+    if (data->origpool)
+        storageDriverLock(driver);
+    else
+        storageDriverLockRead(driver);
+    virStoragePoolObjLock(pool);
+    if (data->origpool)
+        virStoragePoolObjLock(data->origpool);
+    storageDriverUnlock(driver);
+
+    virStorageVolJobSetState(data->job, state);
+
+    if (data->origvol)
+        data->origvol->in_use--;
+    if (data->origpool) {
+        data->origpool->asyncjobs--;
+        virStoragePoolObjUnlock(data->origpool);
+    }
+    if (type == VIR_STORAGE_VOL_JOB_CLONE)
+        vol->building = 0;
+    else
+        vol->in_use--;
+    if (type == VIR_STORAGE_VOL_JOB_WIPE)
+        pool->wipejobs--;
+    pool->asyncjobs--;
+    storageDriverJobSignal(driver);
+
+    switch ((virStorageVolJobType) type) {
+    case VIR_STORAGE_VOL_JOB_CLONE:
+        if (rc < 0) {
+            storageVolDeleteInternal(data->volobj, data->backend, pool, vol,
+                                     0, false);
+            break;
+        }
+
+        /* Updating pool metadata */
+        pool->def->allocation += vol->target.allocation;
+        pool->def->available -= vol->target.allocation;
+        break;
+
+    case VIR_STORAGE_VOL_JOB_RESIZE:
+        if (rc < 0)
+            break;
+
+        vol->target.capacity = data->capacity;
+        if (data->flags & VIR_STORAGE_VOL_RESIZE_ALLOCATE)
+            vol->target.allocation = data->capacity;
+
+        /* Update pool metadata */
+        pool->def->allocation += (data->capacity - vol->target.capacity);
+        pool->def->available -= (data->capacity - vol->target.capacity);
+        break;
+
+    case VIR_STORAGE_VOL_JOB_WIPE:
+    case VIR_STORAGE_VOL_JOB_NONE:
+    case VIR_STORAGE_VOL_JOB_LAST:
+        break;
+    }
+
+    virStoragePoolObjUnlock(pool);
+    return rc;
+}
+
+
+static void
+storageVolJobThread(void *opaque)
+{
+    storageVolJobDataPtr data = opaque;
+    virStorageDriverStatePtr driver = data->driver;
+
+    storageVolJobEnd(data, storageVolJobRun(data));
+    storageVolJobDataFree(data);
+
+    virMutexLock(&driver->jobLock);
+    driver->jobThreads--;
+    virCondBroadcast(&driver->jobCond);
+    virMutexUnlock(&driver->jobLock);
+}
 
-    for (i = 0; i < pool->volumes.count; i++) {
-        if (pool->volumes.objs[i] == vol) {
-            VIR_INFO("Deleting volume '%s' from storage pool '%s'",
-                     vol->name, pool->def->name);
-            virStorageVolDefFree(vol);
 
-            VIR_DELETE_ELEMENT(pool->volumes.objs, i, pool->volumes.count);
-            break;
-        }
+/*
+ * Run the job set up by storageVolJobBegin, after the caller released
+ * the pool locks. If @async, the job runs in a new thread and 0 is
+ * returned once it was started; otherwise the outcome of the job is
+ * returned. Frees @data in any case.
+ */
+static int
+storageVolJobStart(storageVolJobDataPtr data,
+                   bool async)
+{
+    virThread thread;
+    int ret;
+
+    data->async = async;
+
+    if (async) {
+        /* Counted before the thread starts, so that storageStateCleanup
+         * can't miss it */
+        virMutexLock(&data->driver->jobLock);
+        data->driver->jobThreads++;
+        virMutexUnlock(&data->driver->jobLock);
+
+        if (virThreadCreate(&thread, false, storageVolJobThread, data) == 0)
+            return 0;
+        virReportSystemError(errno, "%s",
+                             _("Unable to create storage volume job thread"));
+
+        virMutexLock(&data->driver->jobLock);
+        data->driver->jobThreads--;
+        virMutexUnlock(&data->driver->jobLock);
+        ret = -1;
+    } else {
+        ret = storageVolJobRun(data);
     }
-    ret = 0;
 
- cleanup:
+    ret = storageVolJobEnd(data, ret);
+    storageVolJobDataFree(data);
     return ret;
 }
 
@@ -1608,7 +2764,7 @@ storageVolDelete(virStorageVolPtr obj,
     virStorageVolDefPtr vol = NULL;
     int ret = -1;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByName(&driver->pools, obj->pool);
     storageDriverUnlock(driver);
 
@@ -1640,12 +2796,8 @@ storageVolDelete(virStorageVolPtr obj,
     if (virStorageVolDeleteEnsureACL(obj->conn, pool->def, vol) < 0)
         goto cleanup;
 
-    if (vol->building) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("volume '%s' is still being allocated."),
-                       vol->name);
+    if (storageVolCheckBusy(vol) < 0)
         goto cleanup;
-    }
 
     if (storageVolDeleteInternal(obj, backend, pool, vol, flags, true) < 0)
         goto cleanup;
@@ -1673,7 +2825,7 @@ storageVolCreateXML(virStoragePoolPtr obj,
 
     virCheckFlags(VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA, NULL);
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
     storageDriverUnlock(driver);
 
@@ -1705,10 +2857,6 @@ storageVolCreateXML(virStoragePoolPtr obj,
         goto cleanup;
     }
 
-    if (VIR_REALLOC_N(pool->volumes.objs,
-                      pool->volumes.count+1) < 0)
-        goto cleanup;
-
     if (!backend->createVol) {
         virReportError(VIR_ERR_NO_SUPPORT,
                        "%s", _("storage pool does not support volume "
@@ -1723,11 +2871,12 @@ storageVolCreateXML(virStoragePoolPtr obj,
         goto cleanup;
     }
 
-    pool->volumes.objs[pool->volumes.count++] = voldef;
+    if (virStoragePoolObjAddVol(pool, voldef) < 0)
+        goto cleanup;
     volobj = virGetStorageVol(obj->conn, pool->def->name, voldef->name,
                               voldef->key, NULL, NULL);
     if (!volobj) {
-        pool->volumes.count--;
+        virStoragePoolObjRemoveVol(pool, voldef);
         goto cleanup;
     }
 
@@ -1752,12 +2901,13 @@ storageVolCreateXML(virStoragePoolPtr obj,
 
         buildret = backend->buildVol(obj->conn, pool, buildvoldef, flags);
 
-        storageDriverLock(driver);
+        storageDriverLockRead(driver);
         virStoragePoolObjLock(pool);
         storageDriverUnlock(driver);
 
         voldef->building = 0;
         pool->asyncjobs--;
+        storageDriverJobSignal(driver);
 
         voldef = NULL;
 
@@ -1800,10 +2950,10 @@ storageVolCreateXMLFrom(virStoragePoolPtr obj,
     virStorageBackendPtr backend;
     virStorageVolDefPtr origvol = NULL, newvol = NULL;
     virStorageVolPtr ret = NULL, volobj = NULL;
-    unsigned long long allocation;
-    int buildret;
+    storageVolJobDataPtr data;
 
-    virCheckFlags(VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA, NULL);
+    virCheckFlags(VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA |
+                  VIR_STORAGE_VOL_CREATE_ASYNC, NULL);
 
     storageDriverLock(driver);
     pool = virStoragePoolObjFindByUUID(&driver->pools, obj->uuid);
@@ -1879,21 +3029,13 @@ storageVolCreateXMLFrom(virStoragePoolPtr obj,
         goto cleanup;
     }
 
-    if (origvol->building) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("volume '%s' is still being allocated."),
-                       origvol->name);
+    if (storageVolCheckBusy(origvol) < 0)
         goto cleanup;
-    }
 
     if (backend->refreshVol &&
         backend->refreshVol(obj->conn, pool, origvol) < 0)
         goto cleanup;
 
-    if (VIR_REALLOC_N(pool->volumes.objs,
-                      pool->volumes.count+1) < 0)
-        goto cleanup;
-
     /* 'Define' the new volume so we get async progress reporting.
      * Wipe any key the user may have suggested, as volume creation
      * will generate the canonical key.  */
@@ -1902,57 +3044,40 @@ storageVolCreateXMLFrom(virStoragePoolPtr obj,
         goto cleanup;
     }
 
-    pool->volumes.objs[pool->volumes.count++] = newvol;
+    if (virStoragePoolObjAddVol(pool, newvol) < 0)
+        goto cleanup;
     volobj = virGetStorageVol(obj->conn, pool->def->name, newvol->name,
                               newvol->key, NULL, NULL);
     if (!volobj) {
-        pool->volumes.count--;
+        virStoragePoolObjRemoveVol(pool, newvol);
         goto cleanup;
     }
 
-    /* Drop the pool lock during volume allocation */
-    pool->asyncjobs++;
-    origvol->building = 1;
-    newvol->building = 1;
-    virStoragePoolObjUnlock(pool);
-
-    if (origpool) {
-        origpool->asyncjobs++;
-        virStoragePoolObjUnlock(origpool);
+    if (!(data = storageVolJobBegin(VIR_STORAGE_VOL_JOB_CLONE, obj->conn,
+                                    backend, pool, newvol, origpool, origvol,
+                                    origvol->target.capacity))) {
+        virStoragePoolObjRemoveVol(pool, newvol);
+        goto cleanup;
     }
+    data->volobj = virObjectRef(volobj);
+    data->flags = flags & ~VIR_STORAGE_VOL_CREATE_ASYNC;
 
-    buildret = backend->buildVolFrom(obj->conn, pool, newvol, origvol, flags);
-
-    storageDriverLock(driver);
-    virStoragePoolObjLock(pool);
-    if (origpool)
-        virStoragePoolObjLock(origpool);
-    storageDriverUnlock(driver);
-
-    origvol->building = 0;
-    newvol->building = 0;
-    allocation = newvol->target.allocation;
-    pool->asyncjobs--;
+    VIR_INFO("Creating volume '%s' in storage pool '%s'",
+             volobj->name, pool->def->name);
 
+    /* Drop the pool lock during volume allocation; the job deletes
+     * the new volume if it fails */
+    newvol = NULL;
+    virStoragePoolObjUnlock(pool);
+    pool = NULL;
     if (origpool) {
-        origpool->asyncjobs--;
         virStoragePoolObjUnlock(origpool);
         origpool = NULL;
     }
 
-    if (buildret < 0) {
-        storageVolDeleteInternal(volobj, backend, pool, newvol, 0, false);
-        newvol = NULL;
+    if (storageVolJobStart(data, flags & VIR_STORAGE_VOL_CREATE_ASYNC) < 0)
         goto cleanup;
-    }
-    newvol = NULL;
-
-    /* Updating pool metadata */
-    pool->def->allocation += allocation;
-    pool->def->available -= allocation;
 
-    VIR_INFO("Creating volume '%s' in storage pool '%s'",
-             volobj->name, pool->def->name);
     ret = volobj;
     volobj = NULL;
 
@@ -1979,9 +3104,9 @@ storageVolDownload(virStorageVolPtr obj,
     virStorageVolDefPtr vol = NULL;
     int ret = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM, -1);
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByName(&driver->pools, obj->pool);
     storageDriverUnlock(driver);
 
@@ -2010,18 +3135,21 @@ storageVolDownload(virStorageVolPtr obj,
     if (virStorageVolDownloadEnsureACL(obj->conn, pool->def, vol) < 0)
         goto cleanup;
 
-    if (vol->building) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("volume '%s' is still being allocated."),
-                       vol->name);
+    if (storageVolCheckBusy(vol) < 0)
         goto cleanup;
-    }
 
-    if (virFDStreamOpenFile(stream,
-                            vol->target.path,
-                            offset, length,
-                            O_RDONLY) < 0)
+    if (flags & VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM) {
+        if (virFDStreamOpenSparseFile(stream,
+                                      vol->target.path,
+                                      offset, length,
+                                      O_RDONLY) < 0)
+            goto cleanup;
+    } else if (virFDStreamOpenFile(stream,
+                                   vol->target.path,
+                                   offset, length,
+                                   O_RDONLY) < 0) {
         goto cleanup;
+    }
 
     ret = 0;
 
@@ -2045,9 +3173,9 @@ storageVolUpload(virStorageVolPtr obj,
     virStorageVolDefPtr vol = NULL;
     int ret = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, -1);
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByName(&driver->pools, obj->pool);
     storageDriverUnlock(driver);
 
@@ -2076,12 +3204,8 @@ storageVolUpload(virStorageVolPtr obj,
     if (virStorageVolUploadEnsureACL(obj->conn, pool->def, vol) < 0)
         goto cleanup;
 
-    if (vol->building) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("volume '%s' is still being allocated."),
-                       vol->name);
+    if (storageVolCheckBusy(vol) < 0)
         goto cleanup;
-    }
 
     switch ((enum virStoragePoolType) pool->def->type) {
     case VIR_STORAGE_POOL_DIR:
@@ -2094,9 +3218,14 @@ storageVolUpload(virStorageVolPtr obj,
     case VIR_STORAGE_POOL_MPATH:
         /* Not using O_CREAT because the file is required to already exist at
          * this point */
-        if (virFDStreamOpenFile(stream, vol->target.path,
-                                offset, length, O_WRONLY) < 0)
+        if (flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM) {
+            if (virFDStreamOpenSparseFile(stream, vol->target.path,
+                                          offset, length, O_WRONLY) < 0)
+                goto cleanup;
+        } else if (virFDStreamOpenFile(stream, vol->target.path,
+                                       offset, length, O_WRONLY) < 0) {
             goto cleanup;
+        }
 
         break;
 
@@ -2129,13 +3258,17 @@ storageVolResize(virStorageVolPtr obj,
     virStoragePoolObjPtr pool = NULL;
     virStorageVolDefPtr vol = NULL;
     unsigned long long abs_capacity;
+    storageVolJobDataPtr data;
+    bool async = !!(flags & VIR_STORAGE_VOL_RESIZE_ASYNC);
     int ret = -1;
 
     virCheckFlags(VIR_STORAGE_VOL_RESIZE_ALLOCATE |
                   VIR_STORAGE_VOL_RESIZE_DELTA |
-                  VIR_STORAGE_VOL_RESIZE_SHRINK, -1);
+                  VIR_STORAGE_VOL_RESIZE_SHRINK |
+                  VIR_STORAGE_VOL_RESIZE_ASYNC, -1);
+    flags &= ~VIR_STORAGE_VOL_RESIZE_ASYNC;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByName(&driver->pools, obj->pool);
     storageDriverUnlock(driver);
 
@@ -2167,12 +3300,8 @@ storageVolResize(virStorageVolPtr obj,
     if (virStorageVolResizeEnsureACL(obj->conn, pool->def, vol) < 0)
         goto cleanup;
 
-    if (vol->building) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("volume '%s' is still being allocated."),
-                       vol->name);
+    if (storageVolCheckBusy(vol) < 0)
         goto cleanup;
-    }
 
     if (flags & VIR_STORAGE_VOL_RESIZE_DELTA) {
         abs_capacity = vol->target.capacity + capacity;
@@ -2209,16 +3338,18 @@ storageVolResize(virStorageVolPtr obj,
         goto cleanup;
     }
 
-    if (backend->resizeVol(obj->conn, pool, vol, abs_capacity, flags) < 0)
+    if (!(data = storageVolJobBegin(VIR_STORAGE_VOL_JOB_RESIZE, obj->conn,
+                                    backend, pool, vol, NULL, NULL, 0)))
         goto cleanup;
+    data->capacity = abs_capacity;
+    data->flags = flags;
 
-    vol->target.capacity = abs_capacity;
-    if (flags & VIR_STORAGE_VOL_RESIZE_ALLOCATE)
-        vol->target.allocation = abs_capacity;
+    /* Allocating the new capacity may take a while */
+    virStoragePoolObjUnlock(pool);
+    pool = NULL;
 
-    /* Update pool metadata */
-    pool->def->allocation += (abs_capacity - vol->target.capacity);
-    pool->def->available -= (abs_capacity - vol->target.capacity);
+    if (storageVolJobStart(data, async) < 0)
+        goto cleanup;
 
     ret = 0;
 
@@ -2250,6 +3381,11 @@ storageVolZeroSparseFile(virStorageVolDefPtr vol,
 {
     int ret = -1;
 
+    /* The file is already sparse, deallocating all of it at once
+     * keeps its size for those looking at it meanwhile */
+    if (virFilePunchHole(fd, 0, size) == 0)
+        return 0;
+
     ret = ftruncate(fd, 0);
     if (ret == -1) {
         virReportSystemError(errno,
@@ -2271,46 +3407,225 @@ storageVolZeroSparseFile(virStorageVolDefPtr vol,
 }
 
 
+/* Zeros are written in chunks of this many bytes, by up to
+ * STORAGE_WIPE_MAX_WORKERS threads, when the kernel can't zero the
+ * volume by itself */
+#define STORAGE_WIPE_CHUNK (1024 * 1024)
+#define STORAGE_WIPE_MAX_WORKERS 4
+/* Alignment of the chunks written with O_DIRECT */
+#define STORAGE_WIPE_ALIGN 4096
+
+struct storageWipeData {
+    int fd;
+    const char *buf;            /* STORAGE_WIPE_CHUNK zeroed bytes */
+    off_t end;
+    virStorageVolJobPtr job;    /* Job to report progress to, or NULL */
+
+    virMutex lock;
+    off_t next;                 /* Start of the next chunk to write */
+    size_t wiped;
+    int err;                    /* errno of the first failed write */
+    off_t errpos;
+};
+
+
+static void
+storageWipeThread(void *opaque)
+{
+    struct storageWipeData *data = opaque;
+
+    while (true) {
+        off_t pos;
+        size_t len;
+        size_t done = 0;
+
+        virMutexLock(&data->lock);
+        if (data->err || data->next >= data->end) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        pos = data->next;
+        len = MIN(STORAGE_WIPE_CHUNK, data->end - pos);
+        data->next += len;
+        virMutexUnlock(&data->lock);
+
+        while (done < len) {
+            ssize_t r = pwrite(data->fd, data->buf + done,
+                               len - done, pos + done);
+
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0) {
+                virMutexLock(&data->lock);
+                if (!data->err) {
+                    data->err = r < 0 ? errno : EIO;
+                    data->errpos = pos + done;
+                }
+                virMutexUnlock(&data->lock);
+                return;
+            }
+            done += r;
+        }
+
+        virMutexLock(&data->lock);
+        data->wiped += len;
+        virMutexUnlock(&data->lock);
+
+        if (virStorageVolJobProgress(data->job, len) < 0) {
+            virMutexLock(&data->lock);
+            if (!data->err) {
+                data->err = ECANCELED;
+                data->errpos = pos + len;
+            }
+            virMutexUnlock(&data->lock);
+            return;
+        }
+    }
+}
+
+
+/*
+ * Write zeros over [@start, @end) of @fd using several threads. The
+ * range must be aligned to STORAGE_WIPE_ALIGN if @fd was opened with
+ * O_DIRECT. Returns 0 on success, or the errno of the first failed
+ * write with its offset in @errpos; ECANCELED if @job was aborted.
+ */
+static int
+storageWipeWrite(int fd,
+                 off_t start,
+                 off_t end,
+                 virStorageVolJobPtr job,
+                 size_t *bytes_wiped,
+                 off_t *errpos)
+{
+    struct storageWipeData data;
+    void *buf = NULL;
+
+    memset(&data, 0, sizeof(data));
+    data.fd = fd;
+    data.next = start;
+    data.end = end;
+    data.job = job;
+
+    if (start >= end)
+        return 0;
+
+#if HAVE_POSIX_MEMALIGN
+    if (posix_memalign(&buf, STORAGE_WIPE_ALIGN, STORAGE_WIPE_CHUNK) != 0) {
+        *errpos = start;
+        return ENOMEM;
+    }
+    memset(buf, 0, STORAGE_WIPE_CHUNK);
+#else
+    if (VIR_ALLOC_N_QUIET(buf, STORAGE_WIPE_CHUNK) < 0) {
+        *errpos = start;
+        return ENOMEM;
+    }
+#endif
+    data.buf = buf;
+
+    if (virMutexInit(&data.lock) < 0) {
+        VIR_FREE(buf);
+        *errpos = start;
+        return errno;
+    }
+
+    virThreadRunWorkers(MIN((end - start + STORAGE_WIPE_CHUNK - 1) /
+                            STORAGE_WIPE_CHUNK, STORAGE_WIPE_MAX_WORKERS),
+                        storageWipeThread, &data);
+
+    virMutexDestroy(&data.lock);
+    VIR_FREE(buf);
+
+    *bytes_wiped += data.wiped;
+    *errpos = data.errpos;
+    return data.err;
+}
+
+
+static void
+storageWipeReportError(virStorageVolDefPtr vol,
+                       int err,
+                       off_t errpos)
+{
+    if (err == ECANCELED)
+        virReportError(VIR_ERR_OPERATION_ABORTED,
+                       _("wiping volume with path '%s' was cancelled"),
+                       vol->target.path);
+    else
+        virReportSystemError(err,
+                             _("Failed to write to storage volume with "
+                               "path '%s' at offset %ju"),
+                             vol->target.path, (uintmax_t)errpos);
+}
+
+
+/*
+ * Zero the extent of @vol starting at @extent_start. The kernel is
+ * asked to zero as much of it as it can without the data going
+ * through userspace; the rest is written from large buffers, through
+ * @directfd if it isn't -1.
+ */
 static int
 storageWipeExtent(virStorageVolDefPtr vol,
                   int fd,
+                  int directfd,
                   off_t extent_start,
                   off_t extent_length,
-                  char *writebuf,
-                  size_t writebuf_length,
                   size_t *bytes_wiped)
 {
-    int ret = -1, written = 0;
-    off_t remaining = 0;
-    size_t write_size = 0;
+    int ret = -1;
+    off_t start = extent_start;
+    off_t end = extent_start + extent_length;
+    off_t aligned_end;
+    off_t first_end;
+    off_t errpos;
+    size_t direct_wiped = 0;
+    int err;
 
     VIR_DEBUG("extent logical start: %ju len: %ju",
               (uintmax_t)extent_start, (uintmax_t)extent_length);
 
-    if ((ret = lseek(fd, extent_start, SEEK_SET)) < 0) {
-        virReportSystemError(errno,
-                             _("Failed to seek to position %ju in volume "
-                               "with path '%s'"),
-                             (uintmax_t)extent_start, vol->target.path);
-        goto cleanup;
-    }
-
-    remaining = extent_length;
-    while (remaining > 0) {
-
-        write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
-        written = safewrite(fd, writebuf, write_size);
-        if (written < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to write %zu bytes to "
-                                   "storage volume with path '%s'"),
-                                 write_size, vol->target.path);
-
+    /* Block device ranges must be multiples of the sector size */
+    aligned_end = start + ((end - start) & ~(off_t)511);
+    if (start % 512 == 0 && aligned_end > start &&
+        virFileZeroRange(fd, start, aligned_end - start) == 0) {
+        VIR_DEBUG("Zeroed %ju bytes of volume with path '%s' in place",
+                  (uintmax_t)(aligned_end - start), vol->target.path);
+        *bytes_wiped += aligned_end - start;
+        ignore_value(virStorageVolJobProgress(vol->job, aligned_end - start));
+        start = aligned_end;
+    }
+
+    if (directfd >= 0 && start % STORAGE_WIPE_ALIGN == 0) {
+        aligned_end = start + ((end - start) &
+                               ~(off_t)(STORAGE_WIPE_ALIGN - 1));
+        /* A device wanting a larger alignment fails the very first
+         * write, which goes alone so that nothing is written, or
+         * counted, twice when falling back */
+        first_end = MIN(aligned_end, start + STORAGE_WIPE_CHUNK);
+        err = storageWipeWrite(directfd, start, first_end, vol->job,
+                               &direct_wiped, &errpos);
+        if (err == 0)
+            err = storageWipeWrite(directfd, first_end, aligned_end,
+                                   vol->job, &direct_wiped, &errpos);
+        *bytes_wiped += direct_wiped;
+
+        if (err == 0) {
+            start = aligned_end;
+        } else if (err == EINVAL && direct_wiped == 0) {
+            VIR_DEBUG("O_DIRECT write to '%s' failed, falling back",
+                      vol->target.path);
+        } else {
+            storageWipeReportError(vol, err, errpos);
             goto cleanup;
         }
+    }
 
-        *bytes_wiped += written;
-        remaining -= written;
+    if ((err = storageWipeWrite(fd, start, end, vol->job,
+                                bytes_wiped, &errpos)) != 0) {
+        storageWipeReportError(vol, err, errpos);
+        goto cleanup;
     }
 
     if (fdatasync(fd) < 0) {
@@ -2321,7 +3636,7 @@ storageWipeExtent(virStorageVolDefPtr vol,
         goto cleanup;
     }
 
-    VIR_DEBUG("Wrote %zu bytes to volume with path '%s'",
+    VIR_DEBUG("Wiped %zu bytes of volume with path '%s'",
               *bytes_wiped, vol->target.path);
 
     ret = 0;
@@ -2335,9 +3650,8 @@ static int
 storageVolWipeInternal(virStorageVolDefPtr def,
                        unsigned int algorithm)
 {
-    int ret = -1, fd = -1;
+    int ret = -1, fd = -1, directfd = -1;
     struct stat st;
-    char *writebuf = NULL;
     size_t bytes_wiped = 0;
     virCommandPtr cmd = NULL;
 
@@ -2403,24 +3717,27 @@ storageVolWipeInternal(virStorageVolDefPtr def,
     } else {
         if (S_ISREG(st.st_mode) && st.st_blocks < (st.st_size / DEV_BSIZE)) {
             ret = storageVolZeroSparseFile(def, st.st_size, fd);
+            if (ret == 0)
+                ignore_value(virStorageVolJobProgress(def->job, st.st_size));
         } else {
-
-            if (VIR_ALLOC_N(writebuf, st.st_blksize) < 0)
-                goto cleanup;
+            /* Bypassing the page cache avoids evicting everything
+             * else from it when writing out large volumes */
+            if (O_DIRECT)
+                directfd = open(def->target.path,
+                                O_WRONLY | O_DIRECT | O_CLOEXEC);
 
             ret = storageWipeExtent(def,
                                     fd,
+                                    directfd,
                                     0,
                                     def->target.allocation,
-                                    writebuf,
-                                    st.st_blksize,
                                     &bytes_wiped);
         }
     }
 
  cleanup:
     virCommandFree(cmd);
-    VIR_FREE(writebuf);
+    VIR_FORCE_CLOSE(directfd);
     VIR_FORCE_CLOSE(fd);
     return ret;
 }
@@ -2434,9 +3751,10 @@ storageVolWipePattern(virStorageVolPtr obj,
     virStorageDriverStatePtr driver = obj->conn->storagePrivateData;
     virStoragePoolObjPtr pool = NULL;
     virStorageVolDefPtr vol = NULL;
+    storageVolJobDataPtr data;
     int ret = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_WIPE_ASYNC, -1);
 
     if (algorithm >= VIR_STORAGE_VOL_WIPE_ALG_LAST) {
         virReportError(VIR_ERR_INVALID_ARG,
@@ -2445,7 +3763,7 @@ storageVolWipePattern(virStorageVolPtr obj,
         return -1;
     }
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByName(&driver->pools, obj->pool);
     storageDriverUnlock(driver);
 
@@ -2474,16 +3792,25 @@ storageVolWipePattern(virStorageVolPtr obj,
     if (virStorageVolWipePatternEnsureACL(obj->conn, pool->def, vol) < 0)
         goto cleanup;
 
-    if (vol->building) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("volume '%s' is still being allocated."),
-                       vol->name);
+    if (storageVolCheckBusy(vol) < 0)
         goto cleanup;
-    }
 
-    if (storageVolWipeInternal(vol, algorithm) == -1) {
+    /* Only zeroing reports its progress */
+    if (!(data = storageVolJobBegin(VIR_STORAGE_VOL_JOB_WIPE, obj->conn,
+                                    NULL, pool, vol, NULL, NULL,
+                                    algorithm == VIR_STORAGE_VOL_WIPE_ALG_ZERO ?
+                                    vol->target.allocation : 0)))
+        goto cleanup;
+    data->algorithm = algorithm;
+
+    /* Wiping takes a while; the job keeps the volume from being
+     * modified without holding the pool lock, and the pool from being
+     * destroyed, deleted or undefined, which wait for it to end */
+    virStoragePoolObjUnlock(pool);
+    pool = NULL;
+
+    if (storageVolJobStart(data, flags & VIR_STORAGE_VOL_WIPE_ASYNC) < 0)
         goto cleanup;
-    }
 
     ret = 0;
 
@@ -2514,7 +3841,7 @@ storageVolGetInfo(virStorageVolPtr obj,
     virStorageVolDefPtr vol;
     int ret = -1;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByName(&driver->pools, obj->pool);
     storageDriverUnlock(driver);
 
@@ -2562,6 +3889,107 @@ storageVolGetInfo(virStorageVolPtr obj,
     return ret;
 }
 
+static int
+storageVolGetJobInfo(virStorageVolPtr obj,
+                     virStorageVolJobInfoPtr info,
+                     unsigned int flags)
+{
+    virStorageDriverStatePtr driver = obj->conn->storagePrivateData;
+    virStoragePoolObjPtr pool;
+    virStorageVolDefPtr vol;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, NULL, obj->pool);
+    storageDriverUnlock(driver);
+
+    if (!pool) {
+        virReportError(VIR_ERR_NO_STORAGE_POOL,
+                       _("no storage pool with matching name '%s'"),
+                       obj->pool);
+        goto cleanup;
+    }
+
+    vol = virStorageVolDefFindByName(pool, obj->name);
+
+    if (!vol) {
+        virReportError(VIR_ERR_NO_STORAGE_VOL,
+                       _("no storage vol with matching name '%s'"),
+                       obj->name);
+        goto cleanup;
+    }
+
+    if (virStorageVolGetJobInfoEnsureACL(obj->conn, pool->def, vol) < 0)
+        goto cleanup;
+
+    if (vol->job)
+        virStorageVolJobGetInfo(vol->job, info);
+    else
+        memset(info, 0, sizeof(*info));
+    ret = 0;
+
+ cleanup:
+    if (pool)
+        virStoragePoolObjUnlock(pool);
+    return ret;
+}
+
+static int
+storageVolAbortJob(virStorageVolPtr obj,
+                   unsigned int flags)
+{
+    virStorageDriverStatePtr driver = obj->conn->storagePrivateData;
+    virStoragePoolObjPtr pool;
+    virStorageVolDefPtr vol;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, NULL, obj->pool);
+    storageDriverUnlock(driver);
+
+    if (!pool) {
+        virReportError(VIR_ERR_NO_STORAGE_POOL,
+                       _("no storage pool with matching name '%s'"),
+                       obj->pool);
+        goto cleanup;
+    }
+
+    vol = virStorageVolDefFindByName(pool, obj->name);
+
+    if (!vol) {
+        virReportError(VIR_ERR_NO_STORAGE_VOL,
+                       _("no storage vol with matching name '%s'"),
+                       obj->name);
+        goto cleanup;
+    }
+
+    if (virStorageVolAbortJobEnsureACL(obj->conn, pool->def, vol) < 0)
+        goto cleanup;
+
+    if (!vol->job) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("no job is active on volume '%s'"), vol->name);
+        goto cleanup;
+    }
+
+    if (virStorageVolJobAbort(vol->job) < 0)
+        goto cleanup;
+
+    /* Let the job go if it is waiting for its turn */
+    storageDriverJobSignal(driver);
+
+    ret = 0;
+
+ cleanup:
+    if (pool)
+        virStoragePoolObjUnlock(pool);
+    return ret;
+}
+
 static char *
 storageVolGetXMLDesc(virStorageVolPtr obj,
                      unsigned int flags)
@@ -2574,7 +4002,7 @@ storageVolGetXMLDesc(virStorageVolPtr obj,
 
     virCheckFlags(0, NULL);
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     pool = virStoragePoolObjFindByName(&driver->pools, obj->pool);
     storageDriverUnlock(driver);
 
@@ -2627,8 +4055,8 @@ storageVolGetPath(virStorageVolPtr obj)
     virStorageVolDefPtr vol;
     char *ret = NULL;
 
-    storageDriverLock(driver);
-    pool = virStoragePoolObjFindByName(&driver->pools, obj->pool);
+    storageDriverLockRead(driver);
+    pool = storagePoolObjFindRead(driver, NULL, obj->pool);
     storageDriverUnlock(driver);
     if (!pool) {
         virReportError(VIR_ERR_NO_STORAGE_POOL,
@@ -2676,7 +4104,7 @@ storageConnectListAllStoragePools(virConnectPtr conn,
     if (virConnectListAllStoragePoolsEnsureACL(conn) < 0)
         goto cleanup;
 
-    storageDriverLock(driver);
+    storageDriverLockRead(driver);
     ret = virStoragePoolObjListExport(conn, driver->pools, pools,
                                       virConnectListAllStoragePoolsCheckACL, flags);
     storageDriverUnlock(driver);
@@ -2732,6 +4160,8 @@ static virStorageDriver storageDriver = {
 
     .storagePoolIsActive = storagePoolIsActive, /* 0.7.3 */
     .storagePoolIsPersistent = storagePoolIsPersistent, /* 0.7.3 */
+    .storageVolGetJobInfo = storageVolGetJobInfo, /* 1.2.4 */
+    .storageVolAbortJob = storageVolAbortJob, /* 1.2.4 */
 };
 
 
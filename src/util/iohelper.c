@@ -23,6 +23,10 @@
  *   - Read existing file
  *   - Write existing file
  *   - Create & write new file
+ *   - Skip holes when reading sparse regular files, and keep
+ *     holes when writing zeros over them
+ *   - Exchange sparse streams, made of data and hole records,
+ *     with the other end of the pipe
  */
 
 #include <config.h>
@@ -30,6 +34,7 @@
 #include <locale.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -44,6 +49,12 @@
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
+/* Both tunable through the environment, see usage() */
+#define IOHELPER_DEFAULT_BUFFER_SIZE (1024 * 1024)
+#define IOHELPER_MAX_BUFFER_SIZE (64 * 1024 * 1024)
+#define IOHELPER_DEFAULT_BUFFERS 2
+#define IOHELPER_MAX_BUFFERS 16
+
 static int
 prepare(const char *path, int oflags, int mode,
         unsigned long long offset)
@@ -73,57 +84,713 @@ prepare(const char *path, int oflags, int mode,
     return fd;
 }
 
+typedef struct _runIOState runIOState;
+typedef runIOState *runIOStatePtr;
+struct _runIOState {
+    int fd;
+    int fdin, fdout;
+    const char *fdinname, *fdoutname;
+    unsigned long long length;
+    size_t buflen;
+    intptr_t alignMask;
+    bool direct;
+    bool sparse;
+    bool nosplice; /* splice is not usable for this pair of FDs */
+
+    /* Reader side */
+    unsigned long long rtotal;
+    bool shortRead; /* true if we hit a short read */
+
+    /* Writer side */
+    unsigned long long wtotal;
+    off_t end;
+    off_t pos;
+    off_t size; /* Original size of a sparse output file */
+};
+
+
+/* Returns true if the @len bytes at @buf are all zero */
+static bool
+runIOIsZero(const char *buf, size_t len)
+{
+    return len == 0 || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+/* Writes @len bytes from @buf to the sparse output file, at its
+ * current position st->pos, in blocks of the O_DIRECT alignment.
+ * Runs of all-zero blocks are only skipped where the file already
+ * reads back as zeros without storage behind it: in its holes, and
+ * beyond its original size, where the caller extends the file at
+ * the end. Allocated ranges are overwritten as usual, so that the
+ * allocation of a preallocated volume is never changed.
+ */
 static int
-runIO(const char *path, int fd, int oflags, unsigned long long length)
+runIOWriteSparse(runIOStatePtr st, const char *buf, size_t len)
+{
+    size_t blksize = st->alignMask + 1;
+    size_t start = 0;
+
+    while (start < len) {
+        bool zero = runIOIsZero(buf + start, MIN(blksize, len - start));
+        size_t end = start + MIN(blksize, len - start);
+        size_t n;
+
+        /* Coalesce the run of blocks of the same kind */
+        while (end < len &&
+               runIOIsZero(buf + end, MIN(blksize, len - end)) == zero)
+            end += MIN(blksize, len - end);
+        n = end - start;
+
+        if (zero && st->pos < st->size) {
+            bool inData;
+            unsigned long long sectionLen;
+
+            if (virFileInData(st->fd, &inData, &sectionLen) < 0)
+                return -1;
+            if (inData || sectionLen == 0)
+                zero = false;
+            if (sectionLen && sectionLen < n)
+                n = sectionLen;
+        }
+
+        if (zero) {
+            if (lseek(st->fd, n, SEEK_CUR) < 0) {
+                virReportSystemError(errno, _("Unable to seek %s"),
+                                     st->fdoutname);
+                return -1;
+            }
+        } else if (safewrite(st->fd, buf + start, n) < 0) {
+            virReportSystemError(errno, _("Unable to write %s"),
+                                 st->fdoutname);
+            return -1;
+        }
+
+        st->pos += n;
+        start += n;
+    }
+
+    return 0;
+}
+
+/* Reads the next chunk of data into @buf, returning the number
+ * of bytes read, 0 at the end of the requested data, or -1 on error
+ */
+static ssize_t
+runIORead(runIOStatePtr st, char *buf)
 {
-    void *base = NULL; /* Location to be freed */
-    char *buf = NULL; /* Aligned location within base */
-    size_t buflen = 1024*1024;
-    intptr_t alignMask = 64*1024 - 1;
+    size_t want;
+    ssize_t got;
+
+    if (st->length &&
+        (st->length - st->rtotal) < st->buflen)
+        st->buflen = st->length - st->rtotal;
+
+    if (st->buflen == 0)
+        return 0; /* End of requested data from client */
+
+    want = st->buflen;
+
+    if (st->sparse && st->fdin == st->fd) {
+        bool inData;
+        unsigned long long sectionLen;
+
+        if (virFileInData(st->fdin, &inData, &sectionLen) < 0)
+            return -1;
+
+        if (sectionLen == 0)
+            return 0; /* End of file before end of requested data */
+
+        if (sectionLen < want)
+            want = sectionLen;
+
+        if (!inData) {
+            /* A hole reads back as zeros, no need to touch the disk */
+            if (lseek(st->fdin, want, SEEK_CUR) < 0) {
+                virReportSystemError(errno, _("Unable to seek %s"),
+                                     st->fdinname);
+                return -1;
+            }
+            memset(buf, 0, want);
+            st->rtotal += want;
+            return want;
+        }
+    }
+
+    if ((got = saferead(st->fdin, buf, want)) < 0) {
+        virReportSystemError(errno, _("Unable to read %s"), st->fdinname);
+        return -1;
+    }
+    if (got == 0)
+        return 0; /* End of file before end of requested data */
+    if (got < want || (want & st->alignMask)) {
+        /* O_DIRECT can handle at most one short read, at end of file */
+        if (st->direct && st->shortRead) {
+            virReportSystemError(EINVAL, "%s",
+                                 _("Too many short reads for O_DIRECT"));
+            return -1;
+        }
+        st->shortRead = true;
+    }
+
+    st->rtotal += got;
+    return got;
+}
+
+/* Writes out a chunk of @got bytes previously filled by runIORead.
+ * @buf must have room for a whole buffer, since O_DIRECT writes
+ * may need to be padded out to the alignment */
+static int
+runIOWrite(runIOStatePtr st, char *buf, size_t got)
+{
+    st->wtotal += got;
+
+    if (st->sparse && st->fdout == st->fd)
+        return runIOWriteSparse(st, buf, got);
+
+    if (st->fdout == st->fd && st->direct &&
+        (got & st->alignMask)) {
+        /* Short read at end of file, pad out and truncate afterwards */
+        size_t padded = (got + st->alignMask) & ~st->alignMask;
+        st->end = st->wtotal;
+        memset(buf + got, 0, padded - got);
+        got = padded;
+    }
+    if (safewrite(st->fdout, buf, got) < 0) {
+        virReportSystemError(errno, _("Unable to write %s"), st->fdoutname);
+        return -1;
+    }
+    if (st->end && ftruncate(st->fd, st->end) < 0) {
+        virReportSystemError(errno, _("Unable to truncate %s"), st->fdoutname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+#if HAVE_SPLICE
+/* Move data between the file and the pipe on the other end of the
+ * helper inside the kernel, which avoids the copy in and out of our
+ * buffer. For sparse files the sections are handled one by one: the
+ * holes of an input file are sent as zeros from @buf rather than
+ * read, and data to be written over the holes of an output file, or
+ * past its end, goes through @buf and runIOWriteSparse so that runs
+ * of zeros are still skipped. Everything else is spliced.
+ *
+ * Returns 0 on success, -1 on error and 1 if splice is not usable
+ * for this pair of FDs. In the latter case nothing has been spliced
+ * yet, and the copy can be continued with runIORead/runIOWrite.
+ */
+static int
+runIOSplice(runIOStatePtr st, char *buf)
+{
+    bool spliced = false;
+
+# ifdef F_SETPIPE_SZ
+    /* Bigger pipes mean fewer, larger splices. This is only a hint,
+     * an unprivileged process may be limited by pipe-max-size */
+    ignore_value(fcntl(st->fdin, F_SETPIPE_SZ, st->buflen));
+    ignore_value(fcntl(st->fdout, F_SETPIPE_SZ, st->buflen));
+# endif
+
+    while (1) {
+        size_t want = st->buflen;
+        bool inData;
+        unsigned long long sectionLen;
+        ssize_t got;
+
+        if (st->length &&
+            (st->length - st->rtotal) < want)
+            want = st->length - st->rtotal;
+
+        if (want == 0)
+            break; /* End of requested data from client */
+
+        if (st->sparse && st->fdin == st->fd) {
+            if (virFileInData(st->fdin, &inData, &sectionLen) < 0)
+                return -1;
+            if (sectionLen == 0)
+                break; /* End of file before end of requested data */
+            want = MIN(want, sectionLen);
+
+            if (!inData) {
+                if (lseek(st->fdin, want, SEEK_CUR) < 0) {
+                    virReportSystemError(errno, _("Unable to seek %s"),
+                                         st->fdinname);
+                    return -1;
+                }
+                memset(buf, 0, want);
+                st->rtotal += want;
+                if (runIOWrite(st, buf, want) < 0)
+                    return -1;
+                continue;
+            }
+        } else if (st->sparse && st->fdout == st->fd) {
+            inData = false;
+            if (st->pos < st->size) {
+                if (virFileInData(st->fdout, &inData, &sectionLen) < 0)
+                    return -1;
+                want = MIN(want, sectionLen);
+            }
+
+            if (!inData) {
+                if ((got = saferead(st->fdin, buf, want)) < 0) {
+                    virReportSystemError(errno, _("Unable to read %s"),
+                                         st->fdinname);
+                    return -1;
+                }
+                if (got == 0)
+                    break; /* End of file before end of requested data */
+                st->rtotal += got;
+                if (runIOWrite(st, buf, got) < 0)
+                    return -1;
+                continue;
+            }
+        }
+
+        got = splice(st->fdin, NULL, st->fdout, NULL, want,
+                     SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            if (!spliced &&
+                (errno == EINVAL || errno == ENOSYS))
+                return 1;
+            virReportSystemError(errno, _("Unable to copy %s to %s"),
+                                 st->fdinname, st->fdoutname);
+            return -1;
+        }
+        if (got == 0)
+            break; /* End of file before end of requested data */
+
+        spliced = true;
+        st->rtotal += got;
+        st->wtotal += got;
+        if (st->sparse && st->fdout == st->fd)
+            st->pos += got;
+    }
+
+    return 0;
+}
+#endif
+
+
+/* Copies exactly @len bytes from the input to the output, splicing
+ * them where possible, or else through @buf. Running out of input
+ * is an error, since the other end announced that many bytes */
+static int
+runIOCopyExact(runIOStatePtr st, char *buf, unsigned long long len)
+{
+    while (len) {
+        size_t want = MIN(len, st->buflen);
+        ssize_t got;
+
+#if HAVE_SPLICE
+        if (!st->nosplice) {
+            got = splice(st->fdin, NULL, st->fdout, NULL, want,
+                         SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                st->nosplice = true;
+                continue;
+            }
+            if (got < 0) {
+                virReportSystemError(errno, _("Unable to copy %s to %s"),
+                                     st->fdinname, st->fdoutname);
+                return -1;
+            }
+        } else
+#endif
+        {
+            if ((got = saferead(st->fdin, buf, want)) < 0) {
+                virReportSystemError(errno, _("Unable to read %s"),
+                                     st->fdinname);
+                return -1;
+            }
+            if (got && safewrite(st->fdout, buf, got) < 0) {
+                virReportSystemError(errno, _("Unable to write %s"),
+                                     st->fdoutname);
+                return -1;
+            }
+        }
+
+        if (got == 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unexpected end of data in %s"), st->fdinname);
+            return -1;
+        }
+        len -= got;
+    }
+
+    return 0;
+}
+
+
+/*
+ * With a sparse stream, the pipe on the other end of the helper does
+ * not carry the plain content of the file but records, each one
+ * either data or a hole, see virFileSparseRecordEncode. Reading the
+ * file, its holes are sent as hole records rather than as zeros.
+ */
+static int
+runIOSparseStreamRead(runIOStatePtr st, char *buf)
+{
+    char header[VIR_FILE_SPARSE_RECORD_HEADER_LEN];
+
+    while (!st->length || st->rtotal < st->length) {
+        bool inData;
+        unsigned long long len;
+
+        if (virFileInData(st->fdin, &inData, &len) < 0)
+            return -1;
+        if (len == 0)
+            break; /* End of file before end of requested data */
+        if (st->length && st->length - st->rtotal < len)
+            len = st->length - st->rtotal;
+        if (inData && len > st->buflen)
+            len = st->buflen;
+
+        virFileSparseRecordEncode(header,
+                                  inData ? VIR_FILE_SPARSE_RECORD_DATA :
+                                           VIR_FILE_SPARSE_RECORD_HOLE,
+                                  len);
+        if (safewrite(st->fdout, header, sizeof(header)) < 0) {
+            virReportSystemError(errno, _("Unable to write %s"),
+                                 st->fdoutname);
+            return -1;
+        }
+
+        if (inData) {
+            if (runIOCopyExact(st, buf, len) < 0)
+                return -1;
+        } else if (lseek(st->fdin, len, SEEK_CUR) < 0) {
+            virReportSystemError(errno, _("Unable to seek %s"),
+                                 st->fdinname);
+            return -1;
+        }
+        st->rtotal += len;
+    }
+
+    return 0;
+}
+
+/* Makes the @len bytes at st->pos of the output file read back as
+ * zeros. Where the file has storage they are deallocated if possible,
+ * or else zeroed; past the original end of the file they are skipped,
+ * and the caller extends the file at the end. */
+static int
+runIOWriteHole(runIOStatePtr st, char *buf, unsigned long long len)
+{
+    if (st->pos < st->size) {
+        off_t inside = MIN(len, st->size - st->pos);
+
+        if (virFilePunchHole(st->fd, st->pos, inside) < 0 &&
+            virFileZeroRange(st->fd, st->pos, inside) < 0) {
+            memset(buf, 0, MIN(inside, st->buflen));
+            while (inside) {
+                size_t n = MIN(inside, st->buflen);
+
+                if (safewrite(st->fd, buf, n) < 0) {
+                    virReportSystemError(errno, _("Unable to write %s"),
+                                         st->fdoutname);
+                    return -1;
+                }
+                inside -= n;
+            }
+        }
+    } else if (!st->sparse) {
+        /* Block devices can't be extended */
+        virReportSystemError(ENOSPC, _("Unable to write %s"),
+                             st->fdoutname);
+        return -1;
+    }
+
+    if (lseek(st->fd, st->pos + len, SEEK_SET) < 0) {
+        virReportSystemError(errno, _("Unable to seek %s"), st->fdoutname);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Writing the file, data records are copied in and hole records are
+ * turned into holes by runIOWriteHole */
+static int
+runIOSparseStreamWrite(runIOStatePtr st, char *buf)
+{
+    char header[VIR_FILE_SPARSE_RECORD_HEADER_LEN];
+
+    if (!st->sparse) {
+        /* A block device, its size is only known by seeking */
+        if ((st->pos = lseek(st->fd, 0, SEEK_CUR)) < 0 ||
+            (st->size = lseek(st->fd, 0, SEEK_END)) < 0 ||
+            lseek(st->fd, st->pos, SEEK_SET) < 0) {
+            virReportSystemError(errno, _("Unable to seek %s"),
+                                 st->fdoutname);
+            return -1;
+        }
+    }
+
+    while (1) {
+        virFileSparseRecordType type;
+        unsigned long long len;
+        ssize_t got;
+
+        if ((got = saferead(st->fdin, header, sizeof(header))) < 0) {
+            virReportSystemError(errno, _("Unable to read %s"),
+                                 st->fdinname);
+            return -1;
+        }
+        if (got == 0)
+            break;
+        if (got < sizeof(header)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Truncated record in %s"), st->fdinname);
+            return -1;
+        }
+        if (virFileSparseRecordDecode(header, &type, &len) < 0)
+            return -1;
+
+        if (st->length && st->length - st->wtotal < len) {
+            virReportSystemError(ENOSPC, _("Unable to write %s"),
+                                 st->fdoutname);
+            return -1;
+        }
+
+        if (type == VIR_FILE_SPARSE_RECORD_DATA) {
+            if (runIOCopyExact(st, buf, len) < 0)
+                return -1;
+        } else if (runIOWriteHole(st, buf, len) < 0) {
+            return -1;
+        }
+        st->wtotal += len;
+        st->pos += len;
+    }
+
+    return 0;
+}
+
+
+/*
+ * With more than one buffer, reading and writing are overlapped: a
+ * separate thread fills buffers from the input while the main thread
+ * drains them to the output, so that neither side waits for the other
+ * as long as there is a free (or a full) buffer.
+ */
+typedef struct _runIOPipeline runIOPipeline;
+typedef runIOPipeline *runIOPipelinePtr;
+struct _runIOPipeline {
+    runIOStatePtr st;
+
+    virMutex lock;
+    virCond cond;
+
+    size_t nbufs;
+    char **bufs;
+    ssize_t *lens;
+    size_t head;  /* Index of the next buffer to write out */
+    size_t count; /* Number of filled buffers */
+
+    bool eof;     /* Reader has finished */
+    bool quit;    /* Writer has failed, reader should stop */
+    virErrorPtr err; /* Error raised by the reader thread */
+};
+
+static void
+runIOPipelineReader(void *opaque)
+{
+    runIOPipelinePtr pipeline = opaque;
+
+    virMutexLock(&pipeline->lock);
+    while (!pipeline->quit) {
+        size_t idx;
+        ssize_t got;
+
+        if (pipeline->count == pipeline->nbufs) {
+            ignore_value(virCondWait(&pipeline->cond, &pipeline->lock));
+            continue;
+        }
+        idx = (pipeline->head + pipeline->count) % pipeline->nbufs;
+        virMutexUnlock(&pipeline->lock);
+
+        got = runIORead(pipeline->st, pipeline->bufs[idx]);
+
+        virMutexLock(&pipeline->lock);
+        if (got <= 0) {
+            if (got < 0)
+                pipeline->err = virSaveLastError();
+            break;
+        }
+        pipeline->lens[idx] = got;
+        pipeline->count++;
+        virCondSignal(&pipeline->cond);
+    }
+    pipeline->eof = true;
+    virCondSignal(&pipeline->cond);
+    virMutexUnlock(&pipeline->lock);
+}
+
+static int
+runIOPipelineRun(runIOPipelinePtr pipeline)
+{
+    virThread reader;
     int ret = -1;
-    int fdin, fdout;
-    const char *fdinname, *fdoutname;
-    unsigned long long total = 0;
-    bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
-    bool shortRead = false; /* true if we hit a short read */
-    off_t end = 0;
+
+    if (virMutexInit(&pipeline->lock) < 0 ||
+        virCondInit(&pipeline->cond) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize locks"));
+        return -1;
+    }
+
+    if (virThreadCreate(&reader, true, runIOPipelineReader, pipeline) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to create reader thread"));
+        goto cleanup;
+    }
+
+    virMutexLock(&pipeline->lock);
+    while (1) {
+        size_t idx;
+
+        if (pipeline->count == 0) {
+            if (pipeline->eof)
+                break;
+            ignore_value(virCondWait(&pipeline->cond, &pipeline->lock));
+            continue;
+        }
+        idx = pipeline->head;
+        virMutexUnlock(&pipeline->lock);
+
+        if (runIOWrite(pipeline->st, pipeline->bufs[idx],
+                       pipeline->lens[idx]) < 0) {
+            virMutexLock(&pipeline->lock);
+            pipeline->quit = true;
+            virCondSignal(&pipeline->cond);
+            break;
+        }
+
+        virMutexLock(&pipeline->lock);
+        pipeline->head = (pipeline->head + 1) % pipeline->nbufs;
+        pipeline->count--;
+        virCondSignal(&pipeline->cond);
+    }
+    virMutexUnlock(&pipeline->lock);
+
+    virThreadJoin(&reader);
+
+    if (!pipeline->quit) {
+        if (pipeline->err) {
+            virSetError(pipeline->err);
+        } else {
+            ret = 0;
+        }
+    }
+
+ cleanup:
+    virFreeError(pipeline->err);
+    virCondDestroy(&pipeline->cond);
+    virMutexDestroy(&pipeline->lock);
+    return ret;
+}
+
+static char *
+runIOAllocBuffer(size_t buflen, intptr_t alignMask, void **base)
+{
+    char *buf = NULL;
 
 #if HAVE_POSIX_MEMALIGN
-    if (posix_memalign(&base, alignMask + 1, buflen)) {
+    if (posix_memalign(base, alignMask + 1, buflen)) {
         virReportOOMError();
-        goto cleanup;
+        return NULL;
     }
-    buf = base;
+    buf = *base;
 #else
     if (VIR_ALLOC_N(buf, buflen + alignMask) < 0)
-        goto cleanup;
-    base = buf;
-    buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
+        return NULL;
+    *base = buf;
+    buf = (char *) (((intptr_t) *base + alignMask) & ~alignMask);
 #endif
 
+    return buf;
+}
+
+/* Reads the size tunable @name from the environment into @val,
+ * which is left unchanged if the variable is not set. Returns -1
+ * if the value is malformed or not between @min and @max */
+static int
+runIOGetTunable(const char *name, size_t min, size_t max, size_t *val)
+{
+    const char *str = virGetEnvAllowSUID(name);
+    unsigned long long tmp;
+
+    if (!str)
+        return 0;
+
+    if (virStrToLong_ull(str, NULL, 10, &tmp) < 0 ||
+        tmp < min || tmp > max) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("%s must be between %zu and %zu, got '%s'"),
+                       name, min, max, str);
+        return -1;
+    }
+
+    *val = tmp;
+    return 0;
+}
+
+static int
+runIO(const char *path, int fd, int oflags, unsigned long long length,
+      bool sparseStream)
+{
+    void **bases = NULL; /* Locations to be freed */
+    char **bufs = NULL; /* Aligned locations within bases */
+    ssize_t *lens = NULL;
+    size_t nbufs = IOHELPER_DEFAULT_BUFFERS;
+    size_t i;
+    int ret = -1;
+    runIOState st;
+    struct stat sb;
+
+    memset(&st, 0, sizeof(st));
+    st.fd = fd;
+    st.length = length;
+    st.buflen = IOHELPER_DEFAULT_BUFFER_SIZE;
+    st.alignMask = 64*1024 - 1;
+    st.direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
+
+    if (runIOGetTunable("LIBVIRT_IOHELPER_BUFFER_SIZE",
+                        st.alignMask + 1, IOHELPER_MAX_BUFFER_SIZE,
+                        &st.buflen) < 0 ||
+        runIOGetTunable("LIBVIRT_IOHELPER_BUFFERS",
+                        1, IOHELPER_MAX_BUFFERS, &nbufs) < 0)
+        goto cleanup;
+
+    /* O_DIRECT needs every full buffer to be aligned */
+    st.buflen = (st.buflen + st.alignMask) & ~st.alignMask;
+
     switch (oflags & O_ACCMODE) {
     case O_RDONLY:
-        fdin = fd;
-        fdinname = path;
-        fdout = STDOUT_FILENO;
-        fdoutname = "stdout";
+        st.fdin = fd;
+        st.fdinname = path;
+        st.fdout = STDOUT_FILENO;
+        st.fdoutname = "stdout";
         /* To make the implementation simpler, we give up on any
          * attempt to use O_DIRECT in a non-trivial manner.  */
-        if (direct && ((end = lseek(fd, 0, SEEK_CUR)) != 0 || length)) {
-            virReportSystemError(end < 0 ? errno : EINVAL, "%s",
+        if (st.direct && ((st.end = lseek(fd, 0, SEEK_CUR)) != 0 || length)) {
+            virReportSystemError(st.end < 0 ? errno : EINVAL, "%s",
                                  _("O_DIRECT read needs entire seekable file"));
             goto cleanup;
         }
         break;
     case O_WRONLY:
-        fdin = STDIN_FILENO;
-        fdinname = "stdin";
-        fdout = fd;
-        fdoutname = path;
+        st.fdin = STDIN_FILENO;
+        st.fdinname = "stdin";
+        st.fdout = fd;
+        st.fdoutname = path;
         /* To make the implementation simpler, we give up on any
          * attempt to use O_DIRECT in a non-trivial manner.  */
-        if (direct && (end = lseek(fd, 0, SEEK_END)) != 0) {
-            virReportSystemError(end < 0 ? errno : EINVAL, "%s",
+        if (st.direct && (st.end = lseek(fd, 0, SEEK_END)) != 0) {
+            virReportSystemError(st.end < 0 ? errno : EINVAL, "%s",
                                  _("O_DIRECT write needs empty seekable file"));
             goto cleanup;
         }
@@ -137,52 +804,89 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
         goto cleanup;
     }
 
-    while (1) {
-        ssize_t got;
+    /* Regular files may be sparse. Rather than reading holes we can
+     * produce the zeros ourselves, and rather than writing runs of
+     * zeros over holes we can leave them alone */
+    if (!st.direct && fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) &&
+        (st.pos = lseek(fd, 0, SEEK_CUR)) >= 0) {
+        st.sparse = true;
+        st.size = sb.st_size;
+    }
 
-        if (length &&
-            (length - total) < buflen)
-            buflen = length - total;
+    if (VIR_ALLOC_N(bases, nbufs) < 0 ||
+        VIR_ALLOC_N(bufs, nbufs) < 0 ||
+        VIR_ALLOC_N(lens, nbufs) < 0)
+        goto cleanup;
 
-        if (buflen == 0)
-            break; /* End of requested data from client */
+    for (i = 0; i < nbufs; i++) {
+        if (!(bufs[i] = runIOAllocBuffer(st.buflen, st.alignMask, &bases[i])))
+            goto cleanup;
+    }
 
-        if ((got = saferead(fdin, buf, buflen)) < 0) {
-            virReportSystemError(errno, _("Unable to read %s"), fdinname);
+    if (sparseStream) {
+        if (st.direct) {
+            virReportSystemError(EINVAL, "%s",
+                                 _("O_DIRECT can't be used with sparse streams"));
             goto cleanup;
         }
-        if (got == 0)
-            break; /* End of file before end of requested data */
-        if (got < buflen || (buflen & alignMask)) {
-            /* O_DIRECT can handle at most one short read, at end of file */
-            if (direct && shortRead) {
-                virReportSystemError(EINVAL, "%s",
-                                     _("Too many short reads for O_DIRECT"));
-            }
-            shortRead = true;
+        if (st.fdin == fd) {
+            if (runIOSparseStreamRead(&st, bufs[0]) < 0)
+                goto cleanup;
+        } else if (runIOSparseStreamWrite(&st, bufs[0]) < 0) {
+            goto cleanup;
         }
+        goto done;
+    }
 
-        total += got;
-        if (fdout == fd && direct && shortRead) {
-            end = total;
-            memset(buf + got, 0, buflen - got);
-            got = (got + alignMask) & ~alignMask;
-        }
-        if (safewrite(fdout, buf, got) < 0) {
-            virReportSystemError(errno, _("Unable to write %s"), fdoutname);
+#if HAVE_SPLICE
+    if (!st.direct) {
+        int rc = runIOSplice(&st, bufs[0]);
+        if (rc < 0)
             goto cleanup;
-        }
-        if (end && ftruncate(fd, end) < 0) {
-            virReportSystemError(errno, _("Unable to truncate %s"), fdoutname);
+        if (rc == 0)
+            goto done;
+    }
+#endif
+
+    if (nbufs > 1) {
+        runIOPipeline pipeline;
+
+        memset(&pipeline, 0, sizeof(pipeline));
+        pipeline.st = &st;
+        pipeline.nbufs = nbufs;
+        pipeline.bufs = bufs;
+        pipeline.lens = lens;
+
+        if (runIOPipelineRun(&pipeline) < 0)
             goto cleanup;
+    } else {
+        while (1) {
+            ssize_t got;
+
+            if ((got = runIORead(&st, bufs[0])) < 0)
+                goto cleanup;
+            if (got == 0)
+                break;
+            if (runIOWrite(&st, bufs[0], got) < 0)
+                goto cleanup;
         }
     }
 
+ done:
+    /* If the data ended with a hole, the file has not been
+     * extended to cover it yet */
+    if (st.sparse && st.fdout == fd &&
+        (fstat(fd, &sb) < 0 ||
+         (st.pos > sb.st_size && ftruncate(fd, st.pos) < 0))) {
+        virReportSystemError(errno, _("Unable to truncate %s"), st.fdoutname);
+        goto cleanup;
+    }
+
     /* Ensure all data is written */
-    if (fdatasync(fdout) < 0) {
+    if (fdatasync(st.fdout) < 0) {
         if (errno != EINVAL && errno != EROFS) {
             /* fdatasync() may fail on some special FDs, e.g. pipes */
-            virReportSystemError(errno, _("unable to fsync %s"), fdoutname);
+            virReportSystemError(errno, _("unable to fsync %s"), st.fdoutname);
             goto cleanup;
         }
     }
@@ -196,7 +900,11 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
         ret = -1;
     }
 
-    VIR_FREE(base);
+    for (i = 0; bases && i < nbufs; i++)
+        VIR_FREE(bases[i]);
+    VIR_FREE(bases);
+    VIR_FREE(bufs);
+    VIR_FREE(lens);
     return ret;
 }
 
@@ -209,8 +917,20 @@ usage(int status)
         fprintf(stderr, _("%s: try --help for more details"), program_name);
     } else {
         printf(_("Usage: %s FILENAME OFLAGS MODE OFFSET LENGTH DELETE\n"
-                 "   or: %s FILENAME LENGTH FD\n"),
-               program_name, program_name);
+                 "   or: %s FILENAME LENGTH FD [SPARSE]\n"
+                 "\n"
+                 "With SPARSE set to 1, the data on the other end of FD is\n"
+                 "a sparse stream made of data and hole records.\n"
+                 "\n"
+                 "Environment:\n"
+                 "  LIBVIRT_IOHELPER_BUFFER_SIZE  size of each I/O buffer in bytes\n"
+                 "                                (default %d, max %d)\n"
+                 "  LIBVIRT_IOHELPER_BUFFERS      number of buffers; with more than\n"
+                 "                                one, reads and writes overlap\n"
+                 "                                (default %d, max %d)\n"),
+               program_name, program_name,
+               IOHELPER_DEFAULT_BUFFER_SIZE, IOHELPER_MAX_BUFFER_SIZE,
+               IOHELPER_DEFAULT_BUFFERS, IOHELPER_MAX_BUFFERS);
     }
     exit(status);
 }
@@ -225,6 +945,7 @@ main(int argc, char **argv)
     int oflags = -1;
     int mode;
     unsigned int delete = 0;
+    unsigned int sparse = 0;
     int fd = -1;
     int lengthIndex = 0;
 
@@ -270,13 +991,18 @@ main(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
         fd = prepare(path, oflags, mode, offset);
-    } else if (argc == 4) { /* FILENAME LENGTH FD */
+    } else if (argc == 4 || argc == 5) { /* FILENAME LENGTH FD [SPARSE] */
         lengthIndex = 2;
         if (virStrToLong_i(argv[3], NULL, 10, &fd) < 0) {
             fprintf(stderr, _("%s: malformed fd %s"),
                     program_name, argv[3]);
             exit(EXIT_FAILURE);
         }
+        if (argc == 5 && virStrToLong_ui(argv[4], NULL, 10, &sparse) < 0) {
+            fprintf(stderr, _("%s: malformed sparse flag %s"),
+                    program_name, argv[4]);
+            exit(EXIT_FAILURE);
+        }
 #ifdef F_GETFL
         oflags = fcntl(fd, F_GETFL);
 #else
@@ -301,7 +1027,7 @@ main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    if (fd < 0 || runIO(path, fd, oflags, length) < 0)
+    if (fd < 0 || runIO(path, fd, oflags, length, sparse != 0) < 0)
         goto error;
 
     if (delete)
@@ -733,6 +733,96 @@ virCgroupGetValueStr(virCgroupPtr group,
 }
 
 
+/*
+ * Like virCgroupGetValueStr, but keep the file open so that reading
+ * it again, as statistics polling does, is a single pread() rather
+ * than resolving the path and opening the file each time.
+ * @key must be a string constant.
+ */
+static int
+virCgroupGetValueStrCached(virCgroupPtr group,
+                           int controller,
+                           const char *key,
+                           char **value)
+{
+    struct virCgroupValueFile *file = NULL;
+    struct virCgroupValueFile newfile = { controller, key, -1 };
+    char *keypath = NULL;
+    size_t nalloc = 0;
+    size_t len = 0;
+    ssize_t got;
+    size_t i;
+    int ret = -1;
+
+    *value = NULL;
+
+    for (i = 0; i < group->nfiles; i++) {
+        if (group->files[i].controller == controller &&
+            STREQ(group->files[i].key, key)) {
+            file = &group->files[i];
+            break;
+        }
+    }
+
+    if (!file) {
+        if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
+            return -1;
+
+        VIR_DEBUG("Open value %s", keypath);
+
+        if ((newfile.fd = open(keypath, O_RDONLY | O_CLOEXEC)) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to read from '%s'"), keypath);
+            goto cleanup;
+        }
+
+        if (VIR_APPEND_ELEMENT_COPY(group->files, group->nfiles, newfile) < 0)
+            goto cleanup;
+        newfile.fd = -1;
+        file = &group->files[i];
+    }
+
+    do {
+        if (VIR_RESIZE_N(*value, nalloc, len, 1024 + 1) < 0)
+            goto error;
+
+        if ((got = pread(file->fd, *value + len,
+                         nalloc - len - 1, len)) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to read cgroup value '%s'"), key);
+            goto error;
+        }
+        len += got;
+
+        if (len > 1024 * 1024) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("cgroup value '%s' is too large"), key);
+            goto error;
+        }
+    } while (got > 0);
+
+    (*value)[len] = '\0';
+
+    /* Terminated with '\n' has sometimes harmful effects to the caller */
+    if (len > 0 && (*value)[len - 1] == '\n')
+        (*value)[len - 1] = '\0';
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(newfile.fd);
+    VIR_FREE(keypath);
+    return ret;
+
+ error:
+    /* The group may have been recreated, open it afresh next time */
+    VIR_FREE(*value);
+    VIR_FORCE_CLOSE(file->fd);
+    VIR_DELETE_ELEMENT(group->files, file - group->files, group->nfiles);
+    goto cleanup;
+}
+
+
 static int
 virCgroupSetValueU64(virCgroupPtr group,
                      int controller,
@@ -1720,6 +1810,10 @@ virCgroupFree(virCgroupPtr *group)
         VIR_FREE((*group)->controllers[i].placement);
     }
 
+    for (i = 0; i < (*group)->nfiles; i++)
+        VIR_FORCE_CLOSE((*group)->files[i].fd);
+    VIR_FREE((*group)->files);
+
     VIR_FREE((*group)->path);
     VIR_FREE(*group);
 }
@@ -3126,8 +3220,8 @@ virCgroupSetCpuCfsQuota(virCgroupPtr group, long long cfs_quota)
 int
 virCgroupGetCpuacctPercpuUsage(virCgroupPtr group, char **usage)
 {
-    return virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage_percpu", usage);
+    return virCgroupGetValueStrCached(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                      "cpuacct.usage_percpu", usage);
 }
 
 
@@ -3530,9 +3624,25 @@ virCgroupGetCpuCfsQuota(virCgroupPtr group, long long *cfs_quota)
 int
 virCgroupGetCpuacctUsage(virCgroupPtr group, unsigned long long *usage)
 {
-    return virCgroupGetValueU64(group,
-                                VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage", usage);
+    char *strval = NULL;
+    int ret = -1;
+
+    if (virCgroupGetValueStrCached(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                   "cpuacct.usage", &strval) < 0)
+        goto cleanup;
+
+    if (virStrToLong_ull(strval, NULL, 10, usage) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to parse '%s' as an integer"),
+                       strval);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(strval);
+    return ret;
 }
 
 
@@ -3545,8 +3655,8 @@ virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
     int ret = -1;
     static double scale = -1.0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpuacct.stat", &str) < 0)
+    if (virCgroupGetValueStrCached(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                   "cpuacct.stat", &str) < 0)
         return -1;
 
     if (!(p = STRSKIP(str, "user ")) ||
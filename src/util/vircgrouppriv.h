@@ -42,10 +42,20 @@ struct virCgroupController {
     char *placement;
 };
 
+/* A value file kept open for repeated reading */
+struct virCgroupValueFile {
+    int controller;
+    const char *key;
+    int fd;
+};
+
 struct virCgroup {
     char *path;
 
     struct virCgroupController controllers[VIR_CGROUP_CONTROLLER_LAST];
+
+    struct virCgroupValueFile *files;
+    size_t nfiles;
 };
 
 #endif /* __VIR_CGROUP_PRIV_H__ */
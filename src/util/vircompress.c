@@ -0,0 +1,676 @@
+/*
+ * vircompress.c: multi-threaded compression of streams in frames
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#if WITH_ZLIB
+# include <zlib.h>
+#endif
+
+#include "vircompress.h"
+#include "viralloc.h"
+#include "virendian.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.compress");
+
+#if WITH_ZLIB
+
+/*
+ * A compressed stream consists of frames, each holding up to frameSize
+ * bytes of the input compressed as a zlib stream of its own, so that
+ * the frames can be compressed and decompressed independently of each
+ * other. The frames are followed by an index with an entry for each
+ * of them. All integers are big endian:
+ *
+ *   frame:       uint32 uncompressed length
+ *                uint32 compressed length
+ *                compressed data
+ *
+ *   index entry: uint64 offset of the frame from the first one
+ *                uint32 uncompressed length
+ *                uint32 compressed length
+ *
+ * The number of frames and the frame size are not part of the stream,
+ * the caller has to record them elsewhere.
+ */
+# define VIR_COMPRESS_FRAME_HEADER 8
+# define VIR_COMPRESS_INDEX_ENTRY 16
+
+typedef struct _virCompressIndex virCompressIndex;
+typedef virCompressIndex *virCompressIndexPtr;
+struct _virCompressIndex {
+    unsigned long long offset;
+    size_t rawLength;
+    size_t length;
+};
+
+typedef struct _virCompressSlot virCompressSlot;
+typedef virCompressSlot *virCompressSlotPtr;
+struct _virCompressSlot {
+    char *in;
+    size_t inLength;
+    char *out;
+    size_t outLength;
+    bool done;
+};
+
+struct _virCompressJob {
+    virMutex lock;
+    virCond cond;
+    virThread thread;
+
+    bool compress;
+    int infd;
+    int outfd;
+    size_t frameSize;
+    size_t nworkers;
+
+    /* Frame N is processed in slots[N % nslots]. Frames are read,
+     * handed to workers and written in order, a frame's slot can
+     * only be reused once it has been written */
+    virCompressSlotPtr slots;
+    size_t nslots;
+    size_t nread;
+    size_t nwork;
+    size_t nwritten;
+    size_t frames;
+    bool reading;
+    bool writing;
+    bool eof;
+
+    /* Only touched by the reader when decompressing and by
+     * the writer when compressing */
+    virCompressIndexPtr index;
+    size_t nindex;
+    size_t maxindex;
+    unsigned long long offset;
+
+    bool failed;
+    virErrorPtr error;
+};
+
+
+static void
+virCompressJobFail(virCompressJobPtr job)
+{
+    if (!job->failed) {
+        job->failed = true;
+        job->error = virSaveLastError();
+    }
+    virCondBroadcast(&job->cond);
+}
+
+
+static int
+virCompressJobAddIndex(virCompressJobPtr job,
+                       size_t rawLength,
+                       size_t length)
+{
+    if (VIR_RESIZE_N(job->index, job->maxindex, job->nindex, 1) < 0)
+        return -1;
+
+    job->index[job->nindex].offset = job->offset;
+    job->index[job->nindex].rawLength = rawLength;
+    job->index[job->nindex].length = length;
+    job->nindex++;
+    job->offset += VIR_COMPRESS_FRAME_HEADER + length;
+    return 0;
+}
+
+
+/* Returns 1 if a frame was read into @slot, 0 on end of input and
+ * -1 on error. @eof is set if there is nothing left to read. */
+static int
+virCompressJobRead(virCompressJobPtr job,
+                   virCompressSlotPtr slot,
+                   bool *eof)
+{
+    char header[VIR_COMPRESS_FRAME_HEADER];
+    ssize_t got;
+
+    if (job->compress) {
+        if ((got = saferead(job->infd, slot->in, job->frameSize)) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to read data to compress"));
+            return -1;
+        }
+        slot->inLength = got;
+        *eof = got < job->frameSize;
+        return got > 0;
+    }
+
+    if ((got = saferead(job->infd, header, sizeof(header))) != sizeof(header)) {
+        if (got < 0)
+            virReportSystemError(errno, "%s",
+                                 _("unable to read compressed data"));
+        else
+            virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                           _("compressed data is truncated"));
+        return -1;
+    }
+
+    slot->outLength = virReadBufInt32BE(header);
+    slot->inLength = virReadBufInt32BE(header + 4);
+    if (slot->outLength == 0 || slot->outLength > job->frameSize ||
+        slot->inLength == 0 || slot->inLength > compressBound(job->frameSize)) {
+        virReportError(VIR_ERR_OPERATION_FAILED,
+                       _("malformed compressed frame %zu"), job->nindex);
+        return -1;
+    }
+
+    if ((got = saferead(job->infd, slot->in, slot->inLength)) != slot->inLength) {
+        if (got < 0)
+            virReportSystemError(errno, "%s",
+                                 _("unable to read compressed data"));
+        else
+            virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                           _("compressed data is truncated"));
+        return -1;
+    }
+
+    if (virCompressJobAddIndex(job, slot->outLength, slot->inLength) < 0)
+        return -1;
+
+    *eof = job->nindex == job->frames;
+    return 1;
+}
+
+
+static int
+virCompressJobProcess(virCompressJobPtr job,
+                      virCompressSlotPtr slot)
+{
+    uLongf len;
+    int rc;
+
+    if (job->compress) {
+        len = compressBound(job->frameSize);
+        rc = compress2((Bytef *)slot->out + VIR_COMPRESS_FRAME_HEADER, &len,
+                       (Bytef *)slot->in, slot->inLength, Z_BEST_SPEED);
+        if (rc != Z_OK) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("unable to compress data: %s"), zError(rc));
+            return -1;
+        }
+        virWriteBufInt32BE(slot->out, slot->inLength);
+        virWriteBufInt32BE(slot->out + 4, len);
+        slot->outLength = VIR_COMPRESS_FRAME_HEADER + len;
+        return 0;
+    }
+
+    len = slot->outLength;
+    rc = uncompress((Bytef *)slot->out, &len,
+                    (Bytef *)slot->in, slot->inLength);
+    if (rc != Z_OK || len != slot->outLength) {
+        virReportError(VIR_ERR_OPERATION_FAILED,
+                       _("unable to decompress data: %s"),
+                       rc != Z_OK ? zError(rc) : _("frame length mismatch"));
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+virCompressJobWrite(virCompressJobPtr job,
+                    virCompressSlotPtr slot)
+{
+    if (safewrite(job->outfd, slot->out, slot->outLength) != slot->outLength) {
+        virReportSystemError(errno, "%s",
+                             job->compress ?
+                             _("unable to write compressed data") :
+                             _("unable to write decompressed data"));
+        return -1;
+    }
+
+    if (job->compress &&
+        virCompressJobAddIndex(job, slot->inLength,
+                               slot->outLength - VIR_COMPRESS_FRAME_HEADER) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/* Run in any number of threads, each of them picks whatever needs
+ * doing next: writing the oldest frame out, compressing a frame or
+ * reading a new one, in order of preference. */
+static void
+virCompressJobWorker(void *opaque)
+{
+    virCompressJobPtr job = opaque;
+    virCompressSlotPtr slot;
+    bool eof;
+    int rc;
+
+    virMutexLock(&job->lock);
+    while (!job->failed) {
+        if (!job->writing && job->nwritten < job->nread &&
+            job->slots[job->nwritten % job->nslots].done) {
+            slot = &job->slots[job->nwritten % job->nslots];
+            job->writing = true;
+            virMutexUnlock(&job->lock);
+            rc = virCompressJobWrite(job, slot);
+            virMutexLock(&job->lock);
+            job->writing = false;
+            slot->done = false;
+            job->nwritten++;
+        } else if (job->nwork < job->nread) {
+            slot = &job->slots[job->nwork++ % job->nslots];
+            virMutexUnlock(&job->lock);
+            rc = virCompressJobProcess(job, slot);
+            virMutexLock(&job->lock);
+            slot->done = true;
+        } else if (!job->reading && !job->eof &&
+                   job->nread - job->nwritten < job->nslots) {
+            slot = &job->slots[job->nread % job->nslots];
+            job->reading = true;
+            eof = false;
+            virMutexUnlock(&job->lock);
+            rc = virCompressJobRead(job, slot, &eof);
+            virMutexLock(&job->lock);
+            job->reading = false;
+            job->eof = eof;
+            if (rc > 0)
+                job->nread++;
+        } else if (job->eof && job->nwritten == job->nread) {
+            break;
+        } else {
+            if (virCondWait(&job->cond, &job->lock) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("failed to wait on condition"));
+                virCompressJobFail(job);
+            }
+            continue;
+        }
+
+        if (rc < 0)
+            virCompressJobFail(job);
+        virCondBroadcast(&job->cond);
+    }
+    virCondBroadcast(&job->cond);
+    virMutexUnlock(&job->lock);
+}
+
+
+static int
+virCompressJobWriteIndex(virCompressJobPtr job)
+{
+    char *buf = NULL;
+    size_t len = job->nindex * VIR_COMPRESS_INDEX_ENTRY;
+    size_t i;
+    int ret = -1;
+
+    if (len == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(buf, len) < 0)
+        return -1;
+
+    for (i = 0; i < job->nindex; i++) {
+        char *entry = buf + i * VIR_COMPRESS_INDEX_ENTRY;
+
+        virWriteBufInt64BE(entry, job->index[i].offset);
+        virWriteBufInt32BE(entry + 8, job->index[i].rawLength);
+        virWriteBufInt32BE(entry + 12, job->index[i].length);
+    }
+
+    if (safewrite(job->outfd, buf, len) != len) {
+        virReportSystemError(errno, "%s",
+                             _("unable to write compressed data index"));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+static int
+virCompressJobCheckIndex(virCompressJobPtr job)
+{
+    char *buf = NULL;
+    size_t len = job->nindex * VIR_COMPRESS_INDEX_ENTRY;
+    ssize_t got;
+    size_t i;
+    int ret = -1;
+
+    if (len == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(buf, len) < 0)
+        return -1;
+
+    if ((got = saferead(job->infd, buf, len)) != len) {
+        if (got < 0)
+            virReportSystemError(errno, "%s",
+                                 _("unable to read compressed data index"));
+        else
+            virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                           _("compressed data index is truncated"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < job->nindex; i++) {
+        char *entry = buf + i * VIR_COMPRESS_INDEX_ENTRY;
+
+        if (virReadBufInt64BE(entry) != job->index[i].offset ||
+            virReadBufInt32BE(entry + 8) != job->index[i].rawLength ||
+            virReadBufInt32BE(entry + 12) != job->index[i].length) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("compressed data index does not match "
+                             "frame %zu"), i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+static void
+virCompressJobRun(void *opaque)
+{
+    virCompressJobPtr job = opaque;
+    int rc = 0;
+
+    virThreadRunWorkers(job->nworkers, virCompressJobWorker, job);
+
+    /* Closing our end of the pipe tells the process on the other end
+     * that there is no more data, or that something went wrong */
+    if (job->compress)
+        VIR_FORCE_CLOSE(job->infd);
+    else
+        VIR_FORCE_CLOSE(job->outfd);
+
+    if (job->failed)
+        return;
+
+    if (job->compress)
+        rc = virCompressJobWriteIndex(job);
+    else
+        rc = virCompressJobCheckIndex(job);
+
+    if (rc < 0) {
+        virMutexLock(&job->lock);
+        virCompressJobFail(job);
+        virMutexUnlock(&job->lock);
+    }
+}
+
+
+static void
+virCompressJobFree(virCompressJobPtr job)
+{
+    size_t i;
+
+    if (!job)
+        return;
+
+    for (i = 0; i < job->nslots; i++) {
+        VIR_FREE(job->slots[i].in);
+        VIR_FREE(job->slots[i].out);
+    }
+    VIR_FREE(job->slots);
+    VIR_FREE(job->index);
+    virFreeError(job->error);
+    if (job->compress)
+        VIR_FORCE_CLOSE(job->infd);
+    else
+        VIR_FORCE_CLOSE(job->outfd);
+    virCondDestroy(&job->cond);
+    virMutexDestroy(&job->lock);
+    VIR_FREE(job);
+}
+
+
+static virCompressJobPtr
+virCompressJobNew(bool compress,
+                  int infd,
+                  int outfd,
+                  size_t frameSize,
+                  size_t frames,
+                  size_t nworkers)
+{
+    virCompressJobPtr job;
+    size_t inSize;
+    size_t outSize;
+    size_t i;
+
+    if (frameSize == 0 || frameSize > VIR_COMPRESS_FRAME_SIZE_MAX) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid compression frame size %zu"), frameSize);
+        return NULL;
+    }
+
+    if (VIR_ALLOC(job) < 0)
+        return NULL;
+
+    if (virMutexInit(&job->lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        VIR_FREE(job);
+        return NULL;
+    }
+    if (virCondInit(&job->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&job->lock);
+        VIR_FREE(job);
+        return NULL;
+    }
+
+    job->compress = compress;
+    job->infd = -1;
+    job->outfd = -1;
+    job->frameSize = frameSize;
+    job->frames = frames;
+    job->nworkers = MAX(nworkers, 1);
+
+    if (compress) {
+        inSize = frameSize;
+        outSize = VIR_COMPRESS_FRAME_HEADER + compressBound(frameSize);
+    } else {
+        inSize = compressBound(frameSize);
+        outSize = frameSize;
+    }
+
+    /* Enough for the reader and the writer to stay ahead
+     * of the workers */
+    if (VIR_ALLOC_N(job->slots, job->nworkers * 2) < 0)
+        goto error;
+    job->nslots = job->nworkers * 2;
+    for (i = 0; i < job->nslots; i++) {
+        if (VIR_ALLOC_N(job->slots[i].in, inSize) < 0 ||
+            VIR_ALLOC_N(job->slots[i].out, outSize) < 0)
+            goto error;
+    }
+
+    if (!compress && frames == 0)
+        job->eof = true;
+
+    job->infd = infd;
+    job->outfd = outfd;
+    if (virThreadCreate(&job->thread, true, virCompressJobRun, job) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create compression thread"));
+        job->infd = job->outfd = -1;
+        goto error;
+    }
+
+    return job;
+
+ error:
+    virCompressJobFree(job);
+    return NULL;
+}
+
+
+/**
+ * virCompressJobStart:
+ * @infd: pointer to the file descriptor to read data from
+ * @outfd: file descriptor to write the compressed data to
+ * @frameSize: amount of data to compress into each frame
+ * @nworkers: number of threads to compress in
+ *
+ * Start compressing everything read from @infd until end of file
+ * into independent frames written to @outfd, followed by their index,
+ * in the background. On success, the job takes over @infd, which is
+ * set to -1, and closes it once it is done reading, so that whoever
+ * writes into the other end of a pipe learns about a failure.
+ *
+ * Returns the job, to be passed to virCompressJobFinish, or NULL on
+ * error.
+ */
+virCompressJobPtr
+virCompressJobStart(int *infd,
+                    int outfd,
+                    size_t frameSize,
+                    size_t nworkers)
+{
+    virCompressJobPtr job;
+
+    if (!(job = virCompressJobNew(true, *infd, outfd, frameSize, 0, nworkers)))
+        return NULL;
+
+    *infd = -1;
+    return job;
+}
+
+
+/**
+ * virDecompressJobStart:
+ * @infd: file descriptor to read the compressed data from
+ * @outfd: pointer to the file descriptor to write data to
+ * @frameSize: frame size the data was compressed with
+ * @frames: number of frames the data was compressed into
+ * @nworkers: number of threads to decompress in
+ *
+ * Start decompressing @frames frames written by a compression job
+ * from @infd to @outfd in the background, and then check the frame
+ * index that follows them. On success, the job takes over @outfd,
+ * which is set to -1, and closes it once all the data is written.
+ *
+ * Returns the job, to be passed to virCompressJobFinish, or NULL on
+ * error.
+ */
+virCompressJobPtr
+virDecompressJobStart(int infd,
+                      int *outfd,
+                      size_t frameSize,
+                      size_t frames,
+                      size_t nworkers)
+{
+    virCompressJobPtr job;
+
+    if (!(job = virCompressJobNew(false, infd, *outfd, frameSize,
+                                  frames, nworkers)))
+        return NULL;
+
+    *outfd = -1;
+    return job;
+}
+
+
+/**
+ * virCompressJobFinish:
+ * @job: the job
+ * @frames: where to store the number of frames processed, or NULL
+ *
+ * Wait for @job to complete and free it.
+ *
+ * Returns 0 if all of the data was processed, -1 with an error
+ * reported otherwise.
+ */
+int
+virCompressJobFinish(virCompressJobPtr job,
+                     size_t *frames)
+{
+    int ret = -1;
+
+    virThreadJoin(&job->thread);
+
+    if (job->failed) {
+        if (job->error)
+            virSetError(job->error);
+        else
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("compression job failed"));
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Processed %zu frames, %llu bytes", job->nindex, job->offset);
+    if (frames)
+        *frames = job->nindex;
+
+    ret = 0;
+ cleanup:
+    virCompressJobFree(job);
+    return ret;
+}
+
+#else /* !WITH_ZLIB */
+
+virCompressJobPtr
+virCompressJobStart(int *infd ATTRIBUTE_UNUSED,
+                    int outfd ATTRIBUTE_UNUSED,
+                    size_t frameSize ATTRIBUTE_UNUSED,
+                    size_t nworkers ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("compression is not supported in this build"));
+    return NULL;
+}
+
+
+virCompressJobPtr
+virDecompressJobStart(int infd ATTRIBUTE_UNUSED,
+                      int *outfd ATTRIBUTE_UNUSED,
+                      size_t frameSize ATTRIBUTE_UNUSED,
+                      size_t frames ATTRIBUTE_UNUSED,
+                      size_t nworkers ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("compression is not supported in this build"));
+    return NULL;
+}
+
+
+int
+virCompressJobFinish(virCompressJobPtr job ATTRIBUTE_UNUSED,
+                     size_t *frames ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("compression is not supported in this build"));
+    return -1;
+}
+
+#endif /* !WITH_ZLIB */
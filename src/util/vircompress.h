@@ -0,0 +1,49 @@
+/*
+ * vircompress.h: multi-threaded compression of streams in frames
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_COMPRESS_H__
+# define __VIR_COMPRESS_H__
+
+# include "internal.h"
+
+/* Upper limit on the uncompressed size of a single frame */
+# define VIR_COMPRESS_FRAME_SIZE_MAX (64 * 1024 * 1024)
+
+typedef struct _virCompressJob virCompressJob;
+typedef virCompressJob *virCompressJobPtr;
+
+virCompressJobPtr virCompressJobStart(int *infd,
+                                      int outfd,
+                                      size_t frameSize,
+                                      size_t nworkers)
+    ATTRIBUTE_NONNULL(1);
+
+virCompressJobPtr virDecompressJobStart(int infd,
+                                        int *outfd,
+                                        size_t frameSize,
+                                        size_t frames,
+                                        size_t nworkers)
+    ATTRIBUTE_NONNULL(2);
+
+int virCompressJobFinish(virCompressJobPtr job,
+                         size_t *frames);
+
+#endif /* __VIR_COMPRESS_H__ */
@@ -90,4 +90,60 @@
      ((uint32_t)(uint8_t)((buf)[2]) << 16) |             \
      ((uint32_t)(uint8_t)((buf)[3]) << 24))
 
+/**
+ * virWriteBufInt64BE:
+ * @buf: byte to start writing at (can be 'char*' or 'unsigned char*');
+ *       evaluating buf must not have any side effects
+ * @val: 64-bit number to write; evaluating val must not have any
+ *       side effects
+ *
+ * Write VAL as a big-endian 64-bit number to the 8 bytes at BUF.
+ * Caller is responsible to avoid writing beyond array bounds.
+ */
+# define virWriteBufInt64BE(buf, val)                    \
+    do {                                                 \
+        (buf)[0] = ((uint64_t)(val) >> 56) & 0xff;       \
+        (buf)[1] = ((uint64_t)(val) >> 48) & 0xff;       \
+        (buf)[2] = ((uint64_t)(val) >> 40) & 0xff;       \
+        (buf)[3] = ((uint64_t)(val) >> 32) & 0xff;       \
+        (buf)[4] = ((uint64_t)(val) >> 24) & 0xff;       \
+        (buf)[5] = ((uint64_t)(val) >> 16) & 0xff;       \
+        (buf)[6] = ((uint64_t)(val) >> 8) & 0xff;        \
+        (buf)[7] = (uint64_t)(val) & 0xff;               \
+    } while (0)
+
+/**
+ * virWriteBufInt32BE:
+ * @buf: byte to start writing at (can be 'char*' or 'unsigned char*');
+ *       evaluating buf must not have any side effects
+ * @val: 32-bit number to write; evaluating val must not have any
+ *       side effects
+ *
+ * Write VAL as a big-endian 32-bit number to the 4 bytes at BUF.
+ * Caller is responsible to avoid writing beyond array bounds.
+ */
+# define virWriteBufInt32BE(buf, val)                    \
+    do {                                                 \
+        (buf)[0] = ((uint32_t)(val) >> 24) & 0xff;       \
+        (buf)[1] = ((uint32_t)(val) >> 16) & 0xff;       \
+        (buf)[2] = ((uint32_t)(val) >> 8) & 0xff;        \
+        (buf)[3] = (uint32_t)(val) & 0xff;               \
+    } while (0)
+
+/**
+ * virWriteBufInt16BE:
+ * @buf: byte to start writing at (can be 'char*' or 'unsigned char*');
+ *       evaluating buf must not have any side effects
+ * @val: 16-bit number to write; evaluating val must not have any
+ *       side effects
+ *
+ * Write VAL as a big-endian 16-bit number to the 2 bytes at BUF.
+ * Caller is responsible to avoid writing beyond array bounds.
+ */
+# define virWriteBufInt16BE(buf, val)                    \
+    do {                                                 \
+        (buf)[0] = ((uint16_t)(val) >> 8) & 0xff;        \
+        (buf)[1] = (uint16_t)(val) & 0xff;               \
+    } while (0)
+
 #endif /* __VIR_ENDIAN_H__ */
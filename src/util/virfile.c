@@ -48,6 +48,11 @@
 #  include <linux/magic.h>
 # endif
 # include <sys/statfs.h>
+# if HAVE_LINUX_FALLOC_H
+#  include <linux/falloc.h>
+# endif
+# include <sys/ioctl.h>
+# include <linux/fs.h>
 #endif
 
 #if defined(__linux__) && HAVE_DECL_LO_FLAGS_AUTOCLEAR
@@ -65,6 +70,7 @@
 #include "virstring.h"
 #include "virstoragefile.h"
 #include "virutil.h"
+#include "virendian.h"
 
 #include "c-ctype.h"
 
@@ -540,6 +546,233 @@ int virFileUpdatePerm(const char *path,
 }
 
 
+/**
+ * virFileInData:
+ * @fd: file to check
+ * @inData: true if current position in the @fd is in data section
+ * @length: amount of bytes until the end of the current section
+ *
+ * With sparse files not every extent has to be physically stored on
+ * the disk. This results in so called data or hole sections. This
+ * function checks whether the current position in the file @fd is
+ * in a data section (@inData = true) or in a hole (@inData = false).
+ * Moreover, it sets @length to match the number of bytes remaining
+ * until the end of the current section. At the end of the file
+ * @inData is false and @length is zero. The current position in
+ * @fd is not changed.
+ *
+ * On platforms which cannot report holes the whole file is
+ * reported as a single data section.
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int
+virFileInData(int fd,
+              bool *inData,
+              unsigned long long *length)
+{
+    int ret = -1;
+    off_t cur, end;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    off_t data, hole;
+#endif
+
+    if ((cur = lseek(fd, 0, SEEK_CUR)) == (off_t) -1) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to get current position in file"));
+        return -1;
+    }
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    data = lseek(fd, cur, SEEK_DATA);
+
+    if (data == (off_t) -1 && errno != ENXIO && errno != EINVAL) {
+        virReportSystemError(errno, "%s", _("Unable to seek to data"));
+        goto cleanup;
+    }
+
+    if (data == (off_t) -1 && errno == ENXIO) {
+        /* We are in the trailing hole, or beyond EOF */
+        if ((end = lseek(fd, 0, SEEK_END)) == (off_t) -1) {
+            virReportSystemError(errno, "%s", _("Unable to seek to EOF"));
+            goto cleanup;
+        }
+        *inData = false;
+        *length = end > cur ? end - cur : 0;
+        ret = 0;
+        goto cleanup;
+    } else if (data > cur) {
+        *inData = false;
+        *length = data - cur;
+        ret = 0;
+        goto cleanup;
+    } else if (data == cur) {
+        if ((hole = lseek(fd, data, SEEK_HOLE)) == (off_t) -1 ||
+            hole == data) {
+            virReportSystemError(errno, "%s", _("Unable to seek to hole"));
+            goto cleanup;
+        }
+        *inData = true;
+        *length = hole - data;
+        ret = 0;
+        goto cleanup;
+    }
+    /* EINVAL means the filesystem does not support SEEK_DATA,
+     * treat the rest of the file as data */
+#endif
+
+    if ((end = lseek(fd, 0, SEEK_END)) == (off_t) -1) {
+        virReportSystemError(errno, "%s", _("Unable to seek to EOF"));
+        goto cleanup;
+    }
+    *inData = end > cur;
+    *length = end > cur ? end - cur : 0;
+    ret = 0;
+
+ cleanup:
+    if (lseek(fd, cur, SEEK_SET) == (off_t) -1) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to restore position in file"));
+        ret = -1;
+    }
+    return ret;
+}
+
+
+/**
+ * virFilePunchHole:
+ * @fd: file to modify
+ * @offset: start of the range
+ * @length: size of the range
+ *
+ * Deallocates the storage backing the given range of @fd, so that
+ * it reads back as zeros, without changing the file size.
+ *
+ * Returns 0 on success, -1 with errno set if the platform or the
+ * filesystem cannot punch holes. No error is reported so that callers
+ * can fall back to writing zeros.
+ */
+int
+virFilePunchHole(int fd ATTRIBUTE_UNUSED,
+                 off_t offset ATTRIBUTE_UNUSED,
+                 off_t length ATTRIBUTE_UNUSED)
+{
+#if HAVE_FALLOCATE && defined(FALLOC_FL_PUNCH_HOLE)
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                     offset, length);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+/**
+ * virFileZeroRange:
+ * @fd: regular file or block device to modify
+ * @offset: start of the range
+ * @length: size of the range
+ *
+ * Makes the given range of @fd read back as zeros without writing
+ * the zeros out. Files have the range zeroed by the filesystem, which
+ * keeps it allocated; holes are never punched, use virFilePunchHole
+ * for files that may become sparse. Block devices have it discarded if
+ * the device guarantees that discarded blocks read as zeros, or else
+ * zeroed by the kernel, which lets the device offload the work. For
+ * block devices, @offset and @length must be multiples of 512.
+ *
+ * Returns 0 on success, -1 with errno set if neither is possible. No
+ * error is reported so that callers can fall back to writing zeros.
+ */
+int
+virFileZeroRange(int fd,
+                 off_t offset ATTRIBUTE_UNUSED,
+                 off_t length ATTRIBUTE_UNUSED)
+{
+    struct stat sb;
+
+    if (fstat(fd, &sb) < 0)
+        return -1;
+
+    if (S_ISBLK(sb.st_mode)) {
+#if defined(__linux__) && defined(BLKZEROOUT)
+        uint64_t range[2] = { offset, length };
+# ifdef BLKDISCARDZEROES
+        unsigned int zeroes = 0;
+
+        if (ioctl(fd, BLKDISCARDZEROES, &zeroes) == 0 && zeroes &&
+            ioctl(fd, BLKDISCARD, range) == 0)
+            return 0;
+# endif
+        return ioctl(fd, BLKZEROOUT, range);
+#endif
+    } else if (S_ISREG(sb.st_mode)) {
+#if HAVE_FALLOCATE && defined(FALLOC_FL_ZERO_RANGE)
+        return fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                         offset, length);
+#endif
+    }
+
+    errno = ENOTSUP;
+    return -1;
+}
+
+
+/**
+ * virFileSparseRecordEncode:
+ * @header: buffer of VIR_FILE_SPARSE_RECORD_HEADER_LEN bytes
+ * @type: type of the record
+ * @length: number of bytes the record stands for
+ *
+ * Fills @header with the header of a record of a sparse stream. A
+ * data record is followed by @length bytes of data, a hole record
+ * stands for @length bytes of zeros that are not sent.
+ */
+void
+virFileSparseRecordEncode(char *header,
+                          virFileSparseRecordType type,
+                          unsigned long long length)
+{
+    virWriteBufInt32BE(header, type);
+    virWriteBufInt64BE(header + 4, length);
+}
+
+
+/**
+ * virFileSparseRecordDecode:
+ * @header: header of VIR_FILE_SPARSE_RECORD_HEADER_LEN bytes
+ * @type: filled with the type of the record
+ * @length: filled with the number of bytes the record stands for
+ *
+ * Parses the header of a record of a sparse stream, as written by
+ * virFileSparseRecordEncode.
+ *
+ * Returns 0 on success, -1 with an error reported if the header is
+ * malformed.
+ */
+int
+virFileSparseRecordDecode(const char *header,
+                          virFileSparseRecordType *type,
+                          unsigned long long *length)
+{
+    unsigned int t = virReadBufInt32BE(header);
+    unsigned long long l = virReadBufInt64BE(header + 4);
+
+    if ((t != VIR_FILE_SPARSE_RECORD_DATA &&
+         t != VIR_FILE_SPARSE_RECORD_HOLE) ||
+        l == 0 || l > LLONG_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("malformed sparse stream record type %u length %llu"),
+                       t, l);
+        return -1;
+    }
+
+    *type = t;
+    *length = l;
+    return 0;
+}
+
+
 #if defined(__linux__) && HAVE_DECL_LO_FLAGS_AUTOCLEAR && \
     !defined(LIBVIRT_SETUID_RPC_CLIENT)
 
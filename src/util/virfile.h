@@ -112,6 +112,33 @@ int virFileUpdatePerm(const char *path,
                       mode_t mode_remove,
                       mode_t mode_add);
 
+int virFileInData(int fd,
+                  bool *inData,
+                  unsigned long long *length)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+int virFilePunchHole(int fd, off_t offset, off_t length);
+int virFileZeroRange(int fd, off_t offset, off_t length);
+
+/* Sparse streams exchanged with the I/O helper are made of records,
+ * each one a header giving the type and the length, both big endian,
+ * followed for data records by the data itself */
+typedef enum {
+    VIR_FILE_SPARSE_RECORD_DATA = 1,
+    VIR_FILE_SPARSE_RECORD_HOLE = 2,
+} virFileSparseRecordType;
+
+# define VIR_FILE_SPARSE_RECORD_HEADER_LEN 12
+
+void virFileSparseRecordEncode(char *header,
+                               virFileSparseRecordType type,
+                               unsigned long long length)
+    ATTRIBUTE_NONNULL(1);
+int virFileSparseRecordDecode(const char *header,
+                              virFileSparseRecordType *type,
+                              unsigned long long *length)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_RETURN_CHECK;
+
 int virFileLoopDeviceAssociate(const char *file,
                                char **dev);
 
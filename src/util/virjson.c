@@ -27,11 +27,11 @@
 #include "viralloc.h"
 #include "virerror.h"
 #include "virlog.h"
+#include "virhashcode.h"
 #include "virstring.h"
 #include "virutil.h"
 
 #if WITH_YAJL
-# include <yajl/yajl_gen.h>
 # include <yajl/yajl_parse.h>
 
 # ifdef WITH_YAJL2
@@ -47,11 +47,28 @@
 
 VIR_LOG_INIT("util.json");
 
+/* Objects with at least this many pairs get a hash table for
+ * looking up keys instead of a linear scan */
+#define VIR_JSON_OBJECT_INDEX_MIN 16
+
 typedef struct _virJSONParserState virJSONParserState;
 typedef virJSONParserState *virJSONParserStatePtr;
 struct _virJSONParserState {
     virJSONValuePtr value;
     char *key;
+    bool full;                  /* whole subtree wanted by the filter */
+    unsigned long long matches; /* filter paths passing through here */
+    bool skipNext;              /* value for the last key is unwanted */
+};
+
+/* Filters are limited by the width of virJSONParserState.matches */
+#define VIR_JSON_FILTER_MAX 64
+
+typedef struct _virJSONParserDone virJSONParserDone;
+typedef virJSONParserDone *virJSONParserDonePtr;
+struct _virJSONParserDone {
+    virJSONValuePtr value;
+    size_t end;
 };
 
 typedef struct _virJSONParser virJSONParser;
@@ -60,6 +77,43 @@ struct _virJSONParser {
     virJSONValuePtr head;
     virJSONParserStatePtr state;
     size_t nstate;
+
+    /* Optional list of paths to extract, each one a NULL terminated
+     * list of object keys, with "*" matching any key or array element */
+    char ***filter;
+    size_t nfilter;
+    size_t skip;                    /* nesting of the skipped container */
+    bool nextFull;
+    unsigned long long nextMatches;
+
+    bool stream;                    /* hand out each top level value */
+    bool complete;
+
+#ifdef WITH_YAJL2
+    /* With yajl 2 a stream parser keeps going past the end of a top
+     * level value, which is queued along with the offset it ends at */
+    yajl_handle hand;
+    size_t base;                    /* stream offset of the parsed chunk */
+    virJSONParserDonePtr done;
+    size_t ndone;
+#endif
+};
+
+struct _virJSONStreamParser {
+#if WITH_YAJL
+    yajl_handle hand;
+#endif
+    virJSONParser parser;
+
+#ifdef WITH_YAJL2
+    size_t parsed;                  /* stream offset seen by yajl */
+    size_t used;                    /* stream offset returned to caller */
+    char *error;                    /* failure after the queued values */
+#endif
+
+    bool filterChanged;
+    char ***filter;
+    size_t nfilter;
 };
 
 
@@ -76,6 +130,7 @@ void virJSONValueFree(virJSONValuePtr value)
             virJSONValueFree(value->data.object.pairs[i].value);
         }
         VIR_FREE(value->data.object.pairs);
+        virHashFree(value->data.object.index);
         break;
     case VIR_JSON_TYPE_ARRAY:
         for (i = 0; i < value->data.array.nvalues; i++)
@@ -135,7 +190,8 @@ virJSONValuePtr virJSONValueNewStringLen(const char *data, size_t length)
     return val;
 }
 
-static virJSONValuePtr virJSONValueNewNumber(const char *data)
+static virJSONValuePtr virJSONValueNewNumberLen(const char *data,
+                                                size_t length)
 {
     virJSONValuePtr val;
 
@@ -143,7 +199,7 @@ static virJSONValuePtr virJSONValueNewNumber(const char *data)
         return NULL;
 
     val->type = VIR_JSON_TYPE_NUMBER;
-    if (VIR_STRDUP(val->data.number, data) < 0) {
+    if (VIR_STRNDUP(val->data.number, data, length) < 0) {
         VIR_FREE(val);
         return NULL;
     }
@@ -151,6 +207,11 @@ static virJSONValuePtr virJSONValueNewNumber(const char *data)
     return val;
 }
 
+static virJSONValuePtr virJSONValueNewNumber(const char *data)
+{
+    return virJSONValueNewNumberLen(data, strlen(data));
+}
+
 virJSONValuePtr virJSONValueNewNumberInt(int data)
 {
     virJSONValuePtr val = NULL;
@@ -260,9 +321,63 @@ virJSONValuePtr virJSONValueNewObject(void)
     return val;
 }
 
-int virJSONValueObjectAppend(virJSONValuePtr object, const char *key, virJSONValuePtr value)
+/* The index borrows the keys of the pairs instead of copying them */
+static uint32_t virJSONObjectIndexCode(const void *name, uint32_t seed)
 {
-    char *newkey;
+    return virHashCodeGen(name, strlen(name), seed);
+}
+
+static bool virJSONObjectIndexEqual(const void *namea, const void *nameb)
+{
+    return STREQ(namea, nameb);
+}
+
+static void *virJSONObjectIndexCopy(const void *name)
+{
+    return (void *)name;
+}
+
+static int virJSONObjectIndexBuild(virJSONObjectPtr object)
+{
+    size_t i;
+
+    if (!(object->index = virHashCreateFull(object->npairs * 2, NULL,
+                                            virJSONObjectIndexCode,
+                                            virJSONObjectIndexEqual,
+                                            virJSONObjectIndexCopy,
+                                            NULL)))
+        return -1;
+
+    for (i = 0; i < object->npairs; i++) {
+        if (virHashAddEntry(object->index, object->pairs[i].key,
+                            object->pairs[i].value) < 0) {
+            virHashFree(object->index);
+            object->index = NULL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static ssize_t virJSONObjectFind(virJSONObjectPtr object, const char *key)
+{
+    size_t i;
+
+    for (i = 0; i < object->npairs; i++) {
+        if (STREQ(object->pairs[i].key, key))
+            return i;
+    }
+
+    return -1;
+}
+
+/* Takes ownership of @key on success */
+static int virJSONValueObjectAppendKey(virJSONValuePtr object,
+                                       char *key,
+                                       virJSONValuePtr value)
+{
+    virJSONObjectPtr obj = &object->data.object;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
@@ -270,19 +385,40 @@ int virJSONValueObjectAppend(virJSONValuePtr object, const char *key, virJSONVal
     if (virJSONValueObjectHasKey(object, key))
         return -1;
 
+    if (VIR_RESIZE_N(obj->pairs, obj->npairs_max, obj->npairs, 1) < 0)
+        return -1;
+
+    obj->pairs[obj->npairs].key = key;
+    obj->pairs[obj->npairs].value = value;
+    obj->npairs++;
+
+    if (obj->index) {
+        if (virHashAddEntry(obj->index, key, value) < 0)
+            goto error;
+    } else if (obj->npairs >= VIR_JSON_OBJECT_INDEX_MIN) {
+        if (virJSONObjectIndexBuild(obj) < 0)
+            goto error;
+    }
+
+    return 0;
+
+ error:
+    obj->npairs--;
+    return -1;
+}
+
+int virJSONValueObjectAppend(virJSONValuePtr object, const char *key, virJSONValuePtr value)
+{
+    char *newkey;
+
     if (VIR_STRDUP(newkey, key) < 0)
         return -1;
 
-    if (VIR_REALLOC_N(object->data.object.pairs,
-                      object->data.object.npairs + 1) < 0) {
+    if (virJSONValueObjectAppendKey(object, newkey, value) < 0) {
         VIR_FREE(newkey);
         return -1;
     }
 
-    object->data.object.pairs[object->data.object.npairs].key = newkey;
-    object->data.object.pairs[object->data.object.npairs].value = value;
-    object->data.object.npairs++;
-
     return 0;
 }
 
@@ -390,8 +526,9 @@ int virJSONValueArrayAppend(virJSONValuePtr array, virJSONValuePtr value)
     if (array->type != VIR_JSON_TYPE_ARRAY)
         return -1;
 
-    if (VIR_REALLOC_N(array->data.array.values,
-                      array->data.array.nvalues + 1) < 0)
+    if (VIR_RESIZE_N(array->data.array.values,
+                     array->data.array.nvalues_max,
+                     array->data.array.nvalues, 1) < 0)
         return -1;
 
     array->data.array.values[array->data.array.nvalues] = value;
@@ -402,32 +539,29 @@ int virJSONValueArrayAppend(virJSONValuePtr array, virJSONValuePtr value)
 
 int virJSONValueObjectHasKey(virJSONValuePtr object, const char *key)
 {
-    size_t i;
-
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return 1;
-    }
+    if (object->data.object.index)
+        return virHashLookup(object->data.object.index, key) ? 1 : 0;
 
-    return 0;
+    return virJSONObjectFind(&object->data.object, key) >= 0 ? 1 : 0;
 }
 
 virJSONValuePtr virJSONValueObjectGet(virJSONValuePtr object, const char *key)
 {
-    size_t i;
+    ssize_t i;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return object->data.object.pairs[i].value;
-    }
+    if (object->data.object.index)
+        return virHashLookup(object->data.object.index, key);
 
-    return NULL;
+    if ((i = virJSONObjectFind(&object->data.object, key)) < 0)
+        return NULL;
+
+    return object->data.object.pairs[i].value;
 }
 
 int virJSONValueObjectKeysNumber(virJSONValuePtr object)
@@ -456,7 +590,7 @@ int
 virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
                             virJSONValuePtr *value)
 {
-    size_t i;
+    ssize_t i;
 
     if (value)
         *value = NULL;
@@ -464,21 +598,21 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            if (value) {
-                *value = object->data.object.pairs[i].value;
-                object->data.object.pairs[i].value = NULL;
-            }
-            VIR_FREE(object->data.object.pairs[i].key);
-            virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            return 1;
-        }
-    }
+    if ((i = virJSONObjectFind(&object->data.object, key)) < 0)
+        return 0;
 
-    return 0;
+    if (value) {
+        *value = object->data.object.pairs[i].value;
+        object->data.object.pairs[i].value = NULL;
+    }
+    if (object->data.object.index)
+        ignore_value(virHashRemoveEntry(object->data.object.index,
+                                        object->data.object.pairs[i].key));
+    VIR_FREE(object->data.object.pairs[i].key);
+    virJSONValueFree(object->data.object.pairs[i].value);
+    VIR_DELETE_ELEMENT_INPLACE(object->data.object.pairs, i,
+                               object->data.object.npairs);
+    return 1;
 }
 
 virJSONValuePtr virJSONValueObjectGetValue(virJSONValuePtr object, unsigned int n)
@@ -715,12 +849,12 @@ static int virJSONParserInsertValue(virJSONParserPtr parser,
                 return -1;
             }
 
-            if (virJSONValueObjectAppend(state->value,
-                                         state->key,
-                                         value) < 0)
+            if (virJSONValueObjectAppendKey(state->value,
+                                            state->key,
+                                            value) < 0)
                 return -1;
 
-            VIR_FREE(state->key);
+            state->key = NULL;
         }   break;
 
         case VIR_JSON_TYPE_ARRAY: {
@@ -743,14 +877,135 @@ static int virJSONParserInsertValue(virJSONParserPtr parser,
     return 0;
 }
 
+
+/*
+ * Decide whether a value at the next position is covered by the
+ * parser filter. @key is the object key of the value, or NULL for
+ * array elements and the top level value. On success, nextFull and
+ * nextMatches describe the value, for use when it is a container.
+ */
+static bool virJSONParserWant(virJSONParserPtr parser,
+                              const char *key,
+                              size_t keylen)
+{
+    virJSONParserStatePtr state;
+    size_t depth = parser->nstate;
+    size_t i;
+
+    parser->nextFull = true;
+    parser->nextMatches = 0;
+
+    if (!parser->nfilter)
+        return true;
+
+    parser->nextFull = false;
+    if (!depth) {
+        for (i = 0; i < parser->nfilter; i++)
+            parser->nextMatches |= 1ULL << i;
+        return true;
+    }
+
+    state = &parser->state[depth - 1];
+    if (state->full) {
+        parser->nextFull = true;
+        return true;
+    }
+
+    for (i = 0; i < parser->nfilter; i++) {
+        const char *name;
+
+        if (!(state->matches & (1ULL << i)))
+            continue;
+
+        name = parser->filter[i][depth - 1];
+        if (STRNEQ(name, "*") &&
+            (!key || strlen(name) != keylen || memcmp(name, key, keylen)))
+            continue;
+
+        if (!parser->filter[i][depth]) {
+            parser->nextFull = true;
+            return true;
+        }
+        parser->nextMatches |= 1ULL << i;
+    }
+
+    return parser->nextMatches != 0;
+}
+
+
+/*
+ * Returns true if the value about to be reported by yajl must
+ * not be added to the tree, either because it lives in a skipped
+ * container or because the filter does not want it.
+ */
+static bool virJSONParserSkipValue(virJSONParserPtr parser)
+{
+    virJSONParserStatePtr state;
+
+    if (parser->skip)
+        return true;
+
+    if (!parser->nfilter)
+        return false;
+
+    if (parser->nstate) {
+        state = &parser->state[parser->nstate - 1];
+        if (state->value->type == VIR_JSON_TYPE_OBJECT) {
+            /* virJSONParserHandleMapKey has already decided */
+            bool skip = state->skipNext;
+            state->skipNext = false;
+            return skip;
+        }
+    }
+
+    return !virJSONParserWant(parser, NULL, 0);
+}
+
+
+/*
+ * Called once a value was added to the tree. In streaming mode a
+ * finished top level value is queued for the caller with yajl 2,
+ * while yajl 1, which cannot parse more than one value per handle,
+ * interrupts the parse so that the caller can pick it up.
+ */
+static int virJSONParserValueDone(virJSONParserPtr parser)
+{
+# ifdef WITH_YAJL2
+    virJSONParserDone done;
+# endif
+
+    if (parser->nstate || !parser->head)
+        return 1;
+
+# ifdef WITH_YAJL2
+    if (parser->stream) {
+        /* Inside a callback yajl counts the bytes up to the end of
+         * the current token */
+        done.value = parser->head;
+        done.end = parser->base + yajl_get_bytes_consumed(parser->hand);
+        if (VIR_APPEND_ELEMENT(parser->done, parser->ndone, done) < 0)
+            return 0;
+        parser->head = NULL;
+        return 1;
+    }
+# endif
+
+    parser->complete = true;
+    return parser->stream ? 0 : 1;
+}
+
+
 static int virJSONParserHandleNull(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewNull();
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p", parser);
 
-    if (!value)
+    if (virJSONParserSkipValue(parser))
+        return 1;
+
+    if (!(value = virJSONValueNewNull()))
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
@@ -758,17 +1013,20 @@ static int virJSONParserHandleNull(void *ctx)
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 static int virJSONParserHandleBoolean(void *ctx, int boolean_)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewBoolean(boolean_);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p boolean=%d", parser, boolean_);
 
-    if (!value)
+    if (virJSONParserSkipValue(parser))
+        return 1;
+
+    if (!(value = virJSONValueNewBoolean(boolean_)))
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
@@ -776,7 +1034,7 @@ static int virJSONParserHandleBoolean(void *ctx, int boolean_)
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 static int virJSONParserHandleNumber(void *ctx,
@@ -784,25 +1042,22 @@ static int virJSONParserHandleNumber(void *ctx,
                                      yajl_size_t l)
 {
     virJSONParserPtr parser = ctx;
-    char *str;
     virJSONValuePtr value;
 
-    if (VIR_STRNDUP(str, s, l) < 0)
-        return -1;
-    value = virJSONValueNewNumber(str);
-    VIR_FREE(str);
-
-    VIR_DEBUG("parser=%p str=%s", parser, str);
+    if (virJSONParserSkipValue(parser))
+        return 1;
 
-    if (!value)
+    if (!(value = virJSONValueNewNumberLen(s, l)))
         return 0;
 
+    VIR_DEBUG("parser=%p str=%s", parser, value->data.number);
+
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 static int virJSONParserHandleString(void *ctx,
@@ -810,12 +1065,15 @@ static int virJSONParserHandleString(void *ctx,
                                      yajl_size_t stringLen)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewStringLen((const char *)stringVal,
-                                                     stringLen);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p str=%p", parser, (const char *)stringVal);
 
-    if (!value)
+    if (virJSONParserSkipValue(parser))
+        return 1;
+
+    if (!(value = virJSONValueNewStringLen((const char *)stringVal,
+                                           stringLen)))
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
@@ -823,7 +1081,7 @@ static int virJSONParserHandleString(void *ctx,
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 static int virJSONParserHandleMapKey(void *ctx,
@@ -835,25 +1093,56 @@ static int virJSONParserHandleMapKey(void *ctx,
 
     VIR_DEBUG("parser=%p key=%p", parser, (const char *)stringVal);
 
+    if (parser->skip)
+        return 1;
+
     if (!parser->nstate)
         return 0;
 
     state = &parser->state[parser->nstate-1];
     if (state->key)
         return 0;
+
+    if (!virJSONParserWant(parser, (const char *)stringVal, stringLen)) {
+        state->skipNext = true;
+        return 1;
+    }
+
     if (VIR_STRNDUP(state->key, (const char *)stringVal, stringLen) < 0)
         return 0;
     return 1;
 }
 
+static int virJSONParserPushState(virJSONParserPtr parser,
+                                  virJSONValuePtr value)
+{
+    if (VIR_REALLOC_N(parser->state,
+                      parser->nstate + 1) < 0)
+        return -1;
+
+    parser->state[parser->nstate].value = value;
+    parser->state[parser->nstate].key = NULL;
+    parser->state[parser->nstate].full = parser->nextFull;
+    parser->state[parser->nstate].matches = parser->nextMatches;
+    parser->state[parser->nstate].skipNext = false;
+    parser->nstate++;
+
+    return 0;
+}
+
 static int virJSONParserHandleStartMap(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewObject();
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p", parser);
 
-    if (!value)
+    if (virJSONParserSkipValue(parser)) {
+        parser->skip++;
+        return 1;
+    }
+
+    if (!(value = virJSONValueNewObject()))
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
@@ -861,14 +1150,8 @@ static int virJSONParserHandleStartMap(void *ctx)
         return 0;
     }
 
-    if (VIR_REALLOC_N(parser->state,
-                      parser->nstate + 1) < 0) {
+    if (virJSONParserPushState(parser, value) < 0)
         return 0;
-    }
-
-    parser->state[parser->nstate].value = value;
-    parser->state[parser->nstate].key = NULL;
-    parser->nstate++;
 
     return 1;
 }
@@ -881,6 +1164,11 @@ static int virJSONParserHandleEndMap(void *ctx)
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (parser->skip) {
+        parser->skip--;
+        return 1;
+    }
+
     if (!parser->nstate)
         return 0;
 
@@ -892,17 +1180,22 @@ static int virJSONParserHandleEndMap(void *ctx)
 
     VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 static int virJSONParserHandleStartArray(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewArray();
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p", parser);
 
-    if (!value)
+    if (virJSONParserSkipValue(parser)) {
+        parser->skip++;
+        return 1;
+    }
+
+    if (!(value = virJSONValueNewArray()))
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
@@ -910,14 +1203,9 @@ static int virJSONParserHandleStartArray(void *ctx)
         return 0;
     }
 
-    if (VIR_REALLOC_N(parser->state,
-                      parser->nstate + 1) < 0)
+    if (virJSONParserPushState(parser, value) < 0)
         return 0;
 
-    parser->state[parser->nstate].value = value;
-    parser->state[parser->nstate].key = NULL;
-    parser->nstate++;
-
     return 1;
 }
 
@@ -928,6 +1216,11 @@ static int virJSONParserHandleEndArray(void *ctx)
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (parser->skip) {
+        parser->skip--;
+        return 1;
+    }
+
     if (!parser->nstate)
         return 0;
 
@@ -939,7 +1232,7 @@ static int virJSONParserHandleEndArray(void *ctx)
 
     VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 static const yajl_callbacks parserCallbacks = {
@@ -957,32 +1250,71 @@ static const yajl_callbacks parserCallbacks = {
 };
 
 
-/* XXX add an incremental streaming parser - yajl trivially supports it */
-virJSONValuePtr virJSONValueFromString(const char *jsonstring)
+static yajl_handle virJSONParserAlloc(virJSONParserPtr parser)
 {
     yajl_handle hand;
-    virJSONParser parser = { NULL, NULL, 0 };
-    virJSONValuePtr ret = NULL;
 # ifndef WITH_YAJL2
     yajl_parser_config cfg = { 1, 1 };
 # endif
 
-    VIR_DEBUG("string=%s", jsonstring);
-
 # ifdef WITH_YAJL2
-    hand = yajl_alloc(&parserCallbacks, NULL, &parser);
+    hand = yajl_alloc(&parserCallbacks, NULL, parser);
     if (hand) {
         yajl_config(hand, yajl_allow_comments, 1);
         yajl_config(hand, yajl_dont_validate_strings, 0);
+        if (parser->stream) {
+            yajl_config(hand, yajl_allow_multiple_values, 1);
+            parser->hand = hand;
+        }
     }
 # else
-    hand = yajl_alloc(&parserCallbacks, &cfg, NULL, &parser);
+    hand = yajl_alloc(&parserCallbacks, &cfg, NULL, parser);
 # endif
-    if (!hand) {
+    if (!hand)
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to create JSON parser"));
-        goto cleanup;
+
+    return hand;
+}
+
+
+/* Drop any partially built value, leaving the filter in place */
+static void virJSONParserClear(virJSONParserPtr parser)
+{
+    size_t i;
+
+    if (parser->nstate) {
+        for (i = 0; i < parser->nstate; i++)
+            VIR_FREE(parser->state[i].key);
+        VIR_FREE(parser->state);
+        parser->nstate = 0;
     }
+    virJSONValueFree(parser->head);
+    parser->head = NULL;
+    parser->skip = 0;
+    parser->complete = false;
+
+# ifdef WITH_YAJL2
+    for (i = 0; i < parser->ndone; i++)
+        virJSONValueFree(parser->done[i].value);
+    VIR_FREE(parser->done);
+    parser->ndone = 0;
+# endif
+}
+
+
+virJSONValuePtr virJSONValueFromString(const char *jsonstring)
+{
+    yajl_handle hand;
+    virJSONParser parser;
+    virJSONValuePtr ret = NULL;
+
+    VIR_DEBUG("string=%s", jsonstring);
+
+    memset(&parser, 0, sizeof(parser));
+
+    if (!(hand = virJSONParserAlloc(&parser)))
+        goto cleanup;
 
     if (yajl_parse(hand,
                    (const unsigned char *)jsonstring,
@@ -995,7 +1327,6 @@ virJSONValuePtr virJSONValueFromString(const char *jsonstring)
                        _("cannot parse json %s: %s"),
                        jsonstring, (const char*) errstr);
         VIR_FREE(errstr);
-        virJSONValueFree(parser.head);
         goto cleanup;
     }
 
@@ -1003,152 +1334,574 @@ virJSONValuePtr virJSONValueFromString(const char *jsonstring)
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("cannot parse json %s: unterminated string/map/array"),
                        jsonstring);
-        virJSONValueFree(parser.head);
     } else {
         ret = parser.head;
+        parser.head = NULL;
     }
 
  cleanup:
-    yajl_free(hand);
+    if (hand)
+        yajl_free(hand);
+
+    VIR_DEBUG("result=%p", ret);
+
+    virJSONParserClear(&parser);
+
+    return ret;
+}
+
+
+/**
+ * virJSONStreamParserNew:
+ *
+ * Create a parser which can be fed a stream of JSON documents in
+ * arbitrarily sized chunks, building each value as soon as its data
+ * arrives rather than waiting for the whole document.
+ *
+ * Returns the new parser, or NULL on error
+ */
+virJSONStreamParserPtr virJSONStreamParserNew(void)
+{
+    virJSONStreamParserPtr ret;
+
+    if (VIR_ALLOC(ret) < 0)
+        return NULL;
+
+    ret->parser.stream = true;
+
+    if (!(ret->hand = virJSONParserAlloc(&ret->parser))) {
+        VIR_FREE(ret);
+        return NULL;
+    }
+
+    return ret;
+}
+
+
+static void virJSONStreamParserFilterFree(char ***filter,
+                                          size_t nfilter)
+{
+    size_t i;
+
+    for (i = 0; i < nfilter; i++)
+        virStringFreeList(filter[i]);
+    VIR_FREE(filter);
+}
 
-    if (parser.nstate) {
-        size_t i;
-        for (i = 0; i < parser.nstate; i++)
-            VIR_FREE(parser.state[i].key);
-        VIR_FREE(parser.state);
+
+/* Drop the handle and anything parsed, leaving the filters in place */
+static void virJSONStreamParserReset(virJSONStreamParserPtr stream)
+{
+    if (stream->hand)
+        yajl_free(stream->hand);
+    stream->hand = NULL;
+    virJSONParserClear(&stream->parser);
+
+# ifdef WITH_YAJL2
+    stream->parser.hand = NULL;
+    stream->parsed = 0;
+    stream->used = 0;
+    VIR_FREE(stream->error);
+# endif
+}
+
+
+void virJSONStreamParserFree(virJSONStreamParserPtr stream)
+{
+    if (!stream)
+        return;
+
+    virJSONStreamParserReset(stream);
+    virJSONStreamParserFilterFree(stream->parser.filter,
+                                  stream->parser.nfilter);
+    virJSONStreamParserFilterFree(stream->filter, stream->nfilter);
+    VIR_FREE(stream);
+}
+
+
+/**
+ * virJSONStreamParserSetFilter:
+ * @stream: the parser
+ * @paths: NULL terminated list of paths, or NULL
+ *
+ * Restrict the values built by @stream to the subtrees named by
+ * @paths, skipping everything else without allocating it. Each path
+ * is a list of object keys separated by '/', where "*" matches any
+ * key or any array element. Containers leading to a requested subtree
+ * are kept, but only with the requested members. A NULL @paths
+ * disables filtering.
+ *
+ * The filter takes effect from the next top level value, so it can
+ * be changed while a value is only partially parsed. Values which
+ * follow in data that was already fed to the parser may have been
+ * built ahead, and keep the filter that was in effect back then.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virJSONStreamParserSetFilter(virJSONStreamParserPtr stream,
+                                 const char *const *paths)
+{
+    char ***filter = NULL;
+    size_t nfilter = 0;
+    size_t i;
+
+    for (i = 0; paths && paths[i]; i++) {
+        if (i == VIR_JSON_FILTER_MAX) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("too many JSON filter paths, maximum is %d"),
+                           VIR_JSON_FILTER_MAX);
+            goto error;
+        }
+
+        if (!*paths[i]) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("empty JSON filter path"));
+            goto error;
+        }
+
+        if (VIR_EXPAND_N(filter, nfilter, 1) < 0)
+            goto error;
+
+        if (!(filter[nfilter - 1] = virStringSplit(paths[i], "/", 0)))
+            goto error;
     }
 
-    VIR_DEBUG("result=%p", parser.head);
+    virJSONStreamParserFilterFree(stream->filter, stream->nfilter);
+    stream->filter = filter;
+    stream->nfilter = nfilter;
+    stream->filterChanged = true;
+    return 0;
+
+ error:
+    virJSONStreamParserFilterFree(filter, nfilter);
+    return -1;
+}
+
+
+/* Swap in a filter set while the parser was in the middle of a value */
+static void virJSONStreamParserUpdateFilter(virJSONStreamParserPtr stream)
+{
+    virJSONParserPtr parser = &stream->parser;
+
+    if (!stream->filterChanged ||
+        parser->head || parser->nstate || parser->skip)
+        return;
+
+    virJSONStreamParserFilterFree(parser->filter, parser->nfilter);
+    parser->filter = stream->filter;
+    parser->nfilter = stream->nfilter;
+    stream->filter = NULL;
+    stream->nfilter = 0;
+    stream->filterChanged = false;
+}
+
 
+/* Describe the failure @rc of parsing @data, returns NULL on OOM */
+static char *virJSONStreamParserError(virJSONStreamParserPtr stream,
+                                      yajl_status rc,
+                                      const char *data,
+                                      size_t len)
+{
+    unsigned char *errstr;
+    char *ret = NULL;
+
+    if (rc == yajl_status_client_canceled) {
+        ignore_value(VIR_STRDUP(ret, _("unable to build value")));
+        return ret;
+    }
+
+    errstr = yajl_get_error(stream->hand, 0, (const unsigned char *)data, len);
+    ignore_value(VIR_STRDUP(ret, (const char *)errstr));
+    VIR_FREE(errstr);
     return ret;
 }
 
 
-static int virJSONValueToStringOne(virJSONValuePtr object,
-                                   yajl_gen g)
+/**
+ * virJSONStreamParserFeed:
+ * @stream: the parser
+ * @data: the next chunk of the input
+ * @len: length of @data
+ * @value: filled with the parsed value, or NULL
+ *
+ * Parse @data, stopping as soon as a complete top level value has
+ * been seen. In that case @value is filled with the value and the
+ * return value tells how much of @data was used, so that the caller
+ * can feed the rest again. Otherwise @value is set to NULL, all of
+ * @data was used and the partial value is kept for the next call.
+ *
+ * With yajl 2 the parser reads on past the end of a value, so the
+ * rest must be fed again unchanged, although it is not parsed twice.
+ * Further data may follow it.
+ *
+ * Returns the number of bytes used, or -1 on error, after which the
+ * parser is reset
+ */
+# ifdef WITH_YAJL2
+ssize_t virJSONStreamParserFeed(virJSONStreamParserPtr stream,
+                                const char *data,
+                                size_t len,
+                                virJSONValuePtr *value)
+{
+    virJSONParserPtr parser = &stream->parser;
+    size_t ahead = stream->parsed - stream->used;
+    yajl_status rc;
+    size_t used;
+
+    *value = NULL;
+
+    /* The head of @data up to @ahead was parsed already, along with
+     * any values queued from it */
+    if (ahead > len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot parse json: data was not fed again"));
+        virJSONStreamParserReset(stream);
+        return -1;
+    }
+
+    if (!parser->ndone && !stream->error && ahead < len) {
+        if (!stream->hand &&
+            !(stream->hand = virJSONParserAlloc(parser)))
+            return -1;
+
+        virJSONStreamParserUpdateFilter(stream);
+
+        parser->base = stream->parsed;
+        rc = yajl_parse(stream->hand, (const unsigned char *)data + ahead,
+                        len - ahead);
+        stream->parsed += len - ahead;
+
+        /* Values finished before the error are handed out first */
+        if (rc != yajl_status_ok &&
+            !(stream->error = virJSONStreamParserError(stream, rc,
+                                                       data + ahead,
+                                                       len - ahead))) {
+            virJSONStreamParserReset(stream);
+            return -1;
+        }
+    }
+
+    if (parser->ndone) {
+        *value = parser->done[0].value;
+        used = parser->done[0].end - stream->used;
+        stream->used = parser->done[0].end;
+        VIR_DELETE_ELEMENT(parser->done, 0, parser->ndone);
+        return used;
+    }
+
+    if (stream->error) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse json: %s"), stream->error);
+        virJSONStreamParserReset(stream);
+        return -1;
+    }
+
+    used = stream->parsed - stream->used;
+    stream->used = stream->parsed;
+    return used;
+}
+# else /* !WITH_YAJL2 */
+ssize_t virJSONStreamParserFeed(virJSONStreamParserPtr stream,
+                                const char *data,
+                                size_t len,
+                                virJSONValuePtr *value)
+{
+    virJSONParserPtr parser = &stream->parser;
+    yajl_status rc;
+    size_t used;
+    char *error;
+
+    *value = NULL;
+
+    if (!stream->hand &&
+        !(stream->hand = virJSONParserAlloc(parser)))
+        return -1;
+
+    virJSONStreamParserUpdateFilter(stream);
+
+    rc = yajl_parse(stream->hand, (const unsigned char *)data, len);
+
+    if (parser->complete) {
+        /* Parsing was interrupted by virJSONParserValueDone, the
+         * handle needs to be replaced before the next value */
+        used = yajl_get_bytes_consumed(stream->hand);
+        yajl_free(stream->hand);
+        stream->hand = NULL;
+
+        *value = parser->head;
+        parser->head = NULL;
+        parser->complete = false;
+        return used;
+    }
+
+    if (rc == yajl_status_ok || rc == yajl_status_insufficient_data)
+        return len;
+
+    if ((error = virJSONStreamParserError(stream, rc, data, len))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse json: %s"), error);
+        VIR_FREE(error);
+    }
+    virJSONStreamParserReset(stream);
+    return -1;
+}
+# endif /* !WITH_YAJL2 */
+
+#else
+virJSONValuePtr virJSONValueFromString(const char *jsonstring ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+virJSONStreamParserPtr virJSONStreamParserNew(void)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+void virJSONStreamParserFree(virJSONStreamParserPtr stream)
+{
+    VIR_FREE(stream);
+}
+int virJSONStreamParserSetFilter(virJSONStreamParserPtr stream ATTRIBUTE_UNUSED,
+                                 const char *const *paths ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+ssize_t virJSONStreamParserFeed(virJSONStreamParserPtr stream ATTRIBUTE_UNUSED,
+                                const char *data ATTRIBUTE_UNUSED,
+                                size_t len ATTRIBUTE_UNUSED,
+                                virJSONValuePtr *value)
+{
+    *value = NULL;
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+#endif
+
+
+/* Length of the UTF-8 sequence starting at @s, or 0 if it is invalid */
+static size_t virJSONUTF8Length(const unsigned char *s)
 {
+    size_t len;
     size_t i;
 
-    VIR_DEBUG("object=%p type=%d gen=%p", object, object->type, g);
+    if (s[0] < 0x80)
+        return 1;
+    else if ((s[0] & 0xE0) == 0xC0)
+        len = 2;
+    else if ((s[0] & 0xF0) == 0xE0)
+        len = 3;
+    else if ((s[0] & 0xF8) == 0xF0)
+        len = 4;
+    else
+        return 0;
+
+    for (i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+    }
+
+    return len;
+}
+
+
+static int virJSONValueToBufferString(virBufferPtr buf,
+                                      const char *str)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    const unsigned char *run = s;
+
+    virBufferAddChar(buf, '"');
+
+    while (*s) {
+        const char *escape;
+        size_t len;
+
+        switch (*s) {
+        case '"':
+            escape = "\\\"";
+            break;
+        case '\\':
+            escape = "\\\\";
+            break;
+        case '\b':
+            escape = "\\b";
+            break;
+        case '\f':
+            escape = "\\f";
+            break;
+        case '\n':
+            escape = "\\n";
+            break;
+        case '\r':
+            escape = "\\r";
+            break;
+        case '\t':
+            escape = "\\t";
+            break;
+        default:
+            if (*s < 0x20) {
+                escape = NULL;
+                break;
+            }
+            if (!(len = virJSONUTF8Length(s))) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("invalid UTF-8 in JSON string '%s'"), str);
+                return -1;
+            }
+            s += len;
+            continue;
+        }
 
-    switch (object->type) {
+        /* Copy the plain characters in one go */
+        virBufferAdd(buf, (const char *)run, s - run);
+        if (escape)
+            virBufferAdd(buf, escape, -1);
+        else
+            virBufferAsprintf(buf, "\\u%04X", *s);
+        run = ++s;
+    }
+
+    virBufferAdd(buf, (const char *)run, s - run);
+    virBufferAddChar(buf, '"');
+    return 0;
+}
+
+
+/* The layout matches what the yajl generator used to produce */
+static int virJSONValueToBufferOne(virJSONValuePtr object,
+                                   virBufferPtr buf,
+                                   bool pretty,
+                                   int depth)
+{
+    size_t i;
+
+    switch ((virJSONType) object->type) {
     case VIR_JSON_TYPE_OBJECT:
-        if (yajl_gen_map_open(g) != yajl_gen_status_ok)
-            return -1;
+        virBufferAddChar(buf, '{');
+        if (pretty)
+            virBufferAddChar(buf, '\n');
         for (i = 0; i < object->data.object.npairs; i++) {
-            if (yajl_gen_string(g,
-                                (unsigned char *)object->data.object.pairs[i].key,
-                                strlen(object->data.object.pairs[i].key))
-                                != yajl_gen_status_ok)
+            if (i)
+                virBufferAddChar(buf, ',');
+            if (pretty)
+                virBufferAsprintf(buf, "%s%*s", i ? "\n" : "",
+                                  4 * (depth + 1), "");
+            if (virJSONValueToBufferString(buf,
+                                           object->data.object.pairs[i].key) < 0)
                 return -1;
-            if (virJSONValueToStringOne(object->data.object.pairs[i].value, g) < 0)
+            virBufferAddChar(buf, ':');
+            if (pretty)
+                virBufferAddChar(buf, ' ');
+            if (virJSONValueToBufferOne(object->data.object.pairs[i].value,
+                                        buf, pretty, depth + 1) < 0)
                 return -1;
         }
-        if (yajl_gen_map_close(g) != yajl_gen_status_ok)
-            return -1;
+        if (pretty)
+            virBufferAsprintf(buf, "\n%*s", 4 * depth, "");
+        virBufferAddChar(buf, '}');
         break;
+
     case VIR_JSON_TYPE_ARRAY:
-        if (yajl_gen_array_open(g) != yajl_gen_status_ok)
-            return -1;
+        virBufferAddChar(buf, '[');
+        if (pretty)
+            virBufferAddChar(buf, '\n');
         for (i = 0; i < object->data.array.nvalues; i++) {
-            if (virJSONValueToStringOne(object->data.array.values[i], g) < 0)
+            if (i)
+                virBufferAddChar(buf, ',');
+            if (pretty)
+                virBufferAsprintf(buf, "%s%*s", i ? "\n" : "",
+                                  4 * (depth + 1), "");
+            if (virJSONValueToBufferOne(object->data.array.values[i],
+                                        buf, pretty, depth + 1) < 0)
                 return -1;
         }
-        if (yajl_gen_array_close(g) != yajl_gen_status_ok)
-            return -1;
+        if (pretty)
+            virBufferAsprintf(buf, "\n%*s", 4 * depth, "");
+        virBufferAddChar(buf, ']');
         break;
 
     case VIR_JSON_TYPE_STRING:
-        if (yajl_gen_string(g, (unsigned char *)object->data.string,
-                            strlen(object->data.string)) != yajl_gen_status_ok)
+        if (virJSONValueToBufferString(buf, object->data.string) < 0)
             return -1;
         break;
 
     case VIR_JSON_TYPE_NUMBER:
-        if (yajl_gen_number(g, object->data.number,
-                            strlen(object->data.number)) != yajl_gen_status_ok)
-            return -1;
+        virBufferAdd(buf, object->data.number, -1);
         break;
 
     case VIR_JSON_TYPE_BOOLEAN:
-        if (yajl_gen_bool(g, object->data.boolean) != yajl_gen_status_ok)
-            return -1;
+        if (object->data.boolean)
+            virBufferAddLit(buf, "true");
+        else
+            virBufferAddLit(buf, "false");
         break;
 
     case VIR_JSON_TYPE_NULL:
-        if (yajl_gen_null(g) != yajl_gen_status_ok)
-            return -1;
+        virBufferAddLit(buf, "null");
         break;
 
     default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unexpected JSON value type %d"), object->type);
         return -1;
     }
 
     return 0;
 }
 
-char *virJSONValueToString(virJSONValuePtr object,
-                           bool pretty)
-{
-    yajl_gen g;
-    const unsigned char *str;
-    char *ret = NULL;
-    yajl_size_t len;
-# ifndef WITH_YAJL2
-    yajl_gen_config conf = { pretty ? 1 : 0, pretty ? "    " : " "};
-# endif
 
+/**
+ * virJSONValueToBuffer:
+ * @object: the value to format
+ * @buf: buffer to append the JSON text to
+ * @pretty: whether to indent the output
+ *
+ * Append the JSON representation of @object to @buf, which allows
+ * callers to add framing around it without copying the text again.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virJSONValueToBuffer(virJSONValuePtr object,
+                         virBufferPtr buf,
+                         bool pretty)
+{
     VIR_DEBUG("object=%p", object);
 
-# ifdef WITH_YAJL2
-    g = yajl_gen_alloc(NULL);
-    if (g) {
-        yajl_gen_config(g, yajl_gen_beautify, pretty ? 1 : 0);
-        yajl_gen_config(g, yajl_gen_indent_string, pretty ? "    " : " ");
-        yajl_gen_config(g, yajl_gen_validate_utf8, 1);
-    }
-# else
-    g = yajl_gen_alloc(&conf, NULL);
-# endif
-    if (!g) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Unable to create JSON formatter"));
-        goto cleanup;
-    }
+    if (virJSONValueToBufferOne(object, buf, pretty, 0) < 0)
+        return -1;
 
-    if (virJSONValueToStringOne(object, g) < 0) {
-        virReportOOMError();
-        goto cleanup;
-    }
+    if (pretty)
+        virBufferAddChar(buf, '\n');
 
-    if (yajl_gen_get_buf(g, &str, &len) != yajl_gen_status_ok) {
+    if (virBufferError(buf)) {
         virReportOOMError();
-        goto cleanup;
+        return -1;
     }
 
-    ignore_value(VIR_STRDUP(ret, (const char *)str));
+    return 0;
+}
 
- cleanup:
-    yajl_gen_free(g);
 
-    VIR_DEBUG("result=%s", NULLSTR(ret));
+char *virJSONValueToString(virJSONValuePtr object,
+                           bool pretty)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *ret;
 
-    return ret;
-}
+    if (virJSONValueToBuffer(object, &buf, pretty) < 0) {
+        virBufferFreeAndReset(&buf);
+        return NULL;
+    }
 
+    ret = virBufferContentAndReset(&buf);
 
-#else
-virJSONValuePtr virJSONValueFromString(const char *jsonstring ATTRIBUTE_UNUSED)
-{
-    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                   _("No JSON parser implementation is available"));
-    return NULL;
-}
-char *virJSONValueToString(virJSONValuePtr object ATTRIBUTE_UNUSED,
-                           bool pretty ATTRIBUTE_UNUSED)
-{
-    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                   _("No JSON parser implementation is available"));
-    return NULL;
+    VIR_DEBUG("result=%s", NULLSTR(ret));
+
+    return ret;
 }
-#endif
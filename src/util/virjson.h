@@ -25,6 +25,8 @@
 # define __VIR_JSON_H_
 
 # include "internal.h"
+# include "virbuffer.h"
+# include "virhash.h"
 
 
 typedef enum {
@@ -56,11 +58,14 @@ struct _virJSONObjectPair {
 
 struct _virJSONObject {
     size_t npairs;
+    size_t npairs_max;
     virJSONObjectPairPtr pairs;
+    virHashTablePtr index; /* key lookup for objects with many pairs */
 };
 
 struct _virJSONArray {
     size_t nvalues;
+    size_t nvalues_max;
     virJSONValuePtr *values;
 };
 
@@ -138,5 +143,23 @@ int virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
 virJSONValuePtr virJSONValueFromString(const char *jsonstring);
 char *virJSONValueToString(virJSONValuePtr object,
                            bool pretty);
+int virJSONValueToBuffer(virJSONValuePtr object,
+                         virBufferPtr buf,
+                         bool pretty)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+typedef struct _virJSONStreamParser virJSONStreamParser;
+typedef virJSONStreamParser *virJSONStreamParserPtr;
+
+virJSONStreamParserPtr virJSONStreamParserNew(void);
+void virJSONStreamParserFree(virJSONStreamParserPtr stream);
+int virJSONStreamParserSetFilter(virJSONStreamParserPtr stream,
+                                 const char *const *paths)
+    ATTRIBUTE_NONNULL(1);
+ssize_t virJSONStreamParserFeed(virJSONStreamParserPtr stream,
+                                const char *data,
+                                size_t len,
+                                virJSONValuePtr *value)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4);
 
 #endif /* __VIR_JSON_H_ */
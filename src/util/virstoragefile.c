@@ -39,6 +39,8 @@
 #include "virendian.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "virthread.h"
+#include "stat-time.h"
 #if HAVE_SYS_SYSCALL_H
 # include <sys/syscall.h>
 #endif
@@ -47,6 +49,36 @@
 
 VIR_LOG_INIT("util.storagefile");
 
+/* Headers of the images whose backing chains were probed, keyed by
+ * canonical path and the user and group they were opened as, so that
+ * probing a chain again only needs to stat the files, and a hit never
+ * skips the access check of a different user. Only regular files are
+ * cached. The cache is emptied when it grows over the size limit.
+ * Files modified less than VIR_STORAGE_FILE_HEADER_CACHE_MIN_AGE
+ * seconds ago are not cached, as a further write in the same clock
+ * tick would not change their timestamps. */
+#define VIR_STORAGE_FILE_HEADER_CACHE_MAX_BYTES (16 * 1024 * 1024)
+#define VIR_STORAGE_FILE_HEADER_CACHE_MIN_AGE 2
+
+typedef struct _virStorageFileHeaderCacheEntry virStorageFileHeaderCacheEntry;
+typedef virStorageFileHeaderCacheEntry *virStorageFileHeaderCacheEntryPtr;
+struct _virStorageFileHeaderCacheEntry {
+    dev_t dev;
+    ino_t ino;
+    mode_t mode;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+
+    size_t len;                 /* Length of the header */
+    size_t datalen;             /* Bytes kept, the rest are zeros */
+    char *data;
+};
+
+static virMutex virStorageFileHeaderCacheLock;
+static virHashTablePtr virStorageFileHeaderCache;
+static size_t virStorageFileHeaderCacheBytes;
+
 VIR_ENUM_IMPL(virStorage, VIR_STORAGE_TYPE_LAST,
               "none",
               "file",
@@ -788,6 +820,195 @@ qcow2GetFeatures(virBitmapPtr *features,
 }
 
 
+static void
+virStorageFileHeaderCacheEntryFree(void *payload,
+                                   const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageFileHeaderCacheEntryPtr entry = payload;
+
+    virStorageFileHeaderCacheBytes -= entry->datalen;
+    VIR_FREE(entry->data);
+    VIR_FREE(entry);
+}
+
+
+static int
+virStorageFileHeaderCacheOnceInit(void)
+{
+    if (virMutexInit(&virStorageFileHeaderCacheLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        return -1;
+    }
+
+    if (!(virStorageFileHeaderCache =
+          virHashCreate(64, virStorageFileHeaderCacheEntryFree)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStorageFileHeaderCache)
+
+
+static bool
+virStorageFileHeaderCacheMatch(virStorageFileHeaderCacheEntryPtr entry,
+                               const struct stat *sb)
+{
+    struct timespec mtime = get_stat_mtime(sb);
+    struct timespec ctime = get_stat_ctime(sb);
+
+    return entry->dev == sb->st_dev &&
+        entry->ino == sb->st_ino &&
+        entry->mode == sb->st_mode &&
+        entry->size == sb->st_size &&
+        entry->mtime.tv_sec == mtime.tv_sec &&
+        entry->mtime.tv_nsec == mtime.tv_nsec &&
+        entry->ctime.tv_sec == ctime.tv_sec &&
+        entry->ctime.tv_nsec == ctime.tv_nsec;
+}
+
+
+static char *
+virStorageFileHeaderCacheKey(const char *canonPath,
+                             uid_t uid,
+                             gid_t gid)
+{
+    char *key;
+
+    if (virAsprintfQuiet(&key, "%d:%d:%s", (int)uid, (int)gid, canonPath) < 0)
+        return NULL;
+
+    return key;
+}
+
+
+/*
+ * Look up the header of the file @canonPath as read by @uid and @gid,
+ * as long as the file was not changed since it was cached. On a hit,
+ * @sb is filled and @buf is set to a copy of the @len bytes long
+ * header.
+ *
+ * Returns 1 on a hit, 0 on a miss, without reporting errors.
+ */
+static int
+virStorageFileHeaderCacheGet(const char *canonPath,
+                             uid_t uid,
+                             gid_t gid,
+                             struct stat *sb,
+                             char **buf,
+                             ssize_t *len)
+{
+    virStorageFileHeaderCacheEntryPtr entry;
+    char *key;
+    int ret = 0;
+
+    if (virStorageFileHeaderCacheInitialize() < 0) {
+        virResetLastError();
+        return 0;
+    }
+
+    if (stat(canonPath, sb) < 0 || !S_ISREG(sb->st_mode))
+        return 0;
+
+    if (!(key = virStorageFileHeaderCacheKey(canonPath, uid, gid)))
+        return 0;
+
+    virMutexLock(&virStorageFileHeaderCacheLock);
+    if (!(entry = virHashLookup(virStorageFileHeaderCache, key)))
+        goto cleanup;
+
+    if (!virStorageFileHeaderCacheMatch(entry, sb)) {
+        virHashRemoveEntry(virStorageFileHeaderCache, key);
+        goto cleanup;
+    }
+
+    /* Internal parsers expect a buffer even for empty files */
+    if (VIR_ALLOC_N_QUIET(*buf, MAX(entry->len, 1)) < 0)
+        goto cleanup;
+    if (entry->datalen)
+        memcpy(*buf, entry->data, entry->datalen);
+    *len = entry->len;
+    ret = 1;
+
+ cleanup:
+    virMutexUnlock(&virStorageFileHeaderCacheLock);
+    VIR_FREE(key);
+    return ret;
+}
+
+
+/*
+ * Remember the @len bytes long header @buf of the file @canonPath
+ * described by @sb, as read by @uid and @gid. Block devices and other
+ * files whose content may change without their timestamps telling are
+ * left out. Failures only mean the header isn't cached.
+ */
+static void
+virStorageFileHeaderCachePut(const char *canonPath,
+                             uid_t uid,
+                             gid_t gid,
+                             const struct stat *sb,
+                             const char *buf,
+                             size_t len)
+{
+    virStorageFileHeaderCacheEntryPtr entry = NULL;
+    size_t datalen = len;
+    char *key;
+
+    if (virStorageFileHeaderCacheInitialize() < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if (!S_ISREG(sb->st_mode) ||
+        get_stat_mtime(sb).tv_sec >
+        time(NULL) - VIR_STORAGE_FILE_HEADER_CACHE_MIN_AGE)
+        return;
+
+    /* Headers are mostly padding */
+    while (datalen > 0 && buf[datalen - 1] == '\0')
+        datalen--;
+
+    if (!(key = virStorageFileHeaderCacheKey(canonPath, uid, gid)))
+        return;
+
+    if (VIR_ALLOC_QUIET(entry) < 0 ||
+        (datalen && VIR_ALLOC_N_QUIET(entry->data, datalen) < 0)) {
+        VIR_FREE(entry);
+        VIR_FREE(key);
+        return;
+    }
+
+    entry->dev = sb->st_dev;
+    entry->ino = sb->st_ino;
+    entry->mode = sb->st_mode;
+    entry->size = sb->st_size;
+    entry->mtime = get_stat_mtime(sb);
+    entry->ctime = get_stat_ctime(sb);
+    entry->len = len;
+    entry->datalen = datalen;
+    if (datalen)
+        memcpy(entry->data, buf, datalen);
+
+    virMutexLock(&virStorageFileHeaderCacheLock);
+    virHashRemoveEntry(virStorageFileHeaderCache, key);
+    if (virStorageFileHeaderCacheBytes + datalen >
+        VIR_STORAGE_FILE_HEADER_CACHE_MAX_BYTES)
+        virHashRemoveAll(virStorageFileHeaderCache);
+
+    if (virHashAddEntry(virStorageFileHeaderCache, key, entry) < 0) {
+        virResetLastError();
+        VIR_FREE(entry->data);
+        VIR_FREE(entry);
+    } else {
+        virStorageFileHeaderCacheBytes += datalen;
+    }
+    virMutexUnlock(&virStorageFileHeaderCacheLock);
+    VIR_FREE(key);
+}
+
+
 /* Given a header in BUF with length LEN, as parsed from the file with
  * user-provided name PATH and opened from CANONPATH, and where any
  * relative backing file will be opened from DIRECTORY, and assuming
@@ -1034,53 +1255,72 @@ virStorageFileGetMetadataFromBuf(const char *path,
 }
 
 
-/* Internal version that also supports a containing directory name.  */
+/* Stat FD, opened from PATH, into SB and read its header into BUF,
+ * which is left NULL for directories.  */
 static int
-virStorageFileGetMetadataFromFDInternal(const char *path,
-                                        const char *canonPath,
-                                        const char *directory,
-                                        int fd,
-                                        int format,
-                                        virStorageFileMetadataPtr meta,
-                                        int *backingFormat,
-                                        char **backingDirectory)
+virStorageFileReadHeader(const char *path,
+                         int fd,
+                         struct stat *sb,
+                         char **buf,
+                         ssize_t *len)
 {
-    char *buf = NULL;
-    ssize_t len = VIR_STORAGE_MAX_HEADER;
-    struct stat sb;
-    int ret = -1;
-    int dummy;
+    *buf = NULL;
+    *len = 0;
 
-    if (!backingFormat)
-        backingFormat = &dummy;
-    *backingFormat = VIR_STORAGE_FILE_NONE;
-    if (fstat(fd, &sb) < 0) {
+    if (fstat(fd, sb) < 0) {
         virReportSystemError(errno,
                              _("cannot stat file '%s'"),
                              path);
         return -1;
     }
 
-    if (S_ISDIR(sb.st_mode)) {
-        /* No header to probe for directories, but also no backing
-         * file; therefore, no inclusion loop is possible, and we
-         * don't need canonName or relDir.  */
-        if (VIR_STRDUP(meta->path, path) < 0)
-            goto cleanup;
-        meta->type = VIR_STORAGE_TYPE_DIR;
-        meta->format = VIR_STORAGE_FILE_DIR;
-        ret = 0;
-        goto cleanup;
-    }
+    if (S_ISDIR(sb->st_mode))
+        return 0;
 
     if (lseek(fd, 0, SEEK_SET) == (off_t)-1) {
         virReportSystemError(errno, _("cannot seek to start of '%s'"), path);
-        goto cleanup;
+        return -1;
     }
 
-    if ((len = virFileReadHeaderFD(fd, len, &buf)) < 0) {
+    if ((*len = virFileReadHeaderFD(fd, VIR_STORAGE_MAX_HEADER, buf)) < 0) {
         virReportSystemError(errno, _("cannot read header '%s'"), path);
-        goto cleanup;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Like virStorageFileGetMetadataInternal, for a file of the given
+ * MODE, which may also be a directory.  */
+static int
+virStorageFileGetMetadataFromHeader(const char *path,
+                                    const char *canonPath,
+                                    const char *directory,
+                                    mode_t mode,
+                                    char *buf,
+                                    size_t len,
+                                    int format,
+                                    virStorageFileMetadataPtr meta,
+                                    int *backingFormat,
+                                    char **backingDirectory)
+{
+    int ret;
+    int dummy;
+
+    if (!backingFormat)
+        backingFormat = &dummy;
+    *backingFormat = VIR_STORAGE_FILE_NONE;
+
+    if (S_ISDIR(mode)) {
+        /* No header to probe for directories, but also no backing
+         * file; therefore, no inclusion loop is possible, and we
+         * don't need canonName or relDir.  */
+        if (VIR_STRDUP(meta->path, path) < 0)
+            return -1;
+        meta->type = VIR_STORAGE_TYPE_DIR;
+        meta->format = VIR_STORAGE_FILE_DIR;
+        return 0;
     }
 
     ret = virStorageFileGetMetadataInternal(path, canonPath, directory,
@@ -1089,11 +1329,39 @@ virStorageFileGetMetadataFromFDInternal(const char *path,
                                             backingFormat, backingDirectory);
 
     if (ret == 0) {
-        if (S_ISREG(sb.st_mode))
+        if (S_ISREG(mode))
             meta->type = VIR_STORAGE_TYPE_FILE;
-        else if (S_ISBLK(sb.st_mode))
+        else if (S_ISBLK(mode))
             meta->type = VIR_STORAGE_TYPE_BLOCK;
     }
+    return ret;
+}
+
+
+/* Internal version that also supports a containing directory name.  */
+static int
+virStorageFileGetMetadataFromFDInternal(const char *path,
+                                        const char *canonPath,
+                                        const char *directory,
+                                        int fd,
+                                        int format,
+                                        virStorageFileMetadataPtr meta,
+                                        int *backingFormat,
+                                        char **backingDirectory)
+{
+    char *buf = NULL;
+    ssize_t len;
+    struct stat sb;
+    int ret = -1;
+
+    if (virStorageFileReadHeader(path, fd, &sb, &buf, &len) < 0)
+        goto cleanup;
+
+    ret = virStorageFileGetMetadataFromHeader(path, canonPath, directory,
+                                              sb.st_mode, buf, len, format,
+                                              meta, backingFormat,
+                                              backingDirectory);
+
  cleanup:
     VIR_FREE(buf);
     return ret;
@@ -1167,19 +1435,34 @@ virStorageFileGetMetadataRecurse(const char *path, const char *canonPath,
         return -1;
 
     if (virStorageIsFile(path)) {
-        if ((fd = virFileOpenAs(canonPath, O_RDONLY, 0, uid, gid, 0)) < 0) {
-            virReportSystemError(-fd, _("Failed to open file '%s'"), path);
-            return -1;
-        }
+        struct stat sb;
+        char *buf = NULL;
+        ssize_t len;
+
+        if (!virStorageFileHeaderCacheGet(canonPath, uid, gid,
+                                          &sb, &buf, &len)) {
+            if ((fd = virFileOpenAs(canonPath, O_RDONLY, 0, uid, gid, 0)) < 0) {
+                virReportSystemError(-fd, _("Failed to open file '%s'"), path);
+                return -1;
+            }
 
-        ret = virStorageFileGetMetadataFromFDInternal(path, canonPath,
-                                                      directory,
-                                                      fd, format, meta,
-                                                      &backingFormat,
-                                                      &backingDirectory);
+            if (virStorageFileReadHeader(path, fd, &sb, &buf, &len) < 0) {
+                VIR_FORCE_CLOSE(fd);
+                return -1;
+            }
+
+            if (VIR_CLOSE(fd) < 0)
+                VIR_WARN("could not close file %s", path);
+
+            virStorageFileHeaderCachePut(canonPath, uid, gid, &sb, buf, len);
+        }
 
-        if (VIR_CLOSE(fd) < 0)
-            VIR_WARN("could not close file %s", path);
+        ret = virStorageFileGetMetadataFromHeader(path, canonPath, directory,
+                                                  sb.st_mode, buf, len,
+                                                  format, meta,
+                                                  &backingFormat,
+                                                  &backingDirectory);
+        VIR_FREE(buf);
     } else {
         /* FIXME: when the proper storage drivers are compiled in, it
          * would be nice to read metadata from the network storage to
@@ -105,6 +105,28 @@ int virRWLockInit(virRWLockPtr m)
     return 0;
 }
 
+/* Like virRWLockInit, but new readers wait for pending writers, so a
+ * steady flow of readers cannot starve them; the lock must not be
+ * taken for reading recursively. */
+int virRWLockInitPreferWriter(virRWLockPtr m)
+{
+    int ret;
+    pthread_rwlockattr_t attr;
+
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    ret = pthread_rwlock_init(&m->lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    return 0;
+}
+
 void virRWLockDestroy(virRWLockPtr m)
 {
     pthread_rwlock_destroy(&m->lock);
@@ -121,6 +143,13 @@ void virRWLockWrite(virRWLockPtr m)
     pthread_rwlock_wrlock(&m->lock);
 }
 
+/* Lock @m for reading if that doesn't require waiting; returns false
+ * if it is held or waited for by a writer */
+bool virRWLockTryRead(virRWLockPtr m)
+{
+    return pthread_rwlock_tryrdlock(&m->lock) == 0;
+}
+
 
 void virRWLockUnlock(virRWLockPtr m)
 {
@@ -282,6 +311,40 @@ void virThreadJoin(virThreadPtr thread)
     pthread_join(thread->thread, NULL);
 }
 
+/**
+ * virThreadRunWorkers:
+ * @nworkers: number of threads to run @func in, the calling one included
+ * @func: the worker
+ * @opaque: data passed to @func
+ *
+ * Run @func in @nworkers threads at once and wait until all of them
+ * returned. @func has to claim its share of the work from @opaque, as
+ * it may end up running in fewer threads than asked for, or just in
+ * the calling one, if threads cannot be created.
+ */
+void virThreadRunWorkers(size_t nworkers,
+                         virThreadFunc func,
+                         void *opaque)
+{
+    virThreadPtr threads = NULL;
+    size_t nthreads = 0;
+    size_t i;
+
+    if (nworkers > 1 &&
+        VIR_ALLOC_N_QUIET(threads, nworkers - 1) == 0) {
+        for (nthreads = 0; nthreads < nworkers - 1; nthreads++) {
+            if (virThreadCreate(&threads[nthreads], true, func, opaque) < 0)
+                break;
+        }
+    }
+
+    func(opaque);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+    VIR_FREE(threads);
+}
+
 void virThreadCancel(virThreadPtr thread)
 {
     pthread_cancel(thread->thread);
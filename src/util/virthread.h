@@ -95,6 +95,9 @@ int virThreadCreate(virThreadPtr thread,
 void virThreadSelf(virThreadPtr thread);
 bool virThreadIsSelf(virThreadPtr thread);
 void virThreadJoin(virThreadPtr thread);
+void virThreadRunWorkers(size_t nworkers,
+                         virThreadFunc func,
+                         void *opaque);
 
 /* This API is *NOT* for general use. It exists solely as a stub
  * for integration with libselinux AVC callbacks */
@@ -131,10 +134,12 @@ void virMutexUnlock(virMutexPtr m);
 
 
 int virRWLockInit(virRWLockPtr m) ATTRIBUTE_RETURN_CHECK;
+int virRWLockInitPreferWriter(virRWLockPtr m) ATTRIBUTE_RETURN_CHECK;
 void virRWLockDestroy(virRWLockPtr m);
 
 void virRWLockRead(virRWLockPtr m);
 void virRWLockWrite(virRWLockPtr m);
+bool virRWLockTryRead(virRWLockPtr m) ATTRIBUTE_RETURN_CHECK;
 void virRWLockUnlock(virRWLockPtr m);
 
 
@@ -39,6 +39,7 @@
 #include "virtime.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "viratomic.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -344,3 +345,40 @@ char *virTimeStringThen(unsigned long long when)
 
     return ret;
 }
+
+
+/**
+ * virTimeHistogramAdd:
+ * @hist: the histogram
+ * @ms: duration in milliseconds
+ *
+ * Record a sample of @ms milliseconds in @hist. Safe to call
+ * concurrently with other updates and readers of @hist.
+ */
+void virTimeHistogramAdd(virTimeHistogramPtr hist,
+                         unsigned long long ms)
+{
+    size_t bucket = 0;
+
+    while (bucket < VIR_TIME_HISTOGRAM_BUCKETS - 1 &&
+           ms >= virTimeHistogramBucketLimit(bucket))
+        bucket++;
+
+    virAtomicIntInc(&hist->buckets[bucket]);
+    virAtomicIntInc(&hist->count);
+}
+
+
+/**
+ * virTimeHistogramBucketLimit:
+ * @bucket: index of a bucket
+ *
+ * Returns the duration in milliseconds that samples counted in
+ * @bucket are shorter than, or 0 for the last, unbounded bucket.
+ */
+unsigned long long virTimeHistogramBucketLimit(size_t bucket)
+{
+    if (bucket >= VIR_TIME_HISTOGRAM_BUCKETS - 1)
+        return 0;
+    return 1ULL << bucket;
+}
@@ -64,4 +64,24 @@ char *virTimeStringNow(void);
 char *virTimeStringThen(unsigned long long when);
 
 
+/* Number of buckets of a virTimeHistogram, enough for the last bounded
+ * one to cover the 30 seconds a job may wait for another to finish */
+# define VIR_TIME_HISTOGRAM_BUCKETS 17
+
+/* Histogram of durations: bucket i counts samples shorter than
+ * 2^i milliseconds, the last bucket all longer ones. Counters are
+ * updated atomically, so reading them needs no lock. */
+typedef struct _virTimeHistogram virTimeHistogram;
+typedef virTimeHistogram *virTimeHistogramPtr;
+struct _virTimeHistogram {
+    int count;
+    int buckets[VIR_TIME_HISTOGRAM_BUCKETS];
+};
+
+void virTimeHistogramAdd(virTimeHistogramPtr hist,
+                         unsigned long long ms)
+    ATTRIBUTE_NONNULL(1);
+unsigned long long virTimeHistogramBucketLimit(size_t bucket);
+
+
 #endif
@@ -24,6 +24,8 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virlog.h"
+#include "virfile.h"
+#include "virbuffer.h"
 
 #include "domain_conf.h"
 
@@ -85,10 +87,407 @@ static int testGetFilesystem(const void *opaque)
     return ret;
 }
 
+
+#define TEST_LOAD_XML \
+    "<domain type='test'>\n" \
+    "  <name>%s</name>\n" \
+    "  <uuid>%08zx-7e46-e869-4ca5-759d51478066</uuid>\n" \
+    "  <memory unit='KiB'>%zu</memory>\n" \
+    "  <vcpu placement='static'>1</vcpu>\n" \
+    "  <os>\n" \
+    "    <type arch='x86_64'>hvm</type>\n" \
+    "  </os>\n" \
+    "  <devices>\n" \
+    "    <disk type='file' device='disk'>\n" \
+    "      <source file='/var/lib/images/%s.img'/>\n" \
+    "      <target dev='vda' bus='virtio'/>\n" \
+    "    </disk>\n" \
+    "    <interface type='network'>\n" \
+    "      <mac address='52:54:00:%02zx:%02zx:%02zx'/>\n" \
+    "      <source network='default'/>\n" \
+    "    </interface>\n" \
+    "  </devices>\n" \
+    "</domain>\n"
+
+static int
+testLoadWriteConfig(const char *dir,
+                    const char *file,
+                    const char *name,
+                    size_t id,
+                    size_t memory)
+{
+    char *path = NULL;
+    char *xml = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&path, "%s/%s.xml", dir, file) < 0 ||
+        virAsprintf(&xml, TEST_LOAD_XML, name, id, memory, name,
+                    (id >> 16) & 0xff, (id >> 8) & 0xff, id & 0xff) < 0)
+        goto cleanup;
+
+    if (virFileWriteStr(path, xml, 0600) < 0) {
+        virReportSystemError(errno, "Cannot write %s", path);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(xml);
+    VIR_FREE(path);
+    return ret;
+}
+
+/*
+ * Load a directory holding more configs than there are parsing
+ * threads, next to files which must be ignored or fail to parse.
+ * Of two files defining the same domain, the one sorting last must
+ * win whichever thread parsed it.
+ */
+static int
+testLoadAllConfigs(const void *opaque)
+{
+    const char *dir = opaque;
+    virDomainObjListPtr doms = NULL;
+    virDomainObjPtr dom = NULL;
+    char *configDir = NULL;
+    char *autostartDir = NULL;
+    char *path = NULL;
+    char *link = NULL;
+    char *name = NULL;
+    int ndoms;
+    size_t i;
+    int ret = -1;
+
+    if (virAsprintf(&configDir, "%s/load", dir) < 0 ||
+        virAsprintf(&autostartDir, "%s/autostart", configDir) < 0)
+        goto cleanup;
+
+    if (virFileMakePath(autostartDir) < 0) {
+        virReportSystemError(errno, "Cannot create %s", autostartDir);
+        goto cleanup;
+    }
+
+    for (i = 0; i < 20; i++) {
+        if (virAsprintf(&name, "dom%zu", i) < 0 ||
+            testLoadWriteConfig(configDir, name, name, i, 1024 + i) < 0)
+            goto cleanup;
+        VIR_FREE(name);
+    }
+
+    if (testLoadWriteConfig(configDir, "dup-b", "dup", 20, 2) < 0 ||
+        testLoadWriteConfig(configDir, "dup-a", "dup", 20, 1) < 0 ||
+        testLoadWriteConfig(configDir, ".hidden", "hidden", 21, 1) < 0 ||
+        testLoadWriteConfig(configDir, "backup", "backup", 22, 1) < 0)
+        goto cleanup;
+
+    if (virAsprintf(&path, "%s/backup.xml", configDir) < 0 ||
+        virAsprintf(&link, "%s/backup.xml.orig", configDir) < 0)
+        goto cleanup;
+    if (rename(path, link) < 0) {
+        virReportSystemError(errno, "Cannot rename %s", path);
+        goto cleanup;
+    }
+    VIR_FREE(link);
+    VIR_FREE(path);
+
+    if (virAsprintf(&path, "%s/broken.xml", configDir) < 0 ||
+        virFileWriteStr(path, "<domain type='test'>", 0600) < 0)
+        goto cleanup;
+    VIR_FREE(path);
+
+    if (virAsprintf(&path, "%s/dom1.xml", configDir) < 0 ||
+        virAsprintf(&link, "%s/dom1.xml", autostartDir) < 0)
+        goto cleanup;
+    if (symlink(path, link) < 0) {
+        virReportSystemError(errno, "Cannot create %s", link);
+        goto cleanup;
+    }
+
+    if (!(doms = virDomainObjListNew()))
+        goto cleanup;
+
+    if (virDomainObjListLoadAllConfigs(doms, configDir, autostartDir, 0,
+                                       caps, xmlopt,
+                                       1 << VIR_DOMAIN_VIRT_TEST,
+                                       NULL, NULL) < 0)
+        goto cleanup;
+
+    ndoms = virDomainObjListNumOfDomains(doms, false, NULL, NULL);
+    if (ndoms != 21) {
+        fprintf(stderr, "Expected 21 domains, got %d\n", ndoms);
+        goto cleanup;
+    }
+
+    if (!(dom = virDomainObjListFindByName(doms, "dup")))
+        goto cleanup;
+    if (!dom->persistent || dom->def->mem.max_balloon != 2) {
+        fprintf(stderr, "Unexpected definition of duplicate domain\n");
+        goto cleanup;
+    }
+    virObjectUnlock(dom);
+
+    for (i = 0; i < 20; i++) {
+        if (virAsprintf(&name, "dom%zu", i) < 0 ||
+            !(dom = virDomainObjListFindByName(doms, name)))
+            goto cleanup;
+        if (!dom->persistent || dom->def->mem.max_balloon != 1024 + i ||
+            dom->autostart != (i == 1)) {
+            fprintf(stderr, "Unexpected definition of %s\n", name);
+            goto cleanup;
+        }
+        virObjectUnlock(dom);
+        dom = NULL;
+        VIR_FREE(name);
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (dom)
+        virObjectUnlock(dom);
+    virObjectUnref(doms);
+    VIR_FREE(name);
+    VIR_FREE(link);
+    VIR_FREE(path);
+    VIR_FREE(autostartDir);
+    VIR_FREE(configDir);
+    return ret;
+}
+
+/* A config directory which does not exist holds no domains */
+static int
+testLoadAllConfigsMissing(const void *opaque)
+{
+    const char *dir = opaque;
+    virDomainObjListPtr doms = NULL;
+    char *configDir = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&configDir, "%s/missing", dir) < 0 ||
+        !(doms = virDomainObjListNew()))
+        goto cleanup;
+
+    if (virDomainObjListLoadAllConfigs(doms, configDir, configDir, 0,
+                                       caps, xmlopt,
+                                       1 << VIR_DOMAIN_VIRT_TEST,
+                                       NULL, NULL) < 0)
+        goto cleanup;
+
+    if (virDomainObjListNumOfDomains(doms, false, NULL, NULL) != 0) {
+        fprintf(stderr, "Domains loaded from a missing directory\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(doms);
+    VIR_FREE(configDir);
+    return ret;
+}
+
+#define TEST_DEVICES_XML \
+    "<domain type='test'>\n" \
+    "  <name>devices</name>\n" \
+    "  <uuid>c7a5fdbd-edaf-9455-926a-d65c16db1809</uuid>\n" \
+    "  <memory unit='KiB'>219136</memory>\n" \
+    "  <vcpu placement='static'>1</vcpu>\n" \
+    "  <os>\n" \
+    "    <type arch='x86_64'>hvm</type>\n" \
+    "  </os>\n" \
+    "%s" \
+    "</domain>\n"
+
+#define TEST_DEVICES_NET(n) \
+    "<interface type='network'>" \
+    "<mac address='52:54:00:00:00:" n "'/>" \
+    "<source network='default'/>" \
+    "</interface>"
+
+#define TEST_DEVICES_DISK(dev) \
+    "<disk type='file' device='disk'>" \
+    "<source file='/var/lib/images/" dev ".img'/>" \
+    "<target dev='" dev "' bus='virtio'/>" \
+    "</disk>"
+
+struct testParseDevicesData {
+    const char *devices;
+    size_t ndisks;
+    const char *nets;   /* last byte of the MAC of each interface */
+    bool fail;
+};
+
+/*
+ * Check that devices are picked up from <devices> in document order,
+ * only where "./devices/<name>" would have found them.
+ */
+static int
+testParseDevices(const void *opaque)
+{
+    const struct testParseDevicesData *data = opaque;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virDomainDefPtr def = NULL;
+    char *xml = NULL;
+    char *nets = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (virAsprintf(&xml, TEST_DEVICES_XML, data->devices) < 0)
+        goto cleanup;
+
+    def = virDomainDefParseString(xml, caps, xmlopt,
+                                  1 << VIR_DOMAIN_VIRT_TEST, 0);
+    if (data->fail) {
+        if (def) {
+            fprintf(stderr, "Should not have parsed %s\n", xml);
+            goto cleanup;
+        }
+        ret = 0;
+        goto cleanup;
+    }
+    if (!def)
+        goto cleanup;
+
+    for (i = 0; i < def->nnets; i++)
+        virBufferAsprintf(&buf, "%s%02x", i ? " " : "",
+                          def->nets[i]->mac.addr[VIR_MAC_BUFLEN - 1]);
+    if (virBufferError(&buf)) {
+        virReportOOMError();
+        goto cleanup;
+    }
+    if (!(nets = virBufferContentAndReset(&buf)) && VIR_STRDUP(nets, "") < 0)
+        goto cleanup;
+
+    if (def->ndisks != data->ndisks) {
+        fprintf(stderr, "Expected %zu disks, got %zu\n",
+                data->ndisks, def->ndisks);
+        goto cleanup;
+    }
+
+    if (STRNEQ(nets, data->nets)) {
+        virtTestDifference(stderr, data->nets, nets);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    virDomainDefFree(def);
+    VIR_FREE(nets);
+    VIR_FREE(xml);
+    return ret;
+}
+
+/*
+ * Check XML cached on a domain object is only handed out until the
+ * next change, and that saving an unchanged status does not touch
+ * the status file.
+ */
+static int
+testObjXMLCache(const void *opaque)
+{
+    const char *dir = opaque;
+    virDomainObjPtr obj = NULL;
+    char *xml = NULL;
+    char *statusFile = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&xml, TEST_LOAD_XML, "cache", (size_t) 0, (size_t) 1024,
+                    "cache", (size_t) 0, (size_t) 0, (size_t) 0) < 0 ||
+        virAsprintf(&statusFile, "%s/cache.xml", dir) < 0)
+        goto cleanup;
+
+    if (!(obj = virDomainObjNew(xmlopt)))
+        goto cleanup;
+
+    if (!(obj->def = virDomainDefParseString(xml, caps, xmlopt,
+                                             1 << VIR_DOMAIN_VIRT_TEST, 0)))
+        goto cleanup;
+    VIR_FREE(xml);
+
+    if (virDomainObjGetCachedXML(obj, 0, &xml) != 0 || xml) {
+        fprintf(stderr, "Unexpected XML cached for a new domain\n");
+        goto cleanup;
+    }
+
+    virDomainObjCacheXML(obj, 0, "<domain/>");
+
+    if (virDomainObjGetCachedXML(obj, 0, &xml) != 1 ||
+        STRNEQ(xml, "<domain/>")) {
+        fprintf(stderr, "Cached XML not found\n");
+        goto cleanup;
+    }
+    VIR_FREE(xml);
+
+    if (virDomainObjGetCachedXML(obj, VIR_DOMAIN_XML_INACTIVE, &xml) != 0) {
+        fprintf(stderr, "Cached XML found for different flags\n");
+        goto cleanup;
+    }
+
+    virDomainObjSetState(obj, VIR_DOMAIN_PAUSED, VIR_DOMAIN_PAUSED_USER);
+
+    if (virDomainObjGetCachedXML(obj, 0, &xml) != 0) {
+        fprintf(stderr, "Stale XML returned after a state change\n");
+        goto cleanup;
+    }
+
+    if (virDomainSaveStatus(xmlopt, dir, obj) < 0)
+        goto cleanup;
+
+    /* Saving again with no change must not recreate the file */
+    if (unlink(statusFile) < 0 ||
+        virDomainSaveStatus(xmlopt, dir, obj) < 0)
+        goto cleanup;
+
+    if (virFileExists(statusFile)) {
+        fprintf(stderr, "Unchanged status was written again\n");
+        goto cleanup;
+    }
+
+    virDomainObjSetState(obj, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_UNPAUSED);
+
+    if (virDomainSaveStatus(xmlopt, dir, obj) < 0)
+        goto cleanup;
+
+    if (!virFileExists(statusFile)) {
+        fprintf(stderr, "Changed status was not written\n");
+        goto cleanup;
+    }
+
+    /* Setters changing the definition must invalidate the cache too */
+    obj->def->id = 1;
+    virDomainObjCacheXML(obj, 0, "<domain/>");
+
+    if (virDomainObjSetMetadata(obj, VIR_DOMAIN_METADATA_DESCRIPTION,
+                                "changed", NULL, NULL, caps, xmlopt,
+                                NULL, VIR_DOMAIN_AFFECT_LIVE) < 0)
+        goto cleanup;
+
+    if (virDomainObjGetCachedXML(obj, 0, &xml) != 0) {
+        fprintf(stderr, "Stale XML returned after a metadata change\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (obj) {
+        virObjectUnlock(obj);
+        virObjectUnref(obj);
+    }
+    VIR_FREE(statusFile);
+    VIR_FREE(xml);
+    return ret;
+}
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/domainconfdir-XXXXXX"
+
 static int
 mymain(void)
 {
     int ret = 0;
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
 
     if ((caps = virTestGenericCapsInit()) == NULL)
         goto cleanup;
@@ -112,6 +511,96 @@ mymain(void)
     DO_TEST_GET_FS("/dev/pts", false);
     DO_TEST_GET_FS("/doesnotexist", false);
 
+#define DO_TEST_PARSE_DEVICES(name, devs, disks, macs, err)             \
+    do {                                                                \
+        struct testParseDevicesData data = {                            \
+            .devices = devs,                                            \
+            .ndisks = disks,                                            \
+            .nets = macs,                                               \
+            .fail = err,                                                \
+        };                                                              \
+        if (virtTestRun("Parse devices " name,                          \
+                        testParseDevices, &data) < 0)                   \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST_PARSE_DEVICES("none", "", 0, "", false);
+    DO_TEST_PARSE_DEVICES("empty", "<devices/>", 0, "", false);
+    DO_TEST_PARSE_DEVICES("interleaved",
+                          "<devices>"
+                          TEST_DEVICES_NET("03")
+                          TEST_DEVICES_DISK("vdb")
+                          TEST_DEVICES_NET("01")
+                          "<controller type='scsi' index='0'/>"
+                          TEST_DEVICES_DISK("vda")
+                          TEST_DEVICES_NET("02")
+                          "</devices>",
+                          2, "03 01 02", false);
+    DO_TEST_PARSE_DEVICES("several <devices>",
+                          "<devices>" TEST_DEVICES_NET("02") "</devices>"
+                          "<devices>" TEST_DEVICES_DISK("vda")
+                          TEST_DEVICES_NET("01") "</devices>",
+                          1, "02 01", false);
+    DO_TEST_PARSE_DEVICES("comments and text",
+                          "<devices>\n"
+                          "<!-- " TEST_DEVICES_NET("09") " -->\n"
+                          "text " TEST_DEVICES_NET("01") " text\n"
+                          "</devices>",
+                          0, "01", false);
+    DO_TEST_PARSE_DEVICES("unknown and nested",
+                          "<devices>"
+                          "<bogus>" TEST_DEVICES_NET("09") "</bogus>"
+                          TEST_DEVICES_NET("01")
+                          "</devices>"
+                          "<bogus><devices>" TEST_DEVICES_NET("08")
+                          "</devices></bogus>",
+                          0, "01", false);
+    DO_TEST_PARSE_DEVICES("other namespace",
+                          "<devices xmlns:x='http://example.org/'>"
+                          "<x:interface type='network'>"
+                          "<x:mac address='52:54:00:00:00:09'/>"
+                          "</x:interface>"
+                          TEST_DEVICES_NET("01")
+                          "</devices>"
+                          "<x:devices xmlns:x='http://example.org/'>"
+                          TEST_DEVICES_NET("08")
+                          "</x:devices>",
+                          0, "01", false);
+    DO_TEST_PARSE_DEVICES("invalid device",
+                          "<devices>"
+                          TEST_DEVICES_NET("01")
+                          "<interface type='bogus'/>"
+                          "</devices>",
+                          0, "", true);
+    DO_TEST_PARSE_DEVICES("duplicate watchdog",
+                          "<devices>"
+                          "<watchdog model='i6300esb'/>"
+                          TEST_DEVICES_NET("01")
+                          "<watchdog model='ib700'/>"
+                          "</devices>",
+                          0, "", true);
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create scratch dir");
+        ret = -1;
+        goto done;
+    }
+
+    if (virtTestRun("Load all configs", testLoadAllConfigs, scratchdir) < 0)
+        ret = -1;
+
+    if (virtTestRun("Load all configs from missing dir",
+                    testLoadAllConfigsMissing, scratchdir) < 0)
+        ret = -1;
+
+    if (virtTestRun("Domain object XML cache", testObjXMLCache,
+                    scratchdir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+ done:
     virObjectUnref(caps);
     virObjectUnref(xmlopt);
 
@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include "testutils.h"
 
@@ -314,6 +315,246 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+
+#define SPARSE_CHUNK 4096
+#define SPARSE_HOLE (SPARSE_CHUNK * 64)
+
+/* Copies a file with data, a hole, data and a trailing hole from
+ * one sparse stream to another, skipping the holes */
+#if HAVE_SPLICE
+/* Moves the data at the head of @in to @out the way the daemon does
+ * for raw stream data. Returns 1 if the data has to go through the
+ * regular stream APIs, 0 on success, -1 on error */
+static int testFDStreamSpliceRaw(virStreamPtr in, virStreamPtr out)
+{
+    size_t len = SPARSE_CHUNK;
+    ssize_t done;
+    int infd;
+    int outfd;
+
+    if ((infd = virFDStreamReserveRaw(in, false, &len)) == -3)
+        return 1;
+    if (infd < 0)
+        return -1;
+
+    while ((outfd = virFDStreamReserveRaw(out, true, &len)) == -2)
+        usleep(20 * 1000);
+    if (outfd < 0)
+        return -1;
+
+    while ((done = splice(infd, NULL, outfd, NULL, len, 0)) < 0 &&
+           (errno == EAGAIN || errno == EINTR))
+        usleep(20 * 1000);
+    if (done <= 0) {
+        virFilePrintf(stderr, "Failed to splice data: %s\n",
+                      done < 0 ? strerror(errno) : "end of file");
+        return -1;
+    }
+
+    virFDStreamCommitRaw(in, done);
+    virFDStreamCommitRaw(out, done);
+    return 0;
+}
+#endif
+
+
+static int testFDStreamSparseCommon(const char *scratchdir,
+                                    bool blocking,
+                                    bool raw)
+{
+    int fd = -1;
+    char *infile = NULL;
+    char *outfile = NULL;
+    int ret = -1;
+    char *pattern = NULL;
+    char *buf = NULL;
+    char *copy = NULL;
+    virStreamPtr in = NULL;
+    virStreamPtr out = NULL;
+    size_t i;
+    virConnectPtr conn = NULL;
+    int flags = 0;
+    const off_t size = SPARSE_CHUNK * 3 + SPARSE_HOLE * 2;
+    struct stat sb;
+
+    if (!blocking)
+        flags |= VIR_STREAM_NONBLOCK;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (VIR_ALLOC_N(pattern, SPARSE_CHUNK * 2) < 0 ||
+        VIR_ALLOC_N(buf, SPARSE_CHUNK) < 0 ||
+        VIR_ALLOC_N(copy, size) < 0)
+        goto cleanup;
+
+    for (i = 0; i < SPARSE_CHUNK * 2; i++)
+        pattern[i] = i % 251 + 1;
+
+    if (virAsprintf(&infile, "%s/input.data", scratchdir) < 0 ||
+        virAsprintf(&outfile, "%s/output.data", scratchdir) < 0)
+        goto cleanup;
+
+    if ((fd = open(infile, O_CREAT|O_WRONLY|O_EXCL, 0600)) < 0)
+        goto cleanup;
+
+    if (safewrite(fd, pattern, SPARSE_CHUNK * 2) != SPARSE_CHUNK * 2 ||
+        lseek(fd, SPARSE_HOLE, SEEK_CUR) < 0 ||
+        safewrite(fd, pattern, SPARSE_CHUNK) != SPARSE_CHUNK ||
+        ftruncate(fd, size) < 0)
+        goto cleanup;
+
+    if (VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    if ((fd = open(outfile, O_CREAT|O_WRONLY|O_EXCL, 0600)) < 0 ||
+        VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    if (!(in = virStreamNew(conn, flags)) ||
+        !(out = virStreamNew(conn, flags)))
+        goto cleanup;
+
+    if (virFDStreamOpenSparseFile(in, infile, 0, 0, O_RDONLY) < 0 ||
+        virFDStreamOpenSparseFile(out, outfile, 0, 0, O_WRONLY) < 0)
+        goto cleanup;
+
+    for (;;) {
+        int got;
+        size_t offset = 0;
+        long long length;
+
+#if HAVE_SPLICE
+        if (raw) {
+            if ((got = testFDStreamSpliceRaw(in, out)) < 0) {
+                virFilePrintf(stderr, "Failed to move raw data: %s\n",
+                              virGetLastErrorMessage());
+                goto cleanup;
+            }
+            if (got == 0)
+                continue;
+        }
+#endif
+
+        got = in->driver->streamRecvFlags(in, buf, SPARSE_CHUNK,
+                                          VIR_STREAM_RECV_STOP_AT_HOLE);
+        if (got == -2 && !blocking) {
+            usleep(20 * 1000);
+            continue;
+        }
+        if (got == -3) {
+            if (in->driver->streamRecvHole(in, &length, 0) < 0 ||
+                length <= 0) {
+                virFilePrintf(stderr, "Failed to skip hole: %s\n",
+                              virGetLastErrorMessage());
+                goto cleanup;
+            }
+            while ((got = out->driver->streamSendHole(out, length, 0)) == -2)
+                usleep(20 * 1000);
+            if (got < 0) {
+                virFilePrintf(stderr, "Failed to send hole: %s\n",
+                              virGetLastErrorMessage());
+                goto cleanup;
+            }
+            continue;
+        }
+        if (got < 0) {
+            virFilePrintf(stderr, "Failed to read stream: %s\n",
+                          virGetLastErrorMessage());
+            goto cleanup;
+        }
+        if (got == 0)
+            break;
+
+        while (offset < got) {
+            int done = out->driver->streamSend(out, buf + offset, got - offset);
+            if (done == -2 && !blocking) {
+                usleep(20 * 1000);
+                continue;
+            }
+            if (done < 0) {
+                virFilePrintf(stderr, "Failed to write stream: %s\n",
+                              virGetLastErrorMessage());
+                goto cleanup;
+            }
+            offset += done;
+        }
+    }
+
+    if (in->driver->streamFinish(in) != 0 ||
+        out->driver->streamFinish(out) != 0) {
+        virFilePrintf(stderr, "Failed to finish stream: %s\n",
+                      virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if ((fd = open(outfile, O_RDONLY)) < 0 ||
+        fstat(fd, &sb) < 0)
+        goto cleanup;
+
+    if (sb.st_size != size) {
+        virFilePrintf(stderr, "Expected size %lld, got %lld\n",
+                      (long long) size, (long long) sb.st_size);
+        goto cleanup;
+    }
+
+    if (saferead(fd, copy, size) != size)
+        goto cleanup;
+
+    for (i = 0; i < size; i++) {
+        char want = 0;
+        if (i < SPARSE_CHUNK * 2)
+            want = pattern[i];
+        else if (i >= SPARSE_CHUNK * 2 + SPARSE_HOLE &&
+                 i < SPARSE_CHUNK * 3 + SPARSE_HOLE)
+            want = pattern[i - SPARSE_CHUNK * 2 - SPARSE_HOLE];
+        if (copy[i] != want) {
+            virFilePrintf(stderr, "Mismatched data at offset %zu\n", i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    if (in)
+        virStreamFree(in);
+    if (out)
+        virStreamFree(out);
+    VIR_FORCE_CLOSE(fd);
+    if (infile != NULL)
+        unlink(infile);
+    if (outfile != NULL)
+        unlink(outfile);
+    if (conn)
+        virConnectClose(conn);
+    VIR_FREE(infile);
+    VIR_FREE(outfile);
+    VIR_FREE(pattern);
+    VIR_FREE(buf);
+    VIR_FREE(copy);
+    return ret;
+}
+
+
+static int testFDStreamSparseBlock(const void *data)
+{
+    return testFDStreamSparseCommon(data, true, false);
+}
+static int testFDStreamSparseNonblock(const void *data)
+{
+    return testFDStreamSparseCommon(data, false, false);
+}
+#if HAVE_SPLICE
+static int testFDStreamSparseRawBlock(const void *data)
+{
+    return testFDStreamSparseCommon(data, true, true);
+}
+static int testFDStreamSparseRawNonblock(const void *data)
+{
+    return testFDStreamSparseCommon(data, false, true);
+}
+#endif
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fakesysfsdir-XXXXXX"
 
 static int
@@ -338,6 +579,16 @@ mymain(void)
         ret = -1;
     if (virtTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
+    if (virtTestRun("Stream sparse blocking ", testFDStreamSparseBlock, scratchdir) < 0)
+        ret = -1;
+    if (virtTestRun("Stream sparse non-blocking ", testFDStreamSparseNonblock, scratchdir) < 0)
+        ret = -1;
+#if HAVE_SPLICE
+    if (virtTestRun("Stream sparse raw blocking ", testFDStreamSparseRawBlock, scratchdir) < 0)
+        ret = -1;
+    if (virtTestRun("Stream sparse raw non-blocking ", testFDStreamSparseRawNonblock, scratchdir) < 0)
+        ret = -1;
+#endif
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
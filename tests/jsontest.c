@@ -7,8 +7,13 @@
 
 #include "internal.h"
 #include "virjson.h"
+#include "virbuffer.h"
+#include "viralloc.h"
+#include "virtime.h"
 #include "testutils.h"
 
+#define VIR_FROM_THIS VIR_FROM_NONE
+
 struct testInfo {
     const char *doc;
     const char *expect;
@@ -130,6 +135,294 @@ testJSONAddRemove(const void *data)
 }
 
 
+struct testStreamInfo {
+    const char *doc;
+    const char *const *filter;
+    const char *expect;
+    bool fail;
+};
+
+
+/* Feed the document in every chunk size, checking that the values
+ * come out the same each time, and that all values preceding a syntax
+ * error are handed out before the error */
+static int
+testJSONStream(const void *data)
+{
+    const struct testStreamInfo *info = data;
+    virJSONStreamParserPtr stream = NULL;
+    virJSONValuePtr value = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *result = NULL;
+    char *str = NULL;
+    size_t len = strlen(info->doc);
+    size_t chunk;
+    int ret = -1;
+
+    for (chunk = 1; chunk <= len; chunk++) {
+        size_t offset = 0;
+
+        if (!(stream = virJSONStreamParserNew()) ||
+            virJSONStreamParserSetFilter(stream, info->filter) < 0)
+            goto cleanup;
+
+        bool failed = false;
+
+        while (offset < len && !failed) {
+            size_t end = MIN(offset + chunk, len);
+
+            while (offset < end) {
+                ssize_t used;
+
+                if ((used = virJSONStreamParserFeed(stream, info->doc + offset,
+                                                    end - offset,
+                                                    &value)) < 0) {
+                    if (info->fail) {
+                        failed = true;
+                        break;
+                    }
+                    if (virTestGetVerbose())
+                        fprintf(stderr, "Fail to parse %s\n", info->doc);
+                    goto cleanup;
+                }
+                offset += used;
+
+                if (value) {
+                    if (!(str = virJSONValueToString(value, false)))
+                        goto cleanup;
+                    virBufferAsprintf(&buf, "%s\n", str);
+                    VIR_FREE(str);
+                    virJSONValueFree(value);
+                    value = NULL;
+                }
+            }
+        }
+
+        virJSONStreamParserFree(stream);
+        stream = NULL;
+
+        if (info->fail && !failed) {
+            if (virTestGetVerbose())
+                fprintf(stderr, "Should not have parsed %s\n", info->doc);
+            goto cleanup;
+        }
+
+        if (virBufferError(&buf))
+            goto cleanup;
+        result = virBufferContentAndReset(&buf);
+
+        if (STRNEQ_NULLABLE(info->expect, result)) {
+            if (virTestGetVerbose()) {
+                fprintf(stderr, "chunk size %zu\n", chunk);
+                virtTestDifference(stderr, info->expect, result);
+            }
+            goto cleanup;
+        }
+        VIR_FREE(result);
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONStreamParserFree(stream);
+    virJSONValueFree(value);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(result);
+    VIR_FREE(str);
+    return ret;
+}
+
+
+/* Exercise key lookup on objects big enough to be indexed */
+static int
+testJSONLookup(const void *data ATTRIBUTE_UNUSED)
+{
+    virJSONValuePtr json;
+    virJSONValuePtr value = NULL;
+    char key[32];
+    size_t i;
+    int ret = -1;
+
+    if (!(json = virJSONValueNewObject()))
+        return -1;
+
+    for (i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectAppendNumberUint(json, key, i) < 0)
+            goto cleanup;
+    }
+
+    if (virJSONValueObjectAppendNull(json, "key42") == 0) {
+        fprintf(stderr, "duplicate key was accepted\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < 100; i += 2) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectRemoveKey(json, key, NULL) != 1)
+            goto cleanup;
+    }
+
+    for (i = 0; i < 100; i++) {
+        unsigned int number;
+
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectHasKey(json, key) != (i % 2)) {
+            fprintf(stderr, "unexpected presence of %s\n", key);
+            goto cleanup;
+        }
+        if (i % 2 &&
+            (virJSONValueObjectGetNumberUint(json, key, &number) < 0 ||
+             number != i)) {
+            fprintf(stderr, "unexpected value of %s\n", key);
+            goto cleanup;
+        }
+    }
+
+    if (virJSONValueObjectAppendString(json, "key0", "again") < 0 ||
+        STRNEQ_NULLABLE(virJSONValueObjectGetString(json, "key0"), "again") ||
+        virJSONValueObjectKeysNumber(json) != 51 ||
+        virJSONValueObjectRemoveKey(json, "key99", &value) != 1 ||
+        virJSONValueObjectGet(json, "key99"))
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(value);
+    virJSONValueFree(json);
+    return ret;
+}
+
+
+/* The pretty printed form of captured replies must be stable */
+static int
+testJSONFormatFile(const void *data)
+{
+    const char *name = data;
+    char *file = NULL;
+    char *doc = NULL;
+    char *result = NULL;
+    virJSONValuePtr json = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&file, "%s/qemumonitorjsondata/%s.json",
+                    abs_srcdir, name) < 0 ||
+        virtTestLoadFile(file, &doc) < 0)
+        goto cleanup;
+
+    if (!(json = virJSONValueFromString(doc)) ||
+        !(result = virJSONValueToString(json, true)))
+        goto cleanup;
+
+    if (STRNEQ(doc, result)) {
+        virtTestDifference(stderr, doc, result);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(json);
+    VIR_FREE(result);
+    VIR_FREE(doc);
+    VIR_FREE(file);
+    return ret;
+}
+
+
+/*
+ * Parse and format a file of captured monitor traffic, which may hold
+ * several documents. With VIR_TEST_EXPENSIVE=1 this is repeated to
+ * serve as a benchmark, the timings are shown with VIR_TEST_DEBUG=1.
+ */
+static int
+testJSONBenchFile(const void *data)
+{
+    const char *name = data;
+    char *file = NULL;
+    char *doc = NULL;
+    char *str = NULL;
+    virJSONStreamParserPtr stream = NULL;
+    virJSONValuePtr value = NULL;
+    virJSONValuePtr copy = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    unsigned long long start, parsed, formatted;
+    unsigned long long parseTime = 0, formatTime = 0;
+    size_t iterations = virTestGetExpensive() ? 1000 : 1;
+    size_t i;
+    size_t len;
+    int ret = -1;
+
+    if (virAsprintf(&file, "%s/%s", abs_srcdir, name) < 0 ||
+        virtTestLoadFile(file, &doc) < 0)
+        goto cleanup;
+    len = strlen(doc);
+
+    for (i = 0; i < iterations; i++) {
+        size_t offset = 0;
+
+        if (!(stream = virJSONStreamParserNew()))
+            goto cleanup;
+
+        while (offset < len) {
+            ssize_t used;
+
+            if (virTimeMillisNow(&start) < 0)
+                goto cleanup;
+            if ((used = virJSONStreamParserFeed(stream, doc + offset,
+                                                len - offset, &value)) < 0)
+                goto cleanup;
+            offset += used;
+            if (!value)
+                continue;
+            if (virTimeMillisNow(&parsed) < 0 ||
+                virJSONValueToBuffer(value, &buf, false) < 0 ||
+                virTimeMillisNow(&formatted) < 0)
+                goto cleanup;
+            parseTime += parsed - start;
+            formatTime += formatted - parsed;
+
+            /* Whatever we format must parse back to the same thing */
+            if (!(str = virBufferContentAndReset(&buf)) ||
+                !(copy = virJSONValueFromString(str)) ||
+                virJSONValueToBuffer(copy, &buf, false) < 0)
+                goto cleanup;
+            if (STRNEQ(str, virBufferCurrentContent(&buf))) {
+                virtTestDifference(stderr, str, virBufferCurrentContent(&buf));
+                goto cleanup;
+            }
+            virBufferFreeAndReset(&buf);
+            VIR_FREE(str);
+            virJSONValueFree(copy);
+            copy = NULL;
+            virJSONValueFree(value);
+            value = NULL;
+        }
+
+        virJSONStreamParserFree(stream);
+        stream = NULL;
+    }
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%s: %zu iterations of %zu bytes, "
+                "parse %llu ms, format %llu ms\n",
+                name, iterations, len, parseTime, formatTime);
+
+    ret = 0;
+
+ cleanup:
+    virJSONStreamParserFree(stream);
+    virJSONValueFree(value);
+    virJSONValueFree(copy);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(str);
+    VIR_FREE(doc);
+    VIR_FREE(file);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -214,6 +507,78 @@ mymain(void)
                        "[ {[\"key1\", \"key2\"]: \"value\"} ]");
     DO_TEST_PARSE_FAIL("object with unterminated key", "{ \"key:7 }");
 
+    if (virtTestRun("lookup", testJSONLookup, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("format getcpu-full", testJSONFormatFile,
+                    "qemumonitorjson-getcpu-full") < 0)
+        ret = -1;
+    if (virtTestRun("format getcpu-host", testJSONFormatFile,
+                    "qemumonitorjson-getcpu-host") < 0)
+        ret = -1;
+
+#define DO_TEST_BENCH(file)                                         \
+    do {                                                            \
+        if (virtTestRun("bench " file, testJSONBenchFile, file) < 0) \
+            ret = -1;                                               \
+    } while (0)
+
+    DO_TEST_BENCH("qemumonitorjsondata/qemumonitorjson-getcpu-full.json");
+    DO_TEST_BENCH("qemumonitorjsondata/qemumonitorjson-getcpu-host.json");
+    DO_TEST_BENCH("qemucapabilitiesdata/caps_1.6.0-1.replies");
+
+#define DO_TEST_STREAM_FULL(name, doc, filter, expect, fail)        \
+    do {                                                            \
+        struct testStreamInfo info = { doc, filter, expect, fail }; \
+        if (virtTestRun(name, testJSONStream, &info) < 0)           \
+            ret = -1;                                               \
+    } while (0)
+
+#define DO_TEST_STREAM(name, doc, filter, expect)                   \
+    DO_TEST_STREAM_FULL(name, doc, filter, expect, false)
+
+    DO_TEST_STREAM("stream",
+                   "{\"QMP\": {\"version\": {\"major\": 2}}}\r\n"
+                   "{\"return\": [{\"device\": \"drive-ide0-0-0\", "
+                   "\"parent\": {\"stats\": {\"wr_highest_offset\": 0}}, "
+                   "\"stats\": {\"rd_bytes\": 12, \"flush\": true}}], "
+                   "\"id\": \"libvirt-2\"}\r\n"
+                   "{\"event\": \"STOP\", \"data\": [null, false]}\r\n",
+                   NULL,
+                   "{\"QMP\":{\"version\":{\"major\":2}}}\n"
+                   "{\"return\":[{\"device\":\"drive-ide0-0-0\","
+                   "\"parent\":{\"stats\":{\"wr_highest_offset\":0}},"
+                   "\"stats\":{\"rd_bytes\":12,\"flush\":true}}],"
+                   "\"id\":\"libvirt-2\"}\n"
+                   "{\"event\":\"STOP\",\"data\":[null,false]}\n");
+
+    {
+        const char *filter[] = { "return/*/device", "return/*/stats", NULL };
+
+        DO_TEST_STREAM("stream filtered",
+                       "{\"return\": [{\"device\": \"drive-ide0-0-0\", "
+                       "\"parent\": {\"stats\": {\"rd_bytes\": 0}}, "
+                       "\"stats\": {\"rd_bytes\": 12}}, "
+                       "{\"stats\": {}, \"device\": \"drive-ide0-0-1\"}], "
+                       "\"id\": \"libvirt-2\"}\r\n"
+                       "[\"skipped\", {\"return\": 1}]\r\n",
+                       filter,
+                       "{\"return\":[{\"device\":\"drive-ide0-0-0\","
+                       "\"stats\":{\"rd_bytes\":12}},"
+                       "{\"stats\":{},\"device\":\"drive-ide0-0-1\"}]}\n"
+                       "[]\n");
+    }
+
+    DO_TEST_STREAM_FULL("stream error",
+                        "{\"return\": {}}\r\n"
+                        "[1, 2]\r\n"
+                        "{\"id\": ]\r\n"
+                        "{\"return\": {}}\r\n",
+                        NULL,
+                        "{\"return\":{}}\n"
+                        "[1,2]\n",
+                        true);
+
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,143 @@
+#include <config.h>
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+# include <linux/fs.h>
+#endif
+
+#include "internal.h"
+
+/*
+ * Lets storagedrivertest take away the shortcuts volume copies use,
+ * so that each of the ways of copying data gets tested whatever the
+ * kernel and filesystem support:
+ *
+ * STORAGE_MOCK_NO_REFLINK: the FICLONE ioctl fails
+ * STORAGE_MOCK_NO_COPY_RANGE: the copy_file_range syscall fails
+ * STORAGE_MOCK_NO_SEEK_DATA: lseek with SEEK_DATA or SEEK_HOLE fails
+ * STORAGE_MOCK_NO_PREALLOC: fallocate fails to preallocate space
+ *
+ * and hold volume jobs at a known point, or make them fail:
+ *
+ * STORAGE_MOCK_STALL: fallocate waits for the file it names to be
+ * removed, which holds zeroing wipes and copies at their start
+ * STORAGE_MOCK_NO_SPACE: fallocate fails to preallocate space with
+ * ENOSPC, failing copies
+ */
+
+static int (*realioctl)(int fd, unsigned long request, ...);
+static long (*realsyscall)(long number, ...);
+static off_t (*reallseek)(int fd, off_t offset, int whence);
+static int (*realfallocate)(int fd, int mode, off_t offset, off_t len);
+
+static void
+init_syms(void)
+{
+    if (realioctl)
+        return;
+
+    realioctl = dlsym(RTLD_NEXT, "ioctl");
+    realsyscall = dlsym(RTLD_NEXT, "syscall");
+    reallseek = dlsym(RTLD_NEXT, "lseek");
+    realfallocate = dlsym(RTLD_NEXT, "fallocate");
+    if (!realioctl || !realsyscall || !reallseek || !realfallocate) {
+        fprintf(stderr, "Error getting symbols");
+        abort();
+    }
+}
+
+int
+ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    void *arg;
+
+    init_syms();
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+#ifdef FICLONE
+    if (request == FICLONE && getenv("STORAGE_MOCK_NO_REFLINK")) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+#endif
+
+    return realioctl(fd, request, arg);
+}
+
+long
+syscall(long number, ...)
+{
+    va_list ap;
+    long args[6];
+    size_t i;
+
+    init_syms();
+
+    va_start(ap, number);
+    for (i = 0; i < ARRAY_CARDINALITY(args); i++)
+        args[i] = va_arg(ap, long);
+    va_end(ap);
+
+#ifdef SYS_copy_file_range
+    if (number == SYS_copy_file_range &&
+        getenv("STORAGE_MOCK_NO_COPY_RANGE")) {
+        errno = ENOSYS;
+        return -1;
+    }
+#endif
+
+    return realsyscall(number, args[0], args[1], args[2],
+                       args[3], args[4], args[5]);
+}
+
+off_t
+lseek(int fd, off_t offset, int whence)
+{
+    init_syms();
+
+#ifdef SEEK_DATA
+    if ((whence == SEEK_DATA || whence == SEEK_HOLE) &&
+        getenv("STORAGE_MOCK_NO_SEEK_DATA")) {
+        errno = EINVAL;
+        return -1;
+    }
+#endif
+
+    return reallseek(fd, offset, whence);
+}
+
+int
+fallocate(int fd, int mode, off_t offset, off_t len)
+{
+    const char *stall;
+
+    init_syms();
+
+    if ((stall = getenv("STORAGE_MOCK_STALL"))) {
+        while (access(stall, F_OK) == 0)
+            usleep(10 * 1000);
+    }
+
+    if (mode == 0 && getenv("STORAGE_MOCK_NO_SPACE")) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if (mode == 0 && getenv("STORAGE_MOCK_NO_PREALLOC")) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    return realfallocate(fd, mode, offset, len);
+}
@@ -0,0 +1,2008 @@
+#include <config.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "datatypes.h"
+#include "driver.h"
+#include "libvirt_internal.h"
+#include "viraccessmanager.h"
+#include "vircommand.h"
+#include "virendian.h"
+#include "virevent.h"
+#include "virfile.h"
+#include "virstoragefile.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "storage/storage_driver.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static virConnectPtr conn;
+static const char *scratchdir;
+
+
+/* Hypervisor driver giving the storage driver a connection to serve */
+static virDrvOpenStatus
+testStorageConnectOpen(virConnectPtr c,
+                       virConnectAuthPtr auth ATTRIBUTE_UNUSED,
+                       unsigned int flags ATTRIBUTE_UNUSED)
+{
+    if (!c->uri || STRNEQ_NULLABLE(c->uri->scheme, "storagetest"))
+        return VIR_DRV_OPEN_DECLINED;
+
+    return VIR_DRV_OPEN_SUCCESS;
+}
+
+static int
+testStorageConnectClose(virConnectPtr c ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+static virDriver testStorageHypervisorDriver = {
+    .no = VIR_DRV_TEST,
+    .name = "storagetest",
+    .connectOpen = testStorageConnectOpen,
+    .connectClose = testStorageConnectClose,
+};
+
+
+/* Start a transient dir pool @name on a new directory, returned in
+ * @dir if not NULL */
+static virStoragePoolPtr
+testPoolNew(const char *name,
+            char **dir)
+{
+    virStoragePoolPtr pool = NULL;
+    char *path = NULL;
+    char *xml = NULL;
+
+    if (virAsprintf(&path, "%s/%s", scratchdir, name) < 0 ||
+        virAsprintf(&xml,
+                    "<pool type='dir'>"
+                    "  <name>%s</name>"
+                    "  <target><path>%s</path></target>"
+                    "</pool>", name, path) < 0)
+        goto cleanup;
+
+    if (mkdir(path, 0700) < 0) {
+        fprintf(stderr, "cannot create %s\n", path);
+        goto cleanup;
+    }
+
+    pool = virStoragePoolCreateXML(conn, xml, 0);
+
+ cleanup:
+    if (pool && dir) {
+        *dir = path;
+        path = NULL;
+    }
+    VIR_FREE(path);
+    VIR_FREE(xml);
+    return pool;
+}
+
+
+/* Write the 512 bytes of an image to @fd: a qcow2 header if @qcow2
+ * is true, zeroes otherwise */
+static int
+testWriteImage(int fd,
+               bool qcow2)
+{
+    unsigned char header[512];
+
+    memset(header, 0, sizeof(header));
+    if (qcow2) {
+        memcpy(header, "QFI\xfb", 4);
+        virWriteBufInt32BE(header + 4, 2);
+        virWriteBufInt32BE(header + 20, 16);
+        virWriteBufInt64BE(header + 24, 1 << 20);
+    }
+
+    if (pwrite(fd, header, sizeof(header), 0) != sizeof(header))
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testCreateImage(const char *dir,
+                const char *name,
+                bool qcow2)
+{
+    char *path = NULL;
+    int fd = -1;
+    int ret = -1;
+
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0)
+        return -1;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        testWriteImage(fd, qcow2) < 0 ||
+        VIR_CLOSE(fd) < 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+/* Rewrite the image @name keeping its size and modification time, so
+ * that only its change time tells */
+static int
+testChangeImageQuietly(const char *dir,
+                       const char *name,
+                       bool qcow2)
+{
+    char *path = NULL;
+    struct stat before;
+    struct stat after;
+    struct timespec times[2];
+    size_t tries = 0;
+    int fd = -1;
+    int ret = -1;
+
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0)
+        return -1;
+
+    if (stat(path, &before) < 0 ||
+        (fd = open(path, O_WRONLY)) < 0 ||
+        testWriteImage(fd, qcow2) < 0 ||
+        VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    times[0] = before.st_atim;
+    times[1] = before.st_mtim;
+
+    /* Restoring the times updates the change time, wait for the clock
+     * to tick if it has not moved yet */
+    do {
+        if (tries++)
+            usleep(10 * 1000);
+        if (utimensat(AT_FDCWD, path, times, 0) < 0 ||
+            stat(path, &after) < 0)
+            goto cleanup;
+    } while (after.st_ctim.tv_sec == before.st_ctim.tv_sec &&
+             after.st_ctim.tv_nsec == before.st_ctim.tv_nsec &&
+             tries < 500);
+
+    if (after.st_size != before.st_size ||
+        after.st_mtim.tv_sec != before.st_mtim.tv_sec ||
+        after.st_mtim.tv_nsec != before.st_mtim.tv_nsec)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0)
+        fprintf(stderr, "cannot rewrite %s\n", path);
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+/* Check that @pool has @nvols volumes and that volume @name has
+ * @format, or is missing if @format is NULL. Mismatches are printed if
+ * @report is true */
+static int
+testCheckVolFull(virStoragePoolPtr pool,
+                 int nvols,
+                 const char *name,
+                 const char *format,
+                 bool report)
+{
+    virStorageVolPtr vol;
+    char *xml = NULL;
+    char *expect = NULL;
+    int n;
+    int ret = -1;
+
+    if ((n = virStoragePoolNumOfVolumes(pool)) != nvols) {
+        if (report)
+            fprintf(stderr, "expected %d volumes, got %d\n", nvols, n);
+        return -1;
+    }
+
+    vol = virStorageVolLookupByName(pool, name);
+    if (!format) {
+        if (vol) {
+            if (report)
+                fprintf(stderr, "volume %s still listed\n", name);
+            goto cleanup;
+        }
+        virResetLastError();
+        return 0;
+    }
+
+    if (!vol ||
+        !(xml = virStorageVolGetXMLDesc(vol, 0)) ||
+        virAsprintf(&expect, "<format type='%s'/>", format) < 0)
+        goto cleanup;
+
+    if (!strstr(xml, expect)) {
+        if (report)
+            fprintf(stderr, "volume %s: expected format %s in %s\n",
+                    name, format, xml);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (vol)
+        virStorageVolFree(vol);
+    VIR_FREE(expect);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+static int
+testCheckVol(virStoragePoolPtr pool,
+             int nvols,
+             const char *name,
+             const char *format)
+{
+    return testCheckVolFull(pool, nvols, name, format, true);
+}
+
+
+/* Wait up to 10 seconds for testCheckVol to pass */
+static int
+testWaitVol(virStoragePoolPtr pool,
+            int nvols,
+            const char *name,
+            const char *format)
+{
+    size_t i;
+
+    for (i = 0; i < 1000; i++) {
+        if (testCheckVolFull(pool, nvols, name, format, false) == 0)
+            return 0;
+        virResetLastError();
+        usleep(10 * 1000);
+    }
+
+    return testCheckVol(pool, nvols, name, format);
+}
+
+
+/*
+ * Refresh a pool whose files are created, left alone, rewritten keeping
+ * their size and modification time, and removed.
+ */
+static int
+testPoolRefresh(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolPtr pool = NULL;
+    char *dir = NULL;
+    char *path = NULL;
+    int ret = -1;
+
+    if (!(pool = testPoolNew("refresh-pool", &dir)) ||
+        testCheckVol(pool, 0, "a.img", NULL) < 0)
+        goto cleanup;
+
+    /* Created */
+    if (testCreateImage(dir, "a.img", false) < 0 ||
+        testCreateImage(dir, "b.img", true) < 0 ||
+        virStoragePoolRefresh(pool, 0) < 0 ||
+        testCheckVol(pool, 2, "a.img", "raw") < 0 ||
+        testCheckVol(pool, 2, "b.img", "qcow2") < 0)
+        goto cleanup;
+
+    /* Unchanged */
+    if (virStoragePoolRefresh(pool, 0) < 0 ||
+        testCheckVol(pool, 2, "a.img", "raw") < 0 ||
+        testCheckVol(pool, 2, "b.img", "qcow2") < 0)
+        goto cleanup;
+
+    /* Changed, with only the change time telling */
+    if (testChangeImageQuietly(dir, "a.img", true) < 0 ||
+        virStoragePoolRefresh(pool, 0) < 0 ||
+        testCheckVol(pool, 2, "a.img", "qcow2") < 0 ||
+        testCheckVol(pool, 2, "b.img", "qcow2") < 0)
+        goto cleanup;
+
+    /* Removed */
+    if (virAsprintf(&path, "%s/b.img", dir) < 0 ||
+        unlink(path) < 0 ||
+        virStoragePoolRefresh(pool, 0) < 0 ||
+        testCheckVol(pool, 1, "b.img", NULL) < 0 ||
+        testCheckVol(pool, 1, "a.img", "qcow2") < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(path);
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+#define TEST_REFRESH_CONCURRENT_VOLS 20
+
+struct testRefreshConcurrentData {
+    virStoragePoolPtr pool;
+    bool create;
+    bool failed;
+};
+
+static void
+testPoolRefreshConcurrentThread(void *opaque)
+{
+    struct testRefreshConcurrentData *data = opaque;
+    virStorageVolPtr vol;
+    char xml[256];
+    size_t i;
+
+    for (i = 0; i < TEST_REFRESH_CONCURRENT_VOLS && !data->failed; i++) {
+        if (!data->create) {
+            if (virStoragePoolRefresh(data->pool, 0) < 0)
+                data->failed = true;
+            continue;
+        }
+
+        snprintf(xml, sizeof(xml),
+                 "<volume>"
+                 "  <name>vol%zu.img</name>"
+                 "  <capacity>65536</capacity>"
+                 "  <allocation>0</allocation>"
+                 "  <target><format type='raw'/></target>"
+                 "</volume>", i);
+        if (!(vol = virStorageVolCreateXML(data->pool, xml, 0)))
+            data->failed = true;
+        else
+            virStorageVolFree(vol);
+    }
+}
+
+/*
+ * Refresh a pool from two threads while a third one creates volumes:
+ * refreshes wait for each other and for the volumes being built, and
+ * no volume created while a refresh scans the pool is lost.
+ */
+static int
+testPoolRefreshConcurrent(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testRefreshConcurrentData data[3];
+    virThread threads[ARRAY_CARDINALITY(data)];
+    virStoragePoolPtr pool;
+    size_t nthreads = 0;
+    size_t i;
+    char name[32];
+    int ret = 0;
+
+    if (!(pool = testPoolNew("concurrent-pool", NULL)))
+        return -1;
+
+    memset(data, 0, sizeof(data));
+    for (i = 0; i < ARRAY_CARDINALITY(data); i++) {
+        data[i].pool = pool;
+        data[i].create = i == 0;
+        if (virThreadCreate(&threads[i], true,
+                            testPoolRefreshConcurrentThread, &data[i]) < 0) {
+            ret = -1;
+            break;
+        }
+        nthreads++;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (data[i].failed) {
+            fprintf(stderr, "%s failed: %s\n",
+                    data[i].create ? "creating volumes" : "refreshing",
+                    virGetLastErrorMessage());
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 &&
+        (virStoragePoolRefresh(pool, 0) < 0 ||
+         virStoragePoolNumOfVolumes(pool) != TEST_REFRESH_CONCURRENT_VOLS))
+        ret = -1;
+
+    for (i = 0; ret == 0 && i < TEST_REFRESH_CONCURRENT_VOLS; i++) {
+        snprintf(name, sizeof(name), "vol%zu.img", i);
+        if (testCheckVol(pool, TEST_REFRESH_CONCURRENT_VOLS, name, "raw") < 0)
+            ret = -1;
+    }
+
+    virStoragePoolDestroy(pool);
+    virStoragePoolFree(pool);
+    return ret;
+}
+
+
+#define TEST_LOOKUP_CONCURRENT_VOLS 40
+
+struct testLookupConcurrentData {
+    virStoragePoolPtr pool;     /* pool the volumes are created in */
+    virStoragePoolPtr other;    /* pool stopped and started meanwhile */
+    const char *dir;
+
+    virMutex lock;
+    size_t created;             /* volumes created so far */
+    bool done;
+    char *error;
+};
+
+/* Record the first failure of a thread, returning true if the test is
+ * over */
+static bool
+testLookupConcurrentCheck(struct testLookupConcurrentData *data,
+                          const char *what)
+{
+    bool done;
+
+    virMutexLock(&data->lock);
+    if (what && !data->error)
+        ignore_value(virAsprintf(&data->error, "%s: %s",
+                                 what, virGetLastErrorMessage()));
+    done = data->done || data->error;
+    virMutexUnlock(&data->lock);
+    return done;
+}
+
+static void
+testLookupConcurrentCreate(void *opaque)
+{
+    struct testLookupConcurrentData *data = opaque;
+    virStorageVolPtr vol;
+    char xml[256];
+    size_t i;
+
+    for (i = 0; i < TEST_LOOKUP_CONCURRENT_VOLS; i++) {
+        snprintf(xml, sizeof(xml),
+                 "<volume>"
+                 "  <name>vol%zu.img</name>"
+                 "  <capacity>65536</capacity>"
+                 "  <allocation>0</allocation>"
+                 "  <target><format type='raw'/></target>"
+                 "</volume>", i);
+        if (!(vol = virStorageVolCreateXML(data->pool, xml, 0))) {
+            testLookupConcurrentCheck(data, "creating a volume");
+            break;
+        }
+        virStorageVolFree(vol);
+
+        virMutexLock(&data->lock);
+        data->created = i + 1;
+        virMutexUnlock(&data->lock);
+    }
+
+    virMutexLock(&data->lock);
+    data->done = true;
+    virMutexUnlock(&data->lock);
+}
+
+static void
+testLookupConcurrentLookup(void *opaque)
+{
+    struct testLookupConcurrentData *data = opaque;
+    virStorageVolPtr vol;
+    char *path = NULL;
+    size_t created;
+
+    while (!testLookupConcurrentCheck(data, NULL)) {
+        virMutexLock(&data->lock);
+        created = data->created;
+        virMutexUnlock(&data->lock);
+        if (!created)
+            continue;
+
+        /* Keys of volumes of dir pools are their paths */
+        VIR_FREE(path);
+        if (virAsprintf(&path, "%s/vol%zu.img", data->dir, created - 1) < 0)
+            break;
+
+        if (!(vol = virStorageVolLookupByKey(conn, path)) ||
+            STRNEQ(vol->pool, "lookup-pool")) {
+            testLookupConcurrentCheck(data, "looking up a volume by key");
+        } else if (virStorageVolFree(vol) < 0 ||
+                   !(vol = virStorageVolLookupByPath(conn, path)) ||
+                   STRNEQ(vol->pool, "lookup-pool")) {
+            testLookupConcurrentCheck(data, "looking up a volume by path");
+        }
+        if (vol)
+            virStorageVolFree(vol);
+
+        if ((vol = virStorageVolLookupByKey(conn, "/no/such/volume"))) {
+            virStorageVolFree(vol);
+            virResetLastError();
+            testLookupConcurrentCheck(data, "looking up a missing volume");
+        }
+    }
+
+    VIR_FREE(path);
+}
+
+static void
+testLookupConcurrentRefresh(void *opaque)
+{
+    struct testLookupConcurrentData *data = opaque;
+
+    while (!testLookupConcurrentCheck(data, NULL)) {
+        if (virStoragePoolRefresh(data->pool, 0) < 0)
+            testLookupConcurrentCheck(data, "refreshing the pool");
+    }
+}
+
+static void
+testLookupConcurrentRestart(void *opaque)
+{
+    struct testLookupConcurrentData *data = opaque;
+
+    while (!testLookupConcurrentCheck(data, NULL)) {
+        if (virStoragePoolDestroy(data->other) < 0 ||
+            virStoragePoolCreate(data->other, 0) < 0)
+            testLookupConcurrentCheck(data, "restarting the other pool");
+    }
+}
+
+/*
+ * Look up the volumes being created in a pool by key and path while
+ * the pool is refreshed, and another pool scanned before it is
+ * stopped and started over and over: every volume is found as soon as
+ * it is created, and lookups don't stall the other operations.
+ */
+static int
+testLookupConcurrent(const void *opaque ATTRIBUTE_UNUSED)
+{
+    void (*funcs[])(void *) = {
+        testLookupConcurrentCreate,
+        testLookupConcurrentLookup,
+        testLookupConcurrentRefresh,
+        testLookupConcurrentRestart,
+    };
+    struct testLookupConcurrentData data;
+    virThread threads[ARRAY_CARDINALITY(funcs)];
+    char *dir = NULL;
+    char *otherpath = NULL;
+    char *otherxml = NULL;
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    memset(&data, 0, sizeof(data));
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+
+    /* The other pool is defined first so that scans of all pools look
+     * at it before the one holding the volumes */
+    if (virAsprintf(&otherpath, "%s/lookup-other", scratchdir) < 0 ||
+        virAsprintf(&otherxml,
+                    "<pool type='dir'>"
+                    "  <name>lookup-other</name>"
+                    "  <target><path>%s</path></target>"
+                    "</pool>", otherpath) < 0 ||
+        virFileMakePath(otherpath) < 0 ||
+        !(data.other = virStoragePoolDefineXML(conn, otherxml, 0)) ||
+        virStoragePoolCreate(data.other, 0) < 0 ||
+        !(data.pool = testPoolNew("lookup-pool", &dir)))
+        goto cleanup;
+    data.dir = dir;
+
+    for (i = 0; i < ARRAY_CARDINALITY(funcs); i++) {
+        if (virThreadCreate(&threads[i], true, funcs[i], &data) < 0) {
+            virMutexLock(&data.lock);
+            data.done = true;
+            virMutexUnlock(&data.lock);
+            break;
+        }
+        nthreads++;
+    }
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (nthreads < ARRAY_CARDINALITY(funcs))
+        goto cleanup;
+    if (data.error) {
+        fprintf(stderr, "%s\n", data.error);
+        goto cleanup;
+    }
+    if (data.created != TEST_LOOKUP_CONCURRENT_VOLS ||
+        virStoragePoolNumOfVolumes(data.pool) != TEST_LOOKUP_CONCURRENT_VOLS)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (data.pool) {
+        virStoragePoolDestroy(data.pool);
+        virStoragePoolFree(data.pool);
+    }
+    if (data.other) {
+        virStoragePoolDestroy(data.other);
+        virStoragePoolUndefine(data.other);
+        virStoragePoolFree(data.other);
+    }
+    virMutexDestroy(&data.lock);
+    VIR_FREE(data.error);
+    VIR_FREE(otherxml);
+    VIR_FREE(otherpath);
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+/*
+ * Wipe a fully allocated volume whose size is not a multiple of the
+ * O_DIRECT alignment: every byte reads back as zero afterwards, and
+ * the volume keeps its size and allocation.
+ */
+static int
+testVolWipe(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const size_t size = 3 * 1024 * 1024 + 1000;
+    virStoragePoolPtr pool = NULL;
+    virStorageVolPtr vol = NULL;
+    char *dir = NULL;
+    char *path = NULL;
+    char *buf = NULL;
+    struct stat before;
+    struct stat after;
+    int fd = -1;
+    size_t i;
+    int ret = -1;
+
+    if (!(pool = testPoolNew("wipe-pool", &dir)) ||
+        virAsprintf(&path, "%s/wipe.img", dir) < 0 ||
+        VIR_ALLOC_N(buf, size) < 0)
+        goto cleanup;
+
+    memset(buf, 'x', size);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, buf, size) < 0 ||
+        VIR_CLOSE(fd) < 0 ||
+        stat(path, &before) < 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        goto cleanup;
+    }
+
+    if (virStoragePoolRefresh(pool, 0) < 0 ||
+        !(vol = virStorageVolLookupByName(pool, "wipe.img")))
+        goto cleanup;
+
+    if (virStorageVolWipe(vol, 0) < 0) {
+        fprintf(stderr, "wiping failed: %s\n", virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0 ||
+        saferead(fd, buf, size) != (ssize_t)size ||
+        fstat(fd, &after) < 0)
+        goto cleanup;
+
+    for (i = 0; i < size; i++) {
+        if (buf[i]) {
+            fprintf(stderr, "byte %zu was not wiped\n", i);
+            goto cleanup;
+        }
+    }
+
+    if (after.st_size != before.st_size ||
+        after.st_blocks < before.st_blocks) {
+        fprintf(stderr, "size %lld blocks %lld became %lld blocks %lld\n",
+                (long long)before.st_size, (long long)before.st_blocks,
+                (long long)after.st_size, (long long)after.st_blocks);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    if (vol)
+        virStorageVolFree(vol);
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(buf);
+    VIR_FREE(path);
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+#define MB (1024 * 1024)
+#define TEST_CLONE_SIZE (6 * MB + 1000)
+
+/* Fill @buf with the content of the clone source: data, a hole, zeros
+ * written out and data again, spanning more chunks than copy workers */
+static void
+testCloneContent(char *buf)
+{
+    memset(buf, 'a', MB);
+    memset(buf + MB, 0, 4 * MB);
+    memset(buf + 5 * MB, 'b', TEST_CLONE_SIZE - 5 * MB);
+}
+
+
+static virStorageVolPtr
+testCloneSource(virStoragePoolPtr pool,
+                const char *dir)
+{
+    virStorageVolPtr vol = NULL;
+    char *path = NULL;
+    char *buf = NULL;
+    int fd = -1;
+
+    if (virAsprintf(&path, "%s/clone-src.img", dir) < 0 ||
+        VIR_ALLOC_N(buf, TEST_CLONE_SIZE) < 0)
+        goto cleanup;
+
+    testCloneContent(buf);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        ftruncate(fd, TEST_CLONE_SIZE) < 0 ||
+        pwrite(fd, buf, MB, 0) != MB ||
+        pwrite(fd, buf + 4 * MB, TEST_CLONE_SIZE - 4 * MB,
+               4 * MB) != TEST_CLONE_SIZE - 4 * MB ||
+        VIR_CLOSE(fd) < 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        goto cleanup;
+    }
+
+    if (virStoragePoolRefresh(pool, 0) < 0)
+        goto cleanup;
+    vol = virStorageVolLookupByName(pool, "clone-src.img");
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(buf);
+    VIR_FREE(path);
+    return vol;
+}
+
+
+struct testCloneData {
+    const char *name;
+    const char *env;            /* storagedrivermock switches to set */
+};
+
+/*
+ * Clone a volume made of data, a hole and zeros through one of the
+ * ways of copying. Clones get the capacity of the source allocated,
+ * which may be preallocated, so that holes can be skipped, or not, so
+ * that they have to be zeroed.
+ */
+static int
+testVolClone(const void *opaque)
+{
+    const struct testCloneData *data = opaque;
+    virStoragePoolPtr pool = NULL;
+    virStorageVolPtr src = NULL;
+    virStorageVolPtr vol = NULL;
+    char **env = NULL;
+    char *dir = NULL;
+    char *path = NULL;
+    char *xml = NULL;
+    char *want = NULL;
+    char *buf = NULL;
+    struct stat st;
+    int fd = -1;
+    size_t i;
+    int ret = -1;
+
+    if (data->env && !(env = virStringSplit(data->env, " ", 0)))
+        return -1;
+    for (i = 0; env && env[i]; i++)
+        setenv(env[i], "1", 1);
+
+    if (!(pool = testPoolNew(data->name, &dir)) ||
+        !(src = testCloneSource(pool, dir)) ||
+        virAsprintf(&path, "%s/clone.img", dir) < 0 ||
+        virAsprintf(&xml,
+                    "<volume>"
+                    "  <name>clone.img</name>"
+                    "  <capacity>%d</capacity>"
+                    "  <allocation>0</allocation>"
+                    "  <target><format type='raw'/></target>"
+                    "</volume>", TEST_CLONE_SIZE) < 0 ||
+        VIR_ALLOC_N(want, TEST_CLONE_SIZE) < 0 ||
+        VIR_ALLOC_N(buf, TEST_CLONE_SIZE) < 0)
+        goto cleanup;
+
+    if (!(vol = virStorageVolCreateXMLFrom(pool, xml, src, 0))) {
+        fprintf(stderr, "cloning failed: %s\n", virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    testCloneContent(want);
+    if ((fd = open(path, O_RDONLY)) < 0 ||
+        fstat(fd, &st) < 0 ||
+        saferead(fd, buf, TEST_CLONE_SIZE) != TEST_CLONE_SIZE)
+        goto cleanup;
+
+    if (st.st_size != TEST_CLONE_SIZE) {
+        fprintf(stderr, "clone size is %lld\n", (long long)st.st_size);
+        goto cleanup;
+    }
+
+    for (i = 0; i < TEST_CLONE_SIZE; i++) {
+        if (buf[i] != want[i]) {
+            fprintf(stderr, "byte %zu: expected %d, got %d\n",
+                    i, want[i], buf[i]);
+            goto cleanup;
+        }
+    }
+
+    if (st.st_blocks * 512ULL < TEST_CLONE_SIZE - 4096) {
+        fprintf(stderr, "clone has only %lld blocks allocated\n",
+                (long long)st.st_blocks);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; env && env[i]; i++)
+        unsetenv(env[i]);
+    virStringFreeList(env);
+    VIR_FORCE_CLOSE(fd);
+    if (vol)
+        virStorageVolFree(vol);
+    if (src)
+        virStorageVolFree(src);
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(buf);
+    VIR_FREE(want);
+    VIR_FREE(xml);
+    VIR_FREE(path);
+    VIR_FREE(dir);
+    return ret;
+}
+
+struct testQcow2Data {
+    const char *name;
+    unsigned long long capacity;
+    bool v3;
+    bool lazy;
+    bool prealloc;
+};
+
+#define QCOW2_CLUSTER (64 * 1024ULL)
+#define QCOW2_OFFSET_MASK 0x00fffffffffffe00ULL
+#define QCOW2_COPIED (1ULL << 63)
+
+static int
+testQcow2Read(int fd,
+              void *buf,
+              size_t len,
+              unsigned long long offset)
+{
+    if (pread(fd, buf, len, offset) != len) {
+        fprintf(stderr, "cannot read %zu bytes at %llu\n", len, offset);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Check the tables of the qcow2 image in @fd of @size bytes, whose
+ * header is in @header: every cluster of the file has a refcount of
+ * one, and if @prealloc every guest cluster is mapped to a distinct
+ * data cluster of the file, or none if not.
+ */
+static int
+testQcow2CheckTables(int fd,
+                     unsigned long long size,
+                     const unsigned char *header,
+                     const struct testQcow2Data *data)
+{
+    unsigned long long nclusters = size / QCOW2_CLUSTER;
+    unsigned long long guest = VIR_DIV_UP(data->capacity, QCOW2_CLUSTER);
+    unsigned long long l1_size = virReadBufInt32BE(header + 36);
+    unsigned long long l1_offset = virReadBufInt64BE(header + 40);
+    unsigned long long rt_offset = virReadBufInt64BE(header + 48);
+    unsigned long long rt_clusters = virReadBufInt32BE(header + 56);
+    unsigned long long last = 0;
+    unsigned char *table = NULL;
+    unsigned char *block = NULL;
+    unsigned char *l1 = NULL;
+    unsigned long long i;
+    unsigned long long j;
+    int ret = -1;
+
+    if (size % QCOW2_CLUSTER ||
+        l1_size != VIR_DIV_UP(guest, QCOW2_CLUSTER / 8)) {
+        fprintf(stderr, "size %llu, L1 size %llu\n", size, l1_size);
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(table, rt_clusters * QCOW2_CLUSTER) < 0 ||
+        VIR_ALLOC_N(block, QCOW2_CLUSTER) < 0 ||
+        VIR_ALLOC_N(l1, l1_size * 8 + 1) < 0 ||
+        testQcow2Read(fd, table, rt_clusters * QCOW2_CLUSTER, rt_offset) < 0 ||
+        testQcow2Read(fd, l1, l1_size * 8, l1_offset) < 0)
+        goto cleanup;
+
+    /* Refcounts of 16 bits, in blocks of one cluster */
+    for (i = 0; i <= nclusters; i++) {
+        unsigned long long index = i / (QCOW2_CLUSTER / 2);
+        unsigned long long offset = virReadBufInt64BE(table + index * 8);
+        size_t k = i % (QCOW2_CLUSTER / 2) * 2;
+        unsigned int refcount = 0;
+
+        if (offset) {
+            if (k == 0 &&
+                testQcow2Read(fd, block, QCOW2_CLUSTER, offset) < 0)
+                goto cleanup;
+            refcount = (block[k] << 8) | block[k + 1];
+        }
+
+        if (refcount != (i < nclusters)) {
+            fprintf(stderr, "cluster %llu of %llu has refcount %u\n",
+                    i, nclusters, refcount);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < l1_size; i++) {
+        unsigned long long entry = virReadBufInt64BE(l1 + i * 8);
+        unsigned long long l2_offset = entry & QCOW2_OFFSET_MASK;
+
+        if (!data->prealloc) {
+            if (entry) {
+                fprintf(stderr, "L1 entry %llu is mapped\n", i);
+                goto cleanup;
+            }
+            continue;
+        }
+
+        if (!(entry & QCOW2_COPIED) || l2_offset % QCOW2_CLUSTER ||
+            l2_offset == 0 || l2_offset >= size ||
+            testQcow2Read(fd, block, QCOW2_CLUSTER, l2_offset) < 0) {
+            fprintf(stderr, "L1 entry %llu is %llx\n", i, entry);
+            goto cleanup;
+        }
+
+        for (j = 0; j < QCOW2_CLUSTER / 8; j++) {
+            unsigned long long cluster = i * (QCOW2_CLUSTER / 8) + j;
+            unsigned long long l2_entry = virReadBufInt64BE(block + j * 8);
+            unsigned long long offset = l2_entry & QCOW2_OFFSET_MASK;
+
+            if (cluster >= guest ? l2_entry != 0 :
+                !(l2_entry & QCOW2_COPIED) || offset % QCOW2_CLUSTER ||
+                offset <= last || offset >= size) {
+                fprintf(stderr, "guest cluster %llu is mapped to %llx\n",
+                        cluster, l2_entry);
+                goto cleanup;
+            }
+            if (cluster < guest)
+                last = offset;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(l1);
+    VIR_FREE(block);
+    VIR_FREE(table);
+    return ret;
+}
+
+/*
+ * Create an empty qcow2 volume, written without qemu-img, and check
+ * that it is probed with the requested capacity and features, that
+ * its tables are consistent, and that qemu-img agrees if installed.
+ */
+static int
+testVolQcow2(const void *opaque)
+{
+    const struct testQcow2Data *data = opaque;
+    virStoragePoolPtr pool = NULL;
+    virStorageVolPtr vol = NULL;
+    virStorageFileMetadataPtr meta = NULL;
+    virCommandPtr cmd = NULL;
+    unsigned char header[QCOW2_CLUSTER];
+    char *dir = NULL;
+    char *path = NULL;
+    char *xml = NULL;
+    char *backing = NULL;
+    char *qemuimg = NULL;
+    int backingFormat;
+    struct stat st;
+    bool lazy = false;
+    int fd = -1;
+    int ret = -1;
+
+    if (!(pool = testPoolNew(data->name, &dir)) ||
+        virAsprintf(&path, "%s/img.qcow2", dir) < 0 ||
+        virAsprintf(&xml,
+                    "<volume>"
+                    "  <name>img.qcow2</name>"
+                    "  <capacity>%llu</capacity>"
+                    "  <target>"
+                    "    <format type='qcow2'/>"
+                    "    %s%s"
+                    "  </target>"
+                    "</volume>", data->capacity,
+                    data->v3 ? "<compat>1.1</compat>" : "",
+                    data->lazy ?
+                    "<features><lazy_refcounts/></features>" : "") < 0)
+        goto cleanup;
+
+    if (!(vol = virStorageVolCreateXML(pool, xml, data->prealloc ?
+                                       VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA :
+                                       0))) {
+        fprintf(stderr, "creating failed: %s\n", virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0 ||
+        fstat(fd, &st) < 0 ||
+        testQcow2Read(fd, header, sizeof(header), 0) < 0)
+        goto cleanup;
+
+    if (!(meta = virStorageFileGetMetadataFromBuf(path, (char *)header,
+                                                  sizeof(header),
+                                                  VIR_STORAGE_FILE_AUTO,
+                                                  &backing,
+                                                  &backingFormat)))
+        goto cleanup;
+
+    if (meta->features)
+        ignore_value(virBitmapGetBit(meta->features,
+                                     VIR_STORAGE_FILE_FEATURE_LAZY_REFCOUNTS,
+                                     &lazy));
+    if (meta->format != VIR_STORAGE_FILE_QCOW2 ||
+        meta->capacity != data->capacity ||
+        backing ||
+        STRNEQ_NULLABLE(meta->compat, data->v3 ? "1.1" : NULL) ||
+        lazy != data->lazy) {
+        fprintf(stderr, "probed format %d capacity %llu backing %s "
+                "compat %s lazy refcounts %d\n",
+                meta->format, meta->capacity, NULLSTR(backing),
+                NULLSTR(meta->compat), lazy);
+        goto cleanup;
+    }
+
+    if (testQcow2CheckTables(fd, st.st_size, header, data) < 0)
+        goto cleanup;
+
+    if ((qemuimg = virFindFileInPath("qemu-img"))) {
+        cmd = virCommandNewArgList(qemuimg, "check", "-f", "qcow2",
+                                   path, NULL);
+        if (virCommandRun(cmd, NULL) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    virCommandFree(cmd);
+    virStorageFileFreeMetadata(meta);
+    if (vol)
+        virStorageVolFree(vol);
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(qemuimg);
+    VIR_FREE(backing);
+    VIR_FREE(xml);
+    VIR_FREE(path);
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+/*
+ * Images whose L1 table is larger than qemu accepts are not written
+ * in-process, but left to qemu-img, which refuses them.
+ */
+static int
+testVolQcow2TooLarge(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolPtr pool = NULL;
+    virStorageVolPtr vol = NULL;
+    char *path = NULL;
+    char *dir = NULL;
+    int ret = -1;
+
+    /* One L2 table more than fits in an L1 table of 32 MiB */
+    if (!(pool = testPoolNew("qcow2-too-large", &dir)) ||
+        virAsprintf(&path, "%s/img.qcow2", dir) < 0)
+        goto cleanup;
+
+    if ((vol = virStorageVolCreateXML(pool,
+                                      "<volume>"
+                                      "  <name>img.qcow2</name>"
+                                      "  <capacity>2251799813685249</capacity>"
+                                      "  <target><format type='qcow2'/></target>"
+                                      "</volume>", 0))) {
+        fprintf(stderr, "image with too large an L1 table was created\n");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (access(path, F_OK) == 0) {
+        fprintf(stderr, "image with too large an L1 table was written\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (vol)
+        virStorageVolFree(vol);
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(path);
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+
+/* Jobs stall in storagedrivermock while this file exists */
+static char *stallpath;
+
+static int
+testJobStall(void)
+{
+    return virFileWriteStr(stallpath, "", 0600);
+}
+
+static void
+testJobRelease(void)
+{
+    unlink(stallpath);
+}
+
+
+/* Create a volume @name of @size bytes of 'x' in @pool, whose target
+ * directory is @dir */
+static virStorageVolPtr
+testJobVolume(virStoragePoolPtr pool,
+              const char *dir,
+              const char *name,
+              size_t size)
+{
+    virStorageVolPtr vol = NULL;
+    char *path = NULL;
+    char *buf = NULL;
+    int fd = -1;
+
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0 ||
+        VIR_ALLOC_N(buf, size) < 0)
+        goto cleanup;
+
+    memset(buf, 'x', size);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, buf, size) < 0 ||
+        VIR_CLOSE(fd) < 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        goto cleanup;
+    }
+
+    if (virStoragePoolRefresh(pool, 0) < 0)
+        goto cleanup;
+    vol = virStorageVolLookupByName(pool, name);
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(buf);
+    VIR_FREE(path);
+    return vol;
+}
+
+
+/* Check that every byte of the file @name in @dir is @c */
+static int
+testJobCheckContent(const char *dir,
+                    const char *name,
+                    char c)
+{
+    char *path = NULL;
+    char *buf = NULL;
+    ssize_t len;
+    ssize_t i;
+    int ret = -1;
+
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0 ||
+        (len = virFileReadAll(path, 16 * MB, &buf)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < len; i++) {
+        if (buf[i] != c) {
+            fprintf(stderr, "%s: byte %zd is %d rather than %d\n",
+                    name, i, buf[i], c);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(buf);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+/* Wait for the job of @vol to reach @state */
+static int
+testJobWait(virStorageVolPtr vol,
+            int state)
+{
+    virStorageVolJobInfo info;
+    size_t i;
+
+    for (i = 0; i < 1000; i++) {
+        if (virStorageVolGetJobInfo(vol, &info, 0) < 0)
+            return -1;
+        if (info.state == state)
+            return 0;
+        usleep(10 * 1000);
+    }
+
+    fprintf(stderr, "job on %s is in state %d rather than %d\n",
+            vol->name, info.state, state);
+    return -1;
+}
+
+
+/* Count the jobs of @vols which are running, and return the index of
+ * the last one queued, or -1 if none is */
+static ssize_t
+testJobCount(virStorageVolPtr *vols,
+             size_t nvols,
+             size_t *running)
+{
+    virStorageVolJobInfo info;
+    ssize_t queued = -1;
+    size_t i;
+
+    *running = 0;
+    for (i = 0; i < nvols; i++) {
+        if (virStorageVolGetJobInfo(vols[i], &info, 0) < 0)
+            return -1;
+        if (info.state == VIR_STORAGE_VOL_JOB_STATE_RUNNING)
+            (*running)++;
+        else if (info.state == VIR_STORAGE_VOL_JOB_STATE_QUEUED)
+            queued = i;
+    }
+
+    return queued;
+}
+
+
+/* Start wiping all of @vols, and wait for all but one of them to be
+ * running. Returns the index of the one queued. */
+static ssize_t
+testJobStartWipes(virStorageVolPtr *vols,
+                  size_t nvols)
+{
+    size_t running = 0;
+    ssize_t queued = -1;
+    size_t i;
+
+    for (i = 0; i < nvols; i++) {
+        if (virStorageVolWipe(vols[i], VIR_STORAGE_VOL_WIPE_ASYNC) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < 1000; i++) {
+        queued = testJobCount(vols, nvols, &running);
+        if (running == nvols - 1 && queued >= 0)
+            break;
+        usleep(10 * 1000);
+    }
+
+    /* Leave the queued job a chance to start anyway */
+    usleep(100 * 1000);
+    queued = testJobCount(vols, nvols, &running);
+    if (running != nvols - 1 || queued < 0) {
+        fprintf(stderr, "%zu jobs running, %s queued\n",
+                running, queued < 0 ? "none" : vols[queued]->name);
+        return -1;
+    }
+
+    return queued;
+}
+
+
+#define TEST_JOB_VOLS 3
+
+/*
+ * Wipe three volumes of a pool at once: only two of the wipes run, the
+ * third one is queued, and can be cancelled without ever touching its
+ * volume.
+ */
+static int
+testJobQueue(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *names[TEST_JOB_VOLS] = { "a.img", "b.img", "c.img" };
+    virStorageVolPtr vols[TEST_JOB_VOLS] = { NULL };
+    virStoragePoolPtr pool = NULL;
+    char *dir = NULL;
+    ssize_t queued;
+    size_t i;
+    int ret = -1;
+
+    if (!(pool = testPoolNew("queue-pool", &dir)))
+        goto cleanup;
+    for (i = 0; i < TEST_JOB_VOLS; i++) {
+        if (!(vols[i] = testJobVolume(pool, dir, names[i], MB)))
+            goto cleanup;
+    }
+
+    if (testJobStall() < 0 ||
+        (queued = testJobStartWipes(vols, TEST_JOB_VOLS)) < 0)
+        goto cleanup;
+
+    if (virStorageVolAbortJob(vols[queued], 0) < 0 ||
+        testJobWait(vols[queued], VIR_STORAGE_VOL_JOB_STATE_CANCELLED) < 0)
+        goto cleanup;
+
+    testJobRelease();
+    for (i = 0; i < TEST_JOB_VOLS; i++) {
+        if (i != queued &&
+            testJobWait(vols[i], VIR_STORAGE_VOL_JOB_STATE_COMPLETED) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < TEST_JOB_VOLS; i++) {
+        if (testJobCheckContent(dir, names[i], i == queued ? 'x' : 0) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    testJobRelease();
+    for (i = 0; i < TEST_JOB_VOLS; i++) {
+        if (vols[i])
+            virStorageVolFree(vols[i]);
+    }
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+struct testJobDestroyData {
+    virStoragePoolPtr pool;
+    bool done;
+    int rc;
+};
+
+static void
+testJobDestroyThread(void *opaque)
+{
+    struct testJobDestroyData *data = opaque;
+
+    data->rc = virStoragePoolDestroy(data->pool);
+    data->done = true;
+}
+
+/*
+ * While a volume is wiped, it can't be deleted, resized or wiped
+ * again, and destroying the pool waits for the wipe to end.
+ */
+static int
+testJobBusy(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testJobDestroyData data = { NULL, false, -1 };
+    virStorageVolPtr vol = NULL;
+    virThread thread;
+    bool joined = true;
+    char *dir = NULL;
+    int ret = -1;
+
+    if (!(data.pool = testPoolNew("busy-pool", &dir)) ||
+        !(vol = testJobVolume(data.pool, dir, "busy.img", MB)))
+        goto cleanup;
+
+    if (testJobStall() < 0 ||
+        virStorageVolWipe(vol, VIR_STORAGE_VOL_WIPE_ASYNC) < 0 ||
+        testJobWait(vol, VIR_STORAGE_VOL_JOB_STATE_RUNNING) < 0)
+        goto cleanup;
+
+    if (virStorageVolDelete(vol, 0) == 0 ||
+        virStorageVolResize(vol, 2 * MB, 0) == 0 ||
+        virStorageVolWipe(vol, 0) == 0) {
+        fprintf(stderr, "volume being wiped was changed\n");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (virThreadCreate(&thread, true, testJobDestroyThread, &data) < 0)
+        goto cleanup;
+    joined = false;
+
+    usleep(100 * 1000);
+    if (data.done) {
+        fprintf(stderr, "pool was destroyed while wiping: %s\n",
+                data.rc < 0 ? virGetLastErrorMessage() : "no error");
+        goto cleanup;
+    }
+
+    testJobRelease();
+    virThreadJoin(&thread);
+    joined = true;
+    if (data.rc < 0) {
+        fprintf(stderr, "destroying the pool failed\n");
+        goto cleanup;
+    }
+
+    if (testJobCheckContent(dir, "busy.img", 0) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testJobRelease();
+    if (!joined)
+        virThreadJoin(&thread);
+    if (vol)
+        virStorageVolFree(vol);
+    if (data.pool) {
+        if (!data.done)
+            virStoragePoolDestroy(data.pool);
+        virStoragePoolFree(data.pool);
+    }
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+/*
+ * A clone which fails, or is cancelled while it is copied, is deleted,
+ * and its source is no longer in use afterwards.
+ */
+static int
+testJobCloneEnd(const void *opaque)
+{
+    bool cancel = *(const bool *)opaque;
+    virStoragePoolPtr pool = NULL;
+    virStorageVolPtr src = NULL;
+    virStorageVolPtr vol = NULL;
+    char *dir = NULL;
+    char *path = NULL;
+    char *xml = NULL;
+    size_t i;
+    int ret = -1;
+
+    /* Copied through userspace, checking for cancellation */
+    setenv("STORAGE_MOCK_NO_REFLINK", "1", 1);
+    setenv("STORAGE_MOCK_NO_COPY_RANGE", "1", 1);
+
+    if (!(pool = testPoolNew(cancel ? "cancel-clone-pool" :
+                             "fail-clone-pool", &dir)) ||
+        !(src = testJobVolume(pool, dir, "src.img", 4 * MB)) ||
+        virAsprintf(&path, "%s/clone.img", dir) < 0 ||
+        virAsprintf(&xml,
+                    "<volume>"
+                    "  <name>clone.img</name>"
+                    "  <capacity>%d</capacity>"
+                    "  <target><format type='raw'/></target>"
+                    "</volume>", 4 * MB) < 0)
+        goto cleanup;
+
+    if (cancel) {
+        if (testJobStall() < 0 ||
+            !(vol = virStorageVolCreateXMLFrom(pool, xml, src,
+                                               VIR_STORAGE_VOL_CREATE_ASYNC)) ||
+            testJobWait(vol, VIR_STORAGE_VOL_JOB_STATE_RUNNING) < 0)
+            goto cleanup;
+
+        if (virStorageVolDelete(src, 0) == 0) {
+            fprintf(stderr, "clone source was deleted\n");
+            goto cleanup;
+        }
+        virResetLastError();
+
+        if (virStorageVolAbortJob(vol, 0) < 0)
+            goto cleanup;
+        testJobRelease();
+
+        for (i = 0; i < 1000 && virStoragePoolNumOfVolumes(pool) != 1; i++)
+            usleep(10 * 1000);
+    } else {
+        setenv("STORAGE_MOCK_NO_SPACE", "1", 1);
+        vol = virStorageVolCreateXMLFrom(pool, xml, src, 0);
+        unsetenv("STORAGE_MOCK_NO_SPACE");
+        if (vol) {
+            fprintf(stderr, "clone succeeded without space\n");
+            goto cleanup;
+        }
+        virResetLastError();
+    }
+
+    if (virStoragePoolNumOfVolumes(pool) != 1 ||
+        access(path, F_OK) == 0) {
+        fprintf(stderr, "clone was not deleted\n");
+        goto cleanup;
+    }
+
+    if (virStorageVolDelete(src, 0) < 0) {
+        fprintf(stderr, "clone source is still in use: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    testJobRelease();
+    unsetenv("STORAGE_MOCK_NO_REFLINK");
+    unsetenv("STORAGE_MOCK_NO_COPY_RANGE");
+    if (vol)
+        virStorageVolFree(vol);
+    if (src)
+        virStorageVolFree(src);
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(xml);
+    VIR_FREE(path);
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+struct testJobCleanupData {
+    bool done;
+};
+
+static void
+testJobCleanupThread(void *opaque)
+{
+    struct testJobCleanupData *data = opaque;
+
+    virStateCleanup();
+    data->done = true;
+}
+
+/*
+ * Shut the driver down while two wipes run and a third one is queued:
+ * the queued one is cancelled, and the driver waits for the others to
+ * end before going away. Must be the last test.
+ */
+static int
+testJobCleanup(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *names[TEST_JOB_VOLS] = { "a.img", "b.img", "c.img" };
+    virStorageVolPtr vols[TEST_JOB_VOLS] = { NULL };
+    struct testJobCleanupData data = { false };
+    virStoragePoolPtr pool = NULL;
+    virThread thread;
+    bool joined = true;
+    char *dir = NULL;
+    ssize_t queued;
+    size_t i;
+    int ret = -1;
+
+    if (!(pool = testPoolNew("cleanup-pool", &dir)))
+        goto cleanup;
+    for (i = 0; i < TEST_JOB_VOLS; i++) {
+        if (!(vols[i] = testJobVolume(pool, dir, names[i], MB)))
+            goto cleanup;
+    }
+
+    if (testJobStall() < 0 ||
+        (queued = testJobStartWipes(vols, TEST_JOB_VOLS)) < 0)
+        goto cleanup;
+
+    virConnectClose(conn);
+    conn = NULL;
+    if (virThreadCreate(&thread, true, testJobCleanupThread, &data) < 0)
+        goto cleanup;
+    joined = false;
+
+    usleep(100 * 1000);
+    if (data.done) {
+        fprintf(stderr, "driver went away with jobs running\n");
+        goto cleanup;
+    }
+
+    testJobRelease();
+    virThreadJoin(&thread);
+    joined = true;
+
+    for (i = 0; i < TEST_JOB_VOLS; i++) {
+        if (testJobCheckContent(dir, names[i], i == queued ? 'x' : 0) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    testJobRelease();
+    if (!joined)
+        virThreadJoin(&thread);
+    for (i = 0; i < TEST_JOB_VOLS; i++) {
+        if (vols[i])
+            virStorageVolFree(vols[i]);
+    }
+    if (pool) {
+        if (conn)
+            virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+/*
+ * Add, change and remove files in a watched pool without ever
+ * refreshing it.
+ */
+static int
+testPoolWatch(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolPtr pool = NULL;
+    char *dir = NULL;
+    char *path = NULL;
+    int ret = -1;
+
+    if (!(pool = testPoolNew("watch-pool", &dir)))
+        goto cleanup;
+
+    if (testCreateImage(dir, "a.img", false) < 0 ||
+        testWaitVol(pool, 1, "a.img", "raw") < 0)
+        goto cleanup;
+
+    if (testCreateImage(dir, "a.img", true) < 0 ||
+        testWaitVol(pool, 1, "a.img", "qcow2") < 0)
+        goto cleanup;
+
+    if (virAsprintf(&path, "%s/a.img", dir) < 0 ||
+        unlink(path) < 0 ||
+        testWaitVol(pool, 0, "a.img", NULL) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(path);
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+#define TEST_WATCH_BUSY_FILES 50
+
+struct testWatchBusyData {
+    const char *dir;
+    bool failed;
+};
+
+static void
+testPoolWatchBusyThread(void *opaque)
+{
+    struct testWatchBusyData *data = opaque;
+    char name[32];
+    size_t i;
+
+    for (i = 0; i < TEST_WATCH_BUSY_FILES && !data->failed; i++) {
+        snprintf(name, sizeof(name), "file%zu.img", i);
+        if (testCreateImage(data->dir, name, i % 2) < 0)
+            data->failed = true;
+        usleep(2 * 1000);
+    }
+}
+
+/*
+ * Create, refresh and delete volumes of a watched pool while files keep
+ * showing up behind its back: the watcher never makes these fail, and
+ * ends up listing every file.
+ */
+static int
+testPoolWatchBusy(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testWatchBusyData data = { NULL, false };
+    virStoragePoolPtr pool = NULL;
+    virStorageVolPtr vol;
+    virThread thread;
+    bool joined = true;
+    char *dir = NULL;
+    char xml[256];
+    size_t i;
+    int ret = -1;
+
+    if (!(pool = testPoolNew("watch-busy-pool", &dir)))
+        goto cleanup;
+
+    data.dir = dir;
+    if (virThreadCreate(&thread, true, testPoolWatchBusyThread, &data) < 0)
+        goto cleanup;
+    joined = false;
+
+    for (i = 0; i < TEST_WATCH_BUSY_FILES; i++) {
+        snprintf(xml, sizeof(xml),
+                 "<volume>"
+                 "  <name>user%zu.img</name>"
+                 "  <capacity>65536</capacity>"
+                 "  <allocation>0</allocation>"
+                 "  <target><format type='raw'/></target>"
+                 "</volume>", i);
+        if (!(vol = virStorageVolCreateXML(pool, xml, 0))) {
+            fprintf(stderr, "creating user%zu.img failed: %s\n",
+                    i, virGetLastErrorMessage());
+            goto cleanup;
+        }
+
+        if (i % 2 && virStorageVolDelete(vol, 0) < 0) {
+            fprintf(stderr, "deleting user%zu.img failed: %s\n",
+                    i, virGetLastErrorMessage());
+            virStorageVolFree(vol);
+            goto cleanup;
+        }
+        virStorageVolFree(vol);
+
+        if (i % 10 == 0 && virStoragePoolRefresh(pool, 0) < 0) {
+            fprintf(stderr, "refreshing failed: %s\n",
+                    virGetLastErrorMessage());
+            goto cleanup;
+        }
+    }
+
+    virThreadJoin(&thread);
+    joined = true;
+    if (data.failed)
+        goto cleanup;
+
+    if (testWaitVol(pool, TEST_WATCH_BUSY_FILES + TEST_WATCH_BUSY_FILES / 2,
+                    "file49.img", "qcow2") < 0 ||
+        testCheckVol(pool, TEST_WATCH_BUSY_FILES + TEST_WATCH_BUSY_FILES / 2,
+                     "user1.img", NULL) < 0)
+        goto cleanup;
+
+    if (virStoragePoolDestroy(pool) < 0) {
+        fprintf(stderr, "destroying failed: %s\n", virGetLastErrorMessage());
+        goto cleanup;
+    }
+    virStoragePoolFree(pool);
+    pool = NULL;
+
+    ret = 0;
+
+ cleanup:
+    if (!joined) {
+        data.failed = true;
+        virThreadJoin(&thread);
+    }
+    if (pool) {
+        virStoragePoolDestroy(pool);
+        virStoragePoolFree(pool);
+    }
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+/*
+ * Leave a watched pool active with changes pending, for virStateCleanup
+ * to stop its watcher while an update may be about to run.
+ */
+static int
+testPoolWatchPending(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolPtr pool;
+    char *dir = NULL;
+    char name[32];
+    size_t i;
+    int ret = 0;
+
+    if (!(pool = testPoolNew("watch-pending-pool", &dir)))
+        return -1;
+
+    for (i = 0; ret == 0 && i < 10; i++) {
+        snprintf(name, sizeof(name), "pending%zu.img", i);
+        if (testCreateImage(dir, name, false) < 0)
+            ret = -1;
+        usleep(100 * 1000);
+    }
+
+    virStoragePoolFree(pool);
+    VIR_FREE(dir);
+    return ret;
+}
+
+
+static virMutex eventLock;
+static bool eventQuit;
+
+static void
+testEventLoop(void *opaque ATTRIBUTE_UNUSED)
+{
+    virMutexLock(&eventLock);
+    while (!eventQuit) {
+        virMutexUnlock(&eventLock);
+        if (virEventRunDefaultImpl() < 0)
+            return;
+        virMutexLock(&eventLock);
+    }
+    virMutexUnlock(&eventLock);
+}
+
+static void
+testEventWakeup(int timer,
+                void *opaque ATTRIBUTE_UNUSED)
+{
+    virEventRemoveTimeout(timer);
+}
+
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/storagedriverdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char template[] = SCRATCHDIRTEMPLATE;
+    virAccessManagerPtr mgr = NULL;
+    char *confdir = NULL;
+    char *conffile = NULL;
+    virThread eventThread;
+    bool eventRunning = false;
+    bool failed = false;
+    bool cancelled = true;
+    int ret = 0;
+
+    if (!(scratchdir = mkdtemp(template))) {
+        fprintf(stderr, "Cannot create scratch directory\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Keep the driver away from the user's pool configs */
+    if (virAsprintf(&stallpath, "%s/stall", scratchdir) < 0 ||
+        setenv("STORAGE_MOCK_STALL", stallpath, 1) < 0 ||
+        setenv("XDG_CONFIG_HOME", scratchdir, 1) < 0 ||
+        !(mgr = virAccessManagerNew("none"))) {
+        ret = -1;
+        goto cleanup;
+    }
+    virAccessManagerSetDefault(mgr);
+
+    /* Pools are watched, with the watchers serving the event loop run
+     * by the main thread of libvirtd */
+    if (virAsprintf(&confdir, "%s/libvirt", scratchdir) < 0 ||
+        virAsprintf(&conffile, "%s/storage.conf", confdir) < 0 ||
+        virFileMakePath(confdir) < 0 ||
+        virFileWriteStr(conffile, "watch_pools = 1\n", 0600) < 0 ||
+        virMutexInit(&eventLock) < 0 ||
+        virEventRegisterDefaultImpl() < 0 ||
+        virThreadCreate(&eventThread, true, testEventLoop, NULL) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+    eventRunning = true;
+
+    if (storageRegister() < 0 ||
+        virRegisterDriver(&testStorageHypervisorDriver) < 0 ||
+        virStateInitialize(false, NULL, NULL) < 0 ||
+        !(conn = virConnectOpen("storagetest:///"))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virtTestRun("Pool refresh", testPoolRefresh, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Pool refresh concurrent",
+                    testPoolRefreshConcurrent, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Volume lookup concurrent",
+                    testLookupConcurrent, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Volume wipe", testVolWipe, NULL) < 0)
+        ret = -1;
+#define DO_TEST_CLONE(name, env)                                        \
+    do {                                                                \
+        struct testCloneData data = { name, env };                      \
+        if (virtTestRun("Volume clone " name, testVolClone, &data) < 0) \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST_CLONE("any", NULL);
+    DO_TEST_CLONE("copy-range", "STORAGE_MOCK_NO_REFLINK");
+    DO_TEST_CLONE("copy-range-no-prealloc",
+                  "STORAGE_MOCK_NO_REFLINK STORAGE_MOCK_NO_PREALLOC");
+    DO_TEST_CLONE("read-write",
+                  "STORAGE_MOCK_NO_REFLINK STORAGE_MOCK_NO_COPY_RANGE");
+    DO_TEST_CLONE("read-write-no-seek-data",
+                  "STORAGE_MOCK_NO_REFLINK STORAGE_MOCK_NO_COPY_RANGE "
+                  "STORAGE_MOCK_NO_SEEK_DATA");
+    DO_TEST_CLONE("read-write-no-prealloc",
+                  "STORAGE_MOCK_NO_REFLINK STORAGE_MOCK_NO_COPY_RANGE "
+                  "STORAGE_MOCK_NO_PREALLOC");
+    DO_TEST_CLONE("read-write-no-seek-data-no-prealloc",
+                  "STORAGE_MOCK_NO_REFLINK STORAGE_MOCK_NO_COPY_RANGE "
+                  "STORAGE_MOCK_NO_SEEK_DATA STORAGE_MOCK_NO_PREALLOC");
+
+#define DO_TEST_QCOW2(name, capacity, v3, lazy, prealloc)               \
+    do {                                                                \
+        struct testQcow2Data data = { name, capacity, v3, lazy, prealloc }; \
+        if (virtTestRun("Volume " name, testVolQcow2, &data) < 0)      \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST_QCOW2("qcow2-v2", MB, false, false, false);
+    DO_TEST_QCOW2("qcow2-v2-prealloc", MB, false, false, true);
+    DO_TEST_QCOW2("qcow2-v3", MB + 1, true, false, false);
+    DO_TEST_QCOW2("qcow2-v3-lazy-prealloc", MB + 1, true, true, true);
+    DO_TEST_QCOW2("qcow2-multi-l2", 1024ULL * MB + 1000, true, false, true);
+    DO_TEST_QCOW2("qcow2-empty", 0, false, false, false);
+    DO_TEST_QCOW2("qcow2-empty-prealloc", 0, true, false, true);
+    if (virtTestRun("Volume qcow2-too-large", testVolQcow2TooLarge, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("Pool watch", testPoolWatch, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Pool watch busy", testPoolWatchBusy, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Pool watch pending", testPoolWatchPending, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("Volume job queue", testJobQueue, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Volume job busy", testJobBusy, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Volume job failed clone", testJobCloneEnd, &failed) < 0)
+        ret = -1;
+    if (virtTestRun("Volume job cancelled clone",
+                    testJobCloneEnd, &cancelled) < 0)
+        ret = -1;
+    if (virtTestRun("Volume job cleanup", testJobCleanup, NULL) < 0)
+        ret = -1;
+
+ cleanup:
+    if (conn)
+        virConnectClose(conn);
+    virStateCleanup();
+    if (eventRunning) {
+        virMutexLock(&eventLock);
+        eventQuit = true;
+        virMutexUnlock(&eventLock);
+        virEventAddTimeout(0, testEventWakeup, NULL, NULL);
+        virThreadJoin(&eventThread);
+    }
+    VIR_FREE(conffile);
+    VIR_FREE(confdir);
+    VIR_FREE(stallpath);
+    virObjectUnref(mgr);
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/storagedrivermock.so")
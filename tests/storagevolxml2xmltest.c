@@ -13,6 +13,7 @@
 #include "storage_conf.h"
 #include "testutilsqemu.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -95,6 +96,475 @@ testCompareXMLToXMLHelper(const void *data)
 }
 
 
+struct testVolLookupData {
+    size_t nvols;
+};
+
+/*
+ * Fill a pool with @nvols volumes, look each of them up by name, key
+ * and path, then remove every other volume and check the lookups
+ * follow.
+ */
+static int
+testVolLookup(const void *opaque)
+{
+    const struct testVolLookupData *data = opaque;
+    virStoragePoolObjPtr pool = NULL;
+    virStorageVolDefPtr vol = NULL;
+    virStorageVolDefPtr *vols = NULL;
+    char buf[128];
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC(pool) < 0 ||
+        VIR_ALLOC_N(vols, data->nvols) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data->nvols; i++) {
+        if (VIR_ALLOC(vol) < 0 ||
+            virAsprintf(&vol->name, "vol%zu.img", i) < 0 ||
+            virAsprintf(&vol->key, "key-%zu", i) < 0 ||
+            virAsprintf(&vol->target.path,
+                        "/var/lib/libvirt/images/vol%zu.img", i) < 0 ||
+            virStoragePoolObjAddVol(pool, vol) < 0)
+            goto cleanup;
+        vols[i] = vol;
+        vol = NULL;
+    }
+
+    for (i = 0; i < data->nvols; i++) {
+        snprintf(buf, sizeof(buf), "vol%zu.img", i);
+        if (virStorageVolDefFindByName(pool, buf) != vols[i])
+            goto cleanup;
+        snprintf(buf, sizeof(buf), "key-%zu", i);
+        if (virStorageVolDefFindByKey(pool, buf) != vols[i])
+            goto cleanup;
+        snprintf(buf, sizeof(buf), "/var/lib/libvirt/images/vol%zu.img", i);
+        if (virStorageVolDefFindByPath(pool, buf) != vols[i])
+            goto cleanup;
+    }
+
+    for (i = 0; i < data->nvols; i += 2) {
+        virStoragePoolObjRemoveVol(pool, vols[i]);
+        virStorageVolDefFree(vols[i]);
+    }
+
+    if (pool->volumes.count != data->nvols / 2)
+        goto cleanup;
+
+    for (i = 0; i < data->nvols; i++) {
+        virStorageVolDefPtr expect = i % 2 ? vols[i] : NULL;
+
+        snprintf(buf, sizeof(buf), "vol%zu.img", i);
+        if (virStorageVolDefFindByName(pool, buf) != expect)
+            goto cleanup;
+        snprintf(buf, sizeof(buf), "key-%zu", i);
+        if (virStorageVolDefFindByKey(pool, buf) != expect)
+            goto cleanup;
+        snprintf(buf, sizeof(buf), "/var/lib/libvirt/images/vol%zu.img", i);
+        if (virStorageVolDefFindByPath(pool, buf) != expect)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStorageVolDefFree(vol);
+    VIR_FREE(vols);
+    if (pool) {
+        virStoragePoolObjClearVols(pool);
+        VIR_FREE(pool);
+    }
+    return ret;
+}
+
+
+/*
+ * Volumes sharing a key or path: lookups must return the first one
+ * in the pool, and the next one once it is removed.
+ */
+static int
+testVolLookupDuplicate(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolObjPtr pool = NULL;
+    virStorageVolDefPtr vols[3] = { NULL, NULL, NULL };
+    const char *key = "shared-key";
+    const char *path = "/var/lib/libvirt/images/shared.img";
+    unsigned int additions;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC(pool) < 0)
+        return -1;
+
+    additions = virStoragePoolObjGetVolAdditions();
+
+    for (i = 0; i < ARRAY_CARDINALITY(vols); i++) {
+        if (VIR_ALLOC(vols[i]) < 0 ||
+            virAsprintf(&vols[i]->name, "vol%zu.img", i) < 0 ||
+            VIR_STRDUP(vols[i]->key, key) < 0 ||
+            VIR_STRDUP(vols[i]->target.path, path) < 0 ||
+            virStoragePoolObjAddVol(pool, vols[i]) < 0)
+            goto cleanup;
+    }
+
+    if (virStoragePoolObjGetVolAdditions() - additions !=
+        ARRAY_CARDINALITY(vols)) {
+        fprintf(stderr, "Volume additions not counted\n");
+        goto cleanup;
+    }
+
+    if (virStorageVolDefFindByKey(pool, key) != vols[0] ||
+        virStorageVolDefFindByPath(pool, path) != vols[0]) {
+        fprintf(stderr, "First volume not returned\n");
+        goto cleanup;
+    }
+
+    /* Removing a volume which is not the one indexed changes nothing */
+    virStoragePoolObjRemoveVol(pool, vols[1]);
+    if (virStorageVolDefFindByKey(pool, key) != vols[0] ||
+        virStorageVolDefFindByPath(pool, path) != vols[0]) {
+        fprintf(stderr, "Lookup changed after removing a duplicate\n");
+        goto cleanup;
+    }
+
+    /* Put it back last: the pool is now vol0, vol2, vol1 */
+    if (virStoragePoolObjAddVol(pool, vols[1]) < 0)
+        goto cleanup;
+
+    virStoragePoolObjRemoveVol(pool, vols[0]);
+    if (virStorageVolDefFindByKey(pool, key) != vols[2] ||
+        virStorageVolDefFindByPath(pool, path) != vols[2]) {
+        fprintf(stderr, "Next volume did not take over\n");
+        goto cleanup;
+    }
+    virStorageVolDefFree(vols[0]);
+    vols[0] = NULL;
+
+    virStoragePoolObjRemoveVol(pool, vols[2]);
+    if (virStorageVolDefFindByKey(pool, key) != vols[1] ||
+        virStorageVolDefFindByName(pool, "vol2.img")) {
+        fprintf(stderr, "Last volume did not take over\n");
+        goto cleanup;
+    }
+    virStorageVolDefFree(vols[2]);
+    vols[2] = NULL;
+
+    virStoragePoolObjRemoveVol(pool, vols[1]);
+    if (virStorageVolDefFindByKey(pool, key) ||
+        virStorageVolDefFindByPath(pool, path)) {
+        fprintf(stderr, "Volume found in an empty pool\n");
+        goto cleanup;
+    }
+
+    /* Removing it twice is harmless */
+    virStoragePoolObjRemoveVol(pool, vols[1]);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(vols); i++) {
+        if (vols[i])
+            virStoragePoolObjRemoveVol(pool, vols[i]);
+        virStorageVolDefFree(vols[i]);
+    }
+    virStoragePoolObjClearVols(pool);
+    VIR_FREE(pool);
+    return ret;
+}
+
+
+#define TEST_VOL_STRESS_THREADS 4
+
+struct testVolStressData {
+    virStoragePoolObjPtr pool;
+    size_t nvols;
+    size_t id;
+    struct testVolStressData *creators;
+    bool done;                  /* Set on creators, under the pool lock */
+    bool failed;
+};
+
+static virStorageVolDefPtr
+testVolStressNew(const char *prefix, size_t id, size_t i)
+{
+    virStorageVolDefPtr vol;
+
+    if (VIR_ALLOC(vol) < 0)
+        return NULL;
+
+    if (virAsprintf(&vol->name, "%s%zu-vol%zu.img", prefix, id, i) < 0 ||
+        virAsprintf(&vol->key, "%s%zu-key-%zu", prefix, id, i) < 0 ||
+        virAsprintf(&vol->target.path, "/var/lib/libvirt/images/%s",
+                    vol->name) < 0) {
+        virStorageVolDefFree(vol);
+        return NULL;
+    }
+
+    return vol;
+}
+
+/* Add volumes to the pool one at a time, then remove every other one,
+ * finding them by name as a refresh may have replaced them */
+static void
+testVolStressCreate(void *opaque)
+{
+    struct testVolStressData *data = opaque;
+    virStorageVolDefPtr vol;
+    char name[128];
+    size_t i;
+
+    for (i = 0; i < data->nvols; i++) {
+        if (!(vol = testVolStressNew("create", data->id, i))) {
+            data->failed = true;
+            return;
+        }
+
+        virStoragePoolObjLock(data->pool);
+        if (virStoragePoolObjAddVol(data->pool, vol) < 0) {
+            virStorageVolDefFree(vol);
+            data->failed = true;
+        }
+        virStoragePoolObjUnlock(data->pool);
+    }
+
+    for (i = 0; i < data->nvols; i += 2) {
+        snprintf(name, sizeof(name), "create%zu-vol%zu.img", data->id, i);
+
+        virStoragePoolObjLock(data->pool);
+        if ((vol = virStorageVolDefFindByName(data->pool, name))) {
+            virStoragePoolObjRemoveVol(data->pool, vol);
+            virStorageVolDefFree(vol);
+        }
+        virStoragePoolObjUnlock(data->pool);
+    }
+}
+
+/* Check that whatever volume a lookup finds, the other lookups agree */
+static void
+testVolStressLookup(void *opaque)
+{
+    struct testVolStressData *data = opaque;
+    struct testVolStressData *creators = data->creators;
+    char name[128];
+    size_t i = 0;
+    size_t j;
+
+    for (;;) {
+        bool done = true;
+        virStorageVolDefPtr vol;
+
+        virStoragePoolObjLockRead(data->pool);
+        for (j = 0; j < TEST_VOL_STRESS_THREADS; j++)
+            done &= creators[j].done;
+
+        snprintf(name, sizeof(name), "create%zu-vol%zu.img",
+                 i % TEST_VOL_STRESS_THREADS, i % data->nvols);
+        if ((vol = virStorageVolDefFindByName(data->pool, name)) &&
+            (virStorageVolDefFindByKey(data->pool, vol->key) != vol ||
+             virStorageVolDefFindByPath(data->pool,
+                                        vol->target.path) != vol))
+            data->failed = true;
+        virStoragePoolObjUnlock(data->pool);
+
+        if (done || data->failed)
+            break;
+        i++;
+    }
+}
+
+/* Drop all volumes and put back a fixed set, as a pool refresh does */
+static void
+testVolStressRefresh(void *opaque)
+{
+    struct testVolStressData *data = opaque;
+    struct testVolStressData *creators = data->creators;
+    virStorageVolDefPtr vol;
+    size_t i;
+    size_t j;
+
+    for (;;) {
+        bool done = true;
+
+        virStoragePoolObjLock(data->pool);
+        for (j = 0; j < TEST_VOL_STRESS_THREADS; j++)
+            done &= creators[j].done;
+
+        virStoragePoolObjClearVols(data->pool);
+        for (i = 0; i < data->nvols; i++) {
+            if (!(vol = testVolStressNew("refresh", 0, i)) ||
+                virStoragePoolObjAddVol(data->pool, vol) < 0) {
+                virStorageVolDefFree(vol);
+                data->failed = true;
+                break;
+            }
+        }
+        virStoragePoolObjUnlock(data->pool);
+
+        if (done || data->failed)
+            break;
+    }
+}
+
+/*
+ * Run threads creating and removing volumes in a pool, alongside
+ * threads looking them up and one refreshing the pool, all going
+ * through the pool lock the way the storage driver does.
+ */
+static int
+testVolStress(const void *opaque)
+{
+    const struct testVolLookupData *lookup = opaque;
+    virStoragePoolObjPtr pool = NULL;
+    struct testVolStressData data[TEST_VOL_STRESS_THREADS * 2 + 1];
+    virThread threads[ARRAY_CARDINALITY(data)];
+    virStorageVolDefPtr vol;
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC(pool) < 0)
+        return -1;
+
+    if (virRWLockInitPreferWriter(&pool->lock) < 0) {
+        VIR_FREE(pool);
+        return -1;
+    }
+
+    memset(data, 0, sizeof(data));
+    for (i = 0; i < ARRAY_CARDINALITY(data); i++) {
+        data[i].pool = pool;
+        data[i].nvols = lookup->nvols;
+        data[i].id = i % TEST_VOL_STRESS_THREADS;
+        data[i].creators = data;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(data); i++) {
+        virThreadFunc func = testVolStressCreate;
+
+        if (i >= TEST_VOL_STRESS_THREADS * 2)
+            func = testVolStressRefresh;
+        else if (i >= TEST_VOL_STRESS_THREADS)
+            func = testVolStressLookup;
+
+        if (virThreadCreate(&threads[nthreads], true, func, &data[i]) < 0)
+            goto join;
+        nthreads++;
+    }
+
+    ret = 0;
+
+ join:
+    /* Don't keep the other threads waiting for creators never started */
+    virStoragePoolObjLock(pool);
+    for (i = nthreads; i < TEST_VOL_STRESS_THREADS; i++)
+        data[i].done = true;
+    virStoragePoolObjUnlock(pool);
+
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (i < TEST_VOL_STRESS_THREADS) {
+            virStoragePoolObjLock(pool);
+            data[i].done = true;
+            virStoragePoolObjUnlock(pool);
+        }
+        if (data[i].failed)
+            ret = -1;
+    }
+
+    /* Whatever is left must be consistently indexed */
+    for (i = 0; i < pool->volumes.count; i++) {
+        vol = pool->volumes.objs[i];
+        if (virStorageVolDefFindByName(pool, vol->name) != vol ||
+            virStorageVolDefFindByKey(pool, vol->key) != vol ||
+            virStorageVolDefFindByPath(pool, vol->target.path) != vol)
+            ret = -1;
+    }
+
+    virStoragePoolObjClearVols(pool);
+    virRWLockDestroy(&pool->lock);
+    VIR_FREE(pool);
+    return ret;
+}
+
+
+#define TEST_VOL_JOB_CHUNKS 1000
+
+static void
+testVolJobProgress(void *opaque)
+{
+    virStorageVolJobPtr job = opaque;
+    size_t i;
+
+    for (i = 0; i < TEST_VOL_JOB_CHUNKS; i++)
+        ignore_value(virStorageVolJobProgress(job, 4096));
+}
+
+/* Follow a job through its states, with several threads reporting
+ * progress as the wipe and copy code do */
+static int
+testVolJob(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStorageVolJobPtr job;
+    virStorageVolJobInfo info;
+    virThread threads[TEST_VOL_STRESS_THREADS];
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(job = virStorageVolJobNew(VIR_STORAGE_VOL_JOB_WIPE,
+                                    4096ULL * TEST_VOL_JOB_CHUNKS *
+                                    TEST_VOL_STRESS_THREADS)))
+        return -1;
+
+    virStorageVolJobGetInfo(job, &info);
+    if (info.type != VIR_STORAGE_VOL_JOB_WIPE ||
+        info.state != VIR_STORAGE_VOL_JOB_STATE_QUEUED ||
+        info.elapsed != 0)
+        goto cleanup;
+
+    virStorageVolJobSetState(job, VIR_STORAGE_VOL_JOB_STATE_RUNNING);
+
+    for (i = 0; i < TEST_VOL_STRESS_THREADS; i++) {
+        if (virThreadCreate(&threads[nthreads], true,
+                            testVolJobProgress, job) < 0)
+            break;
+        nthreads++;
+    }
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+    if (nthreads != TEST_VOL_STRESS_THREADS)
+        goto cleanup;
+
+    virStorageVolJobGetInfo(job, &info);
+    if (info.state != VIR_STORAGE_VOL_JOB_STATE_RUNNING ||
+        info.processed != info.total)
+        goto cleanup;
+
+    if (virStorageVolJobIsAborted(job) ||
+        virStorageVolJobAbort(job) < 0 ||
+        !virStorageVolJobIsAborted(job) ||
+        virStorageVolJobProgress(job, 1) != -1)
+        goto cleanup;
+
+    virStorageVolJobSetState(job, VIR_STORAGE_VOL_JOB_STATE_CANCELLED);
+    virStorageVolJobGetInfo(job, &info);
+    if (info.state != VIR_STORAGE_VOL_JOB_STATE_CANCELLED)
+        goto cleanup;
+
+    /* A finished job can't be aborted */
+    if (virStorageVolJobAbort(job) == 0)
+        goto cleanup;
+    virResetLastError();
+
+    ret = 0;
+
+ cleanup:
+    virStorageVolJobFree(job);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -123,6 +593,41 @@ mymain(void)
     DO_TEST("pool-sheepdog", "vol-sheepdog");
     DO_TEST("pool-gluster", "vol-gluster-dir");
 
+#define DO_TEST_LOOKUP(n)                                               \
+    do {                                                                \
+        struct testVolLookupData data = {                               \
+            .nvols = n,                                                 \
+        };                                                              \
+        if (virtTestRun("Storage Vol lookup " #n,                       \
+                        testVolLookup, &data) < 0)                      \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST_LOOKUP(0);
+    DO_TEST_LOOKUP(1);
+    DO_TEST_LOOKUP(100);
+
+    if (virtTestRun("Storage Vol lookup duplicates",
+                    testVolLookupDuplicate, NULL) < 0)
+        ret = -1;
+
+#define DO_TEST_STRESS(n)                                               \
+    do {                                                                \
+        struct testVolLookupData data = {                               \
+            .nvols = n,                                                 \
+        };                                                              \
+        if (virtTestRun("Storage Vol concurrent access " #n,            \
+                        testVolStress, &data) < 0)                      \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST_STRESS(100);
+    if (virTestGetExpensive())
+        DO_TEST_STRESS(1000);
+
+    if (virtTestRun("Storage Vol job", testVolJob, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -595,6 +595,53 @@ static int testCgroupGetPercpuStats(const void *args ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testCgroupGetCpuacctUsage(const void *args ATTRIBUTE_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    char *path = NULL;
+    unsigned long long usage;
+    int rv, ret = -1;
+
+    if ((rv = virCgroupNewPartition("/virtualmachines", true,
+                                    (1 << VIR_CGROUP_CONTROLLER_CPU) |
+                                    (1 << VIR_CGROUP_CONTROLLER_CPUACCT),
+                                    &cgroup)) < 0) {
+        fprintf(stderr, "Could not create /virtualmachines cgroup: %d\n", -rv);
+        goto cleanup;
+    }
+
+    if (virCgroupGetCpuacctUsage(cgroup, &usage) < 0)
+        goto cleanup;
+
+    if (usage != 2787788855799582ULL) {
+        fprintf(stderr,
+                "Wrong value from virCgroupGetCpuacctUsage: %llu\n", usage);
+        goto cleanup;
+    }
+
+    /* The file is kept open; reading it again must see the new value */
+    if (virCgroupPathOfController(cgroup, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  "cpuacct.usage", &path) < 0 ||
+        virFileWriteStr(path, "42\n", 0) < 0)
+        goto cleanup;
+
+    if (virCgroupGetCpuacctUsage(cgroup, &usage) < 0)
+        goto cleanup;
+
+    if (usage != 42) {
+        fprintf(stderr,
+                "Stale value from virCgroupGetCpuacctUsage: %llu\n", usage);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(path);
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
 static int testCgroupGetMemoryUsage(const void *args ATTRIBUTE_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -803,6 +850,9 @@ mymain(void)
     if (virtTestRun("virCgroupGetPercpuStats works", testCgroupGetPercpuStats, NULL) < 0)
         ret = -1;
 
+    if (virtTestRun("virCgroupGetCpuacctUsage works", testCgroupGetCpuacctUsage, NULL) < 0)
+        ret = -1;
+
     setenv("VIR_CGROUP_MOCK_MODE", "allinone", 1);
     if (virtTestRun("New cgroup for self (allinone)", testCgroupNewForSelfAllInOne, NULL) < 0)
         ret = -1;
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <fcntl.h>
+
+#include "testutils.h"
+#include "vircompress.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "viralloc.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#if WITH_ZLIB
+
+static const char *scratchdir;
+
+struct testCompressData {
+    size_t len;
+    size_t frameSize;
+    size_t nworkers;
+    /* Offset of a byte to corrupt in the compressed data, if non-zero */
+    size_t corrupt;
+    /* Difference between the number of frames to decompress and
+     * the number that were written */
+    int frames;
+};
+
+
+static int
+testCompressFile(const char *path,
+                 const char *data,
+                 size_t len)
+{
+    int fd;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, data, len) != len ||
+        VIR_CLOSE(fd) < 0) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+testCompress(const void *opaque)
+{
+    const struct testCompressData *data = opaque;
+    char *input = NULL;
+    char *output = NULL;
+    char *inpath = NULL;
+    char *zpath = NULL;
+    char *outpath = NULL;
+    virCompressJobPtr job;
+    size_t frames = 0;
+    size_t want = (data->len + data->frameSize - 1) / data->frameSize;
+    int infd = -1;
+    int outfd = -1;
+    int len;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(input, data->len + 1) < 0 ||
+        virAsprintf(&inpath, "%s/input.data", scratchdir) < 0 ||
+        virAsprintf(&zpath, "%s/input.data.z", scratchdir) < 0 ||
+        virAsprintf(&outpath, "%s/output.data", scratchdir) < 0)
+        goto cleanup;
+
+    /* Half of each frame compresses well, the other half doesn't */
+    for (i = 0; i < data->len; i++) {
+        if ((i / (data->frameSize / 2)) % 2)
+            input[i] = (i * 2654435761U) >> 13;
+        else
+            input[i] = i / 64;
+    }
+
+    if (testCompressFile(inpath, input, data->len) < 0)
+        goto cleanup;
+
+    if ((infd = open(inpath, O_RDONLY)) < 0 ||
+        (outfd = open(zpath, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+        fprintf(stderr, "Cannot open files to compress\n");
+        goto cleanup;
+    }
+
+    if (!(job = virCompressJobStart(&infd, outfd, data->frameSize,
+                                    data->nworkers)))
+        goto cleanup;
+
+    if (infd != -1) {
+        fprintf(stderr, "Compression job did not take over input\n");
+        goto cleanup;
+    }
+
+    if (virCompressJobFinish(job, &frames) < 0)
+        goto cleanup;
+
+    if (frames != want) {
+        fprintf(stderr, "Expected %zu frames, got %zu\n", want, frames);
+        goto cleanup;
+    }
+
+    if (VIR_CLOSE(outfd) < 0)
+        goto cleanup;
+
+    if (data->corrupt) {
+        if ((outfd = open(zpath, O_WRONLY)) < 0 ||
+            lseek(outfd, data->corrupt, SEEK_SET) < 0 ||
+            safewrite(outfd, "\xff\xff\xff\xff", 4) != 4 ||
+            VIR_CLOSE(outfd) < 0) {
+            fprintf(stderr, "Cannot corrupt %s\n", zpath);
+            goto cleanup;
+        }
+    }
+
+    if ((infd = open(zpath, O_RDONLY)) < 0 ||
+        (outfd = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+        fprintf(stderr, "Cannot open files to decompress\n");
+        goto cleanup;
+    }
+
+    if (!(job = virDecompressJobStart(infd, &outfd, data->frameSize,
+                                      frames + data->frames,
+                                      data->nworkers)))
+        goto cleanup;
+
+    if (outfd != -1) {
+        fprintf(stderr, "Decompression job did not take over output\n");
+        goto cleanup;
+    }
+
+    if (virCompressJobFinish(job, NULL) < 0) {
+        if (data->corrupt || data->frames)
+            ret = 0;
+        goto cleanup;
+    }
+
+    if (data->corrupt || data->frames) {
+        fprintf(stderr, "Decompressing damaged data did not fail\n");
+        goto cleanup;
+    }
+
+    if ((len = virFileReadAll(outpath, data->len + 1, &output)) < 0)
+        goto cleanup;
+
+    if (len != data->len || memcmp(input, output, len) != 0) {
+        fprintf(stderr, "Decompressed data does not match\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(infd);
+    VIR_FORCE_CLOSE(outfd);
+    VIR_FREE(input);
+    VIR_FREE(output);
+    VIR_FREE(inpath);
+    VIR_FREE(zpath);
+    VIR_FREE(outpath);
+    return ret;
+}
+
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/compressdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char dir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!mkdtemp(dir)) {
+        virFilePrintf(stderr, "Cannot create compressdir");
+        abort();
+    }
+    scratchdir = dir;
+
+# define DO_TEST_FULL(name, len, frameSize, nworkers, corrupt, frames)  \
+    do {                                                                \
+        struct testCompressData data = {                                \
+            len, frameSize, nworkers, corrupt, frames                   \
+        };                                                              \
+        if (virtTestRun(name, testCompress, &data) < 0)                 \
+            ret = -1;                                                   \
+    } while (0)
+
+# define DO_TEST(name, len, frameSize, nworkers)                        \
+    DO_TEST_FULL(name, len, frameSize, nworkers, 0, 0)
+
+    DO_TEST("empty", 0, 4096, 4);
+    DO_TEST("short", 100, 4096, 4);
+    DO_TEST("one frame", 4096, 4096, 4);
+    DO_TEST("one thread", 4096 * 50 + 123, 4096, 1);
+    DO_TEST("two threads", 4096 * 50 + 123, 4096, 2);
+    DO_TEST("many threads", 4096 * 50, 4096, 16);
+    DO_TEST("large frames", 1024 * 1024 * 3 + 1, 1024 * 1024, 4);
+    DO_TEST_FULL("corrupt frame", 4096 * 20, 4096, 4, 4096, 0);
+    DO_TEST_FULL("corrupt header", 4096 * 20, 4096, 4, 2, 0);
+    DO_TEST_FULL("missing frames", 4096 * 20, 4096, 4, 0, 1);
+    DO_TEST_FULL("extra frames", 4096 * 20, 4096, 4, 0, -1);
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(dir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif
@@ -86,6 +86,32 @@ test2(const void *data ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int
+test3(const void *data ATTRIBUTE_UNUSED)
+{
+    /* Writing should round-trip through reading, even with
+     * unaligned access.  */
+    unsigned char array[13] = { 0 };
+    unsigned char expect[] = { 0, 1, 2, 3, 4, 5, 6, 7,
+                               8, 0x89, 0x8a, 0x8b, 0x8c };
+    int ret = -1;
+
+    virWriteBufInt64BE(array + 1, 0x0102030405060708ULL);
+    virWriteBufInt32BE(array + 9, 0x898a8b8cU);
+    if (memcmp(array, expect, sizeof(array)) != 0)
+        goto cleanup;
+
+    virWriteBufInt16BE(array + 3, 0x8d8eU);
+    if (virReadBufInt32BE(array + 1) != 0x01028d8eU)
+        goto cleanup;
+    if (virReadBufInt64BE(array + 5) != 0x05060708898a8b8cULL)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -95,6 +121,8 @@ mymain(void)
         ret = -1;
     if (virtTestRun("test2", test2, NULL) < 0)
         ret = -1;
+    if (virtTestRun("test3", test3, NULL) < 0)
+        ret = -1;
 
     return ret;
 }
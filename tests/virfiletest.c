@@ -21,10 +21,15 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "testutils.h"
 #include "virfile.h"
 #include "virstring.h"
+#include "viralloc.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
 
 
 #if defined HAVE_MNTENT_H && defined HAVE_GETMNTENT_R
@@ -89,6 +94,175 @@ static int testFileGetMountSubtree(const void *opaque)
 }
 #endif /* ! defined HAVE_MNTENT_H && defined HAVE_GETMNTENT_R */
 
+#define EXTENT (1024 * 1024)
+
+struct testFileInDataSection {
+    bool inData;
+    unsigned long long length;
+};
+
+/* Lays out a file as hole, data, hole, data, hole and
+ * checks that virFileInData walks through it correctly */
+static int testFileInData(const void *opaque ATTRIBUTE_UNUSED)
+{
+    static const struct testFileInDataSection expect[] = {
+        { false, EXTENT },
+        { true, EXTENT },
+        { false, EXTENT },
+        { true, EXTENT },
+        { false, EXTENT },
+        { false, 0 },
+    };
+    char path[] = "virfiletest-indata-XXXXXX";
+    char *buf = NULL;
+    int fd = -1;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(buf, EXTENT) < 0)
+        return -1;
+    memset(buf, 'x', EXTENT);
+
+    if ((fd = mkostemp(path, O_CLOEXEC)) < 0) {
+        fprintf(stderr, "Unable to create %s\n", path);
+        goto cleanup;
+    }
+    unlink(path);
+
+    if (ftruncate(fd, 5 * EXTENT) < 0 ||
+        lseek(fd, EXTENT, SEEK_SET) < 0 ||
+        safewrite(fd, buf, EXTENT) < 0 ||
+        lseek(fd, 3 * EXTENT, SEEK_SET) < 0 ||
+        safewrite(fd, buf, EXTENT) < 0 ||
+        lseek(fd, 0, SEEK_SET) < 0) {
+        fprintf(stderr, "Unable to populate %s\n", path);
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(expect); i++) {
+        bool inData;
+        unsigned long long length;
+        off_t cur = lseek(fd, 0, SEEK_CUR);
+
+        if (virFileInData(fd, &inData, &length) < 0)
+            goto cleanup;
+
+        if (i == 0 && inData) {
+            /* Filesystem doesn't report holes */
+            ret = EXIT_AM_SKIP;
+            goto cleanup;
+        }
+
+        if (inData != expect[i].inData ||
+            length != expect[i].length) {
+            fprintf(stderr,
+                    "Section %zu: expected inData=%d length=%llu, "
+                    "got inData=%d length=%llu\n",
+                    i, expect[i].inData, expect[i].length, inData, length);
+            goto cleanup;
+        }
+
+        if (lseek(fd, 0, SEEK_CUR) != cur) {
+            fprintf(stderr, "Section %zu: file position changed\n", i);
+            goto cleanup;
+        }
+
+        if (lseek(fd, length, SEEK_CUR) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(buf);
+    return ret;
+}
+
+/* Zeroes the middle of three extents of data, checking that the
+ * rest is left alone and that nothing is deallocated */
+static int testFileZeroRange(const void *opaque ATTRIBUTE_UNUSED)
+{
+    char path[] = "virfiletest-zerorange-XXXXXX";
+    char *buf = NULL;
+    struct stat before;
+    struct stat after;
+    int pipefd[2] = { -1, -1 };
+    int fd = -1;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(buf, 3 * EXTENT) < 0)
+        return -1;
+    memset(buf, 'x', 3 * EXTENT);
+
+    if ((fd = mkostemp(path, O_CLOEXEC)) < 0) {
+        fprintf(stderr, "Unable to create %s\n", path);
+        goto cleanup;
+    }
+    unlink(path);
+
+    if (safewrite(fd, buf, 3 * EXTENT) < 0 ||
+        fsync(fd) < 0 ||
+        fstat(fd, &before) < 0) {
+        fprintf(stderr, "Unable to populate %s\n", path);
+        goto cleanup;
+    }
+
+    if (virFileZeroRange(fd, EXTENT, EXTENT) < 0) {
+        if (errno == ENOTSUP || errno == EOPNOTSUPP || errno == ENOSYS) {
+            /* Filesystem can't zero ranges in place */
+            ret = EXIT_AM_SKIP;
+        } else {
+            fprintf(stderr, "Unable to zero range: %s\n", strerror(errno));
+        }
+        goto cleanup;
+    }
+
+    if (fstat(fd, &after) < 0 ||
+        pread(fd, buf, 3 * EXTENT, 0) != 3 * EXTENT)
+        goto cleanup;
+
+    if (after.st_size != before.st_size) {
+        fprintf(stderr, "Size changed from %lld to %lld\n",
+                (long long)before.st_size, (long long)after.st_size);
+        goto cleanup;
+    }
+
+    if (after.st_blocks < before.st_blocks) {
+        fprintf(stderr, "Blocks dropped from %lld to %lld\n",
+                (long long)before.st_blocks, (long long)after.st_blocks);
+        goto cleanup;
+    }
+
+    for (i = 0; i < 3 * EXTENT; i++) {
+        char want = i >= EXTENT && i < 2 * EXTENT ? 0 : 'x';
+
+        if (buf[i] != want) {
+            fprintf(stderr, "Byte %zu: expected %d, got %d\n",
+                    i, want, buf[i]);
+            goto cleanup;
+        }
+    }
+
+    /* Only files and block devices can be zeroed */
+    if (pipe(pipefd) < 0)
+        goto cleanup;
+    if (virFileZeroRange(pipefd[1], 0, EXTENT) == 0 || errno != ENOTSUP) {
+        fprintf(stderr, "Zeroing a pipe did not fail with ENOTSUP\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(pipefd[0]);
+    VIR_FORCE_CLOSE(pipefd[1]);
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(buf);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -126,6 +300,11 @@ mymain(void)
     DO_TEST_MOUNT_SUBTREE("/etc/aliases.db", MTAB_PATH2, "/etc/aliases.db", wantmounts2b, false);
 #endif /* ! defined HAVE_MNTENT_H && defined HAVE_GETMNTENT_R */
 
+    if (virtTestRun("File in data", testFileInData, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("File zero range", testFileZeroRange, NULL) < 0)
+        ret = -1;
+
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
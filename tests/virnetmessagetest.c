@@ -28,7 +28,8 @@
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
-#include "rpc/virnetmessage.h"
+#define __VIR_NET_MESSAGE_PRIV_H_ALLOW__
+#include "rpc/virnetmessagepriv.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -455,6 +456,366 @@ static int testMessagePayloadDecode(const void *args ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testMessagePayloadEncodeLarge(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessageError err;
+    virNetMessageError decoded;
+    virNetMessagePtr msg = virNetMessageNew(true);
+    size_t msglen = 1024 * 1024;
+    size_t total;
+    int ret = -1;
+
+    memset(&err, 0, sizeof(err));
+    memset(&decoded, 0, sizeof(decoded));
+
+    if (!msg)
+        return -1;
+
+    err.code = VIR_ERR_INTERNAL_ERROR;
+    err.domain = VIR_FROM_RPC;
+    err.level = VIR_ERR_ERROR;
+
+    /* Large enough that the initial message buffer must grow */
+    if (VIR_ALLOC(err.message) < 0 ||
+        VIR_ALLOC_N(*err.message, msglen + 1) < 0)
+        goto cleanup;
+    memset(*err.message, 'x', msglen);
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_MESSAGE;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_ERROR;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &err) < 0)
+        goto cleanup;
+
+    if (msg->bufferLength <= msglen ||
+        msg->bufferAlloc < msg->bufferLength) {
+        VIR_DEBUG("Unexpected message length %zu allocated %zu",
+                  msg->bufferLength, msg->bufferAlloc);
+        goto cleanup;
+    }
+
+    /* Now decode it again from the same buffer */
+    total = msg->bufferLength;
+    msg->bufferLength = 4;
+    msg->bufferOffset = 0;
+
+    if (virNetMessageDecodeLength(msg) < 0) {
+        VIR_DEBUG("Failed to decode message length");
+        goto cleanup;
+    }
+
+    if (msg->bufferLength != total) {
+        VIR_DEBUG("Expecting length %zu got %zu",
+                  total, msg->bufferLength);
+        goto cleanup;
+    }
+
+    if (virNetMessageDecodeHeader(msg) < 0) {
+        VIR_DEBUG("Failed to decode message header");
+        goto cleanup;
+    }
+
+    if (virNetMessageDecodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &decoded) < 0) {
+        VIR_DEBUG("Failed to decode message payload");
+        goto cleanup;
+    }
+
+    if (decoded.message == NULL ||
+        STRNEQ(*decoded.message, *err.message)) {
+        VIR_DEBUG("Decoded message does not match");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    xdr_free((xdrproc_t)xdr_virNetMessageError, (void*)&err);
+    xdr_free((xdrproc_t)xdr_virNetMessageError, (void*)&decoded);
+    virNetMessageFree(msg);
+    return ret;
+}
+
+/* Total number of idle buffers in all size classes */
+static size_t testMessageBufferPoolIdle(void)
+{
+    size_t len = 1;
+    size_t size, nfree, max;
+    size_t total = 0;
+
+    while (virNetMessageBufferPoolGetStats(len, &size, &nfree, &max) == 0) {
+        total += nfree;
+        len = size + 1;
+    }
+
+    return total;
+}
+
+static int testMessageBufferPoolClass(size_t size, size_t max)
+{
+    virNetMessagePtr *msgs = NULL;
+    char **buffers = NULL;
+    size_t clsize, nfree, clmax;
+    size_t i;
+    int ret = -1;
+
+    virNetMessageBufferPoolDrain();
+
+    /* One more buffer than the class retains */
+    if (VIR_ALLOC_N(msgs, max + 1) < 0 ||
+        VIR_ALLOC_N(buffers, max + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i <= max; i++) {
+        if (!(msgs[i] = virNetMessageNew(false)) ||
+            virNetMessageAllocBuffer(msgs[i], size - i % 2) < 0)
+            goto cleanup;
+
+        if (msgs[i]->bufferAlloc != size) {
+            VIR_DEBUG("Expected a %zu byte buffer, got %zu",
+                      size, msgs[i]->bufferAlloc);
+            goto cleanup;
+        }
+        buffers[i] = msgs[i]->buffer;
+    }
+
+    for (i = 0; i <= max; i++) {
+        virNetMessageFreeBuffer(msgs[i]);
+
+        if (msgs[i]->buffer || msgs[i]->bufferAlloc) {
+            VIR_DEBUG("Buffer was not released from the message");
+            goto cleanup;
+        }
+
+        if (virNetMessageBufferPoolGetStats(size, &clsize,
+                                            &nfree, &clmax) < 0 ||
+            nfree != MIN(i + 1, max)) {
+            VIR_DEBUG("Expected %zu idle %zu byte buffers, got %zu",
+                      MIN(i + 1, max), size, nfree);
+            goto cleanup;
+        }
+    }
+
+    /* The last buffer freed did not fit in the pool, the others
+     * are handed out again, most recently freed first */
+    for (i = 0; i < max; i++) {
+        if (virNetMessageAllocBuffer(msgs[i], size) < 0)
+            goto cleanup;
+
+        if (msgs[i]->buffer != buffers[max - 1 - i]) {
+            VIR_DEBUG("Buffer %p of size %zu was not reused, got %p",
+                      buffers[max - 1 - i], size, msgs[i]->buffer);
+            goto cleanup;
+        }
+    }
+
+    if (testMessageBufferPoolIdle() != 0) {
+        VIR_DEBUG("Expected no idle buffers");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    for (i = 0; msgs && i <= max; i++)
+        virNetMessageFree(msgs[i]);
+    VIR_FREE(msgs);
+    VIR_FREE(buffers);
+    return ret;
+}
+
+static int testMessageBufferPoolOversize(size_t len)
+{
+    virNetMessagePtr msg = NULL;
+    int ret = -1;
+
+    virNetMessageBufferPoolDrain();
+
+    if (!(msg = virNetMessageNew(false)) ||
+        virNetMessageAllocBuffer(msg, len) < 0)
+        goto cleanup;
+
+    if (msg->bufferAlloc != len) {
+        VIR_DEBUG("Expected a %zu byte buffer, got %zu",
+                  len, msg->bufferAlloc);
+        goto cleanup;
+    }
+
+    virNetMessageFreeBuffer(msg);
+
+    if (msg->buffer || testMessageBufferPoolIdle() != 0) {
+        VIR_DEBUG("Oversize buffer of %zu bytes was pooled", len);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+static int testMessageBufferPool(const void *args ATTRIBUTE_UNUSED)
+{
+    size_t len = 1;
+    size_t size, nfree, max;
+    int ret = -1;
+
+    while (virNetMessageBufferPoolGetStats(len, &size, &nfree, &max) == 0) {
+        if (max == 0 ||
+            testMessageBufferPoolClass(size, max) < 0)
+            goto cleanup;
+        len = size + 1;
+    }
+
+    if (len == 1) {
+        VIR_DEBUG("No buffer size classes");
+        goto cleanup;
+    }
+
+    if (testMessageBufferPoolOversize(len) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virNetMessageBufferPoolDrain();
+    return ret;
+}
+
+static int testMessagePayloadEncodeGrow(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessageError err;
+    virNetMessagePtr msg = virNetMessageNew(true);
+    size_t msglen = VIR_NET_MESSAGE_INITIAL * 5;
+    size_t size, nfree, max;
+    size_t idle;
+    int ret = -1;
+
+    memset(&err, 0, sizeof(err));
+
+    if (!msg)
+        return -1;
+
+    virNetMessageBufferPoolDrain();
+
+    err.code = VIR_ERR_INTERNAL_ERROR;
+    err.domain = VIR_FROM_RPC;
+    err.level = VIR_ERR_ERROR;
+
+    if (VIR_ALLOC(err.message) < 0 ||
+        VIR_ALLOC_N(*err.message, msglen + 1) < 0)
+        goto cleanup;
+    memset(*err.message, 'x', msglen);
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_MESSAGE;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_ERROR;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &err) < 0)
+        goto cleanup;
+
+    if (virNetMessageBufferPoolGetStats(msg->bufferLength, &size,
+                                        &nfree, &max) < 0 ||
+        msg->bufferAlloc != size) {
+        VIR_DEBUG("Message of %zu bytes has a %zu byte buffer",
+                  msg->bufferLength, msg->bufferAlloc);
+        goto cleanup;
+    }
+
+    /* Every buffer given up while growing is back in the pool. With
+     * xdr_sizeof the header buffer is grown straight to its final
+     * size, otherwise it goes through each size class in between */
+    idle = testMessageBufferPoolIdle();
+#if HAVE_XDR_SIZEOF
+    if (idle != 1) {
+#else
+    if (idle != 2) {
+#endif
+        VIR_DEBUG("Unexpected %zu buffers given up while growing", idle);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    xdr_free((xdrproc_t)xdr_virNetMessageError, (void*)&err);
+    virNetMessageFree(msg);
+    virNetMessageBufferPoolDrain();
+    return ret;
+}
+
+static int testMessagePayloadEncodeTooLarge(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessageError err;
+    virNetMessagePtr msg = virNetMessageNew(true);
+    char **strs[4];
+    size_t msglen = VIR_NET_MESSAGE_STRING_MAX;
+    size_t i;
+    int ret = -1;
+
+    memset(&err, 0, sizeof(err));
+
+    if (!msg)
+        return -1;
+
+    err.code = VIR_ERR_INTERNAL_ERROR;
+    err.domain = VIR_FROM_RPC;
+    err.level = VIR_ERR_ERROR;
+
+    /* Each string is within its own limit, but together they
+     * exceed the maximum message size */
+    if (VIR_ALLOC(err.message) < 0 ||
+        VIR_ALLOC(err.str1) < 0 ||
+        VIR_ALLOC(err.str2) < 0 ||
+        VIR_ALLOC(err.str3) < 0)
+        goto cleanup;
+    strs[0] = err.message;
+    strs[1] = err.str1;
+    strs[2] = err.str2;
+    strs[3] = err.str3;
+
+    for (i = 0; i < ARRAY_CARDINALITY(strs); i++) {
+        if (VIR_ALLOC_N(*strs[i], msglen + 1) < 0)
+            goto cleanup;
+        memset(*strs[i], 'x', msglen);
+    }
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_MESSAGE;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_ERROR;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &err) == 0) {
+        VIR_DEBUG("Encoded a message of %zu bytes", msg->bufferLength);
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (msg->bufferLength > VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX) {
+        VIR_DEBUG("Message buffer grew to %zu bytes", msg->bufferLength);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    xdr_free((xdrproc_t)xdr_virNetMessageError, (void*)&err);
+    virNetMessageFree(msg);
+    return ret;
+}
+
 static int testMessagePayloadStreamEncode(const void *args ATTRIBUTE_UNUSED)
 {
     char stream[] = "The quick brown fox jumps over the lazy dog";
@@ -522,6 +883,98 @@ static int testMessagePayloadStreamEncode(const void *args ATTRIBUTE_UNUSED)
 }
 
 
+static int testMessagePayloadStreamRaw(const void *args ATTRIBUTE_UNUSED)
+{
+    char stream[] = "The quick brown fox jumps over the lazy dog";
+    virNetMessagePtr msg = virNetMessageNew(true);
+    virNetStreamRaw data = { strlen(stream) };
+    static const char expect[] = {
+        0x00, 0x00, 0x00, 0x20,  /* Length */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x07,  /* Type */
+        0x00, 0x00, 0x00, 0x99,  /* Serial */
+        0x00, 0x00, 0x00, 0x02,  /* Status */
+
+        0x00, 0x00, 0x00, 0x2b,  /* Raw data length */
+
+        'T', 'h', 'e', ' ',
+        'q', 'u', 'i', 'c',
+        'k', ' ', 'b', 'r',
+        'o', 'w', 'n', ' ',
+        'f', 'o', 'x', ' ',
+        'j', 'u', 'm', 'p',
+        's', ' ', 'o', 'v',
+        'e', 'r', ' ', 't',
+        'h', 'e', ' ', 'l',
+        'a', 'z', 'y', ' ',
+        'd', 'o', 'g',
+    };
+    size_t len;
+    int ret = -1;
+
+    if (!msg)
+        return -1;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_STREAM_RAW;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetStreamRaw,
+                                   &data) < 0)
+        goto cleanup;
+
+    if (virNetMessageAppendRaw(msg, stream, strlen(stream)) < 0)
+        goto cleanup;
+
+    if (ARRAY_CARDINALITY(expect) != msg->bufferLength) {
+        VIR_DEBUG("Expect message length %zu got %zu",
+                  sizeof(expect), msg->bufferLength);
+        goto cleanup;
+    }
+
+    if (msg->bufferOffset != 0) {
+        VIR_DEBUG("Expect message offset 0 got %zu",
+                  msg->bufferOffset);
+        goto cleanup;
+    }
+
+    if (memcmp(expect, msg->buffer, sizeof(expect)) != 0) {
+        virtTestDifferenceBin(stderr, expect, msg->buffer, sizeof(expect));
+        goto cleanup;
+    }
+
+    /* Decoding leaves the message as it was */
+    msg->bufferLength = 0x20;
+    if (virNetMessageDecodeHeader(msg) < 0 ||
+        virNetMessageDecodeRawLength(msg, &len) < 0)
+        goto cleanup;
+
+    if (len != strlen(stream)) {
+        VIR_DEBUG("Expect raw data length %zu got %zu",
+                  strlen(stream), len);
+        goto cleanup;
+    }
+
+    if (msg->bufferOffset != 0x1c || msg->bufferLength != 0x20) {
+        VIR_DEBUG("Expect message offset 28 and length 32, got %zu and %zu",
+                  msg->bufferOffset, msg->bufferLength);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -541,8 +994,22 @@ mymain(void)
     if (virtTestRun("Message Payload Decode", testMessagePayloadDecode, NULL) < 0)
         ret = -1;
 
+    if (virtTestRun("Message Payload Encode Large", testMessagePayloadEncodeLarge, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("Message Payload Encode Grow", testMessagePayloadEncodeGrow, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("Message Payload Encode Too Large", testMessagePayloadEncodeTooLarge, NULL) < 0)
+        ret = -1;
+
     if (virtTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
+    if (virtTestRun("Message Payload Stream Raw", testMessagePayloadStreamRaw, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("Message Buffer Pool", testMessageBufferPool, NULL) < 0)
+        ret = -1;
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -21,12 +21,16 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/time.h>
 
 #include "testutils.h"
 #include "vircommand.h"
+#include "virendian.h"
 #include "virerror.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virprocess.h"
 #include "virstoragefile.h"
 #include "virstring.h"
 
@@ -438,18 +442,287 @@ testStorageLookup(const void *args)
     return ret;
 }
 
+#define cachedir abs_builddir "/virstoragecachedata"
+
+/* Write a qcow2 header of 1024 bytes to the start of NAME, with
+ * BACKING of format BACKINGFMT as backing file if not NULL */
+static int
+testChainCacheWriteImage(const char *name,
+                         const char *backing,
+                         const char *backingFmt)
+{
+    unsigned char header[1024];
+    int fd;
+    int ret = -1;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "QFI\xfb", 4);
+    virWriteBufInt32BE(header + 4, 2);
+    virWriteBufInt32BE(header + 20, 16);
+    virWriteBufInt64BE(header + 24, 1024 * 1024);
+    if (backing) {
+        virWriteBufInt64BE(header + 8, 512);
+        virWriteBufInt32BE(header + 16, strlen(backing));
+        memcpy(header + 512, backing, strlen(backing));
+        virWriteBufInt32BE(header + 72, 0xE2792ACA);
+        virWriteBufInt32BE(header + 76, strlen(backingFmt));
+        memcpy(header + 80, backingFmt, strlen(backingFmt));
+    }
+
+    if ((fd = open(name, O_WRONLY | O_CREAT, 0600)) < 0)
+        goto cleanup;
+    if (safewrite(fd, header, sizeof(header)) < 0 ||
+        VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0)
+        fprintf(stderr, "unable to write %s\n", name);
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+/* Set the timestamps of NAME far enough in the past for its header to
+ * be cached */
+static int
+testChainCacheBackdate(const char *name)
+{
+    struct timeval times[2];
+
+    if (gettimeofday(&times[0], NULL) < 0)
+        return -1;
+    times[0].tv_sec -= 60;
+    times[0].tv_usec = 0;
+    times[1] = times[0];
+
+    if (utimes(name, times) < 0) {
+        fprintf(stderr, "unable to set times of %s\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Create the chain top -> mid -> base in cachedir, all of it old
+ * enough to be cached */
+static int
+testChainCachePrep(void)
+{
+    if (virFileExists(cachedir) && virFileDeleteTree(cachedir) < 0)
+        return -1;
+    if (virFileMakePath(cachedir) < 0 ||
+        chdir(cachedir) < 0) {
+        fprintf(stderr, "unable to create %s\n", cachedir);
+        return -1;
+    }
+
+    if (virFileWriteStr("base", "", 0600) < 0 ||
+        testChainCacheWriteImage("mid", "base", "raw") < 0 ||
+        testChainCacheWriteImage("top", "mid", "qcow2") < 0 ||
+        testChainCacheBackdate("base") < 0 ||
+        testChainCacheBackdate("mid") < 0 ||
+        testChainCacheBackdate("top") < 0)
+        return -1;
+
+    return 0;
+}
+
+static virStorageFileMetadataPtr
+testChainCacheProbe(uid_t uid, gid_t gid)
+{
+    return virStorageFileGetMetadata(cachedir "/top", VIR_STORAGE_FILE_QCOW2,
+                                     uid, gid, false);
+}
+
+/* Check that the chain from META has the backing files of DEPTH */
+static int
+testChainCacheCheck(virStorageFileMetadataPtr meta,
+                    size_t depth)
+{
+    static const char *names[] = { "top", "mid", "base" };
+    size_t i;
+
+    for (i = 0; i < depth; i++) {
+        const char *want = names[i ? i + 3 - depth : 0];
+        char *path;
+        bool match;
+
+        if (!meta) {
+            fprintf(stderr, "chain ends before %s\n", want);
+            return -1;
+        }
+
+        if (virAsprintf(&path, "%s/%s", cachedir, want) < 0)
+            return -1;
+        match = STREQ_NULLABLE(meta->canonPath, path);
+        VIR_FREE(path);
+        if (!match) {
+            fprintf(stderr, "expected %s, got %s\n",
+                    want, NULLSTR(meta->canonPath));
+            return -1;
+        }
+
+        meta = meta->backingMeta;
+    }
+
+    if (meta) {
+        fprintf(stderr, "chain goes on to %s\n", NULLSTR(meta->canonPath));
+        return -1;
+    }
+    return 0;
+}
+
+/* A chain probed again from the cache is the same */
+static int
+testChainCacheHit(const void *args ATTRIBUTE_UNUSED)
+{
+    virStorageFileMetadataPtr cold = NULL;
+    virStorageFileMetadataPtr warm = NULL;
+    int ret = -1;
+
+    if (testChainCachePrep() < 0 ||
+        !(cold = testChainCacheProbe(-1, -1)) ||
+        !(warm = testChainCacheProbe(-1, -1)))
+        goto cleanup;
+
+    if (testChainCacheCheck(cold, 3) < 0 ||
+        testChainCacheCheck(warm, 3) < 0 ||
+        cold->capacity != warm->capacity)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virStorageFileFreeMetadata(cold);
+    virStorageFileFreeMetadata(warm);
+    return ret;
+}
+
+/* Rebasing the top image in place, keeping its size and timestamps so
+ * that only the change time tells, is noticed */
+static int
+testChainCacheRewrite(const void *args ATTRIBUTE_UNUSED)
+{
+    virStorageFileMetadataPtr meta = NULL;
+    int ret = -1;
+
+    if (testChainCachePrep() < 0 ||
+        !(meta = testChainCacheProbe(-1, -1)) ||
+        testChainCacheCheck(meta, 3) < 0)
+        goto cleanup;
+    virStorageFileFreeMetadata(meta);
+
+    if (testChainCacheWriteImage("top", "base", "raw") < 0 ||
+        testChainCacheBackdate("top") < 0 ||
+        !(meta = testChainCacheProbe(-1, -1)) ||
+        testChainCacheCheck(meta, 2) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virStorageFileFreeMetadata(meta);
+    return ret;
+}
+
+/* Renaming another image of the same size and timestamps over the top
+ * one is noticed */
+static int
+testChainCacheReplace(const void *args ATTRIBUTE_UNUSED)
+{
+    virStorageFileMetadataPtr meta = NULL;
+    int ret = -1;
+
+    if (testChainCachePrep() < 0 ||
+        !(meta = testChainCacheProbe(-1, -1)) ||
+        testChainCacheCheck(meta, 3) < 0)
+        goto cleanup;
+    virStorageFileFreeMetadata(meta);
+
+    if (testChainCacheWriteImage("top.new", "base", "raw") < 0 ||
+        testChainCacheBackdate("top.new") < 0 ||
+        rename("top.new", "top") < 0 ||
+        !(meta = testChainCacheProbe(-1, -1)) ||
+        testChainCacheCheck(meta, 2) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virStorageFileFreeMetadata(meta);
+    return ret;
+}
+
+/* A chain cached by one user isn't handed to another one who can't
+ * open it: the child shares the cache filled by root but not the
+ * access to the images */
+static int
+testChainCacheUser(const void *args ATTRIBUTE_UNUSED)
+{
+    virStorageFileMetadataPtr meta = NULL;
+    int status;
+    pid_t pid;
+    int ret = -1;
+
+    if (geteuid() != 0)
+        return EXIT_AM_SKIP;
+
+    if (testChainCachePrep() < 0 ||
+        !(meta = testChainCacheProbe(0, 0)) ||
+        testChainCacheCheck(meta, 3) < 0)
+        goto cleanup;
+
+    if ((pid = virFork()) < 0)
+        goto cleanup;
+    if (pid == 0) {
+        virStorageFileMetadataPtr child;
+
+        if (setgid(65534) < 0 || setuid(65534) < 0)
+            _exit(EXIT_FAILURE);
+        child = testChainCacheProbe(65534, 65534);
+        _exit(child ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    if (virProcessWait(pid, &status, false) < 0)
+        goto cleanup;
+    if (status != 0) {
+        fprintf(stderr, "chain probed without access to it\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStorageFileFreeMetadata(meta);
+    return ret;
+}
+
 static int
 mymain(void)
 {
-    int ret;
+    int ret = 0;
+    int rc;
     virCommandPtr cmd = NULL;
     struct testChainData data;
     virStorageFileMetadataPtr chain = NULL;
 
+    /* The header cache is tested on images written directly */
+    if (virtTestRun("Chain cache hit", testChainCacheHit, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Chain cache rewrite", testChainCacheRewrite, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Chain cache replace", testChainCacheReplace, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Chain cache user", testChainCacheUser, NULL) < 0)
+        ret = -1;
+    if (chdir(abs_builddir) < 0)
+        ret = -1;
+    virFileDeleteTree(cachedir);
+
     /* Prep some files with qemu-img; if that is not found on PATH, or
      * if it lacks support for qcow2 and qed, skip this test.  */
-    if ((ret = testPrepImages()) != 0)
-        return ret;
+    if ((rc = testPrepImages()) != 0)
+        return ret < 0 ? EXIT_FAILURE : rc;
 
 #define TEST_ONE_CHAIN(id, start, format, flags, ...)                \
     do {                                                             \
@@ -72,6 +72,45 @@ static int testTimeFields(const void *args)
 }
 
 
+static int testTimeHistogram(const void *args ATTRIBUTE_UNUSED)
+{
+    virTimeHistogram hist;
+    const unsigned long long samples[] = {
+        0, 1, 3, 4, 1023, 1024, 30000, 32767, 32768, 1000000
+    };
+    const int expected[VIR_TIME_HISTOGRAM_BUCKETS] = {
+        1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 2, 2
+    };
+    size_t i;
+
+    memset(&hist, 0, sizeof(hist));
+
+    for (i = 0; i < ARRAY_CARDINALITY(samples); i++)
+        virTimeHistogramAdd(&hist, samples[i]);
+
+    if (hist.count != ARRAY_CARDINALITY(samples)) {
+        VIR_DEBUG("Expect count %zu got %d",
+                  ARRAY_CARDINALITY(samples), hist.count);
+        return -1;
+    }
+
+    for (i = 0; i < VIR_TIME_HISTOGRAM_BUCKETS; i++) {
+        if (hist.buckets[i] != expected[i]) {
+            VIR_DEBUG("Expect bucket %zu to be %d got %d",
+                      i, expected[i], hist.buckets[i]);
+            return -1;
+        }
+    }
+
+    if (virTimeHistogramBucketLimit(3) != 8 ||
+        virTimeHistogramBucketLimit(VIR_TIME_HISTOGRAM_BUCKETS - 2) < 30000 ||
+        virTimeHistogramBucketLimit(VIR_TIME_HISTOGRAM_BUCKETS - 1) != 0)
+        return -1;
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -119,6 +158,9 @@ mymain(void)
 
     TEST_FIELDS(2147483648000ull, 2038,  1, 19,  3, 14,  8);
 
+    if (virtTestRun("Test histogram", testTimeHistogram, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -635,6 +635,10 @@ static const vshCmdOptDef opts_vol_upload[] = {
      .type = VSH_OT_INT,
      .help = N_("amount of data to upload")
     },
+    {.name = "sparse",
+     .type = VSH_OT_BOOL,
+     .help = N_("skip holes in the file rather than send them as zeros")
+    },
     {.name = NULL}
 };
 
@@ -647,6 +651,33 @@ cmdVolUploadSource(virStreamPtr st ATTRIBUTE_UNUSED,
     return saferead(*fd, bytes, nbytes);
 }
 
+static int
+cmdVolUploadHole(virStreamPtr st ATTRIBUTE_UNUSED,
+                 int *inData, long long *length, void *opaque)
+{
+    int *fd = opaque;
+    bool data;
+    unsigned long long len;
+
+    if (virFileInData(*fd, &data, &len) < 0)
+        return -1;
+
+    *inData = data;
+    *length = len;
+    return 0;
+}
+
+static int
+cmdVolUploadSkip(virStreamPtr st ATTRIBUTE_UNUSED,
+                 long long length, void *opaque)
+{
+    int *fd = opaque;
+
+    if (lseek(*fd, length, SEEK_CUR) == (off_t) -1)
+        return -1;
+    return 0;
+}
+
 static bool
 cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
 {
@@ -657,6 +688,8 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
     virStreamPtr st = NULL;
     const char *name = NULL;
     unsigned long long offset = 0, length = 0;
+    bool sparse = vshCommandOptBool(cmd, "sparse");
+    unsigned int flags = 0;
 
     if (vshCommandOptULongLong(cmd, "offset", &offset) < 0) {
         vshError(ctl, _("Unable to parse integer"));
@@ -668,6 +701,9 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
         return false;
     }
 
+    if (sparse)
+        flags |= VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM;
+
     if (!(vol = vshCommandOptVol(ctl, cmd, "vol", "pool", &name))) {
         return false;
     }
@@ -685,12 +721,18 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    if (virStorageVolUpload(vol, st, offset, length, 0) < 0) {
+    if (virStorageVolUpload(vol, st, offset, length, flags) < 0) {
         vshError(ctl, _("cannot upload to volume %s"), name);
         goto cleanup;
     }
 
-    if (virStreamSendAll(st, cmdVolUploadSource, &fd) < 0) {
+    if (sparse) {
+        if (virStreamSparseSendAll(st, cmdVolUploadSource, cmdVolUploadHole,
+                                   cmdVolUploadSkip, &fd) < 0) {
+            vshError(ctl, _("cannot send data to volume %s"), name);
+            goto cleanup;
+        }
+    } else if (virStreamSendAll(st, cmdVolUploadSource, &fd) < 0) {
         vshError(ctl, _("cannot send data to volume %s"), name);
         goto cleanup;
     }
@@ -753,9 +795,27 @@ static const vshCmdOptDef opts_vol_download[] = {
      .type = VSH_OT_INT,
      .help = N_("amount of data to download")
     },
+    {.name = "sparse",
+     .type = VSH_OT_BOOL,
+     .help = N_("leave holes in the file rather than write zeros")
+    },
     {.name = NULL}
 };
 
+static int
+cmdVolDownloadHole(virStreamPtr st ATTRIBUTE_UNUSED,
+                   long long length, void *opaque)
+{
+    int *fd = opaque;
+    off_t cur;
+
+    /* Extending the file makes up for a hole at the end */
+    if ((cur = lseek(*fd, length, SEEK_CUR)) == (off_t) -1 ||
+        ftruncate(*fd, cur) < 0)
+        return -1;
+    return 0;
+}
+
 static bool
 cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
 {
@@ -767,6 +827,8 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
     const char *name = NULL;
     unsigned long long offset = 0, length = 0;
     bool created = false;
+    bool sparse = vshCommandOptBool(cmd, "sparse");
+    unsigned int flags = 0;
 
     if (vshCommandOptULongLong(cmd, "offset", &offset) < 0) {
         vshError(ctl, _("Unable to parse integer"));
@@ -778,6 +840,9 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
         return false;
     }
 
+    if (sparse)
+        flags |= VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM;
+
     if (!(vol = vshCommandOptVol(ctl, cmd, "vol", "pool", &name)))
         return false;
 
@@ -799,12 +864,18 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    if (virStorageVolDownload(vol, st, offset, length, 0) < 0) {
+    if (virStorageVolDownload(vol, st, offset, length, flags) < 0) {
         vshError(ctl, _("cannot download from volume %s"), name);
         goto cleanup;
     }
 
-    if (virStreamRecvAll(st, vshStreamSink, &fd) < 0) {
+    if (sparse) {
+        if (virStreamSparseRecvAll(st, vshStreamSink, cmdVolDownloadHole,
+                                   &fd) < 0) {
+            vshError(ctl, _("cannot receive data from volume %s"), name);
+            goto cleanup;
+        }
+    } else if (virStreamRecvAll(st, vshStreamSink, &fd) < 0) {
         vshError(ctl, _("cannot receive data from volume %s"), name);
         goto cleanup;
     }